@@ -1,4 +1,14 @@
 CFG_LTC_OPTEE_THREAD ?= y
+# Number of bignum scratch memory pools shared by the threads, bounds how
+# many asymmetric crypto operations can run in parallel. Each pool takes
+# about 52 kB of .bss. 0 means one pool per core (CFG_TEE_CORE_NB_CORE),
+# which is the default. With CFG_WITH_PAGER=y the pools are paged through
+# the small secure memory, so a single pool is the default there.
+ifeq ($(CFG_WITH_PAGER),y)
+CFG_LTC_MPA_POOLS ?= 1
+else
+CFG_LTC_MPA_POOLS ?= 0
+endif
 # Size of emulated TrustZone protected SRAM, 448 kB.
 # Only applicable when paging is enabled.
 CFG_CORE_TZSRAM_EMUL_SIZE ?= 458752
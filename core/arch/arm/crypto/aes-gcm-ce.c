@@ -10,6 +10,7 @@
 #include <kernel/thread.h>
 #include <tomcrypt.h>
 #include <types_ext.h>
+#include <util.h>
 
 static void get_be_block(void *dst, const void *src)
 {
@@ -27,24 +28,74 @@ static void put_be_block(void *dst, const void *src)
 	put_be64((uint8_t *)dst + 8, s[0]);
 }
 
+/* Stores a hash key in little endian and multiplied by 'x' */
+static void ghash_reflect(uint64_t k[2], uint64_t hi, uint64_t lo)
+{
+	k[0] = (lo << 1) | (hi >> 63);
+	/* Masked instead of branching on the secret top bit */
+	k[1] = (hi << 1) | (lo >> 63);
+	k[1] ^= 0xc200000000000000UL & -(hi >> 63);
+}
+
+static void ghash_update(uint64_t dg[2], const void *data, size_t num_blocks,
+			 const uint64_t k[2], const void *head)
+{
+#ifdef CFG_HWSUPP_PMULT_64
+	pmull_ghash_update_p64(num_blocks, dg, data, k, head);
+#else
+	pmull_ghash_update_p8(num_blocks, dg, data, k, head);
+#endif
+}
+
+#ifdef ARM64
+/*
+ * Powers of H used by pmull_gcm_*crypt() when processing 4 blocks. With
+ * a zero digest, GHASH of a single block X gives X * H, so the powers
+ * are computed with the constant time PMULL code from H in big endian.
+ */
+static void set_key_powers(struct internal_aes_gcm_state *state,
+			   const uint8_t h[TEE_AES_BLOCK_SIZE])
+{
+	const uint64_t *k = (const void *)state->hash_subkey;
+	uint8_t p[TEE_AES_BLOCK_SIZE];
+	uint32_t vfp_state;
+	uint64_t pk[2];
+	uint64_t dg[2];
+	size_t n;
+
+	COMPILE_TIME_ASSERT(offsetof(struct internal_aes_gcm_state,
+				     hash_subkey_pow) ==
+			    offsetof(struct internal_aes_gcm_state,
+				     hash_subkey) + TEE_AES_BLOCK_SIZE);
+
+	memcpy(p, h, sizeof(p));
+
+	vfp_state = thread_kernel_enable_vfp();
+	for (n = 0; n < ARRAY_SIZE(state->hash_subkey_pow); n++) {
+		dg[0] = 0;
+		dg[1] = 0;
+		ghash_update(dg, p, 1, k, NULL);
+		put_be_block(p, dg);
+		ghash_reflect(pk, dg[1], dg[0]);
+		memcpy(state->hash_subkey_pow[n], pk, TEE_AES_BLOCK_SIZE);
+	}
+	thread_kernel_disable_vfp(vfp_state);
+}
+#endif
+
 void internal_aes_gcm_set_key(struct internal_aes_gcm_state *state,
 			      const struct internal_aes_gcm_key *enc_key)
 {
+	uint8_t h[TEE_AES_BLOCK_SIZE];
 	uint64_t k[2];
-	uint64_t a;
-	uint64_t b;
-
-	internal_aes_gcm_encrypt_block(enc_key, state->ctr, state->hash_subkey);
 
-	/* Store hash key in little endian and multiply by 'x' */
-	b = get_be64(state->hash_subkey);
-	a = get_be64(state->hash_subkey + 8);
-	k[0] = (a << 1) | (b >> 63);
-	k[1] = (b << 1) | (a >> 63);
-	if (b >> 63)
-		k[1] ^= 0xc200000000000000UL;
+	internal_aes_gcm_encrypt_block(enc_key, state->ctr, h);
 
+	ghash_reflect(k, get_be64(h), get_be64(h + 8));
 	memcpy(state->hash_subkey, k, TEE_AES_BLOCK_SIZE);
+#ifdef ARM64
+	set_key_powers(state, h);
+#endif
 }
 
 void internal_aes_gcm_ghash_update(struct internal_aes_gcm_state *state,
@@ -60,12 +111,7 @@ void internal_aes_gcm_ghash_update(struct internal_aes_gcm_state *state,
 	k = (void *)state->hash_subkey;
 
 	vfp_state = thread_kernel_enable_vfp();
-
-#ifdef CFG_HWSUPP_PMULT_64
-	pmull_ghash_update_p64(num_blocks, dg, data, k, head);
-#else
-	pmull_ghash_update_p8(num_blocks, dg, data, k, head);
-#endif
+	ghash_update(dg, data, num_blocks, k, head);
 	thread_kernel_disable_vfp(vfp_state);
 
 	put_be_block(state->hash_state, dg);
@@ -15,13 +15,16 @@ void pmull_ghash_update_p8(int blocks, uint64_t dg[2], const uint8_t *src,
 
 void pmull_gcm_load_round_keys(const uint64_t rk[30], int rounds);
 
+/*
+ * k[] holds H followed by H^2, H^3 and H^4 which are used to process 4
+ * blocks at a time.
+ */
 void pmull_gcm_encrypt(int blocks, uint64_t dg[2], uint8_t dst[],
-		       const uint8_t src[], const uint64_t k[2],
+		       const uint8_t src[], const uint64_t k[8],
 		       uint64_t ctr[], int rounds, uint8_t ks[]);
 
-
 void pmull_gcm_decrypt(int blocks, uint64_t dg[2], uint8_t dst[],
-		       const uint8_t src[], const uint64_t k[2],
+		       const uint8_t src[], const uint64_t k[8],
 		       uint64_t ctr[], int rounds);
 
 uint32_t pmull_gcm_aes_sub(uint32_t input);
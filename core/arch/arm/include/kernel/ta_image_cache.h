@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+#ifndef KERNEL_TA_IMAGE_CACHE_H
+#define KERNEL_TA_IMAGE_CACHE_H
+
+#include <stdbool.h>
+#include <sys/queue.h>
+#include <tee_api_types.h>
+#include <types_ext.h>
+#include <utee_defines.h>
+
+/* A segment of a TA as described by its ELF program headers */
+struct ta_image_seg {
+	vaddr_t offs;
+	size_t size;
+	uint32_t flags;
+	uint32_t type;
+};
+
+/*
+ * A verified and relocated TA image, that is the content of the memory
+ * of the TA right after it has been loaded and before it has been run.
+ * Images are identified by the UUID of the TA and the hash of the TA
+ * binary from its signed header.
+ */
+struct ta_image {
+	TEE_UUID uuid;
+	uint8_t tag[TEE_MAX_HASH_SIZE];
+	unsigned int tag_len;
+	bool is_32bit;
+	uint32_t load_addr;
+	struct ta_image_seg *segs;
+	size_t num_segs;
+	struct mobj *mobj;
+	void *va;
+	size_t size;
+	/* Size of the start of the image which is read-only for the TA */
+	size_t ro_size;
+
+	/* Private to the cache */
+	unsigned int ref_count;
+	TAILQ_ENTRY(ta_image) link;
+};
+
+struct ta_image_cache_stats {
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t evictions;
+	uint32_t images;
+	size_t size;
+};
+
+#ifdef CFG_TA_IMAGE_CACHE
+/*
+ * Allocates an image of @size bytes with room for @num_segs segments,
+ * the caller holds the only reference. Returns NULL if out of memory.
+ */
+struct ta_image *ta_image_alloc(size_t size, size_t num_segs);
+
+/*
+ * Adds a completely initialized image to the cache, evicting the least
+ * recently used images to make room for it. The reference of the caller
+ * is transferred to the cache.
+ */
+void ta_image_cache_add(struct ta_image *img);
+
+/* Returns a new reference to a cached image or NULL if there's none */
+struct ta_image *ta_image_cache_get(const TEE_UUID *uuid, const uint8_t *tag,
+				    unsigned int tag_len);
+
+/* Releases a reference returned by ta_image_cache_get() */
+void ta_image_cache_put(struct ta_image *img);
+
+/*
+ * Evicts the cached images which aren't in use to give their memory back
+ * to TA RAM. Returns true if any memory was freed.
+ */
+bool ta_image_cache_shrink(void);
+
+void ta_image_cache_get_stats(struct ta_image_cache_stats *stats, bool reset);
+#else
+static inline bool ta_image_cache_shrink(void)
+{
+	return false;
+}
+#endif /*CFG_TA_IMAGE_CACHE*/
+
+#endif /*KERNEL_TA_IMAGE_CACHE_H*/
@@ -618,6 +618,33 @@ void thread_rpc_free_payload(uint64_t cookie, struct mobj *mobj);
 uint32_t thread_rpc_cmd(uint32_t cmd, size_t num_params,
 		struct optee_msg_param *params);
 
+/*
+ * struct thread_alloc_stats - per core statistics of thread allocation
+ * @alloc_count:	number of threads allocated for standard SMCs
+ * @limit_count:	number of standard SMCs rejected with
+ *			OPTEE_SMC_RETURN_ETHREAD_LIMIT
+ * @resume_count:	number of threads resumed from RPC
+ * @probe_count:	total number of thread slots examined while
+ *			allocating
+ * @max_probes:		maximum number of slots examined by one allocation
+ */
+struct thread_alloc_stats {
+	uint32_t alloc_count;
+	uint32_t limit_count;
+	uint32_t resume_count;
+	uint32_t probe_count;
+	uint32_t max_probes;
+};
+
+#ifdef CFG_WITH_STATS
+/*
+ * Copies the thread allocation statistics of core @core_pos to @stats
+ * and clears them if @reset is true
+ */
+void thread_get_alloc_stats(size_t core_pos, struct thread_alloc_stats *stats,
+			    bool reset);
+#endif
+
 #endif /*ASM*/
 
 #endif /*KERNEL_THREAD_H*/
@@ -6,6 +6,7 @@
 #define KERNEL_USER_TA_H
 
 #include <assert.h>
+#include <kernel/handle.h>
 #include <kernel/tee_ta_manager.h>
 #include <kernel/thread.h>
 #include <mm/tee_mm.h>
@@ -26,12 +27,20 @@ struct user_ta_ctx {
 	struct tee_ta_session_head open_sessions;
 	/* List of cryp states created by this TA */
 	struct tee_cryp_state_head cryp_states;
+	/* Handles of cryp states, used as TA visible state identifiers */
+	struct handle_db cryp_state_db;
 	/* List of storage objects opened by this TA */
 	struct tee_obj_head objects;
+	/* Handles of storage objects, used as TA visible object handles */
+	struct handle_db obj_db;
 	/* List of storage enumerators opened by this TA */
 	struct tee_storage_enum_head storage_enums;
 	struct mobj *mobj_code; /* secure world memory */
 	struct mobj *mobj_stack; /* stack */
+#if defined(CFG_TA_IMAGE_CACHE)
+	/* Cached image mapped for the read-only start of the TA, if any */
+	struct ta_image *shared_image;
+#endif
 	uint32_t load_addr;	/* elf load addr (from TAs address space) */
 	struct tee_mmu_info *mmu;	/* Saved MMU information (ddr only) */
 	void *ta_time_offs;	/* Time reference used by the TA */
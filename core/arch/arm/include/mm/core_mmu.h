@@ -357,6 +357,18 @@ void core_mmu_get_user_map(struct core_mmu_user_map *map);
  */
 void core_mmu_set_user_map(struct core_mmu_user_map *map);
 
+/*
+ * core_mmu_resume_user_map() - Activate a user VA space again
+ * @map:	The user VA space to activate, deactivated earlier with
+ *		core_mmu_set_user_map(NULL) and with translation tables
+ *		left untouched since
+ *
+ * Unlike core_mmu_set_user_map() the TLB isn't invalidated. That's done
+ * each time a user VA space is deactivated, so the TLB of this CPU can't
+ * hold any entries for the ASID of @map.
+ */
+void core_mmu_resume_user_map(struct core_mmu_user_map *map);
+
 /*
  * struct core_mmu_table_info - Properties for a translation table
  * @table:	Pointer to translation table
@@ -119,6 +119,21 @@ struct mobj *mobj_reg_shm_alloc(paddr_t *pages, size_t num_pages,
 
 struct mobj *mobj_reg_shm_find_by_cookie(uint64_t cookie);
 
+/*
+ * Lookup counters of mobj_reg_shm_find_by_cookie(), @probes is the total
+ * number of hash chain entries visited and @registered the number of
+ * currently registered objects.
+ */
+struct mobj_reg_shm_stats {
+	uint32_t lookups;
+	uint32_t hits;
+	uint32_t probes;
+	uint32_t max_probes;
+	uint32_t registered;
+};
+
+void mobj_reg_shm_get_stats(struct mobj_reg_shm_stats *stats, bool reset);
+
 TEE_Result mobj_reg_shm_map(struct mobj *mobj);
 TEE_Result mobj_reg_shm_unmap(struct mobj *mobj);
 
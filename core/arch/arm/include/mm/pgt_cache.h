@@ -53,6 +53,44 @@ void pgt_alloc(struct pgt_cache *pgt_cache, void *owning_ctx,
 	       vaddr_t begin, vaddr_t last);
 void pgt_free(struct pgt_cache *pgt_cache, bool save_ctx);
 
+#ifdef CFG_CORE_KEEP_USER_MAP
+/*
+ * struct pgt_kept - page tables kept populated by a thread
+ * @pgt_cache:	the page tables
+ * @ctx:	context the page tables are populated for, NULL if none
+ * @link:	link in the list of all kept page tables
+ *
+ * Protected by the mutex of the page table pool. Kept page tables are
+ * returned to the pool when pgt_alloc() runs out of page tables.
+ */
+struct pgt_kept {
+	struct pgt_cache pgt_cache;
+	void *ctx;
+	SLIST_ENTRY(pgt_kept) link;
+};
+
+/*
+ * Moves the page tables in @pgt_cache, populated for @ctx, to @kept. Page
+ * tables already kept in @kept are freed.
+ */
+void pgt_keep(struct pgt_kept *kept, struct pgt_cache *pgt_cache, void *ctx);
+
+/*
+ * Moves the page tables in @kept to the empty @pgt_cache if they're still
+ * kept for @ctx and returns true. Else frees the page tables kept for
+ * another context, if any, and returns false.
+ */
+bool pgt_take_kept(struct pgt_kept *kept, struct pgt_cache *pgt_cache,
+		   void *ctx);
+
+/* Frees all page tables kept for @ctx */
+void pgt_flush_kept_ctx(void *ctx);
+#else
+static inline void pgt_flush_kept_ctx(void *ctx __unused)
+{
+}
+#endif
+
 #ifdef CFG_PAGED_USER_TA
 void pgt_flush_ctx_range(struct pgt_cache *pgt_cache, void *ctx,
 			 vaddr_t begin, vaddr_t last);
@@ -226,6 +226,10 @@ struct tee_pager_stats {
 	size_t zi_released;
 	size_t npages;		/* number of load pages */
 	size_t npages_all;	/* number of pages */
+	size_t faults;		/* faults which loaded a page */
+	size_t fault_around;	/* pages loaded ahead of a fault */
+	size_t clean_evictions;	/* pages evicted without being saved */
+	size_t dirty_evictions;	/* RW pages encrypted when evicted */
 };
 
 #ifdef CFG_WITH_PAGER
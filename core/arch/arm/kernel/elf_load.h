@@ -29,6 +29,14 @@ struct user_ta_store_ops {
 	 */
 	TEE_Result (*get_size)(const struct user_ta_store_handle *h,
 			       size_t *size);
+	/*
+	 * Optional. Return a tag identifying the TA binary, the hash from
+	 * its verified signed header, which may be trusted before the TA
+	 * has been read. @tag_len is the size of @tag on input and the
+	 * length of the tag on output.
+	 */
+	TEE_Result (*get_tag)(const struct user_ta_store_handle *h,
+			      uint8_t *tag, unsigned int *tag_len);
 	/*
 	 * Read the TA sequentially, from the start of the TA header (struct
 	 * ta_head) up to the end of the ELF.
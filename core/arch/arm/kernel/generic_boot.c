@@ -275,7 +275,7 @@ static void init_vcore(tee_mm_pool_t *mm_vcore)
 #endif
 
 	if (!tee_mm_init(mm_vcore, begin, end, SMALL_PAGE_SHIFT,
-			 TEE_MM_POOL_NO_FLAGS))
+			 TEE_MM_POOL_TREE))
 		panic("tee_mm_vcore init failed");
 }
 
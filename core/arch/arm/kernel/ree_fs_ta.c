@@ -20,9 +20,20 @@
 
 #include "elf_load.h"
 
+/*
+ * The TA is read from normal world through a window of at most
+ * CFG_REE_FS_TA_WINDOW_SIZE bytes of shared memory which is refilled as
+ * the TA is read sequentially. Hashing and copying into secure memory is
+ * done on one window at a time, so a large TA doesn't need a large
+ * contiguous non-secure buffer.
+ */
 struct user_ta_store_handle {
-	struct shdr *nw_ta; /* Non-secure (shared memory) */
-	size_t nw_ta_size;
+	TEE_UUID uuid;
+	uint8_t *nw_ta; /* Non-secure (shared memory) window */
+	size_t nw_ta_size; /* Size of the whole TA */
+	size_t win_offs; /* Offset of the window in the TA */
+	size_t win_len; /* Bytes of the TA currently in the window */
+	size_t win_size;
 	uint64_t cookie;
 	struct mobj *mobj;
 	size_t offs;
@@ -31,20 +42,11 @@ struct user_ta_store_handle {
 	uint32_t hash_algo;
 };
 
-/*
- * Load a TA via RPC with UUID defined by input param @uuid. The virtual
- * address of the raw TA binary is received in out parameter @ta.
- */
-static TEE_Result rpc_load(const TEE_UUID *uuid, struct shdr **ta,
-			   uint64_t *cookie_ta, size_t *ta_size,
-			   struct mobj **mobj)
+/* Get the size of the TA with UUID defined by input param @uuid via RPC */
+static TEE_Result rpc_get_ta_size(const TEE_UUID *uuid, size_t *ta_size)
 {
 	TEE_Result res;
 	struct optee_msg_param params[2];
-	uint64_t cta = 0;
-
-	if (!uuid || !ta || !cookie_ta || !mobj || !ta_size)
-		return TEE_ERROR_BAD_PARAMETERS;
 
 	memset(params, 0, sizeof(params));
 	params[0].attr = OPTEE_MSG_ATTR_TYPE_VALUE_INPUT;
@@ -58,25 +60,107 @@ static TEE_Result rpc_load(const TEE_UUID *uuid, struct shdr **ta,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	*mobj = thread_rpc_alloc_payload(params[1].u.tmem.size, &cta);
-	if (!*mobj)
+	*ta_size = params[1].u.tmem.size;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result alloc_window(struct user_ta_store_handle *h, size_t size)
+{
+	h->mobj = thread_rpc_alloc_payload(size, &h->cookie);
+	if (!h->mobj)
 		return TEE_ERROR_OUT_OF_MEMORY;
 
-	*ta = mobj_get_va(*mobj, 0);
+	h->nw_ta = mobj_get_va(h->mobj, 0);
 	/* We don't expect NULL as thread_rpc_alloc_payload() was successful */
-	assert(*ta);
-	*cookie_ta = cta;
-	*ta_size = params[1].u.tmem.size;
+	assert(h->nw_ta);
+	h->win_size = size;
+	h->win_len = 0;
+	return TEE_SUCCESS;
+}
 
+static void free_window(struct user_ta_store_handle *h)
+{
+	if (h->mobj)
+		thread_rpc_free_payload(h->cookie, h->mobj);
+	h->mobj = NULL;
+	h->nw_ta = NULL;
+}
+
+/*
+ * Load the part of the TA starting at @offs into the window via RPC. A
+ * window smaller than the TA is loaded with a third parameter holding
+ * the offset, tee-supplicants without support for it fail the request
+ * or return a size other than the one requested.
+ */
+static TEE_Result rpc_load_window(struct user_ta_store_handle *h, size_t offs)
+{
+	TEE_Result res;
+	struct optee_msg_param params[3];
+	size_t len = MIN(h->win_size, h->nw_ta_size - offs);
+	size_t num_params = 2;
+
+	memset(params, 0, sizeof(params));
 	params[0].attr = OPTEE_MSG_ATTR_TYPE_VALUE_INPUT;
-	tee_uuid_to_octets((void *)&params[0].u.value, uuid);
-	msg_param_init_memparam(params + 1, *mobj, 0, params[1].u.tmem.size,
-				cta, MSG_PARAM_MEM_DIR_OUT);
+	tee_uuid_to_octets((void *)&params[0].u.value, &h->uuid);
+	msg_param_init_memparam(params + 1, h->mobj, 0, len, h->cookie,
+				MSG_PARAM_MEM_DIR_OUT);
+	if (len != h->nw_ta_size) {
+		params[2].attr = OPTEE_MSG_ATTR_TYPE_VALUE_INPUT;
+		params[2].u.value.a = offs;
+		num_params = 3;
+	}
 
-	res = thread_rpc_cmd(OPTEE_MSG_RPC_CMD_LOAD_TA, 2, params);
+	res = thread_rpc_cmd(OPTEE_MSG_RPC_CMD_LOAD_TA, num_params, params);
 	if (res != TEE_SUCCESS)
-		thread_rpc_free_payload(cta, *mobj);
-	return res;
+		return res;
+	if (msg_param_get_buf_size(params + 1) != len)
+		return TEE_ERROR_GENERIC;
+
+	h->win_offs = offs;
+	h->win_len = len;
+	return TEE_SUCCESS;
+}
+
+/*
+ * Fall back to loading the whole TA at once, used when the tee-supplicant
+ * fails to load a partial window.
+ */
+static TEE_Result rpc_load_full(struct user_ta_store_handle *h)
+{
+	TEE_Result res;
+
+	free_window(h);
+	res = alloc_window(h, h->nw_ta_size);
+	if (res != TEE_SUCCESS)
+		return res;
+	return rpc_load_window(h, 0);
+}
+
+/*
+ * Load a TA via RPC with UUID defined by input param @uuid, the start of
+ * the raw TA binary ends up in the window of @h.
+ */
+static TEE_Result rpc_load(const TEE_UUID *uuid,
+			   struct user_ta_store_handle *h)
+{
+	TEE_Result res;
+	size_t ta_size;
+
+	res = rpc_get_ta_size(uuid, &ta_size);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	h->uuid = *uuid;
+	h->nw_ta_size = ta_size;
+
+	res = alloc_window(h, MIN(ta_size, (size_t)CFG_REE_FS_TA_WINDOW_SIZE));
+	if (res != TEE_SUCCESS)
+		return res;
+	res = rpc_load_window(h, 0);
+	if (res == TEE_SUCCESS || h->win_size == ta_size)
+		return res;
+
+	return rpc_load_full(h);
 }
 
 static TEE_Result ta_open(const TEE_UUID *uuid,
@@ -84,12 +168,8 @@ static TEE_Result ta_open(const TEE_UUID *uuid,
 {
 	struct user_ta_store_handle *handle;
 	struct shdr *shdr = NULL;
-	struct mobj *mobj = NULL;
 	void *hash_ctx = NULL;
 	uint32_t hash_algo = 0;
-	struct shdr *ta = NULL;
-	size_t ta_size = 0;
-	uint64_t cookie = 0;
 	TEE_Result res;
 	size_t offs;
 
@@ -98,12 +178,13 @@ static TEE_Result ta_open(const TEE_UUID *uuid,
 		return TEE_ERROR_OUT_OF_MEMORY;
 
 	/* Request TA from tee-supplicant */
-	res = rpc_load(uuid, &ta, &cookie, &ta_size, &mobj);
+	res = rpc_load(uuid, handle);
 	if (res != TEE_SUCCESS)
-		goto error;
+		goto error_free_payload;
 
 	/* Make secure copy of signed header */
-	shdr = shdr_alloc_and_copy(ta, ta_size);
+	shdr = shdr_alloc_and_copy((struct shdr *)handle->nw_ta,
+				   handle->win_len);
 	if (!shdr) {
 		res = TEE_ERROR_SECURITY;
 		goto error_free_payload;
@@ -139,10 +220,12 @@ static TEE_Result ta_open(const TEE_UUID *uuid,
 		TEE_UUID bs_uuid;
 		struct shdr_bootstrap_ta bs_hdr;
 
-		if (ta_size < SHDR_GET_SIZE(shdr) + sizeof(bs_hdr))
-			return TEE_ERROR_SECURITY;
+		if (handle->win_len < SHDR_GET_SIZE(shdr) + sizeof(bs_hdr)) {
+			res = TEE_ERROR_SECURITY;
+			goto error_free_hash;
+		}
 
-		memcpy(&bs_hdr, ((uint8_t *)ta + offs), sizeof(bs_hdr));
+		memcpy(&bs_hdr, handle->nw_ta + offs, sizeof(bs_hdr));
 
 		/*
 		 * There's a check later that the UUID embedded inside the
@@ -163,27 +246,22 @@ static TEE_Result ta_open(const TEE_UUID *uuid,
 		offs += sizeof(bs_hdr);
 	}
 
-	if (ta_size != offs + shdr->img_size) {
+	if (handle->nw_ta_size != offs + shdr->img_size) {
 		res = TEE_ERROR_SECURITY;
 		goto error_free_hash;
 	}
 
-	handle->nw_ta = ta;
-	handle->nw_ta_size = ta_size;
-	handle->cookie = cookie;
 	handle->offs = offs;
 	handle->hash_algo = hash_algo;
 	handle->hash_ctx = hash_ctx;
 	handle->shdr = shdr;
-	handle->mobj = mobj;
 	*h = handle;
 	return TEE_SUCCESS;
 
 error_free_hash:
 	crypto_hash_free_ctx(hash_ctx, hash_algo);
 error_free_payload:
-	thread_rpc_free_payload(cookie, mobj);
-error:
+	free_window(handle);
 	shdr_free(shdr);
 	free(handle);
 	return res;
@@ -196,6 +274,18 @@ static TEE_Result ta_get_size(const struct user_ta_store_handle *h,
 	return TEE_SUCCESS;
 }
 
+static TEE_Result ta_get_tag(const struct user_ta_store_handle *h,
+			     uint8_t *tag, unsigned int *tag_len)
+{
+	if (!tag || *tag_len < h->shdr->hash_size) {
+		*tag_len = h->shdr->hash_size;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	*tag_len = h->shdr->hash_size;
+	memcpy(tag, SHDR_GET_HASH(h->shdr), h->shdr->hash_size);
+	return TEE_SUCCESS;
+}
+
 static TEE_Result check_digest(struct user_ta_store_handle *h)
 {
 	void *digest = NULL;
@@ -220,20 +310,41 @@ out:
 static TEE_Result ta_read(struct user_ta_store_handle *h, void *data,
 			  size_t len)
 {
-	uint8_t *src = (uint8_t *)h->nw_ta + h->offs;
-	uint8_t *dst = src;
-	TEE_Result res;
+	uint8_t *dst = data;
+	TEE_Result res = TEE_SUCCESS;
+	uint8_t *src;
+	size_t n;
 
 	if (h->offs + len > h->nw_ta_size)
 		return TEE_ERROR_BAD_PARAMETERS;
-	if (data) {
-		dst = data; /* Hash secure buffer (shm might be modified) */
-		memcpy(dst, src, len);
+
+	while (len) {
+		if (h->offs == h->win_offs + h->win_len) {
+			res = rpc_load_window(h, h->offs);
+			if (res != TEE_SUCCESS && h->win_size != h->nw_ta_size)
+				res = rpc_load_full(h);
+			if (res != TEE_SUCCESS)
+				return res;
+		}
+
+		src = h->nw_ta + h->offs - h->win_offs;
+		n = MIN(len, h->win_offs + h->win_len - h->offs);
+		if (dst) {
+			/* Hash secure buffer (shm might be modified) */
+			memcpy(dst, src, n);
+			res = crypto_hash_update(h->hash_ctx, h->hash_algo,
+						 dst, n);
+			dst += n;
+		} else {
+			res = crypto_hash_update(h->hash_ctx, h->hash_algo,
+						 src, n);
+		}
+		if (res != TEE_SUCCESS)
+			return TEE_ERROR_SECURITY;
+		h->offs += n;
+		len -= n;
 	}
-	res = crypto_hash_update(h->hash_ctx, h->hash_algo, dst, len);
-	if (res != TEE_SUCCESS)
-		return TEE_ERROR_SECURITY;
-	h->offs += len;
+
 	if (h->offs == h->nw_ta_size) {
 		/*
 		 * Last read: time to check if our digest matches the expected
@@ -248,7 +359,7 @@ static void ta_close(struct user_ta_store_handle *h)
 {
 	if (!h)
 		return;
-	thread_rpc_free_payload(h->cookie, h->mobj);
+	free_window(h);
 	free(h->hash_ctx);
 	free(h->shdr);
 	free(h);
@@ -258,6 +369,7 @@ static struct user_ta_store_ops ops = {
 	.description = "REE",
 	.open = ta_open,
 	.get_size = ta_get_size,
+	.get_tag = ta_get_tag,
 	.read = ta_read,
 	.close = ta_close,
 	.priority = 10,
@@ -3,6 +3,7 @@ srcs-y += user_ta.c
 srcs-$(CFG_REE_FS_TA) += ree_fs_ta.c
 srcs-$(CFG_EARLY_TA) += early_ta.c
 srcs-$(CFG_SECSTOR_TA) += secstor_ta.c
+srcs-$(CFG_TA_IMAGE_CACHE) += ta_image_cache.c
 endif
 srcs-y += pseudo_ta.c
 srcs-y += elf_load.c
@@ -0,0 +1,170 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <kernel/mutex.h>
+#include <kernel/ta_image_cache.h>
+#include <mm/mobj.h>
+#include <mm/tee_mm.h>
+#include <stdlib.h>
+#include <string.h>
+#include <trace.h>
+
+/*
+ * Images are kept in TA RAM, most recently used first, the total size of
+ * the cached images is at most CFG_TA_IMAGE_CACHE_SIZE bytes. An image
+ * removed from the cache is freed once the last user has released it.
+ */
+static struct mutex cache_mu = MUTEX_INITIALIZER;
+static TAILQ_HEAD(ta_image_head, ta_image) cache_head =
+	TAILQ_HEAD_INITIALIZER(cache_head);
+static struct ta_image_cache_stats cache_stats;
+
+static void free_image(struct ta_image *img)
+{
+	if (img->va)
+		memset(img->va, 0, img->size);
+	mobj_free(img->mobj);
+	free(img->segs);
+	free(img);
+}
+
+/* Drops the reference of the cache, called with cache_mu held */
+static void evict(struct ta_image *img)
+{
+	TAILQ_REMOVE(&cache_head, img, link);
+	cache_stats.images--;
+	cache_stats.size -= img->size;
+	cache_stats.evictions++;
+
+	img->ref_count--;
+	if (!img->ref_count)
+		free_image(img);
+}
+
+struct ta_image *ta_image_alloc(size_t size, size_t num_segs)
+{
+	struct ta_image *img = calloc(1, sizeof(*img));
+
+	if (!img)
+		return NULL;
+
+	img->segs = calloc(num_segs, sizeof(*img->segs));
+	if (!img->segs)
+		goto err;
+	img->mobj = mobj_mm_alloc(mobj_sec_ddr, size, &tee_mm_sec_ddr);
+	if (!img->mobj)
+		goto err;
+	img->va = mobj_get_va(img->mobj, 0);
+	if (!img->va)
+		goto err;
+
+	img->num_segs = num_segs;
+	img->size = size;
+	img->ref_count = 1;
+	return img;
+err:
+	free_image(img);
+	return NULL;
+}
+
+void ta_image_cache_add(struct ta_image *img)
+{
+	struct ta_image *i;
+	struct ta_image *next;
+
+	mutex_lock(&cache_mu);
+
+	if (img->size > CFG_TA_IMAGE_CACHE_SIZE) {
+		mutex_unlock(&cache_mu);
+		ta_image_cache_put(img);
+		return;
+	}
+
+	/* Another version of the TA, or the same loaded concurrently */
+	TAILQ_FOREACH_SAFE(i, &cache_head, link, next)
+		if (!memcmp(&i->uuid, &img->uuid, sizeof(img->uuid)))
+			evict(i);
+
+	while (cache_stats.size + img->size > CFG_TA_IMAGE_CACHE_SIZE)
+		evict(TAILQ_LAST(&cache_head, ta_image_head));
+
+	TAILQ_INSERT_HEAD(&cache_head, img, link);
+	cache_stats.images++;
+	cache_stats.size += img->size;
+
+	mutex_unlock(&cache_mu);
+}
+
+struct ta_image *ta_image_cache_get(const TEE_UUID *uuid, const uint8_t *tag,
+				    unsigned int tag_len)
+{
+	struct ta_image *img;
+
+	mutex_lock(&cache_mu);
+
+	TAILQ_FOREACH(img, &cache_head, link) {
+		if (!memcmp(&img->uuid, uuid, sizeof(*uuid)) &&
+		    img->tag_len == tag_len && !memcmp(img->tag, tag, tag_len))
+			break;
+	}
+
+	if (img) {
+		TAILQ_REMOVE(&cache_head, img, link);
+		TAILQ_INSERT_HEAD(&cache_head, img, link);
+		img->ref_count++;
+		cache_stats.hits++;
+	} else {
+		cache_stats.misses++;
+	}
+
+	mutex_unlock(&cache_mu);
+	return img;
+}
+
+void ta_image_cache_put(struct ta_image *img)
+{
+	bool last;
+
+	if (!img)
+		return;
+
+	mutex_lock(&cache_mu);
+	img->ref_count--;
+	last = !img->ref_count;
+	mutex_unlock(&cache_mu);
+
+	if (last)
+		free_image(img);
+}
+
+bool ta_image_cache_shrink(void)
+{
+	struct ta_image *img;
+	struct ta_image *next;
+	bool freed = false;
+
+	mutex_lock(&cache_mu);
+	TAILQ_FOREACH_SAFE(img, &cache_head, link, next) {
+		if (img->ref_count == 1) {
+			evict(img);
+			freed = true;
+		}
+	}
+	mutex_unlock(&cache_mu);
+
+	return freed;
+}
+
+void ta_image_cache_get_stats(struct ta_image_cache_stats *stats, bool reset)
+{
+	mutex_lock(&cache_mu);
+	*stats = cache_stats;
+	if (reset) {
+		cache_stats.hits = 0;
+		cache_stats.misses = 0;
+		cache_stats.evictions = 0;
+	}
+	mutex_unlock(&cache_mu);
+}
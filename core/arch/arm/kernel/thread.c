@@ -31,6 +31,7 @@
 
 #include <arm.h>
 #include <assert.h>
+#include <atomic.h>
 #include <keep.h>
 #include <kernel/asan.h>
 #include <kernel/misc.h>
@@ -154,9 +155,26 @@ long thread_user_kcode_offset;
 static size_t thread_user_kcode_size;
 #endif /*CFG_CORE_UNMAP_CORE_AT_EL0*/
 
-static unsigned int thread_global_lock = SPINLOCK_UNLOCK;
 static bool thread_prealloc_rpc_cache;
 
+/*
+ * Held by thread_enable/disable_prealloc_rpc_cache() while they keep all
+ * thread slots claimed, taken by thread_alloc_and_run() before giving up
+ * so such slots aren't mistaken for threads in use.
+ */
+static unsigned int thread_claim_all_lock = SPINLOCK_UNLOCK;
+
+/*
+ * Per core index of the thread slot where thread_alloc_and_run() starts
+ * looking for a free thread. It's updated with the thread last freed by
+ * the core so cores tend to stay on separate slots.
+ */
+static size_t thread_alloc_hint[CFG_TEE_CORE_NB_CORE];
+
+#ifdef CFG_WITH_STATS
+static struct thread_alloc_stats thread_alloc_stats[CFG_TEE_CORE_NB_CORE];
+#endif
+
 static void init_canaries(void)
 {
 #ifdef CFG_WITH_STACK_CANARIES
@@ -217,16 +235,119 @@ void thread_check_canaries(void)
 #endif/*CFG_WITH_STACK_CANARIES*/
 }
 
-static void lock_global(void)
+/*
+ * Thread slots are claimed by atomically changing the state from
+ * @old_state to THREAD_STATE_ACTIVE, the owner of an active thread
+ * releases it with a store-release of the new state. This way standard
+ * SMCs on different cores don't serialize on a global lock.
+ */
+static bool claim_thread(size_t n, enum thread_state old_state)
+{
+	unsigned int state = old_state;
+
+	/* The compare and swap is weak and may fail spuriously */
+	while (!atomic_cas_uint(&threads[n].state, &state,
+				THREAD_STATE_ACTIVE))
+		if (state != old_state)
+			return false;
+	return true;
+}
+
+static void release_thread(size_t n, enum thread_state new_state)
+{
+	atomic_store_release_uint(&threads[n].state, new_state);
+}
+
+/*
+ * Claims all threads to keep them from being allocated, fails if any
+ * thread is in use. On success thread_claim_all_lock is held until
+ * release_all_threads() is called.
+ */
+static bool claim_all_free_threads(void)
+{
+	size_t n;
+
+	cpu_spin_lock(&thread_claim_all_lock);
+
+	for (n = 0; n < CFG_NUM_THREADS; n++) {
+		if (!claim_thread(n, THREAD_STATE_FREE)) {
+			while (n)
+				release_thread(--n, THREAD_STATE_FREE);
+			cpu_spin_unlock(&thread_claim_all_lock);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void release_all_threads(void)
+{
+	size_t n;
+
+	for (n = 0; n < CFG_NUM_THREADS; n++)
+		release_thread(n, THREAD_STATE_FREE);
+
+	cpu_spin_unlock(&thread_claim_all_lock);
+}
+
+static bool claim_free_thread(size_t hint, size_t *n, size_t *probes)
+{
+	size_t i;
+
+	for (i = 0; i < CFG_NUM_THREADS; i++) {
+		*n = (hint + i) % CFG_NUM_THREADS;
+		if (atomic_load_uint(&threads[*n].state) == THREAD_STATE_FREE &&
+		    claim_thread(*n, THREAD_STATE_FREE)) {
+			*probes += i + 1;
+			return true;
+		}
+	}
+
+	*probes += i;
+	return false;
+}
+
+#ifdef CFG_WITH_STATS
+static void update_alloc_stats(bool found, size_t probes)
+{
+	struct thread_alloc_stats *s = thread_alloc_stats + get_core_pos();
+
+	if (found)
+		s->alloc_count++;
+	else
+		s->limit_count++;
+	s->probe_count += probes;
+	if (probes > s->max_probes)
+		s->max_probes = probes;
+}
+
+static void update_resume_stats(void)
 {
-	cpu_spin_lock(&thread_global_lock);
+	thread_alloc_stats[get_core_pos()].resume_count++;
 }
 
-static void unlock_global(void)
+void thread_get_alloc_stats(size_t core_pos, struct thread_alloc_stats *stats,
+			    bool reset)
+{
+	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
+
+	assert(core_pos < CFG_TEE_CORE_NB_CORE);
+	*stats = thread_alloc_stats[core_pos];
+	if (reset)
+		memset(thread_alloc_stats + core_pos, 0, sizeof(*stats));
+	thread_unmask_exceptions(exceptions);
+}
+#else
+static void update_alloc_stats(bool found __unused, size_t probes __unused)
 {
-	cpu_spin_unlock(&thread_global_lock);
 }
 
+static void update_resume_stats(void)
+{
+}
+#endif
+
 #ifdef ARM32
 uint32_t thread_get_exceptions(void)
 {
@@ -414,8 +535,11 @@ void thread_init_boot_thread(void)
 		SLIST_INIT(&threads[n].tsd.pgt_cache);
 	}
 
-	for (n = 0; n < CFG_TEE_CORE_NB_CORE; n++)
+	for (n = 0; n < CFG_TEE_CORE_NB_CORE; n++) {
 		thread_core_local[n].curr_thread = -1;
+		thread_alloc_hint[n] = (n * CFG_NUM_THREADS) /
+				       CFG_TEE_CORE_NB_CORE;
+	}
 
 	l->curr_thread = 0;
 	threads[0].state = THREAD_STATE_ACTIVE;
@@ -434,23 +558,26 @@ void thread_clr_boot_thread(void)
 
 static void thread_alloc_and_run(struct thread_smc_args *args)
 {
-	size_t n;
+	size_t hint = thread_alloc_hint[get_core_pos()];
+	size_t n = 0;
+	size_t probes = 0;
 	struct thread_core_local *l = thread_get_core_local();
 	bool found_thread = false;
 
 	assert(l->curr_thread == -1);
 
-	lock_global();
-
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state == THREAD_STATE_FREE) {
-			threads[n].state = THREAD_STATE_ACTIVE;
-			found_thread = true;
-			break;
-		}
+	found_thread = claim_free_thread(hint, &n, &probes);
+	if (!found_thread) {
+		/*
+		 * The slots may only be held by claim_all_free_threads(),
+		 * wait for it to release them and look again.
+		 */
+		cpu_spin_lock(&thread_claim_all_lock);
+		found_thread = claim_free_thread(hint, &n, &probes);
+		cpu_spin_unlock(&thread_claim_all_lock);
 	}
 
-	unlock_global();
+	update_alloc_stats(found_thread, probes);
 
 	if (!found_thread) {
 		args->a0 = OPTEE_SMC_RETURN_ETHREAD_LIMIT;
@@ -535,22 +662,23 @@ static void thread_resume_from_rpc(struct thread_smc_args *args)
 
 	assert(l->curr_thread == -1);
 
-	lock_global();
-
-	if (n < CFG_NUM_THREADS &&
-	    threads[n].state == THREAD_STATE_SUSPENDED &&
-	    args->a7 == threads[n].hyp_clnt_id)
-		threads[n].state = THREAD_STATE_ACTIVE;
-	else
+	if (n < CFG_NUM_THREADS && claim_thread(n, THREAD_STATE_SUSPENDED)) {
+		/* hyp_clnt_id is only stable while we own the thread */
+		if (args->a7 != threads[n].hyp_clnt_id) {
+			release_thread(n, THREAD_STATE_SUSPENDED);
+			rv = OPTEE_SMC_RETURN_ERESUME;
+		}
+	} else {
 		rv = OPTEE_SMC_RETURN_ERESUME;
-
-	unlock_global();
+	}
 
 	if (rv) {
 		args->a0 = rv;
 		return;
 	}
 
+	update_resume_stats();
+
 	l->curr_thread = n;
 
 	if (is_user_mode(&threads[n].regs))
@@ -691,14 +819,11 @@ void thread_state_free(void)
 		(void *)(threads[ct].stack_va_end - STACK_THREAD_SIZE),
 		STACK_THREAD_SIZE);
 
-	lock_global();
-
 	assert(threads[ct].state == THREAD_STATE_ACTIVE);
-	threads[ct].state = THREAD_STATE_FREE;
 	threads[ct].flags = 0;
 	l->curr_thread = -1;
-
-	unlock_global();
+	thread_alloc_hint[get_core_pos()] = ct;
+	release_thread(ct, THREAD_STATE_FREE);
 }
 
 #ifdef CFG_WITH_PAGER
@@ -746,13 +871,10 @@ int thread_state_suspend(uint32_t flags, uint32_t cpsr, vaddr_t pc)
 	}
 	thread_lazy_restore_ns_vfp();
 
-	lock_global();
-
 	assert(threads[ct].state == THREAD_STATE_ACTIVE);
 	threads[ct].flags |= flags;
 	threads[ct].regs.cpsr = cpsr;
 	threads[ct].regs.pc = pc;
-	threads[ct].state = THREAD_STATE_SUSPENDED;
 
 	threads[ct].have_user_map = core_mmu_user_mapping_is_active();
 	if (threads[ct].have_user_map) {
@@ -762,7 +884,8 @@ int thread_state_suspend(uint32_t flags, uint32_t cpsr, vaddr_t pc)
 
 	l->curr_thread = -1;
 
-	unlock_global();
+	/* The thread may be resumed on another core as soon as released */
+	release_thread(ct, THREAD_STATE_SUSPENDED);
 
 	return ct;
 }
@@ -1210,13 +1333,9 @@ bool thread_disable_prealloc_rpc_cache(uint64_t *cookie)
 	size_t n;
 	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_FOREIGN_INTR);
 
-	lock_global();
-
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state != THREAD_STATE_FREE) {
-			rv = false;
-			goto out;
-		}
+	if (!claim_all_free_threads()) {
+		rv = false;
+		goto out;
 	}
 
 	rv = true;
@@ -1226,37 +1345,30 @@ bool thread_disable_prealloc_rpc_cache(uint64_t *cookie)
 			*cookie = threads[n].rpc_carg;
 			threads[n].rpc_carg = 0;
 			threads[n].rpc_arg = NULL;
-			goto out;
+			goto out_release;
 		}
 	}
 
 	*cookie = 0;
 	thread_prealloc_rpc_cache = false;
+out_release:
+	release_all_threads();
 out:
-	unlock_global();
 	thread_unmask_exceptions(exceptions);
 	return rv;
 }
 
 bool thread_enable_prealloc_rpc_cache(void)
 {
-	bool rv;
-	size_t n;
+	bool rv = false;
 	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_FOREIGN_INTR);
 
-	lock_global();
-
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state != THREAD_STATE_FREE) {
-			rv = false;
-			goto out;
-		}
+	if (claim_all_free_threads()) {
+		thread_prealloc_rpc_cache = true;
+		release_all_threads();
+		rv = true;
 	}
 
-	rv = true;
-	thread_prealloc_rpc_cache = true;
-out:
-	unlock_global();
 	thread_unmask_exceptions(exceptions);
 	return rv;
 }
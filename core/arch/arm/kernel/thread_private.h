@@ -100,7 +100,7 @@ struct thread_vfp_state {
 
 struct thread_ctx {
 	struct thread_ctx_regs regs;
-	enum thread_state state;
+	unsigned int state;	/* enum thread_state, updated atomically */
 	vaddr_t stack_va_end;
 	uint32_t hyp_clnt_id;
 	uint32_t flags;
@@ -31,6 +31,7 @@
 #include <compiler.h>
 #include <keep.h>
 #include <kernel/panic.h>
+#include <kernel/ta_image_cache.h>
 #include <kernel/tee_ta_manager.h>
 #include <kernel/thread.h>
 #include <kernel/user_ta.h>
@@ -130,12 +131,67 @@ static TEE_Result config_final_paging(struct user_ta_ctx *utc)
 }
 #endif /*!CFG_PAGED_USER_TA*/
 
+#ifdef CFG_TA_IMAGE_CACHE
+static size_t get_shared_size(struct user_ta_ctx *utc)
+{
+	if (utc->shared_image)
+		return utc->shared_image->ro_size;
+	return 0;
+}
+
+static void put_shared_image(struct user_ta_ctx *utc)
+{
+	ta_image_cache_put(utc->shared_image);
+	utc->shared_image = NULL;
+}
+#else
+static size_t get_shared_size(struct user_ta_ctx *utc __unused)
+{
+	return 0;
+}
+
+static void put_shared_image(struct user_ta_ctx *utc __unused)
+{
+}
+#endif
+
+/*
+ * Maps a PT_LOAD segment, the part of it below get_shared_size() is
+ * mapped from the shared image and always with the final attributes.
+ */
+static TEE_Result map_segment(struct user_ta_ctx *utc,
+			      const struct ta_image_seg *seg, bool init_attrs)
+{
+	size_t shared_size = get_shared_size(utc);
+	vaddr_t offs = seg->offs;
+	size_t size = seg->size;
+#ifdef CFG_TA_IMAGE_CACHE
+	TEE_Result res;
+	size_t n;
+
+	if (offs < shared_size) {
+		n = MIN(size, shared_size - offs);
+		res = tee_mmu_map_add_segment(utc, utc->shared_image->mobj, 0,
+					offs, n,
+					elf_flags_to_mattr(seg->flags, false));
+		if (res != TEE_SUCCESS || n == size)
+			return res;
+		offs += n;
+		size -= n;
+	}
+#endif
+
+	return tee_mmu_map_add_segment(utc, utc->mobj_code, shared_size, offs,
+				       size, elf_flags_to_mattr(seg->flags,
+								init_attrs));
+}
+
 static TEE_Result load_elf_segments(struct user_ta_ctx *utc,
-			struct elf_load_state *elf_state, bool init_attrs)
+			const struct ta_image_seg *segs, size_t num_segs,
+			bool init_attrs)
 {
 	TEE_Result res;
-	uint32_t mattr;
-	size_t idx = 0;
+	size_t n;
 
 	tee_mmu_map_init(utc);
 
@@ -147,28 +203,14 @@ static TEE_Result load_elf_segments(struct user_ta_ctx *utc,
 	/*
 	 * Add code segment
 	 */
-	while (true) {
-		vaddr_t offs;
-		size_t size;
-		uint32_t flags;
-		uint32_t type;
-
-		res = elf_load_get_next_segment(elf_state, &idx, &offs, &size,
-						&flags, &type);
-		if (res == TEE_ERROR_ITEM_NOT_FOUND)
-			break;
-		if (res != TEE_SUCCESS)
-			return res;
-
-		if (type == PT_LOAD) {
-			mattr = elf_flags_to_mattr(flags, init_attrs);
-			res = tee_mmu_map_add_segment(utc, utc->mobj_code,
-						      offs, size, mattr);
+	for (n = 0; n < num_segs; n++) {
+		if (segs[n].type == PT_LOAD) {
+			res = map_segment(utc, segs + n, init_attrs);
 			if (res != TEE_SUCCESS)
 				return res;
-		} else if (type == PT_ARM_EXIDX) {
-			utc->exidx_start = offs;
-			utc->exidx_size = size;
+		} else if (segs[n].type == PT_ARM_EXIDX) {
+			utc->exidx_start = segs[n].offs;
+			utc->exidx_size = segs[n].size;
 		}
 	}
 
@@ -178,84 +220,270 @@ static TEE_Result load_elf_segments(struct user_ta_ctx *utc,
 		return config_final_paging(utc);
 }
 
+static TEE_Result get_elf_segments(struct elf_load_state *elf_state,
+			struct ta_image_seg **segs_ret, size_t *num_segs_ret)
+{
+	TEE_Result res;
+	struct ta_image_seg *segs;
+	size_t num_segs = 0;
+	size_t idx = 0;
+	size_t n;
+
+	while (elf_load_get_next_segment(elf_state, &idx, NULL, NULL, NULL,
+					 NULL) == TEE_SUCCESS)
+		num_segs++;
+
+	segs = calloc(num_segs, sizeof(*segs));
+	if (!segs)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	idx = 0;
+	for (n = 0; n < num_segs; n++) {
+		res = elf_load_get_next_segment(elf_state, &idx,
+						&segs[n].offs, &segs[n].size,
+						&segs[n].flags, &segs[n].type);
+		if (res != TEE_SUCCESS) {
+			free(segs);
+			return res;
+		}
+	}
+
+	*segs_ret = segs;
+	*num_segs_ret = num_segs;
+	return TEE_SUCCESS;
+}
+
 static struct mobj *alloc_ta_mem(size_t size)
 {
 #ifdef CFG_PAGED_USER_TA
 	return mobj_paged_alloc(size);
 #else
-	return mobj_mm_alloc(mobj_sec_ddr, size, &tee_mm_sec_ddr);
+	struct mobj *mobj = mobj_mm_alloc(mobj_sec_ddr, size, &tee_mm_sec_ddr);
+
+	/* Cached TA images give their memory back when TA RAM runs out */
+	if (!mobj && ta_image_cache_shrink())
+		mobj = mobj_mm_alloc(mobj_sec_ddr, size, &tee_mm_sec_ddr);
+	return mobj;
 #endif
 }
 
-static TEE_Result load_elf(struct user_ta_ctx *utc,
-			   const struct user_ta_store_ops *ta_store,
-			   struct user_ta_store_handle *ta_handle)
+/*
+ * Allocates the memory of the TA and maps it with the attributes used
+ * while loading the TA, leaving the TA context active.
+ */
+static TEE_Result map_ta_mem(struct user_ta_ctx *utc,
+			     const struct ta_head *ta_head, size_t vasize,
+			     const struct ta_image_seg *segs, size_t num_segs)
 {
 	TEE_Result res;
-	struct elf_load_state *elf_state = NULL;
-	struct ta_head *ta_head;
-	void *p;
-	size_t vasize;
-
-	res = elf_load_init(ta_store, ta_handle, &elf_state);
-	if (res != TEE_SUCCESS)
-		goto out;
 
-	res = elf_load_head(elf_state, sizeof(struct ta_head), &p, &vasize,
-			    &utc->is_32bit);
-	if (res != TEE_SUCCESS)
-		goto out;
-	ta_head = p;
-
-	utc->mobj_code = alloc_ta_mem(vasize);
-	if (!utc->mobj_code) {
-		res = TEE_ERROR_OUT_OF_MEMORY;
-		goto out;
-	}
+	utc->mobj_code = alloc_ta_mem(vasize - get_shared_size(utc));
+	if (!utc->mobj_code)
+		return TEE_ERROR_OUT_OF_MEMORY;
 
 	/* Currently all TA must execute from DDR */
-	if (!(ta_head->flags & TA_FLAG_EXEC_DDR)) {
-		res = TEE_ERROR_BAD_FORMAT;
-		goto out;
-	}
+	if (!(ta_head->flags & TA_FLAG_EXEC_DDR))
+		return TEE_ERROR_BAD_FORMAT;
 	/* Temporary assignment to setup memory mapping */
 	utc->ctx.flags = TA_FLAG_USER_MODE | TA_FLAG_EXEC_DDR;
 
 	/* Ensure proper aligment of stack */
 	utc->mobj_stack = alloc_ta_mem(ROUNDUP(ta_head->stack_size,
 					       STACK_ALIGNMENT));
-	if (!utc->mobj_stack) {
-		res = TEE_ERROR_OUT_OF_MEMORY;
-		goto out;
-	}
+	if (!utc->mobj_stack)
+		return TEE_ERROR_OUT_OF_MEMORY;
 
 	/*
 	 * Map physical memory into TA virtual memory
 	 */
 
 	res = tee_mmu_init(utc);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = load_elf_segments(utc, segs, num_segs, true /* init attrs */);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	tee_mmu_set_ctx(&utc->ctx);
+	return TEE_SUCCESS;
+}
+
+/* Releases what map_ta_mem() has set up, even partially */
+static void unmap_ta_mem(struct user_ta_ctx *utc)
+{
+	tee_mmu_set_ctx(NULL);
+	pgt_flush_ctx(&utc->ctx);
+	tee_pager_rem_uta_areas(utc);
+	tee_mmu_final(utc);
+	mobj_free(utc->mobj_code);
+	utc->mobj_code = NULL;
+	mobj_free(utc->mobj_stack);
+	utc->mobj_stack = NULL;
+}
+
+#ifdef CFG_TA_IMAGE_CACHE
+/*
+ * The start of the image which may be shared by the instances of the
+ * TA: the granules below the first writable segment, keeping at least
+ * the last granule private.
+ */
+static size_t get_ro_size(const struct ta_image_seg *segs, size_t num_segs,
+			  size_t vasize)
+{
+	size_t end = vasize - 1;
+	size_t n;
+
+	for (n = 0; n < num_segs; n++)
+		if (segs[n].type == PT_LOAD && (segs[n].flags & PF_W))
+			end = MIN(end, (size_t)segs[n].offs);
+
+	return ROUNDDOWN(end, CORE_MMU_USER_CODE_SIZE);
+}
+
+static unsigned int get_image_tag(const struct user_ta_store_ops *ta_store,
+				  struct user_ta_store_handle *ta_handle,
+				  uint8_t tag[TEE_MAX_HASH_SIZE])
+{
+	unsigned int tag_len = TEE_MAX_HASH_SIZE;
+
+	if (!ta_store->get_tag ||
+	    ta_store->get_tag(ta_handle, tag, &tag_len) != TEE_SUCCESS)
+		return 0;
+	return tag_len;
+}
+
+/* Saves the image of a TA which has been loaded but hasn't run yet */
+static void cache_image(struct user_ta_ctx *utc, const TEE_UUID *uuid,
+			const uint8_t *tag, unsigned int tag_len,
+			const struct ta_image_seg *segs, size_t num_segs,
+			size_t vasize)
+{
+	struct ta_image *img;
+
+	if (vasize > CFG_TA_IMAGE_CACHE_SIZE)
+		return;
+
+	img = ta_image_alloc(vasize, num_segs);
+	if (!img)
+		return;
+
+	img->uuid = *uuid;
+	memcpy(img->tag, tag, tag_len);
+	img->tag_len = tag_len;
+	img->is_32bit = utc->is_32bit;
+	img->load_addr = tee_mmu_get_load_addr(&utc->ctx);
+	memcpy(img->segs, segs, num_segs * sizeof(*segs));
+	img->ro_size = get_ro_size(segs, num_segs, vasize);
+	memcpy(img->va, (void *)(vaddr_t)img->load_addr, vasize);
+	ta_image_cache_add(img);
+}
+
+/*
+ * *relocated is set if the image has been relocated for another address
+ * than the one the TA is mapped at, the image can't be used then.
+ */
+static TEE_Result load_cached_image(struct user_ta_ctx *utc,
+				    struct ta_image *img, bool *relocated)
+{
+	size_t shared_size = get_shared_size(utc);
+	TEE_Result res;
+
+	utc->is_32bit = img->is_32bit;
+	res = map_ta_mem(utc, img->va, img->size, img->segs, img->num_segs);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (tee_mmu_get_load_addr(&utc->ctx) != img->load_addr) {
+		*relocated = true;
+		return TEE_ERROR_BAD_STATE;
+	}
+
+	memcpy((void *)(vaddr_t)(img->load_addr + shared_size),
+	       (uint8_t *)img->va + shared_size, img->size - shared_size);
+
+	return load_elf_segments(utc, img->segs, img->num_segs,
+				 false /* final attrs */);
+}
+#endif /*CFG_TA_IMAGE_CACHE*/
+
+static TEE_Result load_elf(struct user_ta_ctx *utc,
+			   const TEE_UUID *uuid __maybe_unused,
+			   const struct user_ta_store_ops *ta_store,
+			   struct user_ta_store_handle *ta_handle)
+{
+	TEE_Result res;
+	struct elf_load_state *elf_state = NULL;
+	struct ta_image_seg *segs = NULL;
+	size_t num_segs = 0;
+	void *p;
+	size_t vasize;
+#ifdef CFG_TA_IMAGE_CACHE
+	uint8_t tag[TEE_MAX_HASH_SIZE];
+	unsigned int tag_len = get_image_tag(ta_store, ta_handle, tag);
+	struct ta_image *img = NULL;
+
+	if (tag_len)
+		img = ta_image_cache_get(uuid, tag, tag_len);
+	if (img) {
+		bool relocated = false;
+
+#ifndef CFG_PAGED_USER_TA
+		/*
+		 * The read-only start of the image is mapped directly, the
+		 * reference is kept until the TA context is destroyed.
+		 */
+		if (img->ro_size)
+			utc->shared_image = img;
+#endif
+		res = load_cached_image(utc, img, &relocated);
+		if (!utc->shared_image)
+			ta_image_cache_put(img);
+		if (!relocated)
+			return res;
+
+		/* Load the TA from its store, which replaces the image */
+		unmap_ta_mem(utc);
+		put_shared_image(utc);
+	}
+#endif
+
+	res = elf_load_init(ta_store, ta_handle, &elf_state);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	res = elf_load_head(elf_state, sizeof(struct ta_head), &p, &vasize,
+			    &utc->is_32bit);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = load_elf_segments(utc, elf_state, true /* init attrs */);
+	res = get_elf_segments(elf_state, &segs, &num_segs);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	tee_mmu_set_ctx(&utc->ctx);
+	res = map_ta_mem(utc, p, vasize, segs, num_segs);
+	if (res != TEE_SUCCESS)
+		goto out;
 
 	res = elf_load_body(elf_state, tee_mmu_get_load_addr(&utc->ctx));
 	if (res != TEE_SUCCESS)
 		goto out;
 
+#ifdef CFG_TA_IMAGE_CACHE
+	if (tag_len)
+		cache_image(utc, uuid, tag, tag_len, segs, num_segs, vasize);
+#endif
+
 	/*
 	 * Replace the init attributes with attributes used when the TA is
 	 * running.
 	 */
-	res = load_elf_segments(utc, elf_state, false /* final attrs */);
+	res = load_elf_segments(utc, segs, num_segs, false /* final attrs */);
 	if (res != TEE_SUCCESS)
 		goto out;
 
 out:
+	free(segs);
 	elf_load_final(elf_state);
 	return res;
 }
@@ -293,7 +521,7 @@ static TEE_Result ta_load(const TEE_UUID *uuid,
 	TAILQ_INIT(&utc->objects);
 	TAILQ_INIT(&utc->storage_enums);
 
-	res = load_elf(utc, ta_store, ta_handle);
+	res = load_elf(utc, uuid, ta_store, ta_handle);
 	if (res != TEE_SUCCESS)
 		goto error_return;
 
@@ -331,11 +559,8 @@ error_return:
 	ta_store->close(ta_handle);
 	tee_mmu_set_ctx(NULL);
 	if (utc) {
-		pgt_flush_ctx(&utc->ctx);
-		tee_pager_rem_uta_areas(utc);
-		tee_mmu_final(utc);
-		mobj_free(utc->mobj_code);
-		mobj_free(utc->mobj_stack);
+		unmap_ta_mem(utc);
+		put_shared_image(utc);
 		free(utc);
 	}
 	return res;
@@ -566,13 +791,14 @@ static void user_ta_ctx_destroy(struct tee_ta_ctx *ctx)
 	 * from the utc->open_sessions list.
 	 */
 	while (!TAILQ_EMPTY(&utc->open_sessions)) {
-		tee_ta_close_session(TAILQ_FIRST(&utc->open_sessions),
+		tee_ta_close_session(TAILQ_FIRST(&utc->open_sessions)->id,
 				     &utc->open_sessions, KERN_IDENTITY);
 	}
 
 	tee_mmu_final(utc);
 	mobj_free(utc->mobj_code);
 	mobj_free(utc->mobj_stack);
+	put_shared_image(utc);
 
 	/* Free cryp states created by this TA */
 	tee_svc_cryp_free_states(utc);
@@ -580,6 +806,8 @@ static void user_ta_ctx_destroy(struct tee_ta_ctx *ctx)
 	tee_obj_close_all(utc);
 	/* Free emums created by this TA */
 	tee_svc_storage_close_all_enum(utc);
+	handle_db_destroy(&utc->cryp_state_db);
+	handle_db_destroy(&utc->obj_db);
 	free(utc);
 }
 
@@ -799,7 +799,7 @@ void core_mmu_get_user_map(struct core_mmu_user_map *map)
 	}
 }
 
-void core_mmu_set_user_map(struct core_mmu_user_map *map)
+static void set_user_map(struct core_mmu_user_map *map, bool inval_tlb)
 {
 	uint64_t ttbr;
 	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
@@ -832,7 +832,8 @@ void core_mmu_set_user_map(struct core_mmu_user_map *map)
 		dsb();	/* Make sure the write above is visible */
 	}
 
-	tlbi_all();
+	if (inval_tlb)
+		tlbi_all();
 
 	thread_unmask_exceptions(exceptions);
 }
@@ -881,7 +882,7 @@ void core_mmu_get_user_map(struct core_mmu_user_map *map)
 	}
 }
 
-void core_mmu_set_user_map(struct core_mmu_user_map *map)
+static void set_user_map(struct core_mmu_user_map *map, bool inval_tlb)
 {
 	uint64_t ttbr;
 	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
@@ -912,7 +913,8 @@ void core_mmu_set_user_map(struct core_mmu_user_map *map)
 		dsb();	/* Make sure the write above is visible */
 	}
 
-	tlbi_all();
+	if (inval_tlb)
+		tlbi_all();
 
 	thread_unmask_exceptions(exceptions);
 }
@@ -957,3 +959,13 @@ enum core_mmu_fault core_mmu_get_fault_type(uint32_t fault_descr)
 	}
 }
 #endif /*ARM64*/
+
+void core_mmu_set_user_map(struct core_mmu_user_map *map)
+{
+	set_user_map(map, true);
+}
+
+void core_mmu_resume_user_map(struct core_mmu_user_map *map)
+{
+	set_user_map(map, false);
+}
@@ -628,7 +628,7 @@ void core_mmu_get_user_map(struct core_mmu_user_map *map)
 	map->ctxid = read_contextidr();
 }
 
-void core_mmu_set_user_map(struct core_mmu_user_map *map)
+static void set_user_map(struct core_mmu_user_map *map, bool inval_tlb)
 {
 	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
 
@@ -650,12 +650,23 @@ void core_mmu_set_user_map(struct core_mmu_user_map *map)
 		isb();
 	}
 
-	tlbi_all();
+	if (inval_tlb)
+		tlbi_all();
 
 	/* Restore interrupts */
 	thread_unmask_exceptions(exceptions);
 }
 
+void core_mmu_set_user_map(struct core_mmu_user_map *map)
+{
+	set_user_map(map, true);
+}
+
+void core_mmu_resume_user_map(struct core_mmu_user_map *map)
+{
+	set_user_map(map, false);
+}
+
 bool core_mmu_user_mapping_is_active(void)
 {
 	bool ret;
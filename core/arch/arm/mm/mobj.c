@@ -311,11 +311,33 @@ struct mobj_reg_shm {
 #define MOBJ_REG_SHM_SIZE(nr_pages) \
 	(sizeof(struct mobj_reg_shm) + sizeof(paddr_t) * (nr_pages))
 
-static SLIST_HEAD(reg_shm_head, mobj_reg_shm) reg_shm_list =
-	SLIST_HEAD_INITIALIZER(reg_shm_head);
+#if (CFG_CORE_REG_SHM_HASH_BUCKETS & (CFG_CORE_REG_SHM_HASH_BUCKETS - 1))
+#error CFG_CORE_REG_SHM_HASH_BUCKETS must be a power of 2
+#endif
+
+/*
+ * Registered shared memory objects are hashed on their cookie, the normal
+ * world may keep a large number of buffers registered and each message
+ * referencing one of them needs a lookup with exceptions masked.
+ */
+SLIST_HEAD(reg_shm_head, mobj_reg_shm);
+static struct reg_shm_head reg_shm_hash[CFG_CORE_REG_SHM_HASH_BUCKETS];
 
 static unsigned int reg_shm_slist_lock = SPINLOCK_UNLOCK;
 
+/* Protected by reg_shm_slist_lock */
+static struct mobj_reg_shm_stats reg_shm_stats;
+
+static struct reg_shm_head *reg_shm_bucket(uint64_t cookie)
+{
+	uint32_t h = (uint32_t)(cookie ^ (cookie >> 32));
+
+	/* Cookies are often aligned addresses, spread the low bits */
+	h *= 0x9e3779b1;
+	h ^= h >> 16;
+	return reg_shm_hash + (h & (CFG_CORE_REG_SHM_HASH_BUCKETS - 1));
+}
+
 static struct mobj_reg_shm *to_mobj_reg_shm(struct mobj *mobj);
 
 static TEE_Result mobj_reg_shm_get_pa(struct mobj *mobj, size_t offst,
@@ -376,8 +398,9 @@ static void mobj_reg_shm_free(struct mobj *mobj)
 	mobj_reg_shm_unmap(mobj);
 
 	exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
-	SLIST_REMOVE(&reg_shm_list, mobj_reg_shm,
+	SLIST_REMOVE(reg_shm_bucket(mobj_reg_shm->cookie), mobj_reg_shm,
 		     mobj_reg_shm, next);
+	reg_shm_stats.registered--;
 	cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
 	free(mobj_reg_shm);
 }
@@ -452,7 +475,8 @@ struct mobj *mobj_reg_shm_alloc(paddr_t *pages, size_t num_pages,
 	}
 
 	exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
-	SLIST_INSERT_HEAD(&reg_shm_list, mobj_reg_shm, next);
+	SLIST_INSERT_HEAD(reg_shm_bucket(cookie), mobj_reg_shm, next);
+	reg_shm_stats.registered++;
 	cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
 
 	return &mobj_reg_shm->mobj;
@@ -464,18 +488,43 @@ err:
 struct mobj *mobj_reg_shm_find_by_cookie(uint64_t cookie)
 {
 	struct mobj_reg_shm *mobj_reg_shm;
+	struct mobj *mobj = NULL;
 	uint32_t exceptions;
+	uint32_t probes = 0;
 
 	exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
-	SLIST_FOREACH(mobj_reg_shm, &reg_shm_list, next) {
+	SLIST_FOREACH(mobj_reg_shm, reg_shm_bucket(cookie), next) {
+		probes++;
 		if (mobj_reg_shm->cookie == cookie) {
-			cpu_spin_unlock_xrestore(&reg_shm_slist_lock,
-						 exceptions);
-			return &mobj_reg_shm->mobj;
+			mobj = &mobj_reg_shm->mobj;
+			break;
 		}
 	}
+
+	reg_shm_stats.lookups++;
+	if (mobj)
+		reg_shm_stats.hits++;
+	reg_shm_stats.probes += probes;
+	if (probes > reg_shm_stats.max_probes)
+		reg_shm_stats.max_probes = probes;
+	cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
+
+	return mobj;
+}
+
+void mobj_reg_shm_get_stats(struct mobj_reg_shm_stats *stats, bool reset)
+{
+	uint32_t exceptions;
+
+	exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
+	*stats = reg_shm_stats;
+	if (reset) {
+		reg_shm_stats.lookups = 0;
+		reg_shm_stats.hits = 0;
+		reg_shm_stats.probes = 0;
+		reg_shm_stats.max_probes = 0;
+	}
 	cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
-	return NULL;
 }
 
 TEE_Result mobj_reg_shm_map(struct mobj *mobj)
@@ -552,7 +601,7 @@ static TEE_Result mobj_mapped_shm_init(void)
 		panic("Can't find region for shmem pool");
 
 	if (!tee_mm_init(&tee_mm_shm, pool_start, pool_end, SMALL_PAGE_SHIFT,
-		    TEE_MM_POOL_NO_FLAGS))
+		    TEE_MM_POOL_TREE))
 		panic("Could not create shmem pool");
 
 	DMSG("Shared memory address range: %" PRIxVA ", %" PRIxVA,
@@ -487,6 +487,93 @@ static struct pgt *pop_from_some_list(vaddr_t vabase __unused,
 }
 #endif /*!CFG_PAGED_USER_TA*/
 
+#ifdef CFG_CORE_KEEP_USER_MAP
+static SLIST_HEAD(, pgt_kept) pgt_kept_list =
+	SLIST_HEAD_INITIALIZER(pgt_kept_list);
+
+static void release_kept_unlocked(struct pgt_kept *kept)
+{
+	SLIST_REMOVE(&pgt_kept_list, kept, pgt_kept, link);
+	pgt_free_unlocked(&kept->pgt_cache, false);
+	kept->ctx = NULL;
+}
+
+/* Frees all kept page tables, returns false if there were none */
+static bool release_all_kept_unlocked(void)
+{
+	bool ret = !SLIST_EMPTY(&pgt_kept_list);
+
+	while (!SLIST_EMPTY(&pgt_kept_list))
+		release_kept_unlocked(SLIST_FIRST(&pgt_kept_list));
+	return ret;
+}
+
+void pgt_keep(struct pgt_kept *kept, struct pgt_cache *pgt_cache, void *ctx)
+{
+	mutex_lock(&pgt_mu);
+
+	if (kept->ctx) {
+		release_kept_unlocked(kept);
+		condvar_broadcast(&pgt_cv);
+	}
+
+	kept->pgt_cache = *pgt_cache;
+	SLIST_INIT(pgt_cache);
+	kept->ctx = ctx;
+	SLIST_INSERT_HEAD(&pgt_kept_list, kept, link);
+
+	mutex_unlock(&pgt_mu);
+}
+
+bool pgt_take_kept(struct pgt_kept *kept, struct pgt_cache *pgt_cache,
+		   void *ctx)
+{
+	bool ret = false;
+
+	assert(SLIST_EMPTY(pgt_cache));
+
+	mutex_lock(&pgt_mu);
+
+	if (kept->ctx == ctx) {
+		SLIST_REMOVE(&pgt_kept_list, kept, pgt_kept, link);
+		*pgt_cache = kept->pgt_cache;
+		SLIST_INIT(&kept->pgt_cache);
+		kept->ctx = NULL;
+		ret = true;
+	} else if (kept->ctx) {
+		release_kept_unlocked(kept);
+		condvar_broadcast(&pgt_cv);
+	}
+
+	mutex_unlock(&pgt_mu);
+	return ret;
+}
+
+void pgt_flush_kept_ctx(void *ctx)
+{
+	struct pgt_kept *kept;
+	struct pgt_kept *next;
+
+	mutex_lock(&pgt_mu);
+
+	kept = SLIST_FIRST(&pgt_kept_list);
+	while (kept) {
+		next = SLIST_NEXT(kept, link);
+		if (kept->ctx == ctx)
+			release_kept_unlocked(kept);
+		kept = next;
+	}
+
+	condvar_broadcast(&pgt_cv);
+	mutex_unlock(&pgt_mu);
+}
+#else
+static bool release_all_kept_unlocked(void)
+{
+	return false;
+}
+#endif /*CFG_CORE_KEEP_USER_MAP*/
+
 static bool pgt_alloc_unlocked(struct pgt_cache *pgt_cache, void *ctx,
 			       vaddr_t begin, vaddr_t last)
 {
@@ -524,6 +611,11 @@ void pgt_alloc(struct pgt_cache *pgt_cache, void *ctx,
 
 	pgt_free_unlocked(pgt_cache, ctx);
 	while (!pgt_alloc_unlocked(pgt_cache, ctx, begin, last)) {
+		/* Rather free page tables kept by threads than wait */
+		if (release_all_kept_unlocked()) {
+			condvar_broadcast(&pgt_cv);
+			continue;
+		}
 		DMSG("Waiting for page tables");
 		condvar_broadcast(&pgt_cv);
 		condvar_wait(&pgt_cv, &pgt_mu);
@@ -34,6 +34,35 @@
 #include <trace.h>
 #include <util.h>
 
+/*
+ * Entry of a pool with TEE_MM_POOL_TREE. The tree links more than double
+ * the size of an entry so entries of other pools are allocated as a
+ * plain tee_mm_entry_t.
+ */
+struct tree_entry {
+	tee_mm_entry_t mm;
+	struct tree_entry *prev;
+	struct tree_entry *left;
+	struct tree_entry *right;
+	uint32_t gap;		/* free pages/sections up to the next entry */
+	uint32_t max_gap;	/* largest gap in this subtree */
+	uint8_t height;		/* height of this subtree */
+};
+
+static size_t entry_size(tee_mm_pool_t *pool)
+{
+	if (pool->flags & TEE_MM_POOL_TREE)
+		return sizeof(struct tree_entry);
+	return sizeof(tee_mm_entry_t);
+}
+
+static struct tree_entry *to_tree_entry(tee_mm_entry_t *mm)
+{
+	if (!mm)
+		return NULL;
+	return container_of(mm, struct tree_entry, mm);
+}
+
 bool tee_mm_init(tee_mm_pool_t *pool, paddr_t lo, paddr_t hi, uint8_t shift,
 		 uint32_t flags)
 {
@@ -49,7 +78,7 @@ bool tee_mm_init(tee_mm_pool_t *pool, paddr_t lo, paddr_t hi, uint8_t shift,
 	pool->hi = hi;
 	pool->shift = shift;
 	pool->flags = flags;
-	pool->entry = calloc(1, sizeof(tee_mm_entry_t));
+	pool->entry = calloc(1, entry_size(pool));
 
 	if (pool->entry == NULL)
 		return false;
@@ -59,6 +88,15 @@ bool tee_mm_init(tee_mm_pool_t *pool, paddr_t lo, paddr_t hi, uint8_t shift,
 	pool->entry->pool = pool;
 	pool->lock = SPINLOCK_UNLOCK;
 
+	if (pool->flags & TEE_MM_POOL_TREE) {
+		struct tree_entry *e = to_tree_entry(pool->entry);
+
+		e->gap = (hi - lo) >> shift;
+		e->max_gap = e->gap;
+		e->height = 1;
+		pool->root = pool->entry;
+	}
+
 	return true;
 }
 
@@ -71,6 +109,7 @@ void tee_mm_final(tee_mm_pool_t *pool)
 		tee_mm_free(pool->entry->next);
 	free(pool->entry);
 	pool->entry = NULL;
+	pool->root = NULL;
 }
 
 static void tee_mm_add(tee_mm_entry_t *p, tee_mm_entry_t *nn)
@@ -80,22 +119,278 @@ static void tee_mm_add(tee_mm_entry_t *p, tee_mm_entry_t *nn)
 	p->next = nn;
 }
 
+/*
+ * With TEE_MM_POOL_TREE all entries, including the head entry
+ * pool->entry, are also kept in an AVL tree in the same order as in the
+ * list, that is, by increasing offset or by decreasing offset with
+ * TEE_MM_POOL_HI_ALLOC. Each entry records the number of free blocks
+ * between itself and the next entry in the list (or the end of the pool)
+ * and the largest such gap in its subtree. This allows finding the
+ * first gap large enough for an allocation by descending the tree,
+ * giving the same result as the first-fit walk of the list.
+ */
+static bool tree_before(tee_mm_pool_t *pool, struct tree_entry *a,
+			struct tree_entry *b)
+{
+	if (&a->mm == pool->entry)
+		return true;
+	if (&b->mm == pool->entry)
+		return false;
+	if (pool->flags & TEE_MM_POOL_HI_ALLOC)
+		return a->mm.offset > b->mm.offset;
+	return a->mm.offset < b->mm.offset;
+}
+
+static uint32_t tree_max_gap(struct tree_entry *e)
+{
+	return e ? e->max_gap : 0;
+}
+
+static uint8_t tree_height(struct tree_entry *e)
+{
+	return e ? e->height : 0;
+}
+
+static void tree_update(struct tree_entry *e)
+{
+	uint32_t gap = MAX(tree_max_gap(e->left), tree_max_gap(e->right));
+
+	e->height = MAX(tree_height(e->left), tree_height(e->right)) + 1;
+	e->max_gap = MAX(e->gap, gap);
+}
+
+static void tree_update_gap(tee_mm_pool_t *pool, struct tree_entry *e)
+{
+	tee_mm_entry_t *mm = &e->mm;
+
+	if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
+		if (mm->next)
+			e->gap = mm->offset - mm->next->offset -
+				 mm->next->size;
+		else
+			e->gap = mm->offset;
+	} else {
+		if (mm->next)
+			e->gap = mm->next->offset - mm->offset - mm->size;
+		else
+			e->gap = ((pool->hi - pool->lo) >> pool->shift) -
+				 mm->offset - mm->size;
+	}
+}
+
+static struct tree_entry *tree_rotate_left(struct tree_entry *e)
+{
+	struct tree_entry *r = e->right;
+
+	e->right = r->left;
+	r->left = e;
+	tree_update(e);
+	tree_update(r);
+	return r;
+}
+
+static struct tree_entry *tree_rotate_right(struct tree_entry *e)
+{
+	struct tree_entry *l = e->left;
+
+	e->left = l->right;
+	l->right = e;
+	tree_update(e);
+	tree_update(l);
+	return l;
+}
+
+static struct tree_entry *tree_balance(struct tree_entry *e)
+{
+	int bf = tree_height(e->left) - tree_height(e->right);
+
+	tree_update(e);
+	if (bf > 1) {
+		if (tree_height(e->left->left) < tree_height(e->left->right))
+			e->left = tree_rotate_left(e->left);
+		return tree_rotate_right(e);
+	}
+	if (bf < -1) {
+		if (tree_height(e->right->right) < tree_height(e->right->left))
+			e->right = tree_rotate_right(e->right);
+		return tree_rotate_left(e);
+	}
+	return e;
+}
+
+static struct tree_entry *tree_insert(tee_mm_pool_t *pool,
+				      struct tree_entry *root,
+				      struct tree_entry *e)
+{
+	if (!root) {
+		e->left = NULL;
+		e->right = NULL;
+		tree_update(e);
+		return e;
+	}
+
+	if (tree_before(pool, e, root))
+		root->left = tree_insert(pool, root->left, e);
+	else
+		root->right = tree_insert(pool, root->right, e);
+	return tree_balance(root);
+}
+
+static struct tree_entry *tree_remove_first(struct tree_entry *root,
+					    struct tree_entry **first)
+{
+	if (!root->left) {
+		*first = root;
+		return root->right;
+	}
+	root->left = tree_remove_first(root->left, first);
+	return tree_balance(root);
+}
+
+static struct tree_entry *tree_remove(tee_mm_pool_t *pool,
+				      struct tree_entry *root,
+				      struct tree_entry *e)
+{
+	struct tree_entry *n;
+
+	if (!root)
+		panic("invalid mm_entry");
+
+	if (root == e) {
+		if (!e->left)
+			return e->right;
+		if (!e->right)
+			return e->left;
+		e->right = tree_remove_first(e->right, &n);
+		n->left = e->left;
+		n->right = e->right;
+		return tree_balance(n);
+	}
+
+	if (tree_before(pool, e, root))
+		root->left = tree_remove(pool, root->left, e);
+	else
+		root->right = tree_remove(pool, root->right, e);
+	return tree_balance(root);
+}
+
+/* Updates max_gap on the path to an entry after its gap has changed */
+static void tree_refresh(tee_mm_pool_t *pool, struct tree_entry *root,
+			 struct tree_entry *e)
+{
+	if (root != e) {
+		if (tree_before(pool, e, root))
+			tree_refresh(pool, root->left, e);
+		else
+			tree_refresh(pool, root->right, e);
+	}
+	tree_update(root);
+}
+
+/* Returns the first entry in list order followed by at least psize blocks */
+static tee_mm_entry_t *tree_first_fit(tee_mm_pool_t *pool, uint32_t psize)
+{
+	struct tree_entry *e = to_tree_entry(pool->root);
+
+	while (e) {
+		if (tree_max_gap(e->left) >= psize)
+			e = e->left;
+		else if (e->gap >= psize)
+			return &e->mm;
+		else if (tree_max_gap(e->right) >= psize)
+			e = e->right;
+		else
+			return NULL;
+	}
+	return NULL;
+}
+
+/*
+ * Returns the last entry in list order which the range [offslo, offshi)
+ * would be inserted after, same as the walk of the list in
+ * tee_mm_alloc2().
+ */
+static tee_mm_entry_t *tree_find_prev(tee_mm_pool_t *pool, uint32_t offslo,
+				      uint32_t offshi)
+{
+	struct tree_entry *e = to_tree_entry(pool->root);
+	struct tree_entry *prev = NULL;
+	bool before;
+
+	while (e) {
+		if (&e->mm == pool->entry)
+			before = true;
+		else if (pool->flags & TEE_MM_POOL_HI_ALLOC)
+			before = offshi < e->mm.offset + e->mm.size;
+		else
+			before = offslo > e->mm.offset;
+
+		if (before) {
+			prev = e;
+			e = e->right;
+		} else {
+			e = e->left;
+		}
+	}
+	return prev ? &prev->mm : NULL;
+}
+
+static tee_mm_entry_t *tree_find(const tee_mm_pool_t *pool, uint32_t offset)
+{
+	struct tree_entry *e = to_tree_entry(pool->root);
+
+	while (e) {
+		if (&e->mm != pool->entry && offset >= e->mm.offset &&
+		    offset < e->mm.offset + e->mm.size)
+			return &e->mm;
+		if ((offset < e->mm.offset) ==
+		    !(pool->flags & TEE_MM_POOL_HI_ALLOC))
+			e = e->left;
+		else
+			e = e->right;
+	}
+	return NULL;
+}
+
+/* Links a new entry after entry in both the list and the tree */
+static void tree_add(tee_mm_pool_t *pool, tee_mm_entry_t *entry,
+		     tee_mm_entry_t *nn)
+{
+	struct tree_entry *e = to_tree_entry(entry);
+	struct tree_entry *n = to_tree_entry(nn);
+
+	tee_mm_add(entry, nn);
+	n->prev = e;
+	if (nn->next)
+		to_tree_entry(nn->next)->prev = n;
+	tree_update_gap(pool, n);
+	tree_update_gap(pool, e);
+	tree_refresh(pool, to_tree_entry(pool->root), e);
+	pool->root = &tree_insert(pool, to_tree_entry(pool->root), n)->mm;
+}
+
+static void tree_del(tee_mm_pool_t *pool, tee_mm_entry_t *p)
+{
+	struct tree_entry *e = to_tree_entry(p);
+	struct tree_entry *prev = e->prev;
+	struct tree_entry *root;
+
+	root = tree_remove(pool, to_tree_entry(pool->root), e);
+	prev->mm.next = p->next;
+	if (p->next)
+		to_tree_entry(p->next)->prev = prev;
+	tree_update_gap(pool, prev);
+	tree_refresh(pool, root, prev);
+	pool->root = &root->mm;
+}
+
 #ifdef CFG_WITH_STATS
 static size_t tee_mm_stats_allocated(tee_mm_pool_t *pool)
 {
-	tee_mm_entry_t *entry;
-	uint32_t sz = 0;
-
 	if (!pool)
 		return 0;
 
-	entry = pool->entry;
-	while (entry) {
-		sz += entry->size;
-		entry = entry->next;
-	}
-
-	return sz << pool->shift;
+	return pool->allocated << pool->shift;
 }
 
 void tee_mm_get_pool_stats(tee_mm_pool_t *pool, struct malloc_stats *stats,
@@ -119,15 +414,24 @@ void tee_mm_get_pool_stats(tee_mm_pool_t *pool, struct malloc_stats *stats,
 	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
 }
 
-static void update_max_allocated(tee_mm_pool_t *pool)
+static void update_allocated(tee_mm_pool_t *pool, tee_mm_entry_t *mm,
+			     bool alloced)
 {
-	size_t sz = tee_mm_stats_allocated(pool);
+	size_t sz;
 
+	if (alloced)
+		pool->allocated += mm->size;
+	else
+		pool->allocated -= mm->size;
+
+	sz = tee_mm_stats_allocated(pool);
 	if (sz > pool->max_allocated)
 		pool->max_allocated = sz;
 }
 #else /* CFG_WITH_STATS */
-static inline void update_max_allocated(tee_mm_pool_t *pool __unused)
+static inline void update_allocated(tee_mm_pool_t *pool __unused,
+				    tee_mm_entry_t *mm __unused,
+				    bool alloced __unused)
 {
 }
 #endif /* CFG_WITH_STATS */
@@ -144,7 +448,7 @@ tee_mm_entry_t *tee_mm_alloc(tee_mm_pool_t *pool, size_t size)
 	if (!pool || !pool->entry)
 		return NULL;
 
-	nn = malloc(sizeof(tee_mm_entry_t));
+	nn = malloc(entry_size(pool));
 	if (!nn)
 		return NULL;
 
@@ -156,6 +460,22 @@ tee_mm_entry_t *tee_mm_alloc(tee_mm_pool_t *pool, size_t size)
 	else
 		psize = ((size - 1) >> pool->shift) + 1;
 
+	if (pool->flags & TEE_MM_POOL_TREE) {
+		if (!psize)
+			psize = 1;
+		entry = tree_first_fit(pool, psize);
+		if (!entry)
+			goto err;
+		if (pool->flags & TEE_MM_POOL_HI_ALLOC)
+			nn->offset = entry->offset - psize;
+		else
+			nn->offset = entry->offset + entry->size;
+		nn->size = psize;
+		nn->pool = pool;
+		tree_add(pool, entry, nn);
+		goto out;
+	}
+
 	/* find free slot */
 	if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
 		while (entry->next != NULL && psize >
@@ -208,7 +528,8 @@ tee_mm_entry_t *tee_mm_alloc(tee_mm_pool_t *pool, size_t size)
 	nn->size = psize;
 	nn->pool = pool;
 
-	update_max_allocated(pool);
+out:
+	update_allocated(pool, nn, true);
 
 	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
 	return nn;
@@ -255,7 +576,7 @@ tee_mm_entry_t *tee_mm_alloc2(tee_mm_pool_t *pool, paddr_t base, size_t size)
 	if ((base + size) < base || base < pool->lo)
 		return NULL;
 
-	mm = malloc(sizeof(tee_mm_entry_t));
+	mm = malloc(entry_size(pool));
 	if (!mm)
 		return NULL;
 
@@ -265,6 +586,18 @@ tee_mm_entry_t *tee_mm_alloc2(tee_mm_pool_t *pool, paddr_t base, size_t size)
 	offslo = (base - pool->lo) >> pool->shift;
 	offshi = ((base - pool->lo + size - 1) >> pool->shift) + 1;
 
+	if (pool->flags & TEE_MM_POOL_TREE) {
+		offshi = MAX(offshi, offslo + 1);
+		entry = tree_find_prev(pool, offslo, offshi);
+		if (!fit_in_gap(pool, entry, offslo, offshi))
+			goto err;
+		mm->offset = offslo;
+		mm->size = offshi - offslo;
+		mm->pool = pool;
+		tree_add(pool, entry, mm);
+		goto out;
+	}
+
 	/* find slot */
 	if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
 		while (entry->next != NULL &&
@@ -285,7 +618,8 @@ tee_mm_entry_t *tee_mm_alloc2(tee_mm_pool_t *pool, paddr_t base, size_t size)
 	mm->size = offshi - offslo;
 	mm->pool = pool;
 
-	update_max_allocated(pool);
+out:
+	update_allocated(pool, mm, true);
 	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
 	return mm;
 err:
@@ -303,16 +637,23 @@ void tee_mm_free(tee_mm_entry_t *p)
 		return;
 
 	exceptions = cpu_spin_lock_xsave(&p->pool->lock);
-	entry = p->pool->entry;
 
-	/* remove entry from list */
-	while (entry->next != NULL && entry->next != p)
-		entry = entry->next;
+	if (p->pool->flags & TEE_MM_POOL_TREE) {
+		tree_del(p->pool, p);
+	} else {
+		entry = p->pool->entry;
 
-	if (!entry->next)
-		panic("invalid mm_entry");
+		/* remove entry from list */
+		while (entry->next != NULL && entry->next != p)
+			entry = entry->next;
 
-	entry->next = entry->next->next;
+		if (!entry->next)
+			panic("invalid mm_entry");
+
+		entry->next = entry->next->next;
+	}
+
+	update_allocated(p->pool, p, false);
 	cpu_spin_unlock_xrestore(&p->pool->lock, exceptions);
 
 	free(p);
@@ -358,7 +699,7 @@ tee_mm_pool_t tee_mm_shm;
 tee_mm_entry_t *tee_mm_find(const tee_mm_pool_t *pool, paddr_t addr)
 {
 	tee_mm_entry_t *entry = pool->entry;
-	uint16_t offset = (addr - pool->lo) >> pool->shift;
+	uint32_t offset = (addr - pool->lo) >> pool->shift;
 	uint32_t exceptions;
 
 	if (addr > pool->hi || addr < pool->lo)
@@ -366,6 +707,13 @@ tee_mm_entry_t *tee_mm_find(const tee_mm_pool_t *pool, paddr_t addr)
 
 	exceptions = cpu_spin_lock_xsave(&((tee_mm_pool_t *)pool)->lock);
 
+	if (pool->flags & TEE_MM_POOL_TREE) {
+		entry = tree_find(pool, offset);
+		cpu_spin_unlock_xrestore(&((tee_mm_pool_t *)pool)->lock,
+					 exceptions);
+		return entry;
+	}
+
 	while (entry->next != NULL) {
 		entry = entry->next;
 
@@ -117,6 +117,7 @@ static TEE_Result tee_mmu_umap_add_param(struct tee_mmu_info *mmu,
 
 	phys_offs = mobj_get_phys_offs(mem->mobj, CORE_MMU_USER_PARAM_SIZE);
 
+	mmu->regions_gen++;
 	mmu->regions[n].mobj = mem->mobj;
 	mmu->regions[n].offset = ROUNDDOWN(phys_offs + mem->offs,
 					   CORE_MMU_USER_PARAM_SIZE);
@@ -337,6 +338,7 @@ void tee_mmu_map_stack(struct user_ta_ctx *utc, struct mobj *mobj)
 	struct tee_ta_region *region = utc->mmu->regions +
 				       TEE_MMU_UMAP_STACK_IDX;
 
+	utc->mmu->regions_gen++;
 	region->mobj = mobj;
 	region->offset = 0;
 	region->va = get_stack_va(utc);
@@ -347,7 +349,8 @@ void tee_mmu_map_stack(struct user_ta_ctx *utc, struct mobj *mobj)
 }
 
 TEE_Result tee_mmu_map_add_segment(struct user_ta_ctx *utc, struct mobj *mobj,
-				   size_t offs, size_t size, uint32_t prot)
+				   size_t mobj_base, size_t offs, size_t size,
+				   uint32_t prot)
 {
 	const uint32_t attr = TEE_MATTR_VALID_BLOCK | TEE_MATTR_SECURE |
 			      (TEE_MATTR_CACHE_CACHED << TEE_MATTR_CACHE_SHIFT);
@@ -358,24 +361,22 @@ TEE_Result tee_mmu_map_add_segment(struct user_ta_ctx *utc, struct mobj *mobj,
 	size_t n = TEE_MMU_UMAP_CODE_IDX;
 	size_t o;
 
+	if ((mobj_base & (granule - 1)) || offs < mobj_base)
+		return TEE_ERROR_SECURITY;
+
 	if (!tbl[n].size) {
 		/* We're continuing the va space from previous entry. */
 		assert(tbl[n - 1].size);
 
 		/* This is the first segment */
+		if (mobj_base)
+			return TEE_ERROR_SECURITY;
 		va = tbl[n - 1].va + tbl[n - 1].size;
 		end_va = ROUNDUP((offs & (granule - 1)) + size, granule) + va;
 		o = ROUNDDOWN(offs, granule);
 		goto set_entry;
 	}
 
-	/*
-	 * mobj of code segments must not change once the first is
-	 * assigned.
-	 */
-	if (mobj != tbl[n].mobj)
-		return TEE_ERROR_SECURITY;
-
 	/*
 	 * Let's find an entry we overlap with or if we need to add a new
 	 * entry.
@@ -403,8 +404,12 @@ TEE_Result tee_mmu_map_add_segment(struct user_ta_ctx *utc, struct mobj *mobj,
 		if (((n + 1) >= TEE_MMU_UMAP_PARAM_IDX) || tbl[n + 1].size)
 			return TEE_ERROR_SECURITY;
 
-		/* offset must match or the segments aren't added in order */
-		if (o != (va - tbl[n].va + tbl[n].offset))
+		/*
+		 * mobj and offset must match or the segments aren't added
+		 * in order
+		 */
+		if (mobj != tbl[n].mobj ||
+		    o - mobj_base != (va - tbl[n].va + tbl[n].offset))
 			return TEE_ERROR_SECURITY;
 		/* We should only overlap in the last granule of the entry. */
 		if ((va + granule) < (tbl[n].va + tbl[n].size))
@@ -412,6 +417,7 @@ TEE_Result tee_mmu_map_add_segment(struct user_ta_ctx *utc, struct mobj *mobj,
 
 		/* Merge protection attribute for this entry */
 		tbl[n].attr |= prot;
+		utc->mmu->regions_gen++;
 
 		va += granule;
 		/* If the segment was completely overlapped, we're done. */
@@ -423,9 +429,10 @@ TEE_Result tee_mmu_map_add_segment(struct user_ta_ctx *utc, struct mobj *mobj,
 	}
 
 set_entry:
+	utc->mmu->regions_gen++;
 	tbl[n].mobj = mobj;
 	tbl[n].va = va;
-	tbl[n].offset = o;
+	tbl[n].offset = o - mobj_base;
 	tbl[n].size = end_va - va;
 	tbl[n].attr = prot | attr;
 
@@ -458,6 +465,7 @@ static void map_kinit(struct user_ta_ctx *utc __maybe_unused)
 void tee_mmu_map_init(struct user_ta_ctx *utc)
 {
 	utc->mmu->ta_private_vmem_end = 0;
+	utc->mmu->regions_gen++;
 	memset(utc->mmu->regions, 0, sizeof(utc->mmu->regions));
 	map_kinit(utc);
 }
@@ -466,6 +474,18 @@ static void clear_param_map(struct user_ta_ctx *utc)
 {
 	const size_t n = TEE_MMU_UMAP_PARAM_IDX;
 	const size_t array_size = ARRAY_SIZE(utc->mmu->regions);
+	size_t m;
+
+	/*
+	 * Invocations without memref parameters leave the regions as they
+	 * are, the user map can then be reused as is.
+	 */
+	for (m = n; m < array_size; m++) {
+		if (utc->mmu->regions[m].size) {
+			utc->mmu->regions_gen++;
+			break;
+		}
+	}
 
 	memset(utc->mmu->regions + n, 0,
 	       (array_size - n) * sizeof(utc->mmu->regions[0]));
@@ -654,6 +674,7 @@ TEE_Result tee_mmu_add_rwmem(struct user_ta_ctx *utc, struct mobj *mobj,
 			return res;
 
 		*va = v;
+		utc->mmu->regions_gen++;
 		reg->va = v;
 		reg->mobj = mobj;
 		reg->offset = 0;
@@ -676,6 +697,7 @@ void tee_mmu_rem_rwmem(struct user_ta_ctx *utc, struct mobj *mobj, vaddr_t va)
 		struct tee_ta_region *reg = utc->mmu->regions + n;
 
 		if (reg->mobj == mobj && reg->va == va) {
+			utc->mmu->regions_gen++;
 			free_pgt(utc, reg->va, reg->size);
 			memset(reg, 0, sizeof(*reg));
 			return;
@@ -691,6 +713,8 @@ void tee_mmu_final(struct user_ta_ctx *utc)
 	if (!utc->mmu)
 		return;
 
+	pgt_flush_kept_ctx(&utc->ctx);
+
 	/* clear MMU entries to avoid clash when asid is reused */
 	tlbi_asid(utc->mmu->asid);
 
@@ -895,9 +919,127 @@ TEE_Result tee_mmu_check_access_rights(const struct user_ta_ctx *utc,
 	return TEE_SUCCESS;
 }
 
+#ifdef CFG_WITH_STATS
+static struct tee_mmu_switch_stats switch_stats[CFG_NUM_THREADS];
+
+static void update_switch_stats(bool reused)
+{
+	struct tee_mmu_switch_stats *s = switch_stats + thread_get_id();
+
+	if (reused)
+		s->reused++;
+	else
+		s->rebuilt++;
+}
+
+void tee_mmu_get_switch_stats(size_t thread_id,
+			      struct tee_mmu_switch_stats *stats, bool reset)
+{
+	assert(thread_id < CFG_NUM_THREADS);
+	*stats = switch_stats[thread_id];
+	if (reset)
+		memset(switch_stats + thread_id, 0, sizeof(*stats));
+}
+#else
+static void update_switch_stats(bool reused __unused)
+{
+}
+#endif
+
+#ifdef CFG_CORE_KEEP_USER_MAP
+/*
+ * The user map a thread has created last and the generation of the
+ * regions it was created from. When the thread unmaps the context its
+ * page tables are kept in pgt_kept, the page directory of the thread is
+ * left as is until it creates another user map. If the thread maps the
+ * context again before the page tables have been freed and the regions
+ * are unchanged, the user map is activated again as it is.
+ */
+struct kept_user_map {
+	struct core_mmu_user_map map;
+	unsigned int regions_gen;
+	struct pgt_kept pgt_kept;
+};
+
+static struct kept_user_map kept_user_maps[CFG_NUM_THREADS];
+
+static void save_user_map(struct user_ta_ctx *utc,
+			  struct core_mmu_user_map *map)
+{
+	struct kept_user_map *k = kept_user_maps + thread_get_id();
+
+	k->map = *map;
+	k->regions_gen = utc->mmu->regions_gen;
+}
+
+static bool keep_user_map(struct thread_specific_data *tsd,
+			  struct user_ta_ctx *utc)
+{
+	struct kept_user_map *k = kept_user_maps + thread_get_id();
+
+	if (k->regions_gen != utc->mmu->regions_gen)
+		return false;
+
+	pgt_keep(&k->pgt_kept, &tsd->pgt_cache, &utc->ctx);
+	return true;
+}
+
+static bool resume_user_map(struct thread_specific_data *tsd,
+			    struct user_ta_ctx *utc)
+{
+	struct kept_user_map *k = kept_user_maps + thread_get_id();
+
+	if (!pgt_take_kept(&k->pgt_kept, &tsd->pgt_cache, &utc->ctx))
+		return false;
+
+	if (k->regions_gen != utc->mmu->regions_gen) {
+		pgt_free(&tsd->pgt_cache, false);
+		return false;
+	}
+
+	core_mmu_resume_user_map(&k->map);
+	return true;
+}
+#else
+static void save_user_map(struct user_ta_ctx *utc __unused,
+			  struct core_mmu_user_map *map __unused)
+{
+}
+
+static bool keep_user_map(struct thread_specific_data *tsd __unused,
+			  struct user_ta_ctx *utc __unused)
+{
+	return false;
+}
+
+static bool resume_user_map(struct thread_specific_data *tsd __unused,
+			    struct user_ta_ctx *utc __unused)
+{
+	return false;
+}
+#endif /*CFG_CORE_KEEP_USER_MAP*/
+
 void tee_mmu_set_ctx(struct tee_ta_ctx *ctx)
 {
 	struct thread_specific_data *tsd = thread_get_tsd();
+	struct user_ta_ctx *prev_utc = NULL;
+	struct user_ta_ctx *utc = NULL;
+
+	if (tsd->ctx && is_user_ta_ctx(tsd->ctx))
+		prev_utc = to_user_ta_ctx(tsd->ctx);
+	if (ctx && is_user_ta_ctx(ctx))
+		utc = to_user_ta_ctx(ctx);
+
+	/*
+	 * If no user map is active and this thread has kept the page
+	 * tables of the user map of ctx, there's no need to create it
+	 * again.
+	 */
+	if (!prev_utc && utc && resume_user_map(tsd, utc)) {
+		update_switch_stats(true);
+		tsd->ctx = ctx;
+		return;
+	}
 
 	core_mmu_set_user_map(NULL);
 	/*
@@ -906,17 +1048,21 @@ void tee_mmu_set_ctx(struct tee_ta_ctx *ctx)
 	 * This function has to be called before there's a chance that
 	 * pgt_free_unlocked() is called.
 	 *
-	 * Save translation tables in a cache if it's a user TA.
+	 * Save translation tables in a cache if it's a user TA. If no
+	 * other user map is created they're kept populated instead, to be
+	 * reused if this thread maps the same user TA next.
 	 */
-	pgt_free(&tsd->pgt_cache, tsd->ctx && is_user_ta_ctx(tsd->ctx));
+	if (!prev_utc || utc || !keep_user_map(tsd, prev_utc))
+		pgt_free(&tsd->pgt_cache, !!prev_utc);
 
-	if (ctx && is_user_ta_ctx(ctx)) {
+	if (utc) {
 		struct core_mmu_user_map map;
-		struct user_ta_ctx *utc = to_user_ta_ctx(ctx);
 
 		core_mmu_create_user_map(utc, &map);
 		core_mmu_set_user_map(&map);
 		tee_pager_assign_uta_tables(utc);
+		save_user_map(utc, &map);
+		update_switch_stats(false);
 	}
 	tsd->ctx = ctx;
 }
@@ -961,7 +1107,7 @@ void teecore_init_ta_ram(void)
 	/* remove previous config and init TA ddr memory pool */
 	tee_mm_final(&tee_mm_sec_ddr);
 	tee_mm_init(&tee_mm_sec_ddr, ps, pe, CORE_MMU_USER_CODE_SHIFT,
-		    TEE_MM_POOL_NO_FLAGS);
+		    TEE_MM_POOL_TREE);
 }
 
 void teecore_init_pub_ram(void)
@@ -82,6 +82,8 @@ struct tee_pager_area {
 	vaddr_t base;
 	size_t size;
 	struct pgt *pgt;
+	vaddr_t ra_next_va;
+	size_t ra_npages;
 	TAILQ_ENTRY(tee_pager_area) link;
 };
 
@@ -108,7 +110,13 @@ struct tee_pager_pmem {
 	TAILQ_ENTRY(tee_pager_pmem) link;
 };
 
-/* The list of physical pages. The first page in the list is the oldest */
+/*
+ * The list of physical pages. The first page in the list is the oldest.
+ *
+ * With CFG_PAGER_CLOCK=y the list is instead the circle of a CLOCK
+ * replacement policy with the hand at the first page. A hidden page
+ * hasn't been referenced since the hand passed it, a mapped page has.
+ */
 TAILQ_HEAD(tee_pager_pmem_head, tee_pager_pmem);
 
 static struct tee_pager_pmem_head tee_pager_pmem_head =
@@ -153,6 +161,26 @@ static inline void incr_npages_all(void)
 	pager_stats.npages_all++;
 }
 
+static inline void incr_faults(void)
+{
+	pager_stats.faults++;
+}
+
+static inline void incr_fault_around(void)
+{
+	pager_stats.fault_around++;
+}
+
+static inline void incr_clean_evictions(void)
+{
+	pager_stats.clean_evictions++;
+}
+
+static inline void incr_dirty_evictions(void)
+{
+	pager_stats.dirty_evictions++;
+}
+
 static inline void set_npages(void)
 {
 	pager_stats.npages = tee_pager_npages;
@@ -166,6 +194,10 @@ void tee_pager_get_stats(struct tee_pager_stats *stats)
 	pager_stats.ro_hits = 0;
 	pager_stats.rw_hits = 0;
 	pager_stats.zi_released = 0;
+	pager_stats.faults = 0;
+	pager_stats.fault_around = 0;
+	pager_stats.clean_evictions = 0;
+	pager_stats.dirty_evictions = 0;
 }
 
 #else /* CFG_WITH_STATS */
@@ -174,6 +206,10 @@ static inline void incr_rw_hits(void) { }
 static inline void incr_hidden_hits(void) { }
 static inline void incr_zi_released(void) { }
 static inline void incr_npages_all(void) { }
+static inline void incr_faults(void) { }
+static inline void incr_fault_around(void) { }
+static inline void incr_clean_evictions(void) { }
+static inline void incr_dirty_evictions(void) { }
 static inline void set_npages(void) { }
 
 void tee_pager_get_stats(struct tee_pager_stats *stats)
@@ -741,27 +777,33 @@ static void tee_pager_load_page(struct tee_pager_area *area, vaddr_t page_va,
 	asan_tag_no_access(va_alias, (uint8_t *)va_alias + SMALL_PAGE_SIZE);
 }
 
-static void tee_pager_save_page(struct tee_pager_pmem *pmem, uint32_t attr)
+/*
+ * Saves a page which is unmapped or write protected. Only pages which
+ * have been written to since they were loaded are mapped writable, so
+ * a page without write permission is clean and is just dropped.
+ * Returns true if the page was dirty and has been written to the store.
+ */
+static bool tee_pager_save_page(struct tee_pager_pmem *pmem, uint32_t attr)
 {
 	const uint32_t dirty_bits = TEE_MATTR_PW | TEE_MATTR_UW |
 				    TEE_MATTR_HIDDEN_DIRTY_BLOCK;
+	size_t offs = pmem->area->base & CORE_MMU_PGDIR_MASK;
+	size_t idx = pmem->pgidx - (offs >> SMALL_PAGE_SHIFT);
+	void *stored_page = pmem->area->store + idx * SMALL_PAGE_SIZE;
 
-	if (pmem->area->type == AREA_TYPE_RW && (attr & dirty_bits)) {
-		size_t offs = pmem->area->base & CORE_MMU_PGDIR_MASK;
-		size_t idx = pmem->pgidx - (offs >> SMALL_PAGE_SHIFT);
-		void *stored_page = pmem->area->store + idx * SMALL_PAGE_SIZE;
-
-		assert(pmem->area->flags & (TEE_MATTR_PW | TEE_MATTR_UW));
-		asan_tag_access(pmem->va_alias,
-				(uint8_t *)pmem->va_alias + SMALL_PAGE_SIZE);
-		encrypt_page(&pmem->area->u.rwp[idx], pmem->va_alias,
-			     stored_page);
-		asan_tag_no_access(pmem->va_alias,
-				   (uint8_t *)pmem->va_alias + SMALL_PAGE_SIZE);
-		FMSG("Saved %#" PRIxVA " iv %#" PRIx64,
-			pmem->area->base + idx * SMALL_PAGE_SIZE,
-			pmem->area->u.rwp[idx].iv);
-	}
+	if (pmem->area->type != AREA_TYPE_RW || !(attr & dirty_bits))
+		return false;
+
+	assert(pmem->area->flags & (TEE_MATTR_PW | TEE_MATTR_UW));
+	asan_tag_access(pmem->va_alias,
+			(uint8_t *)pmem->va_alias + SMALL_PAGE_SIZE);
+	encrypt_page(&pmem->area->u.rwp[idx], pmem->va_alias, stored_page);
+	asan_tag_no_access(pmem->va_alias,
+			   (uint8_t *)pmem->va_alias + SMALL_PAGE_SIZE);
+	FMSG("Saved %#" PRIxVA " iv %#" PRIx64,
+		pmem->area->base + idx * SMALL_PAGE_SIZE,
+		pmem->area->u.rwp[idx].iv);
+	return true;
 }
 
 #ifdef CFG_PAGED_USER_TA
@@ -1040,7 +1082,10 @@ bool tee_pager_set_uta_area_attr(struct user_ta_ctx *utc, vaddr_t base,
 	struct tee_pager_area *area = find_area(utc->areas, b);
 	uint32_t exceptions;
 	struct tee_pager_pmem *pmem;
+	const uint32_t dirty_bits = TEE_MATTR_PW | TEE_MATTR_UW |
+				    TEE_MATTR_HIDDEN_DIRTY_BLOCK;
 	paddr_t pa;
+	uint32_t new_a;
 	uint32_t a;
 	uint32_t f;
 
@@ -1068,14 +1113,23 @@ bool tee_pager_set_uta_area_attr(struct user_ta_ctx *utc, vaddr_t base,
 				assert(pa == get_pmem_pa(pmem));
 			else
 				pa = get_pmem_pa(pmem);
-			if (a == f)
+
+			/*
+			 * Pages which haven't been written to stay read-only
+			 * until the first write fault, else they'd have to
+			 * be encrypted when evicted.
+			 */
+			new_a = f;
+			if (!(a & dirty_bits) || !(flags & TEE_MATTR_UW))
+				new_a &= ~(TEE_MATTR_PW | TEE_MATTR_UW);
+			if (a == new_a)
 				continue;
 			area_set_entry(pmem->area, pmem->pgidx, 0, 0);
 			tlbi_mva_allasid(area_idx2va(pmem->area, pmem->pgidx));
 			if (!(flags & TEE_MATTR_UW))
 				tee_pager_save_page(pmem, a);
 
-			area_set_entry(pmem->area, pmem->pgidx, pa, f);
+			area_set_entry(pmem->area, pmem->pgidx, pa, new_a);
 			/*
 			 * Make sure the table update is visible before
 			 * continuing.
@@ -1150,8 +1204,14 @@ static bool tee_pager_unhide_page(vaddr_t page_va)
 			 */
 			dsb_ishst();
 
+#ifndef CFG_PAGER_CLOCK
+			/*
+			 * With CLOCK the page keeps its place, being mapped
+			 * again marks it as referenced.
+			 */
 			TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
 			TAILQ_INSERT_TAIL(&tee_pager_pmem_head, pmem, link);
+#endif
 			incr_hidden_hits();
 			return true;
 		}
@@ -1160,16 +1220,41 @@ static bool tee_pager_unhide_page(vaddr_t page_va)
 	return false;
 }
 
+/* Hides a mapped page, the next access to it is a hidden hit */
+static void hide_page(struct tee_pager_pmem *pmem)
+{
+	paddr_t pa;
+	uint32_t attr;
+	uint32_t a;
+
+	area_get_entry(pmem->area, pmem->pgidx, &pa, &attr);
+	if (!(attr & TEE_MATTR_VALID_BLOCK))
+		return;
+
+	assert(pa == get_pmem_pa(pmem));
+	if (attr & (TEE_MATTR_PW | TEE_MATTR_UW)){
+		a = TEE_MATTR_HIDDEN_DIRTY_BLOCK;
+		FMSG("Hide %#" PRIxVA,
+		     area_idx2va(pmem->area, pmem->pgidx));
+	} else
+		a = TEE_MATTR_HIDDEN_BLOCK;
+
+	area_set_entry(pmem->area, pmem->pgidx, pa, a);
+	tlbi_mva_allasid(area_idx2va(pmem->area, pmem->pgidx));
+}
+
+#ifdef CFG_PAGER_CLOCK
+/* With CLOCK pages are hidden as the hand passes them */
+static void tee_pager_hide_pages(void)
+{
+}
+#else
 static void tee_pager_hide_pages(void)
 {
 	struct tee_pager_pmem *pmem;
 	size_t n = 0;
 
 	TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link) {
-		paddr_t pa;
-		uint32_t attr;
-		uint32_t a;
-
 		if (n >= TEE_PAGER_NHIDE)
 			break;
 		n++;
@@ -1178,22 +1263,10 @@ static void tee_pager_hide_pages(void)
 		if (!pmem->area)
 			continue;
 
-		area_get_entry(pmem->area, pmem->pgidx, &pa, &attr);
-		if (!(attr & TEE_MATTR_VALID_BLOCK))
-			continue;
-
-		assert(pa == get_pmem_pa(pmem));
-		if (attr & (TEE_MATTR_PW | TEE_MATTR_UW)){
-			a = TEE_MATTR_HIDDEN_DIRTY_BLOCK;
-			FMSG("Hide %#" PRIxVA,
-			     area_idx2va(pmem->area, pmem->pgidx));
-		} else
-			a = TEE_MATTR_HIDDEN_BLOCK;
-
-		area_set_entry(pmem->area, pmem->pgidx, pa, a);
-		tlbi_mva_allasid(area_idx2va(pmem->area, pmem->pgidx));
+		hide_page(pmem);
 	}
 }
+#endif /*CFG_PAGER_CLOCK*/
 
 /*
  * Find mapped pmem, hide and move to pageble pmem.
@@ -1232,16 +1305,53 @@ static bool tee_pager_release_one_phys(struct tee_pager_area *area,
 	return false;
 }
 
-/* Finds the oldest page and unmats it from its old virtual address */
+#ifdef CFG_PAGER_CLOCK
+/*
+ * Advances the CLOCK hand until it's at a page which is unused or hasn't
+ * been referenced since the hand last passed it. Referenced pages get a
+ * second chance, they're hidden and passed. This ends within one turn
+ * since all pages are hidden by then.
+ */
+static void pager_clock_advance(void)
+{
+	struct tee_pager_pmem *pmem;
+	uint32_t attr;
+
+	while (true) {
+		pmem = TAILQ_FIRST(&tee_pager_pmem_head);
+		if (pmem->pgidx == INVALID_PGIDX)
+			return;
+
+		area_get_entry(pmem->area, pmem->pgidx, NULL, &attr);
+		if (!(attr & TEE_MATTR_VALID_BLOCK))
+			return;
+
+		hide_page(pmem);
+		TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
+		TAILQ_INSERT_TAIL(&tee_pager_pmem_head, pmem, link);
+	}
+}
+#else
+static void pager_clock_advance(void)
+{
+}
+#endif /*CFG_PAGER_CLOCK*/
+
+/*
+ * Finds the oldest page, or with CLOCK the first page not recently
+ * referenced, and unmaps it from its old virtual address
+ */
 static struct tee_pager_pmem *tee_pager_get_page(struct tee_pager_area *area)
 {
 	struct tee_pager_pmem *pmem;
 
-	pmem = TAILQ_FIRST(&tee_pager_pmem_head);
-	if (!pmem) {
+	if (TAILQ_EMPTY(&tee_pager_pmem_head)) {
 		EMSG("No pmem entries");
 		return NULL;
 	}
+	pager_clock_advance();
+
+	pmem = TAILQ_FIRST(&tee_pager_pmem_head);
 	if (pmem->pgidx != INVALID_PGIDX) {
 		uint32_t a;
 
@@ -1250,7 +1360,10 @@ static struct tee_pager_pmem *tee_pager_get_page(struct tee_pager_area *area)
 		area_set_entry(pmem->area, pmem->pgidx, 0, 0);
 		pgt_dec_used_entries(pmem->area->pgt);
 		tlbi_mva_allasid(area_idx2va(pmem->area, pmem->pgidx));
-		tee_pager_save_page(pmem, a);
+		if (tee_pager_save_page(pmem, a))
+			incr_dirty_evictions();
+		else
+			incr_clean_evictions();
 	}
 
 	TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
@@ -1377,6 +1490,137 @@ static void stat_handle_fault(void)
 }
 #endif
 
+/*
+ * Loads the page at page_va into the physical page pmem, using the
+ * aliased mapping, and maps it. Pages of writable areas are mapped
+ * read-only until they're written to.
+ */
+static void pager_map_page(struct tee_pager_area *area, vaddr_t page_va,
+			   struct tee_pager_pmem *pmem)
+{
+	uint32_t attr;
+	paddr_t pa;
+
+	/* load page code & data */
+	tee_pager_load_page(area, page_va, pmem->va_alias);
+
+	pmem->area = area;
+	pmem->pgidx = area_va2idx(area, page_va);
+	attr = get_area_mattr(area->flags) &
+		~(TEE_MATTR_PW | TEE_MATTR_UW);
+	pa = get_pmem_pa(pmem);
+
+	/*
+	 * We've updated the page using the aliased mapping and
+	 * some cache maintenence is now needed if it's an
+	 * executable page.
+	 *
+	 * Since the d-cache is a Physically-indexed,
+	 * physically-tagged (PIPT) cache we can clean either the
+	 * aliased address or the real virtual address. In this
+	 * case we choose the real virtual address.
+	 *
+	 * The i-cache can also be PIPT, but may be something else
+	 * too like VIPT. The current code requires the caches to
+	 * implement the IVIPT extension, that is:
+	 * "instruction cache maintenance is required only after
+	 * writing new data to a physical address that holds an
+	 * instruction."
+	 *
+	 * To portably invalidate the icache the page has to
+	 * be mapped at the final virtual address but not
+	 * executable.
+	 */
+	if (area->flags & (TEE_MATTR_PX | TEE_MATTR_UX)) {
+		uint32_t mask = TEE_MATTR_PX | TEE_MATTR_UX |
+				TEE_MATTR_PW | TEE_MATTR_UW;
+
+		/* Set a temporary read-only mapping */
+		area_set_entry(pmem->area, pmem->pgidx, pa,
+			       attr & ~mask);
+		tlbi_mva_allasid(page_va);
+
+		/*
+		 * Doing these operations to LoUIS (Level of
+		 * unification, Inner Shareable) would be enough
+		 */
+		cache_op_inner(DCACHE_AREA_CLEAN, (void *)page_va,
+			       SMALL_PAGE_SIZE);
+		cache_op_inner(ICACHE_AREA_INVALIDATE, (void *)page_va,
+			       SMALL_PAGE_SIZE);
+
+		/* Set the final mapping */
+		area_set_entry(area, pmem->pgidx, pa, attr);
+		tlbi_mva_allasid(page_va);
+	} else {
+		area_set_entry(area, pmem->pgidx, pa, attr);
+		/*
+		 * No need to flush TLB for this entry, it was
+		 * invalid. We should use a barrier though, to make
+		 * sure that the change is visible.
+		 */
+		dsb_ishst();
+	}
+	pgt_inc_used_entries(area->pgt);
+
+	FMSG("Mapped 0x%" PRIxVA " -> 0x%" PRIxPA, page_va, pa);
+}
+
+/*
+ * Returns the number of pages following page_va to load together with it.
+ * The window starts at CFG_PAGER_FAULT_AROUND pages and is doubled, up to
+ * CFG_PAGER_READ_AHEAD_MAX pages, each time the area is faulted at the
+ * page right after the previous window. It's kept small compared to the
+ * number of pageable pages since each page loaded ahead evicts the oldest
+ * one.
+ */
+static size_t get_fault_around_npages(struct tee_pager_area *area,
+				      vaddr_t page_va)
+{
+	size_t n = CFG_PAGER_FAULT_AROUND;
+	size_t ra;
+
+	if (area->type == AREA_TYPE_LOCK)
+		return 0;
+
+	if (page_va == area->ra_next_va) {
+		ra = area->ra_npages ? area->ra_npages * 2 : 1;
+		ra = MIN(ra, (size_t)CFG_PAGER_READ_AHEAD_MAX);
+		n = MAX(n, ra);
+	}
+	n = MIN(n, tee_pager_npages / 8);
+	n = MIN(n, (area->base + area->size - page_va) / SMALL_PAGE_SIZE - 1);
+
+	area->ra_npages = n;
+	area->ra_next_va = page_va + (n + 1) * SMALL_PAGE_SIZE;
+	return n;
+}
+
+/*
+ * Loads and maps the pages following a faulting page in the same area,
+ * pages already mapped or hidden are skipped.
+ */
+static void pager_fault_around(struct tee_pager_area *area, vaddr_t page_va)
+{
+	struct tee_pager_pmem *pmem;
+	size_t n = get_fault_around_npages(area, page_va);
+	vaddr_t va = page_va;
+	uint32_t attr;
+
+	while (n--) {
+		va += SMALL_PAGE_SIZE;
+		area_get_entry(area, area_va2idx(area, va), NULL, &attr);
+		if (attr)
+			continue;
+
+		pmem = tee_pager_get_page(area);
+		if (!pmem)
+			return;
+		pager_map_page(area, va, pmem);
+		incr_fault_around();
+	}
+}
+
 bool tee_pager_handle_fault(struct abort_info *ai)
 {
 	struct tee_pager_area *area;
@@ -1419,8 +1663,6 @@ bool tee_pager_handle_fault(struct abort_info *ai)
 
 	if (!tee_pager_unhide_page(page_va)) {
 		struct tee_pager_pmem *pmem = NULL;
-		uint32_t attr;
-		paddr_t pa;
 
 		/*
 		 * The page wasn't hidden, but some other core may have
@@ -1441,72 +1683,10 @@ bool tee_pager_handle_fault(struct abort_info *ai)
 			abort_print(ai);
 			panic();
 		}
+		pager_map_page(area, page_va, pmem);
+		incr_faults();
 
-		/* load page code & data */
-		tee_pager_load_page(area, page_va, pmem->va_alias);
-
-
-		pmem->area = area;
-		pmem->pgidx = area_va2idx(area, ai->va);
-		attr = get_area_mattr(area->flags) &
-			~(TEE_MATTR_PW | TEE_MATTR_UW);
-		pa = get_pmem_pa(pmem);
-
-		/*
-		 * We've updated the page using the aliased mapping and
-		 * some cache maintenence is now needed if it's an
-		 * executable page.
-		 *
-		 * Since the d-cache is a Physically-indexed,
-		 * physically-tagged (PIPT) cache we can clean either the
-		 * aliased address or the real virtual address. In this
-		 * case we choose the real virtual address.
-		 *
-		 * The i-cache can also be PIPT, but may be something else
-		 * too like VIPT. The current code requires the caches to
-		 * implement the IVIPT extension, that is:
-		 * "instruction cache maintenance is required only after
-		 * writing new data to a physical address that holds an
-		 * instruction."
-		 *
-		 * To portably invalidate the icache the page has to
-		 * be mapped at the final virtual address but not
-		 * executable.
-		 */
-		if (area->flags & (TEE_MATTR_PX | TEE_MATTR_UX)) {
-			uint32_t mask = TEE_MATTR_PX | TEE_MATTR_UX |
-					TEE_MATTR_PW | TEE_MATTR_UW;
-
-			/* Set a temporary read-only mapping */
-			area_set_entry(pmem->area, pmem->pgidx, pa,
-				       attr & ~mask);
-			tlbi_mva_allasid(page_va);
-
-			/*
-			 * Doing these operations to LoUIS (Level of
-			 * unification, Inner Shareable) would be enough
-			 */
-			cache_op_inner(DCACHE_AREA_CLEAN, (void *)page_va,
-				       SMALL_PAGE_SIZE);
-			cache_op_inner(ICACHE_AREA_INVALIDATE, (void *)page_va,
-				       SMALL_PAGE_SIZE);
-
-			/* Set the final mapping */
-			area_set_entry(area, pmem->pgidx, pa, attr);
-			tlbi_mva_allasid(page_va);
-		} else {
-			area_set_entry(area, pmem->pgidx, pa, attr);
-			/*
-			 * No need to flush TLB for this entry, it was
-			 * invalid. We should use a barrier though, to make
-			 * sure that the change is visible.
-			 */
-			dsb_ishst();
-		}
-		pgt_inc_used_entries(area->pgt);
-
-		FMSG("Mapped 0x%" PRIxVA " -> 0x%" PRIxPA, page_va, pa);
-
+		pager_fault_around(area, page_va);
 	}
 
 	tee_pager_hide_pages();
@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <crypto/crypto.h>
+#include <inttypes.h>
+#include <kernel/tee_time.h>
+#include <pta_invoke_tests.h>
+#include <string.h>
+#include <trace.h>
+#include <utee_defines.h>
+
+#include "core_self_tests.h"
+
+#define ECC_BENCH_DEFAULT_COUNT	10
+#define ECC_BENCH_SIG_SIZE	64
+
+static TEE_Result sign_digest(struct ecc_keypair *key, const uint8_t *digest,
+			      uint8_t *sig, size_t *sig_len)
+{
+	*sig_len = ECC_BENCH_SIG_SIZE;
+	return crypto_acipher_ecc_sign(TEE_ALG_ECDSA_P256, key, digest,
+				       TEE_SHA256_HASH_SIZE, sig, sig_len);
+}
+
+/*
+ * Signs a SHA-256 digest count times with a fresh ECDSA P-256 key. The
+ * precomputed tables of the curve, if enabled, are built by the key
+ * generation. The last signature is verified to check the result.
+ */
+TEE_Result core_ecc_sign_bench(uint32_t param_types,
+			       TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	uint8_t digest[TEE_SHA256_HASH_SIZE];
+	struct ecc_public_key pub = { NULL };
+	struct ecc_keypair key = { NULL };
+	uint8_t sig[ECC_BENCH_SIG_SIZE];
+	size_t sig_len;
+	TEE_Result res;
+	TEE_Time start;
+	uint32_t ms;
+	size_t count;
+	size_t n;
+
+	if (exp_pt != param_types) {
+		DMSG("bad parameter types");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	count = params[0].value.a;
+	if (!count)
+		count = ECC_BENCH_DEFAULT_COUNT;
+
+	res = crypto_acipher_alloc_ecc_keypair(&key, 256);
+	if (res)
+		return res;
+	res = crypto_acipher_alloc_ecc_public_key(&pub, 256);
+	if (res)
+		goto out;
+	key.curve = TEE_ECC_CURVE_NIST_P256;
+	res = crypto_acipher_gen_ecc_key(&key);
+	if (res)
+		goto out;
+	pub.curve = key.curve;
+	crypto_bignum_copy(pub.x, key.x);
+	crypto_bignum_copy(pub.y, key.y);
+
+	memset(digest, 0xa5, sizeof(digest));
+	res = tee_time_get_sys_time(&start);
+	if (res)
+		goto out;
+	for (n = 0; n < count; n++) {
+		res = sign_digest(&key, digest, sig, &sig_len);
+		if (res)
+			goto out;
+	}
+	ms = core_tests_elapsed_ms(&start);
+
+	res = crypto_acipher_ecc_verify(TEE_ALG_ECDSA_P256, &pub, digest,
+					sizeof(digest), sig, sig_len);
+	if (res)
+		goto out;
+
+	params[1].value.a = ms;
+	params[1].value.b = ms * 1000 / count;
+
+	DMSG("%zu ECDSA P-256 signatures in %"PRIu32" ms", count, ms);
+out:
+	crypto_bignum_free(key.d);
+	crypto_bignum_free(key.x);
+	crypto_bignum_free(key.y);
+	crypto_acipher_free_ecc_public_key(&pub);
+	return res;
+}
@@ -4,6 +4,9 @@
  */
 
 #include <assert.h>
+#include <mm/mobj.h>
+#include <optee_msg.h>
+#include <optee_msg_supplicant.h>
 #include <string.h>
 #include <tee/fs_htree.h>
 #include <tee/tee_fs_rpc.h>
@@ -24,6 +27,12 @@ struct test_aux {
 	size_t data_len;
 	size_t data_alloced;
 	uint8_t *block;
+	size_t num_block_rpcs;
+	struct tee_fs_rpc_batch batch;
+	unsigned int batch_depth;
+	bool writev_unsupported;
+	size_t num_writev;
+	size_t num_write;
 };
 
 static TEE_Result test_get_offs_size(enum tee_fs_htree_type type, size_t idx,
@@ -97,8 +106,17 @@ static TEE_Result test_read_init(void *aux, struct tee_fs_rpc_operation *op,
 	size_t offs;
 	size_t sz;
 
+	/* Like the REE FS, commit queued writes before reading */
+	if (a->batch_depth) {
+		res = tee_fs_rpc_batch_final(&a->batch);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
 	res = test_get_offs_size(type, idx, vers, &offs, &sz);
 	if (res == TEE_SUCCESS) {
+		if (type == TEE_FS_HTREE_TYPE_BLOCK)
+			a->num_block_rpcs++;
 		memset(op, 0, sizeof(*op));
 		op->params[0].u.value.a = (vaddr_t)aux;
 		op->params[0].u.value.b = offs;
@@ -132,11 +150,118 @@ static TEE_Result test_read_final(struct tee_fs_rpc_operation *op,
 	return TEE_SUCCESS;
 }
 
+static TEE_Result test_write_data(struct test_aux *a, size_t offs,
+				  const void *data, size_t sz)
+{
+	size_t end = offs + sz;
+
+	if (end > a->data_alloced) {
+		EMSG("out of bounds");
+		return TEE_ERROR_GENERIC;
+	}
+
+	memcpy(a->data + offs, data, sz);
+	if (end > a->data_len)
+		a->data_len = end;
+	return TEE_SUCCESS;
+}
+
+static uint8_t *test_batch_buf(struct tee_fs_rpc_batch *b,
+				const struct optee_msg_param *param,
+				size_t *size)
+{
+	paddr_t pa;
+
+	switch (param->attr) {
+	case OPTEE_MSG_ATTR_TYPE_RMEM_INPUT:
+		*size = param->u.rmem.size;
+		return b->va + param->u.rmem.offs;
+	case OPTEE_MSG_ATTR_TYPE_TMEM_INPUT:
+		if (mobj_get_pa(b->mobj, 0, 0, &pa) != TEE_SUCCESS ||
+		    param->u.tmem.buf_ptr < pa)
+			return NULL;
+		*size = param->u.tmem.size;
+		return b->va + (param->u.tmem.buf_ptr - pa);
+	default:
+		return NULL;
+	}
+}
+
+/*
+ * Stub of the tee-supplicant side of the requests sent by the FS RPC
+ * write batch, OPTEE_MRF_WRITEV is rejected like an older tee-supplicant
+ * would if test_aux::writev_unsupported is set.
+ */
+static TEE_Result test_batch_commit(void *aux, struct tee_fs_rpc_operation *op)
+{
+	struct test_aux *a = aux;
+	const struct optee_mrf_iovec *iov;
+	TEE_Result res;
+	uint8_t *buf;
+	size_t buf_len;
+	size_t num_iov;
+	size_t n;
+
+	if (op->num_params != 2 ||
+	    op->params[0].attr != OPTEE_MSG_ATTR_TYPE_VALUE_INPUT ||
+	    op->params[0].u.value.b != (uint64_t)a->batch.fd)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	buf = test_batch_buf(&a->batch, op->params + 1, &buf_len);
+	if (!buf)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	switch (op->params[0].u.value.a) {
+	case OPTEE_MRF_WRITEV:
+		if (a->writev_unsupported)
+			return TEE_ERROR_NOT_SUPPORTED;
+
+		iov = (const void *)buf;
+		num_iov = op->params[0].u.value.c;
+		if (num_iov > buf_len / sizeof(*iov))
+			return TEE_ERROR_BAD_PARAMETERS;
+
+		for (n = 0; n < num_iov; n++) {
+			if (iov[n].data_offs > buf_len ||
+			    iov[n].len > buf_len - iov[n].data_offs)
+				return TEE_ERROR_BAD_PARAMETERS;
+			res = test_write_data(a, iov[n].offset,
+					      buf + iov[n].data_offs,
+					      iov[n].len);
+			if (res != TEE_SUCCESS)
+				return res;
+		}
+		a->num_writev++;
+		return TEE_SUCCESS;
+	case OPTEE_MRF_WRITE:
+		a->num_write++;
+		return test_write_data(a, op->params[0].u.value.c, buf,
+				       buf_len);
+	default:
+		return TEE_ERROR_NOT_SUPPORTED;
+	}
+}
+
 static TEE_Result test_write_init(void *aux, struct tee_fs_rpc_operation *op,
 				  enum tee_fs_htree_type type, size_t idx,
 				  uint8_t vers, void **data)
 {
-	return test_read_init(aux, op, type, idx, vers, data);
+	TEE_Result res;
+	struct test_aux *a = aux;
+	size_t offs;
+	size_t sz;
+
+	if (!a->batch_depth)
+		return test_read_init(aux, op, type, idx, vers, data);
+
+	res = test_get_offs_size(type, idx, vers, &offs, &sz);
+	if (res != TEE_SUCCESS)
+		return res;
+	if (type == TEE_FS_HTREE_TYPE_BLOCK)
+		a->num_block_rpcs++;
+
+	/* The queued write leaves a zero aux pointer for test_write_final() */
+	return tee_fs_rpc_batch_write_init(&a->batch, op, offs, sz, data);
 }
 
 static TEE_Result test_write_final(struct tee_fs_rpc_operation *op)
@@ -144,18 +269,42 @@ static TEE_Result test_write_final(struct tee_fs_rpc_operation *op)
 	struct test_aux *a = uint_to_ptr(op->params[0].u.value.a);
 	size_t offs = op->params[0].u.value.b;
 	size_t sz = op->params[0].u.value.c;
-	size_t end = offs + sz;
 
-	if (end > a->data_alloced) {
-		EMSG("out of bounds");
-		return TEE_ERROR_GENERIC;
-	}
+	if (!a)
+		return TEE_SUCCESS;
 
-	memcpy(a->data + offs, a->block, sz);
-	if (end > a->data_len)
-		a->data_len = end;
+	return test_write_data(a, offs, a->block, sz);
+}
+
+/* Nests like the REE FS, the outermost test_write_end() commits */
+static TEE_Result test_write_begin(void *aux)
+{
+	struct test_aux *a = aux;
+
+	if (!a->batch_depth) {
+		tee_fs_rpc_batch_init(&a->batch, OPTEE_MSG_RPC_CMD_FS, 0);
+		a->batch.commit = test_batch_commit;
+		a->batch.commit_aux = a;
+	}
+	a->batch_depth++;
 	return TEE_SUCCESS;
+}
+
+static TEE_Result test_write_end(void *aux, bool abort)
+{
+	struct test_aux *a = aux;
 
+	assert(a->batch_depth);
+	a->batch_depth--;
+
+	if (abort) {
+		tee_fs_rpc_batch_abort(&a->batch);
+		return TEE_SUCCESS;
+	}
+	if (a->batch_depth)
+		return TEE_SUCCESS;
+
+	return tee_fs_rpc_batch_final(&a->batch);
 }
 
 static const struct tee_fs_htree_storage test_htree_ops = {
@@ -164,6 +313,8 @@ static const struct tee_fs_htree_storage test_htree_ops = {
 	.rpc_read_final = test_read_final,
 	.rpc_write_init = test_write_init,
 	.rpc_write_final = test_write_final,
+	.rpc_write_begin = test_write_begin,
+	.rpc_write_end = test_write_end,
 };
 
 #define CHECK_RES(res, cleanup)						\
@@ -616,6 +767,227 @@ out:
 	return res;
 }
 
+/*
+ * Checks that repeated reads and writes of a block are served from the
+ * block cache and that dirty blocks are written back when synced.
+ */
+static TEE_Result test_block_cache(size_t num_blocks)
+{
+	const size_t cached = !!CFG_REE_FS_HTREE_CACHE_BLOCKS;
+	TEE_Result res;
+	struct tee_fs_htree *ht = NULL;
+	struct tee_ta_session *sess;
+	uint8_t hash[TEE_FS_HTREE_HASH_SIZE];
+	const TEE_UUID *uuid;
+	struct test_aux *aux;
+	size_t n;
+
+	res = tee_ta_get_current_session(&sess);
+	if (res)
+		return res;
+	uuid = &sess->ctx->uuid;
+
+	aux = aux_alloc(num_blocks);
+	if (!aux)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	aux->data_len = 0;
+	memset(aux->data, 0xce, aux->data_alloced);
+
+	res = tee_fs_htree_open(true, hash, uuid, &test_htree_ops, aux, &ht);
+	CHECK_RES(res, goto out);
+	res = do_range(write_block, &ht, 0, num_blocks, 1);
+	CHECK_RES(res, goto out);
+	res = tee_fs_htree_sync_to_storage(&ht, hash);
+	CHECK_RES(res, goto out);
+	tee_fs_htree_close(&ht);
+
+	res = tee_fs_htree_open(false, hash, uuid, &test_htree_ops, aux, &ht);
+	CHECK_RES(res, goto out);
+
+	aux->num_block_rpcs = 0;
+	for (n = 0; n < 3; n++) {
+		res = read_block(&ht, 0, 1);
+		CHECK_RES(res, goto out);
+	}
+	if (aux->num_block_rpcs != (cached ? 1 : 3)) {
+		EMSG("error: %zu block reads", aux->num_block_rpcs);
+		res = TEE_ERROR_GENERIC;
+		goto out;
+	}
+
+	aux->num_block_rpcs = 0;
+	aux->num_writev = 0;
+	for (n = 0; n < 3; n++) {
+		res = write_block(&ht, 0, 2);
+		CHECK_RES(res, goto out);
+	}
+	res = read_block(&ht, 0, 2);
+	CHECK_RES(res, goto out);
+	res = tee_fs_htree_sync_to_storage(&ht, hash);
+	CHECK_RES(res, goto out);
+	if (aux->num_block_rpcs != (cached ? 1 : 4)) {
+		EMSG("error: %zu block writes", aux->num_block_rpcs);
+		res = TEE_ERROR_GENERIC;
+		goto out;
+	}
+	/* The node and the head are written with a single request */
+	if (aux->num_writev != 1) {
+		EMSG("error: %zu vectored writes", aux->num_writev);
+		res = TEE_ERROR_GENERIC;
+		goto out;
+	}
+	tee_fs_htree_close(&ht);
+
+	/* Verify that the synced block reads back from storage */
+	res = tee_fs_htree_open(false, hash, uuid, &test_htree_ops, aux, &ht);
+	CHECK_RES(res, goto out);
+	res = read_block(&ht, 0, 2);
+	CHECK_RES(res, goto out);
+	res = do_range(read_block, &ht, 1, num_blocks - 1, 1);
+	CHECK_RES(res, goto out);
+
+out:
+	tee_fs_htree_close(&ht);
+	aux_free(aux);
+	return res;
+}
+
+/*
+ * Checks that the writes queued in a batch are sent as one OPTEE_MRF_WRITE
+ * request each when tee-supplicant doesn't support OPTEE_MRF_WRITEV.
+ */
+static TEE_Result test_writev_fallback(size_t num_blocks)
+{
+	TEE_Result res;
+	struct tee_fs_htree *ht = NULL;
+	struct tee_ta_session *sess;
+	uint8_t hash[TEE_FS_HTREE_HASH_SIZE];
+	const TEE_UUID *uuid;
+	struct test_aux *aux;
+
+	res = tee_ta_get_current_session(&sess);
+	if (res)
+		return res;
+	uuid = &sess->ctx->uuid;
+
+	aux = aux_alloc(num_blocks);
+	if (!aux)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	aux->data_len = 0;
+	memset(aux->data, 0xce, aux->data_alloced);
+	aux->writev_unsupported = true;
+
+	res = tee_fs_htree_open(true, hash, uuid, &test_htree_ops, aux, &ht);
+	CHECK_RES(res, goto out);
+	res = do_range(write_block, &ht, 0, num_blocks, 1);
+	CHECK_RES(res, goto out);
+	res = tee_fs_htree_sync_to_storage(&ht, hash);
+	CHECK_RES(res, goto out);
+	tee_fs_htree_close(&ht);
+
+	if (aux->num_writev || !aux->num_write) {
+		EMSG("error: %zu vectored writes, %zu writes",
+		     aux->num_writev, aux->num_write);
+		res = TEE_ERROR_GENERIC;
+		goto out;
+	}
+
+	res = tee_fs_htree_open(false, hash, uuid, &test_htree_ops, aux, &ht);
+	CHECK_RES(res, goto out);
+	res = do_range(read_block, &ht, 0, num_blocks, 1);
+	CHECK_RES(res, goto out);
+
+out:
+	tee_fs_htree_close(&ht);
+	aux_free(aux);
+	return res;
+}
+
+/*
+ * Checks that data blocks written between test_write_begin() and
+ * test_write_end(), as done by the REE FS, are sent together with the
+ * nodes and the head in one OPTEE_MRF_WRITEV request, and that nothing
+ * reaches storage if the writes are aborted.
+ */
+static TEE_Result test_batched_write(size_t num_blocks)
+{
+	TEE_Result res;
+	struct tee_fs_htree *ht = NULL;
+	struct tee_ta_session *sess;
+	uint8_t hash[TEE_FS_HTREE_HASH_SIZE];
+	const TEE_UUID *uuid;
+	struct test_aux *aux;
+	size_t data_len;
+
+	res = tee_ta_get_current_session(&sess);
+	if (res)
+		return res;
+	uuid = &sess->ctx->uuid;
+
+	aux = aux_alloc(num_blocks);
+	if (!aux)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	aux->data_len = 0;
+	memset(aux->data, 0xce, aux->data_alloced);
+
+	res = tee_fs_htree_open(true, hash, uuid, &test_htree_ops, aux, &ht);
+	CHECK_RES(res, goto out);
+
+	aux->num_writev = 0;
+	aux->num_write = 0;
+	test_write_begin(aux);
+	res = do_range(write_block, &ht, 0, num_blocks, 1);
+	if (!res)
+		res = tee_fs_htree_sync_to_storage(&ht, hash);
+	if (!res)
+		res = test_write_end(aux, false);
+	else
+		test_write_end(aux, true);
+	CHECK_RES(res, goto out);
+	if (aux->num_writev != 1 || aux->num_write) {
+		EMSG("error: %zu vectored writes, %zu writes",
+		     aux->num_writev, aux->num_write);
+		res = TEE_ERROR_GENERIC;
+		goto out;
+	}
+	tee_fs_htree_close(&ht);
+
+	res = tee_fs_htree_open(false, hash, uuid, &test_htree_ops, aux, &ht);
+	CHECK_RES(res, goto out);
+	res = do_range(read_block, &ht, 0, num_blocks, 1);
+	CHECK_RES(res, goto out);
+
+	/* Aborted writes are discarded */
+	aux->num_writev = 0;
+	data_len = aux->data_len;
+	test_write_begin(aux);
+	res = do_range(write_block, &ht, 0, num_blocks, 2);
+	if (!res)
+		res = tee_fs_htree_sync_to_storage(&ht, NULL);
+	test_write_end(aux, true);
+	CHECK_RES(res, goto out);
+	tee_fs_htree_close(&ht);
+	if (aux->num_writev || aux->num_write || aux->data_len != data_len) {
+		EMSG("error: aborted writes reached storage");
+		res = TEE_ERROR_GENERIC;
+		goto out;
+	}
+
+	/* The storage still holds the synced tree */
+	res = tee_fs_htree_open(false, hash, uuid, &test_htree_ops, aux, &ht);
+	CHECK_RES(res, goto out);
+	res = do_range(read_block, &ht, 0, num_blocks, 1);
+	CHECK_RES(res, goto out);
+
+out:
+	tee_fs_htree_close(&ht);
+	aux_free(aux);
+	return res;
+}
+
 TEE_Result core_fs_htree_tests(uint32_t nParamTypes,
 			       TEE_Param pParams[TEE_NUM_PARAMS] __unused)
 {
@@ -628,5 +1000,17 @@ TEE_Result core_fs_htree_tests(uint32_t nParamTypes,
 	if (res)
 		return res;
 
+	res = test_block_cache(5);
+	if (res)
+		return res;
+
+	res = test_writev_fallback(5);
+	if (res)
+		return res;
+
+	res = test_batched_write(5);
+	if (res)
+		return res;
+
 	return test_corrupt(5);
 }
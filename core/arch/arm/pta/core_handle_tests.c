@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <inttypes.h>
+#include <kernel/handle.h>
+#include <kernel/tee_time.h>
+#include <pta_invoke_tests.h>
+#include <stdlib.h>
+#include <string.h>
+#include <trace.h>
+#include <utee_defines.h>
+
+#include "core_self_tests.h"
+
+/*
+ * Both databases grow to the next power of two above the count, larger
+ * counts are only limited by the core heap.
+ */
+#define HANDLE_BENCH_DEFAULT_COUNT	1000
+
+/*
+ * Reference allocator which scans for the first unused slot, as
+ * handle_get() used to do before it kept a free list.
+ */
+struct scan_db {
+	void **ptrs;
+	size_t max_ptrs;
+};
+
+static int scan_get(struct scan_db *db, void *ptr)
+{
+	size_t n;
+	size_t new_max_ptrs;
+	void *p;
+
+	for (n = 0; n < db->max_ptrs; n++) {
+		if (!db->ptrs[n]) {
+			db->ptrs[n] = ptr;
+			return n;
+		}
+	}
+
+	new_max_ptrs = db->max_ptrs ? db->max_ptrs * 2 : 4;
+	p = realloc(db->ptrs, new_max_ptrs * sizeof(void *));
+	if (!p)
+		return -1;
+	db->ptrs = p;
+	memset(db->ptrs + db->max_ptrs, 0,
+	       (new_max_ptrs - db->max_ptrs) * sizeof(void *));
+	db->max_ptrs = new_max_ptrs;
+
+	db->ptrs[n] = ptr;
+	return n;
+}
+
+static void scan_put(struct scan_db *db, int handle)
+{
+	if (handle >= 0 && (size_t)handle < db->max_ptrs)
+		db->ptrs[handle] = NULL;
+}
+
+/*
+ * Fills the database with count handles and then releases and
+ * reallocates them in a scattered order, which is what makes a first-fit
+ * scan expensive. res is set to TEE_ERROR_OUT_OF_MEMORY and the loop
+ * stops if a handle can't be allocated.
+ */
+#define BENCH_LOOP(get, put, db, handles, count, obj, res) do { \
+		size_t __i; \
+		size_t __j; \
+		\
+		(res) = TEE_SUCCESS; \
+		for (__i = 0; __i < (count); __i++) { \
+			(handles)[__i] = get((db), (obj)); \
+			if ((handles)[__i] < 0) { \
+				(res) = TEE_ERROR_OUT_OF_MEMORY; \
+				break; \
+			} \
+		} \
+		for (__i = 0; !(res) && __i < (count); __i++) { \
+			__j = (__i * 7919) % (count); \
+			put((db), (handles)[__j]); \
+			(handles)[__j] = get((db), (obj)); \
+			if ((handles)[__j] < 0) \
+				(res) = TEE_ERROR_OUT_OF_MEMORY; \
+		} \
+	} while (0)
+
+static TEE_Result check_handle_db(struct handle_db *db, int *handles,
+				  size_t count, void *obj)
+{
+	size_t n;
+	int h;
+
+	for (n = 0; n < count; n++) {
+		if (handles[n] <= 0 || handle_lookup(db, handles[n]) != obj)
+			return TEE_ERROR_GENERIC;
+	}
+
+	h = handles[0];
+	if (handle_put(db, h) != obj || handle_lookup(db, h))
+		return TEE_ERROR_GENERIC;
+	handles[0] = handle_get(db, obj);
+	if (handles[0] <= 0)
+		return TEE_ERROR_GENERIC;
+#ifdef CFG_HANDLE_DB_GENERATIONS
+	/* The slot is reused but the stale handle must stay invalid */
+	if (handles[0] == h || handle_lookup(db, h) || handle_put(db, h))
+		return TEE_ERROR_GENERIC;
+#endif
+	if (handle_lookup(db, 0))
+		return TEE_ERROR_GENERIC;
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result core_handle_db_bench(uint32_t param_types,
+				TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	struct handle_db db = HANDLE_DB_INITIALIZER;
+	struct scan_db sdb = { NULL, 0 };
+	static uint32_t obj;
+	TEE_Result res;
+	TEE_Time start;
+	size_t count;
+	int *handles;
+
+	if (exp_pt != param_types) {
+		DMSG("bad parameter types");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	count = params[0].value.a;
+	if (!count)
+		count = HANDLE_BENCH_DEFAULT_COUNT;
+	handles = calloc(count, sizeof(*handles));
+	if (!handles)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	res = tee_time_get_sys_time(&start);
+	if (res)
+		goto out;
+	BENCH_LOOP(scan_get, scan_put, &sdb, handles, count, &obj, res);
+	if (res) {
+		EMSG("first-fit scan: out of memory");
+		goto out;
+	}
+	params[1].value.a = core_tests_elapsed_ms(&start);
+	/* Not needed any longer, leave the heap to the handle_db */
+	free(sdb.ptrs);
+	sdb.ptrs = NULL;
+
+	res = tee_time_get_sys_time(&start);
+	if (res)
+		goto out;
+	BENCH_LOOP(handle_get, handle_put, &db, handles, count, &obj, res);
+	if (res) {
+		EMSG("handle_db: out of memory");
+		goto out;
+	}
+	params[1].value.b = core_tests_elapsed_ms(&start);
+
+	res = check_handle_db(&db, handles, count, &obj);
+	if (res) {
+		EMSG("handle_db check failed");
+		goto out;
+	}
+
+	DMSG("%zu handles: %"PRIu32" ms with first-fit scan, %"PRIu32
+	     " ms with free list", count, params[1].value.a,
+	     params[1].value.b);
+
+out:
+	handle_db_destroy(&db);
+	free(sdb.ptrs);
+	free(handles);
+	return res;
+}
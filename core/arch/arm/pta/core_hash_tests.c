@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <crypto/crypto.h>
+#include <inttypes.h>
+#include <kernel/tee_time.h>
+#include <pta_invoke_tests.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tee/tee_cryp_utl.h>
+#include <trace.h>
+#include <utee_defines.h>
+#include <util.h>
+
+#include "core_self_tests.h"
+
+#define HASH_BENCH_DEFAULT_KIB	1024
+#define HASH_BENCH_CHUNK_SIZE	(16 * 1024)
+
+/*
+ * Hashes kib KiB with one of the TEE_ALG_SHA* algorithms, updating with
+ * HASH_BENCH_CHUNK_SIZE bytes at a time as a TA hashing a large buffer
+ * would do.
+ */
+TEE_Result core_hash_bench(uint32_t param_types,
+			   TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	uint8_t digest[TEE_MAX_HASH_SIZE];
+	uint8_t *buf = NULL;
+	void *ctx = NULL;
+	size_t digest_size;
+	uint32_t algo;
+	TEE_Result res;
+	TEE_Time start;
+	uint64_t len;
+	uint32_t ms;
+	size_t kib;
+	size_t n;
+
+	if (exp_pt != param_types) {
+		DMSG("bad parameter types");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	algo = params[0].value.a;
+	kib = params[0].value.b;
+	if (!kib)
+		kib = HASH_BENCH_DEFAULT_KIB;
+
+	res = tee_hash_get_digest_size(algo, &digest_size);
+	if (res)
+		return res;
+
+	buf = malloc(HASH_BENCH_CHUNK_SIZE);
+	if (!buf)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	memset(buf, 0xa5, HASH_BENCH_CHUNK_SIZE);
+
+	res = crypto_hash_alloc_ctx(&ctx, algo);
+	if (res)
+		goto out;
+	res = crypto_hash_init(ctx, algo);
+	if (res)
+		goto out;
+
+	len = (uint64_t)kib * 1024;
+	res = tee_time_get_sys_time(&start);
+	if (res)
+		goto out;
+	while (len) {
+		n = MIN(len, (uint64_t)HASH_BENCH_CHUNK_SIZE);
+		res = crypto_hash_update(ctx, algo, buf, n);
+		if (res)
+			goto out;
+		len -= n;
+	}
+	res = crypto_hash_final(ctx, algo, digest, digest_size);
+	if (res)
+		goto out;
+	ms = core_tests_elapsed_ms(&start);
+
+	params[1].value.a = ms;
+	params[1].value.b = ms ? (uint64_t)kib * 1000 / 1024 / ms : 0;
+
+	DMSG("Hash algo %#"PRIx32": %zu KiB in %"PRIu32" ms", algo, kib, ms);
+out:
+	crypto_hash_free_ctx(ctx, algo);
+	free(buf);
+	return res;
+}
@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <inttypes.h>
+#include <mm/core_mmu.h>
+#include <mm/tee_mm.h>
+#include <pta_invoke_tests.h>
+#include <stdlib.h>
+#include <string.h>
+#include <trace.h>
+#include <utee_defines.h>
+
+#include "core_self_tests.h"
+
+/*
+ * Entries of a TEE_MM_POOL_TREE pool are about 64 bytes on the core heap,
+ * larger counts are only limited by the core heap.
+ */
+#define MM_BENCH_DEFAULT_COUNT	256
+#define MM_BENCH_DEFAULT_ROUNDS	16
+#define MM_BENCH_POOL_BASE	0x80000000
+#define MM_BENCH_MAX_PAGES	16
+#define MM_BENCH_NO_ENTRY	UINT32_MAX
+
+/* Deterministic page count of allocation n, 1 to MM_BENCH_MAX_PAGES */
+static size_t bench_pages(size_t n)
+{
+	return (n * 2654435761u >> 7) % MM_BENCH_MAX_PAGES + 1;
+}
+
+/* Number of tee_mm_alloc() and tee_mm_free() calls timed by bench_round() */
+static size_t bench_alloc_ops(size_t count)
+{
+	return count + 2 * ((count + 1) / 2);
+}
+
+/*
+ * Fragments the pool by allocating count entries of varying size and
+ * freeing every other, then reallocates the holes with different sizes
+ * and looks up every entry. The pool is large enough for all entries so
+ * a failed allocation means that the heap is exhausted. The time spent
+ * is added to @alloc_ns and @find_ns.
+ */
+static TEE_Result bench_round(tee_mm_pool_t *pool, tee_mm_entry_t **mm,
+			      size_t count, uint64_t *alloc_ns,
+			      uint64_t *find_ns)
+{
+	uint64_t start;
+	size_t n;
+
+	start = core_tests_timestamp();
+	for (n = 0; n < count; n++) {
+		mm[n] = tee_mm_alloc(pool, bench_pages(n) * SMALL_PAGE_SIZE);
+		if (!mm[n])
+			goto err_oom;
+	}
+	for (n = 0; n < count; n += 2) {
+		tee_mm_free(mm[n]);
+		mm[n] = NULL;
+	}
+	for (n = 0; n < count; n += 2) {
+		mm[n] = tee_mm_alloc(pool,
+				     bench_pages(n + 1) * SMALL_PAGE_SIZE);
+		if (!mm[n])
+			goto err_oom;
+	}
+	*alloc_ns += core_tests_elapsed_ns(start);
+
+	start = core_tests_timestamp();
+	for (n = 0; n < count; n++) {
+		if (tee_mm_find(pool, tee_mm_get_smem(mm[n])) != mm[n])
+			return TEE_ERROR_GENERIC;
+	}
+	*find_ns += core_tests_elapsed_ns(start);
+
+	return TEE_SUCCESS;
+
+err_oom:
+	EMSG("out of memory at entry %zu", n);
+	return TEE_ERROR_OUT_OF_MEMORY;
+}
+
+/*
+ * Runs @rounds rounds of bench_round(), emptying the pool after each.
+ * The offsets of the entries of the last round are returned in offs[]
+ * and the time per operation in @alloc_ns and @find_ns.
+ */
+static TEE_Result run_bench(tee_mm_pool_t *pool, tee_mm_entry_t **mm,
+			    uint32_t *offs, size_t count, size_t rounds,
+			    uint32_t *alloc_ns, uint32_t *find_ns)
+{
+	TEE_Result res = TEE_SUCCESS;
+	uint64_t alloc_total = 0;
+	uint64_t find_total = 0;
+	size_t r;
+	size_t n;
+
+	for (r = 0; r < rounds && !res; r++) {
+		res = bench_round(pool, mm, count, &alloc_total, &find_total);
+
+		for (n = 0; n < count; n++) {
+			if (mm[n]) {
+				offs[n] = tee_mm_get_offset(mm[n]);
+				tee_mm_free(mm[n]);
+				mm[n] = NULL;
+			} else {
+				offs[n] = MM_BENCH_NO_ENTRY;
+			}
+		}
+	}
+
+	*alloc_ns = alloc_total / (rounds * bench_alloc_ops(count));
+	*find_ns = find_total / (rounds * count);
+	return res;
+}
+
+TEE_Result core_mm_pool_bench(uint32_t param_types,
+			      TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE);
+	tee_mm_pool_t pool;
+	tee_mm_entry_t **mm = NULL;
+	uint32_t *list_offs = NULL;
+	uint32_t *tree_offs = NULL;
+	TEE_Result res = TEE_ERROR_OUT_OF_MEMORY;
+	paddr_t pool_end;
+	size_t rounds;
+	size_t count;
+	size_t n;
+
+	if (exp_pt != param_types) {
+		DMSG("bad parameter types");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	count = params[0].value.a;
+	if (!count)
+		count = MM_BENCH_DEFAULT_COUNT;
+	rounds = params[0].value.b;
+	if (!rounds)
+		rounds = MM_BENCH_DEFAULT_ROUNDS;
+
+	mm = calloc(count, sizeof(*mm));
+	list_offs = calloc(count, sizeof(*list_offs));
+	tree_offs = calloc(count, sizeof(*tree_offs));
+	if (!mm || !list_offs || !tree_offs)
+		goto out;
+
+	/*
+	 * Room for all entries at their largest with some slack. The pools
+	 * are run one after the other to leave the heap to one of them.
+	 */
+	pool_end = MM_BENCH_POOL_BASE +
+		   count * (MM_BENCH_MAX_PAGES + 1) * SMALL_PAGE_SIZE;
+	if (!tee_mm_init(&pool, MM_BENCH_POOL_BASE, pool_end,
+			 SMALL_PAGE_SHIFT, TEE_MM_POOL_NO_FLAGS))
+		goto out;
+	res = run_bench(&pool, mm, list_offs, count, rounds,
+			&params[1].value.a, &params[2].value.a);
+	tee_mm_final(&pool);
+	if (res)
+		goto out;
+
+	res = TEE_ERROR_OUT_OF_MEMORY;
+	if (!tee_mm_init(&pool, MM_BENCH_POOL_BASE, pool_end,
+			 SMALL_PAGE_SHIFT, TEE_MM_POOL_TREE))
+		goto out;
+	res = run_bench(&pool, mm, tree_offs, count, rounds,
+			&params[1].value.b, &params[2].value.b);
+	tee_mm_final(&pool);
+	if (res)
+		goto out;
+
+	/* Both pools are first-fit and must end up with the same layout */
+	for (n = 0; n < count; n++) {
+		if (list_offs[n] != tree_offs[n]) {
+			EMSG("pool layout mismatch at entry %zu", n);
+			res = TEE_ERROR_GENERIC;
+			goto out;
+		}
+	}
+
+	DMSG("%zu entries, %zu rounds: alloc/free %"PRIu32" ns (list) %"
+	     PRIu32" ns (tree), find %"PRIu32" ns (list) %"PRIu32
+	     " ns (tree)", count, rounds, params[1].value.a,
+	     params[1].value.b, params[2].value.a, params[2].value.b);
+
+out:
+	free(mm);
+	free(list_offs);
+	free(tree_offs);
+	return res;
+}
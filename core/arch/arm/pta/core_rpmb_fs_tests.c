@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <inttypes.h>
+#include <kernel/tee_time.h>
+#include <pta_invoke_tests.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tee/tee_fs.h>
+#include <trace.h>
+#include <utee_defines.h>
+
+#include "core_self_tests.h"
+
+#ifdef CFG_RPMB_MULTIBLOCK_WRITE
+static TEE_Result timed_write(const void *buf, size_t size,
+			      uint16_t max_blkcnt, uint32_t *ms,
+			      uint32_t *blkcnt)
+{
+	TEE_Result res;
+	TEE_Time start;
+	uint16_t n = 0;
+
+	res = tee_time_get_sys_time(&start);
+	if (res)
+		return res;
+
+	res = tee_rpmb_fs_bench_write(buf, size, max_blkcnt, &n);
+	if (res)
+		return res;
+
+	*ms = core_tests_elapsed_ms(&start);
+	*blkcnt = n;
+	return TEE_SUCCESS;
+}
+
+TEE_Result core_rpmb_fs_write_bench(uint32_t param_types,
+				    TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE);
+	TEE_Result res;
+	uint32_t blkcnt;
+	size_t size;
+	uint8_t *buf;
+
+	if (exp_pt != param_types) {
+		DMSG("bad parameter types");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	size = params[0].value.a;
+	buf = malloc(size);
+	if (!buf)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	memset(buf, 0x5a, size);
+
+	res = timed_write(buf, size, 1, &params[1].value.a, &blkcnt);
+	if (res)
+		goto out;
+
+	res = timed_write(buf, size, 0, &params[1].value.b,
+			  &params[2].value.a);
+	if (res)
+		goto out;
+	params[2].value.b = 0;
+
+	DMSG("RPMB write %zu bytes: %"PRIu32" ms (1 block/request), %"PRIu32
+	     " ms (%"PRIu32" blocks/request)", size, params[1].value.a,
+	     params[1].value.b, params[2].value.a);
+
+out:
+	free(buf);
+	return res;
+}
+#else
+TEE_Result core_rpmb_fs_write_bench(uint32_t param_types __unused,
+				    TEE_Param params[TEE_NUM_PARAMS] __unused)
+{
+	/* Only one block per request, nothing to compare */
+	DMSG("CFG_RPMB_MULTIBLOCK_WRITE is disabled");
+	return TEE_ERROR_NOT_SUPPORTED;
+}
+#endif /*CFG_RPMB_MULTIBLOCK_WRITE*/
@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <crypto/crypto.h>
+#include <inttypes.h>
+#include <kernel/mutex.h>
+#include <kernel/tee_time.h>
+#include <pta_invoke_tests.h>
+#include <string.h>
+#include <trace.h>
+#include <utee_defines.h>
+
+#include "core_self_tests.h"
+
+#define RSA_BENCH_KEY_BITS	2048
+#define RSA_BENCH_DEFAULT_COUNT	10
+#define RSA_BENCH_ALGO		TEE_ALG_RSASSA_PKCS1_V1_5_SHA256
+
+/*
+ * The key is generated by the first invocation and shared by all
+ * sessions, it's only read once generated.
+ */
+static struct mutex bench_key_mu = MUTEX_INITIALIZER;
+static struct rsa_keypair bench_key;
+static bool bench_key_valid;
+
+static void free_key(struct rsa_keypair *key)
+{
+	crypto_bignum_free(key->e);
+	crypto_bignum_free(key->d);
+	crypto_bignum_free(key->n);
+	crypto_bignum_free(key->p);
+	crypto_bignum_free(key->q);
+	crypto_bignum_free(key->qp);
+	crypto_bignum_free(key->dp);
+	crypto_bignum_free(key->dq);
+}
+
+static TEE_Result get_bench_key(void)
+{
+	static const uint8_t e[] = { 0x01, 0x00, 0x01 };
+	TEE_Result res = TEE_SUCCESS;
+
+	mutex_lock(&bench_key_mu);
+	if (bench_key_valid)
+		goto out;
+
+	res = crypto_acipher_alloc_rsa_keypair(&bench_key, RSA_BENCH_KEY_BITS);
+	if (res)
+		goto out;
+	res = crypto_bignum_bin2bn(e, sizeof(e), bench_key.e);
+	if (!res)
+		res = crypto_acipher_gen_rsa_key(&bench_key,
+						 RSA_BENCH_KEY_BITS);
+	if (res) {
+		free_key(&bench_key);
+		goto out;
+	}
+	bench_key_valid = true;
+out:
+	mutex_unlock(&bench_key_mu);
+	return res;
+}
+
+static TEE_Result sign_digest(struct rsa_keypair *key, const uint8_t *digest)
+{
+	uint8_t sig[RSA_BENCH_KEY_BITS / 8];
+	size_t sig_len = sizeof(sig);
+
+	return crypto_acipher_rsassa_sign(RSA_BENCH_ALGO, key, -1, digest,
+					  TEE_SHA256_HASH_SIZE, sig, &sig_len);
+}
+
+/*
+ * Copies the values of the bench key into a new key object, the values
+ * precomputed from the key when it's first used aren't copied
+ */
+static TEE_Result copy_bench_key(struct rsa_keypair *key)
+{
+	TEE_Result res;
+
+	res = crypto_acipher_alloc_rsa_keypair(key, RSA_BENCH_KEY_BITS);
+	if (res)
+		return res;
+	crypto_bignum_copy(key->e, bench_key.e);
+	crypto_bignum_copy(key->d, bench_key.d);
+	crypto_bignum_copy(key->n, bench_key.n);
+	crypto_bignum_copy(key->p, bench_key.p);
+	crypto_bignum_copy(key->q, bench_key.q);
+	crypto_bignum_copy(key->qp, bench_key.qp);
+	crypto_bignum_copy(key->dp, bench_key.dp);
+	crypto_bignum_copy(key->dq, bench_key.dq);
+	return TEE_SUCCESS;
+}
+
+/*
+ * Signs a SHA-256 digest count times with a 2048-bit RSA key. Opening
+ * several sessions invoking this concurrently shows how signing scales
+ * with the number of cores.
+ */
+TEE_Result core_rsa_sign_bench(uint32_t param_types,
+			       TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	uint8_t digest[TEE_SHA256_HASH_SIZE];
+	TEE_Result res;
+	TEE_Time start;
+	uint32_t ms;
+	size_t count;
+	size_t n;
+
+	if (exp_pt != param_types) {
+		DMSG("bad parameter types");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	count = params[0].value.a;
+	if (!count)
+		count = RSA_BENCH_DEFAULT_COUNT;
+
+	res = get_bench_key();
+	if (res)
+		return res;
+
+	memset(digest, 0xa5, sizeof(digest));
+	res = tee_time_get_sys_time(&start);
+	if (res)
+		return res;
+	for (n = 0; n < count; n++) {
+		res = sign_digest(&bench_key, digest);
+		if (res)
+			return res;
+	}
+	ms = core_tests_elapsed_ms(&start);
+
+	params[1].value.a = ms;
+	params[1].value.b = ms ? count * 1000 / ms : 0;
+
+	DMSG("%zu RSA-%d signatures in %"PRIu32" ms", count,
+	     RSA_BENCH_KEY_BITS, ms);
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * Compares the latency of the first signature with a key object, when
+ * values precomputed from the key have to be set up, with the following
+ * ones.
+ */
+TEE_Result core_rsa_key_cache_bench(uint32_t param_types,
+				    TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	uint8_t digest[TEE_SHA256_HASH_SIZE];
+	struct rsa_keypair key;
+	TEE_Result res;
+	uint64_t start;
+	uint64_t first_ns;
+	uint64_t ns;
+	size_t count;
+	size_t n;
+
+	if (exp_pt != param_types) {
+		DMSG("bad parameter types");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	count = params[0].value.a;
+	if (!count)
+		count = RSA_BENCH_DEFAULT_COUNT;
+
+	res = get_bench_key();
+	if (res)
+		return res;
+	res = copy_bench_key(&key);
+	if (res)
+		return res;
+
+	memset(digest, 0x5a, sizeof(digest));
+	start = core_tests_timestamp();
+	res = sign_digest(&key, digest);
+	if (res)
+		goto out;
+	first_ns = core_tests_elapsed_ns(start);
+
+	start = core_tests_timestamp();
+	for (n = 0; n < count; n++) {
+		res = sign_digest(&key, digest);
+		if (res)
+			goto out;
+	}
+	ns = core_tests_elapsed_ns(start);
+
+	params[1].value.a = first_ns / 1000;
+	params[1].value.b = ns / count / 1000;
+
+	DMSG("RSA-%d sign: first %"PRIu32" us, then %"PRIu32" us",
+	     RSA_BENCH_KEY_BITS, params[1].value.a, params[1].value.b);
+out:
+	free_key(&key);
+	return res;
+}
@@ -25,11 +25,17 @@
  * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  * POSSIBILITY OF SUCH DAMAGE.
  */
+#include <arm.h>
 #include <assert.h>
+#include <crypto/crypto.h>
 #include <malloc.h>
+#include <mpalib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <trace.h>
 #include <kernel/panic.h>
+#include <kernel/tee_time.h>
+#include <utee_defines.h>
 #include <util.h>
 #include "core_self_tests.h"
 
@@ -285,6 +291,7 @@ static int self_test_malloc(void)
 	int *p3 = NULL, *p4 = NULL;
 	bool r;
 	int ret = 0;
+	size_t n;
 
 	LOG("malloc tests (malloc, free, calloc, realloc, memalign):");
 	LOG("  p1=%p  p2=%p  p3=%p  p4=%p",
@@ -384,6 +391,26 @@ static int self_test_malloc(void)
 	p3 = NULL;
 	p4 = NULL;
 
+	/* test small buffers recycled through the per-CPU magazines */
+	p1 = malloc(40);
+	LOG("- p1 = malloc(40)");
+	if (p1)
+		memset(p1, 0xa5, 40);
+	free(p1);
+	LOG("- free p1");
+	p3 = calloc(10, sizeof(int));
+	LOG("- p3 = calloc(10, %zu)", sizeof(int));
+	r = !!p3;
+	for (n = 0; r && n < 10; n++)
+		r = !p3[n];
+	if (!r)
+		ret = -1;
+	LOG("  => test %s", r ? "ok" : "FAILED");
+	LOG("");
+	free(p3);
+	p1 = NULL;
+	p3 = NULL;
+
 	/* test free(NULL) */
 	LOG("- free NULL");
 	free(NULL);
@@ -393,13 +420,283 @@ static int self_test_malloc(void)
 	return ret;
 }
 
+uint32_t core_tests_elapsed_ms(const TEE_Time *start)
+{
+	TEE_Time now;
+	TEE_Time diff;
+
+	if (tee_time_get_sys_time(&now))
+		return 0;
+	TEE_TIME_SUB(now, *start, diff);
+	return diff.seconds * TEE_TIME_MILLIS_BASE + diff.millis;
+}
+
+uint64_t core_tests_timestamp(void)
+{
+	return read_cntpct();
+}
+
+uint64_t core_tests_elapsed_ns(uint64_t start)
+{
+	uint64_t ticks = read_cntpct() - start;
+	uint64_t freq = read_cntfrq();
+
+	if (!freq)
+		return 0;
+	return ticks / freq * 1000000000ULL +
+	       ticks % freq * 1000000000ULL / freq;
+}
+
 /* exported entry points for some basic test */
+#ifdef CFG_CRYPTO_CTR_DRBG
+/*
+ * AES-256 CTR_DRBG without derivation function, personalization string
+ * or additional input. The inputs are those of the NIST SP 800-90A
+ * examples, the expected output of the second request was computed with
+ * an independent implementation of SP 800-90A.
+ */
+static int self_test_ctr_drbg(void)
+{
+	static const uint8_t ret_bits[] = {
+		0xf0, 0x8f, 0x8d, 0x02, 0x1d, 0x4b, 0x6e, 0x0f,
+		0x8b, 0x65, 0x69, 0xe5, 0x45, 0x05, 0x7a, 0xac,
+		0xc2, 0x10, 0x5c, 0x82, 0xa2, 0x2a, 0x9c, 0x53,
+		0x5f, 0xf3, 0x0f, 0x53, 0xbb, 0x19, 0x16, 0xb7,
+		0x6c, 0x1d, 0xe6, 0xf3, 0x93, 0x5b, 0x6f, 0x31,
+		0x6c, 0x8f, 0x5c, 0xe5, 0xc6, 0xed, 0xa6, 0xf9,
+		0x53, 0x31, 0xc9, 0x1d, 0xd1, 0xca, 0x51, 0x42,
+		0x66, 0xbc, 0xf4, 0x35, 0xde, 0x0d, 0x6d, 0x20,
+	};
+	uint8_t entropy_reseed[48];
+	uint8_t entropy[48];
+	uint8_t out[sizeof(ret_bits)];
+	size_t n;
+
+	for (n = 0; n < sizeof(entropy); n++) {
+		entropy[n] = n;
+		entropy_reseed[n] = 0x80 + n;
+	}
+
+	if (crypto_ctr_drbg_test(entropy, entropy_reseed, out, sizeof(out)))
+		return -1;
+	if (memcmp(out, ret_bits, sizeof(out))) {
+		LOG("CTR_DRBG known answer mismatch");
+		return -1;
+	}
+
+	return 0;
+}
+#else
+static int self_test_ctr_drbg(void)
+{
+	return 0;
+}
+#endif
+
+#ifdef CFG_CRYPTO_SHA512
+#define SELF_TEST_SHA512_REPEAT	9
+
+/* Hashes msg with SHA-512, updating with at most chunk bytes at a time */
+static int sha512_digest(const uint8_t *msg, size_t len, size_t chunk,
+			 uint8_t *digest)
+{
+	void *ctx = NULL;
+	TEE_Result res;
+	size_t n;
+
+	res = crypto_hash_alloc_ctx(&ctx, TEE_ALG_SHA512);
+	if (res)
+		return -1;
+	res = crypto_hash_init(ctx, TEE_ALG_SHA512);
+	while (!res && len) {
+		n = MIN(len, chunk);
+		res = crypto_hash_update(ctx, TEE_ALG_SHA512, msg, n);
+		msg += n;
+		len -= n;
+	}
+	if (!res)
+		res = crypto_hash_final(ctx, TEE_ALG_SHA512, digest,
+					TEE_SHA512_HASH_SIZE);
+	crypto_hash_free_ctx(ctx, TEE_ALG_SHA512);
+	return res ? -1 : 0;
+}
+
+static int sha512_check(const char *name __maybe_unused, const uint8_t *msg,
+			size_t len, size_t chunk, const uint8_t *expect)
+{
+	uint8_t digest[TEE_SHA512_HASH_SIZE];
+
+	if (sha512_digest(msg, len, chunk, digest))
+		return -1;
+	if (memcmp(digest, expect, sizeof(digest))) {
+		LOG("  => SHA-512 %s, %zu bytes at a time: mismatch", name,
+		    chunk);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * The one-block and two-block examples of FIPS 180-4, hashed in one
+ * update and in pieces not aligned on the block size. The expected digest
+ * of 9 copies of the two-block message, hashed in updates of several
+ * blocks, was computed with an independent implementation.
+ */
+static int self_test_sha512(void)
+{
+	static const uint8_t abc[] = "abc";
+	static const uint8_t msg896[] =
+		"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+		"hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu";
+	static const uint8_t abc_digest[] = {
+		0xdd, 0xaf, 0x35, 0xa1, 0x93, 0x61, 0x7a, 0xba,
+		0xcc, 0x41, 0x73, 0x49, 0xae, 0x20, 0x41, 0x31,
+		0x12, 0xe6, 0xfa, 0x4e, 0x89, 0xa9, 0x7e, 0xa2,
+		0x0a, 0x9e, 0xee, 0xe6, 0x4b, 0x55, 0xd3, 0x9a,
+		0x21, 0x92, 0x99, 0x2a, 0x27, 0x4f, 0xc1, 0xa8,
+		0x36, 0xba, 0x3c, 0x23, 0xa3, 0xfe, 0xeb, 0xbd,
+		0x45, 0x4d, 0x44, 0x23, 0x64, 0x3c, 0xe8, 0x0e,
+		0x2a, 0x9a, 0xc9, 0x4f, 0xa5, 0x4c, 0xa4, 0x9f,
+	};
+	static const uint8_t msg896_digest[] = {
+		0x8e, 0x95, 0x9b, 0x75, 0xda, 0xe3, 0x13, 0xda,
+		0x8c, 0xf4, 0xf7, 0x28, 0x14, 0xfc, 0x14, 0x3f,
+		0x8f, 0x77, 0x79, 0xc6, 0xeb, 0x9f, 0x7f, 0xa1,
+		0x72, 0x99, 0xae, 0xad, 0xb6, 0x88, 0x90, 0x18,
+		0x50, 0x1d, 0x28, 0x9e, 0x49, 0x00, 0xf7, 0xe4,
+		0x33, 0x1b, 0x99, 0xde, 0xc4, 0xb5, 0x43, 0x3a,
+		0xc7, 0xd3, 0x29, 0xee, 0xb6, 0xdd, 0x26, 0x54,
+		0x5e, 0x96, 0xe5, 0x5b, 0x87, 0x4b, 0xe9, 0x09,
+	};
+	static const uint8_t repeat_digest[] = {
+		0x35, 0xa0, 0x0b, 0xb2, 0xf2, 0xb9, 0xef, 0x8f,
+		0x42, 0x46, 0x96, 0xfc, 0x99, 0xd1, 0x47, 0xae,
+		0xe6, 0xef, 0xaa, 0x82, 0xfa, 0xd9, 0xdb, 0xd2,
+		0x50, 0x8d, 0xba, 0x7d, 0xb1, 0x1b, 0x58, 0x4d,
+		0xdc, 0x4e, 0x6c, 0x79, 0xb2, 0xd5, 0x4c, 0xef,
+		0x15, 0xdc, 0xe7, 0x19, 0xed, 0xc4, 0x32, 0x13,
+		0x75, 0xea, 0x76, 0xb2, 0x2b, 0x5f, 0xe1, 0x62,
+		0xdc, 0x4b, 0x4a, 0xa3, 0x6b, 0xcd, 0x04, 0x17,
+	};
+	size_t len = sizeof(msg896) - 1;
+	uint8_t *buf;
+	size_t n;
+	int ret = -1;
+
+	LOG("- SHA-512 known answers");
+	if (sha512_check("abc", abc, sizeof(abc) - 1, 3, abc_digest) ||
+	    sha512_check("896-bit", msg896, len, len, msg896_digest) ||
+	    sha512_check("896-bit", msg896, len, 1, msg896_digest) ||
+	    sha512_check("896-bit", msg896, len, 67, msg896_digest))
+		return -1;
+
+	buf = malloc(len * SELF_TEST_SHA512_REPEAT);
+	if (!buf)
+		return -1;
+	for (n = 0; n < SELF_TEST_SHA512_REPEAT; n++)
+		memcpy(buf + n * len, msg896, len);
+	n = len * SELF_TEST_SHA512_REPEAT;
+	if (sha512_check("repeated", buf, n, n, repeat_digest) ||
+	    sha512_check("repeated", buf, n, 300, repeat_digest) ||
+	    sha512_check("repeated", buf, n, 256, repeat_digest))
+		goto out;
+	ret = 0;
+out:
+	free(buf);
+	return ret;
+}
+#else
+static int self_test_sha512(void)
+{
+	return 0;
+}
+#endif
+
+/*
+ * Runs the prime test on 2048-bit numbers with a scratch pool laid out
+ * like the one of the TEE_BigInt functions in libutee, 12 variables of
+ * 2048 bits, which can't hold the table of the windowed exponentiation
+ * next to the Miller-Rabin temporaries.
+ */
+#define SELF_TEST_MPA_POOL_VARS	12
+#define SELF_TEST_MPA_BITS	2048
+
+static int self_test_mpa_prime(void)
+{
+	static const char prime[] = "0x"
+		"f56d526954ebb7fa46ae89aeedb8fa06"
+		"a7bb32f0bfe78c984cf4a3db0ecb026a"
+		"68dbadbaa1212eecc65c0976fa4f5211"
+		"f7b7138324673132a762fca586ff04e6"
+		"32ab21601090a61d5f040042c2b92f68"
+		"77c7ec329e52a9a078cf934ad19d18e5"
+		"5fb741170d84c6d214ecb8e4587c9289"
+		"d7423ca5ab80c694419461ecea291083"
+		"6c0d91b79c974203043a88343db0f336"
+		"c79985f81706aa8c12a650cbc2578d0c"
+		"119b0d549ec2a1f845d1df920691d0e4"
+		"914dcc27346c399ef423c16c1f0c0120"
+		"78d78cd06a19a4128fdf99cc4284eb79"
+		"cbb51af531f361d7418736fc8bcd6cef"
+		"96bf08206ece7de4b6568c7f66190e42"
+		"626634655e5da4ca4f33138c8e04863b";
+	/* Product of two 1024-bit primes */
+	static const char composite[] = "0x"
+		"c330738c50a378738d407990a69b2512"
+		"8ff9e26defac80a0cd75cf68a30d7e7a"
+		"c3c3494f176cbe54ab9a197c01c9ed9a"
+		"1c0d1306d1563d97f0b7182093422799"
+		"33498c9b2376bbbd827e127db3866dcc"
+		"8a0a6254b1fa05dba6ad2d2f797cfb91"
+		"2c8a4cd1f860c5a7d5285f6437e3c982"
+		"1f47a7c3a130198ea69cef2a3027eb0c"
+		"e9aceb47f7278eece2d4a3aa3cbaa7f6"
+		"3cc32438d81f682785042de13d3fa131"
+		"7ec40740ac8fe240ec680e53e420360f"
+		"5b8626ed9b290b563ccc1c9ac984e538"
+		"f8f1d91c35dff2badbc5a04abaf6b799"
+		"de2a57d9904895ffde93f6cc068f965c"
+		"59b68602414565fb6d087eeabf32b811"
+		"40e22f2db38e18347c04d258379e7c33";
+	size_t pool_size = mpa_scratch_mem_size_in_U32(SELF_TEST_MPA_POOL_VARS,
+						       SELF_TEST_MPA_BITS) *
+			   sizeof(uint32_t);
+	size_t n_size = mpa_StaticVarSizeInU32(SELF_TEST_MPA_BITS);
+	mpa_scratch_mem pool = malloc(pool_size);
+	mpanum n = malloc(n_size * sizeof(uint32_t));
+	int ret = -1;
+
+	if (!pool || !n)
+		goto out;
+	mpa_init_scratch_mem(pool, pool_size, SELF_TEST_MPA_BITS);
+	mpa_init_static(n, n_size);
+
+	LOG("- mpa_is_prob_prime() with a small scratch pool");
+	mpa_set_str(n, prime);
+	if (mpa_is_prob_prime(n, 80, pool) == 0) {
+		LOG("  => 2048-bit prime reported composite");
+		goto out;
+	}
+	mpa_set_str(n, composite);
+	if (mpa_is_prob_prime(n, 80, pool) != 0) {
+		LOG("  => 2048-bit composite reported prime");
+		goto out;
+	}
+	ret = 0;
+out:
+	free(pool);
+	free(n);
+	return ret;
+}
+
 TEE_Result core_self_tests(uint32_t nParamTypes __unused,
 		TEE_Param pParams[TEE_NUM_PARAMS] __unused)
 {
 	if (self_test_mul_signed_overflow() || self_test_add_overflow() ||
 	    self_test_sub_overflow() || self_test_mul_unsigned_overflow() ||
-	    self_test_division() || self_test_malloc()) {
+	    self_test_division() || self_test_malloc() ||
+	    self_test_ctr_drbg() || self_test_mpa_prime() ||
+	    self_test_sha512()) {
 		EMSG("some self_test_xxx failed! you should enable local LOG");
 		return TEE_ERROR_GENERIC;
 	}
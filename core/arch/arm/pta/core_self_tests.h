@@ -31,6 +31,24 @@
 #include <tee_api_types.h>
 #include <tee_api_defines.h>
 
+/*
+ * Returns the number of milliseconds elapsed since @start, as returned by
+ * tee_time_get_sys_time(), or 0 if the system time isn't available
+ */
+uint32_t core_tests_elapsed_ms(const TEE_Time *start);
+
+/*
+ * Returns a timestamp of the ARM generic timer, for timings shorter than
+ * what core_tests_elapsed_ms() can resolve
+ */
+uint64_t core_tests_timestamp(void);
+
+/*
+ * Returns the number of nanoseconds elapsed since @start, as returned by
+ * core_tests_timestamp(), or 0 if the timer frequency isn't known
+ */
+uint64_t core_tests_elapsed_ns(uint64_t start);
+
 /* basic run-time tests */
 TEE_Result core_self_tests(uint32_t nParamTypes,
 			   TEE_Param pParams[TEE_NUM_PARAMS]);
@@ -41,4 +59,25 @@ TEE_Result core_fs_htree_tests(uint32_t nParamTypes,
 TEE_Result core_mutex_tests(uint32_t nParamTypes,
 			    TEE_Param pParams[TEE_NUM_PARAMS]);
 
+TEE_Result core_rpmb_fs_write_bench(uint32_t nParamTypes,
+				    TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_handle_db_bench(uint32_t nParamTypes,
+				TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_mm_pool_bench(uint32_t nParamTypes,
+			      TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_rsa_sign_bench(uint32_t nParamTypes,
+			       TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_rsa_key_cache_bench(uint32_t nParamTypes,
+				    TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_ecc_sign_bench(uint32_t nParamTypes,
+			       TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_hash_bench(uint32_t nParamTypes,
+			   TEE_Param pParams[TEE_NUM_PARAMS]);
+
 #endif /*CORE_SELF_TESTS_H*/
@@ -431,6 +431,28 @@ static TEE_Result invoke_command(void *pSessionContext __unused,
 #endif
 	case PTA_INVOKE_TESTS_CMD_MUTEX:
 		return core_mutex_tests(nParamTypes, pParams);
+#if defined(CFG_RPMB_FS)
+	case PTA_INVOKE_TESTS_CMD_RPMB_WRITE_BENCH:
+		return core_rpmb_fs_write_bench(nParamTypes, pParams);
+#endif
+	case PTA_INVOKE_TESTS_CMD_HANDLE_DB_BENCH:
+		return core_handle_db_bench(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_MM_POOL_BENCH:
+		return core_mm_pool_bench(nParamTypes, pParams);
+#if defined(CFG_CRYPTO_RSA)
+	case PTA_INVOKE_TESTS_CMD_RSA_SIGN_BENCH:
+		return core_rsa_sign_bench(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_RSA_KEY_CACHE_BENCH:
+		return core_rsa_key_cache_bench(nParamTypes, pParams);
+#endif
+#if defined(CFG_CRYPTO_ECC)
+	case PTA_INVOKE_TESTS_CMD_ECC_SIGN_BENCH:
+		return core_ecc_sign_bench(nParamTypes, pParams);
+#endif
+#if defined(_CFG_CRYPTO_WITH_HASH)
+	case PTA_INVOKE_TESTS_CMD_HASH_BENCH:
+		return core_hash_bench(nParamTypes, pParams);
+#endif
 	default:
 		break;
 	}
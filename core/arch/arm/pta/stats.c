@@ -3,11 +3,16 @@
  * Copyright (c) 2015, Linaro Limited
  */
 #include <compiler.h>
+#include <crypto/crypto_accel.h>
 #include <stdio.h>
 #include <trace.h>
 #include <kernel/pseudo_ta.h>
+#include <kernel/ta_image_cache.h>
+#include <kernel/thread.h>
+#include <mm/mobj.h>
 #include <mm/tee_pager.h>
 #include <mm/tee_mm.h>
+#include <mm/tee_mmu.h>
 #include <string.h>
 #include <string_ext.h>
 #include <malloc.h>
@@ -20,8 +25,15 @@
 
 #define STATS_CMD_PAGER_STATS		0
 #define STATS_CMD_ALLOC_STATS		1
+#define STATS_CMD_THREAD_STATS		2
+#define STATS_CMD_MALLOC_CACHE_STATS	3
+#define STATS_CMD_REG_SHM_STATS		4
+#define STATS_CMD_CRYPTO_ACCEL_STATS	5
+#define STATS_CMD_TA_IMAGE_CACHE_STATS	6
+#define STATS_CMD_USER_MAP_STATS	7
 
 #define STATS_NB_POOLS			3
+#define PAGER_STATS_NB_COUNTERS		4
 
 static TEE_Result get_alloc_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 {
@@ -95,15 +107,42 @@ static TEE_Result get_alloc_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 static TEE_Result get_pager_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 {
 	struct tee_pager_stats stats;
+	uint32_t *counters;
+	uint32_t fault_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+					    TEE_PARAM_TYPE_VALUE_OUTPUT,
+					    TEE_PARAM_TYPE_VALUE_OUTPUT,
+					    TEE_PARAM_TYPE_VALUE_OUTPUT);
+	uint32_t counters_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+					       TEE_PARAM_TYPE_VALUE_OUTPUT,
+					       TEE_PARAM_TYPE_VALUE_OUTPUT,
+					       TEE_PARAM_TYPE_MEMREF_OUTPUT);
 
+	/*
+	 * The fourth parameter is optional. As values it gets the number of
+	 * faults and of pages loaded ahead of them. As a memref it gets
+	 * PAGER_STATS_NB_COUNTERS uint32_t: the same two counters followed
+	 * by the number of pages evicted clean and dirty. The counters
+	 * cover all the paged areas.
+	 */
 	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
 			    TEE_PARAM_TYPE_VALUE_OUTPUT,
 			    TEE_PARAM_TYPE_VALUE_OUTPUT,
-			    TEE_PARAM_TYPE_NONE) != type) {
-		EMSG("expect 3 output values as argument");
+			    TEE_PARAM_TYPE_NONE) != type && type != fault_pt &&
+	    type != counters_pt) {
+		EMSG("expect 3 or 4 output values as argument");
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
+	if (type == counters_pt) {
+		if (p[3].memref.size < PAGER_STATS_NB_COUNTERS *
+				       sizeof(uint32_t)) {
+			p[3].memref.size = PAGER_STATS_NB_COUNTERS *
+					   sizeof(uint32_t);
+			return TEE_ERROR_SHORT_BUFFER;
+		}
+		p[3].memref.size = PAGER_STATS_NB_COUNTERS * sizeof(uint32_t);
+	}
+
 	tee_pager_get_stats(&stats);
 	p[0].value.a = stats.npages;
 	p[0].value.b = stats.npages_all;
@@ -111,6 +150,201 @@ static TEE_Result get_pager_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 	p[1].value.b = stats.rw_hits;
 	p[2].value.a = stats.hidden_hits;
 	p[2].value.b = stats.zi_released;
+	if (type == fault_pt) {
+		p[3].value.a = stats.faults;
+		p[3].value.b = stats.fault_around;
+	} else if (type == counters_pt) {
+		counters = p[3].memref.buffer;
+		counters[0] = stats.faults;
+		counters[1] = stats.fault_around;
+		counters[2] = stats.clean_evictions;
+		counters[3] = stats.dirty_evictions;
+	}
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_thread_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct thread_alloc_stats *stats;
+	size_t size_to_retrieve;
+	size_t n;
+
+	/*
+	 * p[0].value.a = 0 if no reset of the stats
+	 * p[1].memref.buffer = output buffer to one struct thread_alloc_stats
+	 *                      per core
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+			    TEE_PARAM_TYPE_MEMREF_OUTPUT,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	size_to_retrieve = sizeof(*stats) * CFG_TEE_CORE_NB_CORE;
+	if (p[1].memref.size < size_to_retrieve) {
+		p[1].memref.size = size_to_retrieve;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	p[1].memref.size = size_to_retrieve;
+	stats = p[1].memref.buffer;
+
+	for (n = 0; n < CFG_TEE_CORE_NB_CORE; n++)
+		thread_get_alloc_stats(n, stats + n, !!p[0].value.a);
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_malloc_cache_stats(uint32_t type,
+					 TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct malloc_cache_stats stats;
+
+	/*
+	 * p[0].value.a = 0 if no reset of the stats
+	 * p[1].value.a = hits, p[1].value.b = misses
+	 * p[2].value.a = refills, p[2].value.b = flushes
+	 * p[3].value.a = bytes currently cached
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT) != type) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	malloc_get_cache_stats(&stats, !!p[0].value.a);
+	p[1].value.a = stats.hits;
+	p[1].value.b = stats.misses;
+	p[2].value.a = stats.refills;
+	p[2].value.b = stats.flushes;
+	p[3].value.a = stats.cached;
+	p[3].value.b = 0;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_reg_shm_stats(uint32_t type,
+				    TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct mobj_reg_shm_stats stats;
+
+	/*
+	 * p[0].value.a = 0 if no reset of the stats
+	 * p[1].value.a = lookups, p[1].value.b = hits
+	 * p[2].value.a = probes, p[2].value.b = longest probe sequence
+	 * p[3].value.a = registered objects, p[3].value.b = hash buckets
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT) != type) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	mobj_reg_shm_get_stats(&stats, !!p[0].value.a);
+	p[1].value.a = stats.lookups;
+	p[1].value.b = stats.hits;
+	p[2].value.a = stats.probes;
+	p[2].value.b = stats.max_probes;
+	p[3].value.a = stats.registered;
+	p[3].value.b = CFG_CORE_REG_SHM_HASH_BUCKETS;
+
+	return TEE_SUCCESS;
+}
+
+#if defined(CFG_CRYPTO_ACCEL)
+static TEE_Result get_crypto_accel_stats(uint32_t type,
+					 TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct crypto_accel_stats stats;
+
+	/*
+	 * p[0].value.a = 0 if no reset of the stats
+	 * p[1].value.a = offloaded operations, p[1].value.b = CPU operations
+	 * p[2].value.a = offloaded KiB, p[2].value.b = CPU KiB
+	 * p[3].value.a = operations kept on the CPU by a full queue
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT) != type) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	crypto_accel_get_stats(&stats, !!p[0].value.a);
+	p[1].value.a = stats.offloaded_ops;
+	p[1].value.b = stats.cpu_ops;
+	p[2].value.a = stats.offloaded_bytes / 1024;
+	p[2].value.b = stats.cpu_bytes / 1024;
+	p[3].value.a = stats.queue_full;
+	p[3].value.b = 0;
+
+	return TEE_SUCCESS;
+}
+#endif
+
+#if defined(CFG_TA_IMAGE_CACHE)
+static TEE_Result get_ta_image_cache_stats(uint32_t type,
+					   TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct ta_image_cache_stats stats;
+
+	/*
+	 * p[0].value.a = 0 if no reset of the stats
+	 * p[1].value.a = hits, p[1].value.b = misses
+	 * p[2].value.a = evictions, p[2].value.b = cached images
+	 * p[3].value.a = cached KiB, p[3].value.b = cache size in KiB
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT) != type) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	ta_image_cache_get_stats(&stats, !!p[0].value.a);
+	p[1].value.a = stats.hits;
+	p[1].value.b = stats.misses;
+	p[2].value.a = stats.evictions;
+	p[2].value.b = stats.images;
+	p[3].value.a = stats.size / 1024;
+	p[3].value.b = CFG_TA_IMAGE_CACHE_SIZE / 1024;
+
+	return TEE_SUCCESS;
+}
+#endif
+
+static TEE_Result get_user_map_stats(uint32_t type,
+				     TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct tee_mmu_switch_stats *stats;
+	size_t size_to_retrieve;
+	size_t n;
+
+	/*
+	 * p[0].value.a = 0 if no reset of the stats
+	 * p[1].memref.buffer = output buffer to one struct
+	 *                      tee_mmu_switch_stats per thread
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+			    TEE_PARAM_TYPE_MEMREF_OUTPUT,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	size_to_retrieve = sizeof(*stats) * CFG_NUM_THREADS;
+	if (p[1].memref.size < size_to_retrieve) {
+		p[1].memref.size = size_to_retrieve;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	p[1].memref.size = size_to_retrieve;
+	stats = p[1].memref.buffer;
+
+	for (n = 0; n < CFG_NUM_THREADS; n++)
+		tee_mmu_get_switch_stats(n, stats + n, !!p[0].value.a);
 
 	return TEE_SUCCESS;
 }
@@ -128,6 +362,22 @@ static TEE_Result invoke_command(void *psess __unused,
 		return get_pager_stats(ptypes, params);
 	case STATS_CMD_ALLOC_STATS:
 		return get_alloc_stats(ptypes, params);
+	case STATS_CMD_THREAD_STATS:
+		return get_thread_stats(ptypes, params);
+	case STATS_CMD_MALLOC_CACHE_STATS:
+		return get_malloc_cache_stats(ptypes, params);
+	case STATS_CMD_REG_SHM_STATS:
+		return get_reg_shm_stats(ptypes, params);
+#if defined(CFG_CRYPTO_ACCEL)
+	case STATS_CMD_CRYPTO_ACCEL_STATS:
+		return get_crypto_accel_stats(ptypes, params);
+#endif
+#if defined(CFG_TA_IMAGE_CACHE)
+	case STATS_CMD_TA_IMAGE_CACHE_STATS:
+		return get_ta_image_cache_stats(ptypes, params);
+#endif
+	case STATS_CMD_USER_MAP_STATS:
+		return get_user_map_stats(ptypes, params);
 	default:
 		break;
 	}
@@ -2,6 +2,20 @@ srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += pta_invoke_tests.c
 srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_self_tests.c
 srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += interrupt_tests.c
 srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_mutex_tests.c
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_handle_tests.c
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_mm_tests.c
+ifeq ($(CFG_RPMB_FS),y)
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_rpmb_fs_tests.c
+endif
+ifeq ($(CFG_CRYPTO_RSA),y)
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_rsa_tests.c
+endif
+ifeq ($(CFG_CRYPTO_ECC),y)
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_ecc_tests.c
+endif
+ifeq ($(_CFG_CRYPTO_WITH_HASH),y)
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_hash_tests.c
+endif
 ifeq ($(CFG_WITH_USER_TA),y)
 srcs-$(CFG_SECSTOR_TA_MGMT_PTA) += secstor_ta_mgmt.c
 srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_fs_htree_tests.c
@@ -327,7 +327,7 @@ cleanup_params:
 
 out:
 	if (s)
-		arg->session = (vaddr_t)s;
+		arg->session = s->id;
 	else
 		arg->session = 0;
 	arg->ret = res;
@@ -339,7 +339,6 @@ static void entry_close_session(struct thread_smc_args *smc_args,
 			struct optee_msg_arg *arg, uint32_t num_params)
 {
 	TEE_Result res;
-	struct tee_ta_session *s;
 
 	if (num_params) {
 		res = TEE_ERROR_BAD_PARAMETERS;
@@ -348,8 +347,8 @@ static void entry_close_session(struct thread_smc_args *smc_args,
 
 	plat_prng_add_jitter_entropy();
 
-	s = (struct tee_ta_session *)(vaddr_t)arg->session;
-	res = tee_ta_close_session(s, &tee_open_sessions, NSAPP_IDENTITY);
+	res = tee_ta_close_session(arg->session, &tee_open_sessions,
+				   NSAPP_IDENTITY);
 out:
 	arg->ret = res;
 	arg->ret_origin = TEE_ORIGIN_TEE;
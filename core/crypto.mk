@@ -32,6 +32,10 @@ CFG_CRYPTO_DSA ?= y
 CFG_CRYPTO_RSA ?= y
 CFG_CRYPTO_DH ?= y
 CFG_CRYPTO_ECC ?= y
+# Precomputed multiples of the base point of each ECC curve, built at first
+# use. Speeds up ECDSA signing and ECC key generation for about 5 KiB of
+# heap per curve (10 KiB for P-521).
+CFG_CRYPTO_ECC_FP ?= $(CFG_CRYPTO_ECC)
 
 # Authenticated encryption
 CFG_CRYPTO_CCM ?= y
@@ -41,6 +45,20 @@ CFG_CRYPTO_AES_GCM_FROM_CRYPTOLIB ?= n
 
 endif
 
+# Accelerator driver running the software implementations, to test the
+# crypto accelerator framework without an accelerator (e.g. on QEMU)
+CFG_CRYPTO_LOOPBACK_ACCEL ?= n
+ifeq ($(CFG_CRYPTO_LOOPBACK_ACCEL),y)
+$(call force,CFG_CRYPTO_ACCEL,y,required by CFG_CRYPTO_LOOPBACK_ACCEL)
+endif
+# Crypto accelerator framework: large hash and cipher operations are
+# offloaded to the accelerator drivers registered for the algorithm
+CFG_CRYPTO_ACCEL ?= n
+
+# crypto_rng_read() is provided by one AES-256 CTR_DRBG (NIST SP 800-90A)
+# per CPU, seeded from the PRNG of the crypto library
+CFG_CRYPTO_CTR_DRBG ?= n
+
 ifeq ($(CFG_WITH_PAGER),y)
 ifneq ($(CFG_CRYPTO_SHA256),y)
 $(warning Warning: Enabling CFG_CRYPTO_SHA256 [required by CFG_WITH_PAGER])
@@ -68,6 +86,10 @@ ifeq ($(CFG_ARM64_core),y)
 CFG_CRYPTO_AES_ARM64_CE ?= $(CFG_CRYPTO_AES)
 CFG_CRYPTO_SHA1_ARM64_CE ?= $(CFG_CRYPTO_SHA1)
 CFG_CRYPTO_SHA256_ARM64_CE ?= $(CFG_CRYPTO_SHA256)
+# The SHA-512 instructions are an optional ARMv8.2 extension which isn't
+# implied by CFG_CRYPTO_WITH_CE, enable only when the CPU is known to have
+# them (ID_AA64ISAR0_EL1.SHA2 == 2).
+CFG_CRYPTO_SHA512_ARM64_CE ?= n
 endif
 
 else #CFG_CRYPTO_WITH_CE
@@ -85,6 +107,9 @@ endif
 ifeq ($(CFG_CRYPTO_SHA256_ARM64_CE),y)
 $(call force,CFG_WITH_VFP,y,required by CFG_CRYPTO_SHA256_ARM64_CE)
 endif
+ifeq ($(CFG_CRYPTO_SHA512_ARM64_CE),y)
+$(call force,CFG_WITH_VFP,y,required by CFG_CRYPTO_SHA512_ARM64_CE)
+endif
 ifeq ($(CFG_CRYPTO_SHA1_ARM32_CE),y)
 $(call force,CFG_WITH_VFP,y,required by CFG_CRYPTO_SHA1_ARM32_CE)
 endif
@@ -98,6 +123,7 @@ endif
 cryp-enable-all-depends = $(call cfg-enable-all-depends,$(strip $(1)),$(foreach v,$(2),CFG_CRYPTO_$(v)))
 $(eval $(call cryp-enable-all-depends,CFG_REE_FS, AES ECB CTR HMAC SHA256 GCM))
 $(eval $(call cryp-enable-all-depends,CFG_RPMB_FS, AES ECB CTR HMAC SHA256 GCM))
+$(eval $(call cryp-enable-all-depends,CFG_CRYPTO_CTR_DRBG, AES))
 
 # Dependency checks: warn and disable some features if dependencies are not met
 
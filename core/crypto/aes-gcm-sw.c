@@ -9,9 +9,17 @@
 #include <string.h>
 #include <tee_api_types.h>
 #include <types_ext.h>
+#include <util.h>
 
 #include "aes-gcm-private.h"
 
+/*
+ * Number of counter blocks encrypted together, it lets a block cipher
+ * implementation interleave several blocks and the GHASH implementation
+ * process several blocks per call.
+ */
+#define CTR_BATCH_BLOCKS	8
+
 void __weak internal_aes_gcm_set_key(struct internal_aes_gcm_state *state,
 				     const struct internal_aes_gcm_key *ek)
 {
@@ -36,6 +44,20 @@ void __weak internal_aes_gcm_ghash_update(struct internal_aes_gcm_state *state,
 						    n * TEE_AES_BLOCK_SIZE);
 }
 
+static void encrypt_ctr_blocks(struct internal_aes_gcm_state *state,
+			       const struct internal_aes_gcm_key *ek,
+			       uint8_t *ks, size_t num_blocks)
+{
+	size_t n;
+
+	for (n = 0; n < num_blocks; n++) {
+		memcpy(ks + n * TEE_AES_BLOCK_SIZE, state->ctr,
+		       sizeof(state->ctr));
+		internal_aes_gcm_inc_ctr(state);
+	}
+	internal_aes_gcm_encrypt_blocks(ek, ks, ks, num_blocks);
+}
+
 void __weak
 internal_aes_gcm_update_payload_block_aligned(
 				struct internal_aes_gcm_state *state,
@@ -43,35 +65,50 @@ internal_aes_gcm_update_payload_block_aligned(
 				TEE_OperationMode m, const void *src,
 				size_t num_blocks, void *dst)
 {
-	size_t n;
+	/* One extra block for buf_cryp when encrypting */
+	uint64_t buf[(CTR_BATCH_BLOCKS + 1) * 2];
+	uint8_t *ks = (uint8_t *)buf;
 	const uint8_t *s = src;
 	uint8_t *d = dst;
-	void *ctr = state->ctr;
-	void *buf_cryp = state->buf_cryp;
+	size_t batch;
+	size_t n;
 
 	assert(!state->buf_pos && num_blocks &&
 	       internal_aes_gcm_ptr_is_block_aligned(s) &&
 	       internal_aes_gcm_ptr_is_block_aligned(d));
 
-	for (n = 0; n < num_blocks; n++) {
-		if (m == TEE_MODE_ENCRYPT) {
-			internal_aes_gcm_xor_block(buf_cryp, s);
-			internal_aes_gcm_ghash_update(state, buf_cryp, NULL, 0);
-			memcpy(d, buf_cryp, sizeof(state->buf_cryp));
+	while (num_blocks) {
+		batch = MIN(num_blocks, (size_t)CTR_BATCH_BLOCKS);
 
-			internal_aes_gcm_encrypt_block(ek, ctr, buf_cryp);
-			internal_aes_gcm_inc_ctr(state);
+		if (m == TEE_MODE_ENCRYPT) {
+			/*
+			 * The key stream of the first block is already in
+			 * buf_cryp, the one of the last counter block is
+			 * kept there for the next block.
+			 */
+			memcpy(ks, state->buf_cryp, TEE_AES_BLOCK_SIZE);
+			encrypt_ctr_blocks(state, ek, ks + TEE_AES_BLOCK_SIZE,
+					   batch);
+			memcpy(state->buf_cryp, ks + batch * TEE_AES_BLOCK_SIZE,
+			       TEE_AES_BLOCK_SIZE);
 		} else {
-			internal_aes_gcm_encrypt_block(ek, ctr, buf_cryp);
-
-			internal_aes_gcm_xor_block(buf_cryp, s);
-			internal_aes_gcm_ghash_update(state, s, NULL, 0);
-			memcpy(d, buf_cryp, sizeof(state->buf_cryp));
+			encrypt_ctr_blocks(state, ek, ks, batch);
+			/* src may be the same as dst, hash it first */
+			internal_aes_gcm_ghash_update(state, NULL, s, batch);
+		}
 
-			internal_aes_gcm_inc_ctr(state);
+		for (n = 0; n < batch * TEE_AES_BLOCK_SIZE;
+		     n += TEE_AES_BLOCK_SIZE) {
+			memcpy(d + n, s + n, TEE_AES_BLOCK_SIZE);
+			internal_aes_gcm_xor_block(d + n, ks + n);
 		}
-		s += TEE_AES_BLOCK_SIZE;
-		d += TEE_AES_BLOCK_SIZE;
+
+		if (m == TEE_MODE_ENCRYPT)
+			internal_aes_gcm_ghash_update(state, NULL, d, batch);
+
+		s += batch * TEE_AES_BLOCK_SIZE;
+		d += batch * TEE_AES_BLOCK_SIZE;
+		num_blocks -= batch;
 	}
 }
 
@@ -82,6 +119,13 @@ internal_aes_gcm_encrypt_block(const struct internal_aes_gcm_key *ek,
 	crypto_aes_enc_block(ek->data, ek->rounds, src, dst);
 }
 
+void __weak
+internal_aes_gcm_encrypt_blocks(const struct internal_aes_gcm_key *ek,
+				const void *src, void *dst, size_t num_blocks)
+{
+	crypto_aes_enc_blocks(ek->data, ek->rounds, src, dst, num_blocks);
+}
+
 TEE_Result __weak
 internal_aes_gcm_expand_enc_key(const void *key, size_t key_len,
 				struct internal_aes_gcm_key *ek)
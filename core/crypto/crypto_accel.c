@@ -0,0 +1,364 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <crypto/crypto.h>
+#include <crypto/crypto_accel.h>
+#include <inttypes.h>
+#include <kernel/spinlock.h>
+#include <stdlib.h>
+#include <string.h>
+#include <trace.h>
+#include <utee_defines.h>
+
+enum accel_state {
+	ACCEL_UNDECIDED,
+	ACCEL_CPU,
+	ACCEL_OFFLOADED,
+};
+
+/*
+ * Context of an operation. Both the software context and the context of
+ * the accelerator, if any, are initialized by crypto_*_init() since it's
+ * only known at the first update which one will be used.
+ */
+struct accel_ctx {
+	struct crypto_accel *accel;
+	void *sw_ctx;
+	void *hw_ctx;
+	bool hw_ready;
+	enum accel_state state;
+};
+
+/* Sorted by decreasing priority, only modified by initcalls */
+static SLIST_HEAD(, crypto_accel) accel_head =
+	SLIST_HEAD_INITIALIZER(accel_head);
+
+static unsigned int stats_lock = SPINLOCK_UNLOCK;
+static struct crypto_accel_stats accel_stats;
+
+TEE_Result crypto_accel_register(struct crypto_accel *accel)
+{
+	struct crypto_accel *a;
+	struct crypto_accel *prev = NULL;
+
+	if (!accel->ops || !accel->ops->alloc_ctx || !accel->ops->free_ctx ||
+	    !accel->queue_depth)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	mutex_init(&accel->mu);
+	condvar_init(&accel->cv);
+	accel->jobs = 0;
+
+	SLIST_FOREACH(a, &accel_head, link) {
+		if (a->priority < accel->priority)
+			break;
+		prev = a;
+	}
+	if (prev)
+		SLIST_INSERT_AFTER(prev, accel, link);
+	else
+		SLIST_INSERT_HEAD(&accel_head, accel, link);
+
+	DMSG("Crypto accelerator %s: algo %#"PRIx32", priority %u",
+	     accel->name, accel->algo, accel->priority);
+	return TEE_SUCCESS;
+}
+
+void crypto_accel_get_stats(struct crypto_accel_stats *stats, bool reset)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&stats_lock);
+
+	*stats = accel_stats;
+	if (reset)
+		memset(&accel_stats, 0, sizeof(accel_stats));
+	cpu_spin_unlock_xrestore(&stats_lock, exceptions);
+}
+
+static void count_cpu(bool new_op, size_t len)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&stats_lock);
+
+	if (new_op)
+		accel_stats.cpu_ops++;
+	accel_stats.cpu_bytes += len;
+	cpu_spin_unlock_xrestore(&stats_lock, exceptions);
+}
+
+static void count_offloaded(bool new_op, size_t len)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&stats_lock);
+
+	if (new_op)
+		accel_stats.offloaded_ops++;
+	accel_stats.offloaded_bytes += len;
+	cpu_spin_unlock_xrestore(&stats_lock, exceptions);
+}
+
+static void count_queue_full(void)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&stats_lock);
+
+	accel_stats.queue_full++;
+	cpu_spin_unlock_xrestore(&stats_lock, exceptions);
+}
+
+static struct crypto_accel *find_accel(uint32_t algo)
+{
+	struct crypto_accel *a;
+
+	SLIST_FOREACH(a, &accel_head, link)
+		if (a->algo == algo)
+			return a;
+	return NULL;
+}
+
+/* Takes a slot in the queue of the accelerator, waiting if needed */
+static void job_begin(struct crypto_accel *a)
+{
+	mutex_lock(&a->mu);
+	while (a->jobs >= a->queue_depth)
+		condvar_wait(&a->cv, &a->mu);
+	a->jobs++;
+	mutex_unlock(&a->mu);
+}
+
+static bool job_try_begin(struct crypto_accel *a)
+{
+	bool ret = false;
+
+	mutex_lock(&a->mu);
+	if (a->jobs < a->queue_depth) {
+		a->jobs++;
+		ret = true;
+	}
+	mutex_unlock(&a->mu);
+	return ret;
+}
+
+static void job_end(struct crypto_accel *a)
+{
+	mutex_lock(&a->mu);
+	a->jobs--;
+	condvar_signal(&a->cv);
+	mutex_unlock(&a->mu);
+}
+
+/*
+ * Chooses where an operation is run at its first update and takes a
+ * slot in the queue of the accelerator if it's offloaded. Returns true if
+ * the update is to be run by the accelerator.
+ */
+static bool begin_update(struct accel_ctx *c, size_t len)
+{
+	bool new_op = false;
+
+	if (c->state == ACCEL_UNDECIDED) {
+		new_op = true;
+		c->state = ACCEL_CPU;
+		if (c->hw_ready && len >= c->accel->min_len) {
+			if (job_try_begin(c->accel)) {
+				c->state = ACCEL_OFFLOADED;
+				count_offloaded(true, len);
+				return true;
+			}
+			count_queue_full();
+		}
+	}
+
+	if (c->state == ACCEL_CPU) {
+		count_cpu(new_op, len);
+		return false;
+	}
+
+	job_begin(c->accel);
+	count_offloaded(false, len);
+	return true;
+}
+
+static TEE_Result alloc_ctx(void **ctx_ret, uint32_t algo,
+			    TEE_Result (*sw_alloc)(void **ctx, uint32_t algo),
+			    void (*sw_free)(void *ctx, uint32_t algo))
+{
+	struct accel_ctx *c = calloc(1, sizeof(*c));
+	TEE_Result res;
+
+	if (!c)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	res = sw_alloc(&c->sw_ctx, algo);
+	if (res)
+		goto err;
+
+	/*
+	 * The accelerator context is needed even if this operation ends up
+	 * on the CPU, a copy of it may be offloaded.
+	 */
+	c->accel = find_accel(algo);
+	if (c->accel) {
+		res = c->accel->ops->alloc_ctx(&c->hw_ctx, algo);
+		if (res) {
+			sw_free(c->sw_ctx, algo);
+			goto err;
+		}
+	}
+
+	*ctx_ret = c;
+	return TEE_SUCCESS;
+err:
+	free(c);
+	return res;
+}
+
+static void free_ctx(struct accel_ctx *c, uint32_t algo,
+		     void (*sw_free)(void *ctx, uint32_t algo))
+{
+	if (!c)
+		return;
+	sw_free(c->sw_ctx, algo);
+	if (c->hw_ctx)
+		c->accel->ops->free_ctx(c->hw_ctx, algo);
+	free(c);
+}
+
+static void copy_state(struct accel_ctx *dst, struct accel_ctx *src,
+		       uint32_t algo,
+		       void (*sw_copy)(void *dst, void *src, uint32_t algo))
+{
+	sw_copy(dst->sw_ctx, src->sw_ctx, algo);
+	dst->state = src->state;
+	dst->hw_ready = src->hw_ready;
+	if (src->hw_ready)
+		src->accel->ops->copy_state(dst->hw_ctx, src->hw_ctx, algo);
+}
+
+#if defined(_CFG_CRYPTO_WITH_HASH)
+TEE_Result crypto_hash_alloc_ctx(void **ctx, uint32_t algo)
+{
+	return alloc_ctx(ctx, algo, crypto_sw_hash_alloc_ctx,
+			 crypto_sw_hash_free_ctx);
+}
+
+void crypto_hash_free_ctx(void *ctx, uint32_t algo)
+{
+	free_ctx(ctx, algo, crypto_sw_hash_free_ctx);
+}
+
+void crypto_hash_copy_state(void *dst_ctx, void *src_ctx, uint32_t algo)
+{
+	copy_state(dst_ctx, src_ctx, algo, crypto_sw_hash_copy_state);
+}
+
+TEE_Result crypto_hash_init(void *ctx, uint32_t algo)
+{
+	struct accel_ctx *c = ctx;
+	TEE_Result res;
+
+	c->state = ACCEL_UNDECIDED;
+	c->hw_ready = false;
+	res = crypto_sw_hash_init(c->sw_ctx, algo);
+	if (res || !c->hw_ctx)
+		return res;
+	c->hw_ready = !c->accel->ops->hash_init(c->hw_ctx, algo);
+	return TEE_SUCCESS;
+}
+
+TEE_Result crypto_hash_update(void *ctx, uint32_t algo, const uint8_t *data,
+			      size_t len)
+{
+	struct accel_ctx *c = ctx;
+	TEE_Result res;
+
+	if (!begin_update(c, len))
+		return crypto_sw_hash_update(c->sw_ctx, algo, data, len);
+
+	res = c->accel->ops->hash_update(c->hw_ctx, algo, data, len);
+	job_end(c->accel);
+	return res;
+}
+
+TEE_Result crypto_hash_final(void *ctx, uint32_t algo, uint8_t *digest,
+			     size_t len)
+{
+	struct accel_ctx *c = ctx;
+	TEE_Result res;
+
+	if (c->state != ACCEL_OFFLOADED) {
+		if (c->state == ACCEL_UNDECIDED)
+			count_cpu(true, 0);
+		c->state = ACCEL_CPU;
+		return crypto_sw_hash_final(c->sw_ctx, algo, digest, len);
+	}
+
+	job_begin(c->accel);
+	res = c->accel->ops->hash_final(c->hw_ctx, algo, digest, len);
+	job_end(c->accel);
+	return res;
+}
+#endif /*_CFG_CRYPTO_WITH_HASH*/
+
+#if defined(_CFG_CRYPTO_WITH_CIPHER)
+TEE_Result crypto_cipher_alloc_ctx(void **ctx, uint32_t algo)
+{
+	return alloc_ctx(ctx, algo, crypto_sw_cipher_alloc_ctx,
+			 crypto_sw_cipher_free_ctx);
+}
+
+void crypto_cipher_free_ctx(void *ctx, uint32_t algo)
+{
+	free_ctx(ctx, algo, crypto_sw_cipher_free_ctx);
+}
+
+void crypto_cipher_copy_state(void *dst_ctx, void *src_ctx, uint32_t algo)
+{
+	copy_state(dst_ctx, src_ctx, algo, crypto_sw_cipher_copy_state);
+}
+
+TEE_Result crypto_cipher_init(void *ctx, uint32_t algo,
+			      TEE_OperationMode mode,
+			      const uint8_t *key1, size_t key1_len,
+			      const uint8_t *key2, size_t key2_len,
+			      const uint8_t *iv, size_t iv_len)
+{
+	struct accel_ctx *c = ctx;
+	TEE_Result res;
+
+	c->state = ACCEL_UNDECIDED;
+	c->hw_ready = false;
+	res = crypto_sw_cipher_init(c->sw_ctx, algo, mode, key1, key1_len,
+				    key2, key2_len, iv, iv_len);
+	if (res || !c->hw_ctx)
+		return res;
+	c->hw_ready = !c->accel->ops->cipher_init(c->hw_ctx, algo, mode,
+						  key1, key1_len, key2,
+						  key2_len, iv, iv_len);
+	return TEE_SUCCESS;
+}
+
+TEE_Result crypto_cipher_update(void *ctx, uint32_t algo,
+				TEE_OperationMode mode, bool last_block,
+				const uint8_t *data, size_t len, uint8_t *dst)
+{
+	struct accel_ctx *c = ctx;
+	TEE_Result res;
+
+	if (!begin_update(c, len))
+		return crypto_sw_cipher_update(c->sw_ctx, algo, mode,
+					       last_block, data, len, dst);
+
+	res = c->accel->ops->cipher_update(c->hw_ctx, algo, mode, last_block,
+					   data, len, dst);
+	job_end(c->accel);
+	return res;
+}
+
+void crypto_cipher_final(void *ctx, uint32_t algo)
+{
+	struct accel_ctx *c = ctx;
+
+	crypto_sw_cipher_final(c->sw_ctx, algo);
+	if (c->hw_ready)
+		c->accel->ops->cipher_final(c->hw_ctx, algo);
+}
+#endif /*_CFG_CRYPTO_WITH_CIPHER*/
@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <crypto/crypto.h>
+#include <kernel/misc.h>
+#include <kernel/panic.h>
+#include <kernel/thread.h>
+#include <string.h>
+#include <tee_api_types.h>
+#include <utee_defines.h>
+#include <util.h>
+
+/*
+ * AES-256 CTR_DRBG as specified in NIST SP 800-90A Rev. 1, without
+ * derivation function, providing crypto_rng_read().
+ *
+ * There's one instance per CPU so that concurrent requests don't
+ * serialize on a single generator. Each instance is seeded, and
+ * reseeded every DRBG_RESEED_INTERVAL requests, with output from the
+ * PRNG of the crypto library which collects the entropy added with
+ * crypto_rng_add_entropy().
+ *
+ * An instance is only used with foreign interrupts masked to stay on
+ * the CPU, requests are split in chunks of DRBG_CHUNK_SIZE bytes to
+ * bound the time spent with interrupts masked.
+ */
+
+#define DRBG_KEY_LEN		32
+#define DRBG_SEED_LEN		(DRBG_KEY_LEN + TEE_AES_BLOCK_SIZE)
+#define DRBG_SEED_BLOCKS	(DRBG_SEED_LEN / TEE_AES_BLOCK_SIZE)
+#define DRBG_CHUNK_SIZE		256
+#define DRBG_CHUNK_BLOCKS	(DRBG_CHUNK_SIZE / TEE_AES_BLOCK_SIZE)
+#define DRBG_RESEED_INTERVAL	1024
+
+struct ctr_drbg {
+	uint64_t enc_key[30];
+	unsigned int rounds;
+	uint8_t v[TEE_AES_BLOCK_SIZE];
+	unsigned int reseed_counter;	/* 0 until instantiated */
+};
+
+static struct ctr_drbg drbgs[CFG_TEE_CORE_NB_CORE];
+
+static void inc_v(uint8_t *v)
+{
+	int n;
+
+	for (n = TEE_AES_BLOCK_SIZE - 1; n >= 0; n--)
+		if (++v[n])
+			break;
+}
+
+/* Encrypts num_blocks blocks of V, incrementing V before each block */
+static void encrypt_v(struct ctr_drbg *d, uint8_t *dst, size_t num_blocks)
+{
+	size_t n;
+
+	for (n = 0; n < num_blocks; n++) {
+		inc_v(d->v);
+		memcpy(dst + n * TEE_AES_BLOCK_SIZE, d->v, TEE_AES_BLOCK_SIZE);
+	}
+	crypto_aes_enc_blocks(d->enc_key, d->rounds, dst, dst, num_blocks);
+}
+
+/* Last step of CTR_DRBG_Update(), temp is DRBG_SEED_LEN bytes */
+static void set_key_v(struct ctr_drbg *d, const uint8_t *temp)
+{
+	if (crypto_aes_expand_enc_key(temp, DRBG_KEY_LEN, d->enc_key,
+				      &d->rounds))
+		panic();
+	memcpy(d->v, temp + DRBG_KEY_LEN, TEE_AES_BLOCK_SIZE);
+}
+
+/*
+ * CTR_DRBG_Instantiate() or CTR_DRBG_Reseed(), the seed is the entropy
+ * input since there's no personalization string or additional input.
+ */
+static void reseed(struct ctr_drbg *d, const uint8_t *seed)
+{
+	uint8_t temp[DRBG_SEED_LEN] = { 0 };
+	size_t n;
+
+	if (!d->reseed_counter)
+		set_key_v(d, temp);
+
+	encrypt_v(d, temp, DRBG_SEED_BLOCKS);
+	for (n = 0; n < DRBG_SEED_LEN; n++)
+		temp[n] ^= seed[n];
+	set_key_v(d, temp);
+	d->reseed_counter = 1;
+	memset(temp, 0, sizeof(temp));
+}
+
+/*
+ * CTR_DRBG_Generate() of at most DRBG_CHUNK_SIZE bytes. The blocks for
+ * the final CTR_DRBG_Update() use the same key and follow the output
+ * blocks, so they're all encrypted at once.
+ */
+static void generate(struct ctr_drbg *d, uint8_t *buf, size_t len)
+{
+	uint8_t temp[(DRBG_CHUNK_BLOCKS + DRBG_SEED_BLOCKS) *
+		     TEE_AES_BLOCK_SIZE];
+	size_t num_blocks = ROUNDUP(len, TEE_AES_BLOCK_SIZE) /
+			    TEE_AES_BLOCK_SIZE;
+
+	encrypt_v(d, temp, num_blocks + DRBG_SEED_BLOCKS);
+	memcpy(buf, temp, len);
+	set_key_v(d, temp + num_blocks * TEE_AES_BLOCK_SIZE);
+	d->reseed_counter++;
+	memset(temp, 0, sizeof(temp));
+}
+
+TEE_Result crypto_rng_read(void *buf, size_t blen)
+{
+	uint8_t seed[DRBG_SEED_LEN];
+	TEE_Result res = TEE_SUCCESS;
+	bool have_seed = false;
+	uint8_t *b = buf;
+	uint32_t exceptions;
+	struct ctr_drbg *d;
+	size_t n;
+
+	while (blen) {
+		exceptions = thread_mask_exceptions(THREAD_EXCP_FOREIGN_INTR);
+		d = drbgs + get_core_pos();
+
+		if (!d->reseed_counter ||
+		    d->reseed_counter > DRBG_RESEED_INTERVAL) {
+			if (!have_seed) {
+				/* The seeding PRNG may take a mutex */
+				thread_unmask_exceptions(exceptions);
+				res = crypto_sw_rng_read(seed, sizeof(seed));
+				if (res)
+					goto out;
+				have_seed = true;
+				continue;
+			}
+			/* Possibly on another CPU, any seed will do */
+			reseed(d, seed);
+			have_seed = false;
+		}
+
+		n = MIN(blen, (size_t)DRBG_CHUNK_SIZE);
+		generate(d, b, n);
+		thread_unmask_exceptions(exceptions);
+		b += n;
+		blen -= n;
+	}
+out:
+	memset(seed, 0, sizeof(seed));
+	return res;
+}
+
+#ifdef CFG_TEE_CORE_EMBED_INTERNAL_TESTS
+TEE_Result crypto_ctr_drbg_test(const uint8_t *entropy,
+				const uint8_t *entropy_reseed,
+				uint8_t *out, size_t len)
+{
+	struct ctr_drbg d = { .reseed_counter = 0 };
+
+	if (len > DRBG_CHUNK_SIZE)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	reseed(&d, entropy);
+	reseed(&d, entropy_reseed);
+	generate(&d, out, len);
+	generate(&d, out, len);
+	memset(&d, 0, sizeof(d));
+
+	return TEE_SUCCESS;
+}
+#endif
@@ -1,4 +1,6 @@
 srcs-y += crypto.c
+srcs-$(CFG_CRYPTO_ACCEL) += crypto_accel.c
+srcs-$(CFG_CRYPTO_CTR_DRBG) += ctr_drbg.c
 srcs-y += aes-gcm.c
 srcs-y += aes-gcm-sw.c
 ifeq ($(CFG_AES_GCM_TABLE_BASED),y)
@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+/*
+ * Crypto accelerator driver running the software implementations, used
+ * to test the crypto accelerator framework on platforms without an
+ * accelerator, like QEMU.
+ */
+
+#include <crypto/crypto_accel.h>
+#include <initcall.h>
+#include <kernel/panic.h>
+#include <tee_api_defines.h>
+#include <util.h>
+
+#define LOOPBACK_MIN_LEN	4096
+#define LOOPBACK_QUEUE_DEPTH	2
+
+static const struct crypto_accel_ops loopback_hash_ops = {
+	.alloc_ctx = crypto_sw_hash_alloc_ctx,
+	.free_ctx = crypto_sw_hash_free_ctx,
+	.copy_state = crypto_sw_hash_copy_state,
+	.hash_init = crypto_sw_hash_init,
+	.hash_update = crypto_sw_hash_update,
+	.hash_final = crypto_sw_hash_final,
+};
+
+static const struct crypto_accel_ops loopback_cipher_ops = {
+	.alloc_ctx = crypto_sw_cipher_alloc_ctx,
+	.free_ctx = crypto_sw_cipher_free_ctx,
+	.copy_state = crypto_sw_cipher_copy_state,
+	.cipher_init = crypto_sw_cipher_init,
+	.cipher_update = crypto_sw_cipher_update,
+	.cipher_final = crypto_sw_cipher_final,
+};
+
+#define LOOPBACK_ACCEL(_algo, _ops) { \
+		.name = "loopback", \
+		.algo = (_algo), \
+		.min_len = LOOPBACK_MIN_LEN, \
+		.queue_depth = LOOPBACK_QUEUE_DEPTH, \
+		.ops = &(_ops), \
+	}
+
+static struct crypto_accel loopback_accels[] = {
+#if defined(CFG_CRYPTO_SHA1)
+	LOOPBACK_ACCEL(TEE_ALG_SHA1, loopback_hash_ops),
+#endif
+#if defined(CFG_CRYPTO_SHA256)
+	LOOPBACK_ACCEL(TEE_ALG_SHA256, loopback_hash_ops),
+#endif
+#if defined(CFG_CRYPTO_AES) && defined(CFG_CRYPTO_ECB)
+	LOOPBACK_ACCEL(TEE_ALG_AES_ECB_NOPAD, loopback_cipher_ops),
+#endif
+#if defined(CFG_CRYPTO_AES) && defined(CFG_CRYPTO_CBC)
+	LOOPBACK_ACCEL(TEE_ALG_AES_CBC_NOPAD, loopback_cipher_ops),
+#endif
+#if defined(CFG_CRYPTO_AES) && defined(CFG_CRYPTO_CTR)
+	LOOPBACK_ACCEL(TEE_ALG_AES_CTR, loopback_cipher_ops),
+#endif
+};
+
+static TEE_Result crypto_loopback_init(void)
+{
+	size_t n;
+
+	for (n = 0; n < ARRAY_SIZE(loopback_accels); n++)
+		if (crypto_accel_register(loopback_accels + n))
+			panic();
+
+	return TEE_SUCCESS;
+}
+driver_init(crypto_loopback_init);
@@ -262,11 +262,32 @@ TEE_Result crypto_rng_add_entropy(const uint8_t *inbuf, size_t len);
 /* To read random data from PRNG implementation. */
 TEE_Result crypto_rng_read(void *buf, size_t blen);
 
+/*
+ * PRNG of the crypto library, with CFG_CRYPTO_CTR_DRBG=y only used to
+ * seed the CTR_DRBGs providing crypto_rng_read()
+ */
+TEE_Result crypto_sw_rng_read(void *buf, size_t blen);
+
+#if defined(CFG_CRYPTO_CTR_DRBG) && defined(CFG_TEE_CORE_EMBED_INTERNAL_TESTS)
+/*
+ * Known answer test hook of the CTR_DRBG: a private instance is
+ * instantiated with @entropy, reseeded with @entropy_reseed, both 48
+ * bytes, and then generates @len bytes twice. The output of the second
+ * request is returned in @out. @len is at most 256.
+ */
+TEE_Result crypto_ctr_drbg_test(const uint8_t *entropy,
+				const uint8_t *entropy_reseed,
+				uint8_t *out, size_t len);
+#endif
+
 TEE_Result rng_generate(void *buffer, size_t len);
 
 TEE_Result crypto_aes_expand_enc_key(const void *key, size_t key_len,
 				     void *enc_key, unsigned int *rounds);
 void crypto_aes_enc_block(const void *enc_key, unsigned int rounds,
 			  const void *src, void *dst);
+/* Encrypts num_blocks independent blocks (ECB), src and dst may overlap */
+void crypto_aes_enc_blocks(const void *enc_key, unsigned int rounds,
+			   const void *src, void *dst, size_t num_blocks);
 
 #endif /* __CRYPTO_CRYPTO_H */
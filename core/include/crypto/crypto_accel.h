@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#ifndef __CRYPTO_CRYPTO_ACCEL_H
+#define __CRYPTO_CRYPTO_ACCEL_H
+
+#include <kernel/mutex.h>
+#include <sys/queue.h>
+#include <tee_api_types.h>
+
+/*
+ * Crypto accelerator framework
+ *
+ * With CFG_CRYPTO_ACCEL=y the crypto_hash_*() and crypto_cipher_*()
+ * functions are provided by core/crypto/crypto_accel.c. Drivers register
+ * a struct crypto_accel per algorithm they implement, the one with the
+ * highest priority is used for the algorithm.
+ *
+ * An operation is run by the accelerator if its first update is at least
+ * min_len bytes and the accelerator has fewer than queue_depth jobs in
+ * flight, else it's run by the software implementation for its whole
+ * lifetime. Each update of an offloaded operation is a job, it waits for
+ * a free slot in the queue of the accelerator.
+ */
+
+struct crypto_accel_ops {
+	TEE_Result (*alloc_ctx)(void **ctx, uint32_t algo);
+	void (*free_ctx)(void *ctx, uint32_t algo);
+	void (*copy_state)(void *dst_ctx, void *src_ctx, uint32_t algo);
+
+	/* Hash algorithms */
+	TEE_Result (*hash_init)(void *ctx, uint32_t algo);
+	TEE_Result (*hash_update)(void *ctx, uint32_t algo,
+				  const uint8_t *data, size_t len);
+	TEE_Result (*hash_final)(void *ctx, uint32_t algo, uint8_t *digest,
+				 size_t len);
+
+	/* Cipher algorithms */
+	TEE_Result (*cipher_init)(void *ctx, uint32_t algo,
+				  TEE_OperationMode mode,
+				  const uint8_t *key1, size_t key1_len,
+				  const uint8_t *key2, size_t key2_len,
+				  const uint8_t *iv, size_t iv_len);
+	TEE_Result (*cipher_update)(void *ctx, uint32_t algo,
+				    TEE_OperationMode mode, bool last_block,
+				    const uint8_t *data, size_t len,
+				    uint8_t *dst);
+	void (*cipher_final)(void *ctx, uint32_t algo);
+};
+
+struct crypto_accel {
+	const char *name;
+	uint32_t algo;
+	unsigned int priority;
+	size_t min_len;
+	unsigned int queue_depth;
+	const struct crypto_accel_ops *ops;
+
+	/* Private to the framework */
+	struct mutex mu;
+	struct condvar cv;
+	unsigned int jobs;
+	SLIST_ENTRY(crypto_accel) link;
+};
+
+struct crypto_accel_stats {
+	uint32_t offloaded_ops;
+	uint32_t cpu_ops;
+	uint64_t offloaded_bytes;
+	uint64_t cpu_bytes;
+	uint32_t queue_full;	/* Operations kept on the CPU by a full queue */
+};
+
+/*
+ * Registers an accelerator, to be called from an initcall. Operations
+ * allocated before the registration keep using the software
+ * implementation.
+ */
+TEE_Result crypto_accel_register(struct crypto_accel *accel);
+
+void crypto_accel_get_stats(struct crypto_accel_stats *stats, bool reset);
+
+/* Software implementations of the algorithms, used by the framework */
+TEE_Result crypto_sw_hash_alloc_ctx(void **ctx, uint32_t algo);
+void crypto_sw_hash_free_ctx(void *ctx, uint32_t algo);
+void crypto_sw_hash_copy_state(void *dst_ctx, void *src_ctx, uint32_t algo);
+TEE_Result crypto_sw_hash_init(void *ctx, uint32_t algo);
+TEE_Result crypto_sw_hash_update(void *ctx, uint32_t algo,
+				 const uint8_t *data, size_t len);
+TEE_Result crypto_sw_hash_final(void *ctx, uint32_t algo, uint8_t *digest,
+				size_t len);
+
+TEE_Result crypto_sw_cipher_alloc_ctx(void **ctx, uint32_t algo);
+void crypto_sw_cipher_free_ctx(void *ctx, uint32_t algo);
+void crypto_sw_cipher_copy_state(void *dst_ctx, void *src_ctx,
+				 uint32_t algo);
+TEE_Result crypto_sw_cipher_init(void *ctx, uint32_t algo,
+				 TEE_OperationMode mode,
+				 const uint8_t *key1, size_t key1_len,
+				 const uint8_t *key2, size_t key2_len,
+				 const uint8_t *iv, size_t iv_len);
+TEE_Result crypto_sw_cipher_update(void *ctx, uint32_t algo,
+				   TEE_OperationMode mode, bool last_block,
+				   const uint8_t *data, size_t len,
+				   uint8_t *dst);
+void crypto_sw_cipher_final(void *ctx, uint32_t algo);
+
+#endif /*__CRYPTO_CRYPTO_ACCEL_H*/
@@ -24,6 +24,10 @@ struct internal_aes_gcm_state {
 	uint64_t HH[16];
 #else
 	uint8_t hash_subkey[TEE_AES_BLOCK_SIZE];
+#if defined(CFG_CRYPTO_WITH_CE) && defined(ARM64)
+	/* H^2, H^3 and H^4, must follow hash_subkey */
+	uint8_t hash_subkey_pow[3][TEE_AES_BLOCK_SIZE];
+#endif
 #endif
 	uint8_t hash_state[TEE_AES_BLOCK_SIZE];
 
@@ -98,4 +102,7 @@ void internal_aes_gcm_update_payload_block_aligned(
 
 void internal_aes_gcm_encrypt_block(const struct internal_aes_gcm_key *enc_key,
 				    const void *src, void *dst);
+void internal_aes_gcm_encrypt_blocks(const struct internal_aes_gcm_key *enc_key,
+				     const void *src, void *dst,
+				     size_t num_blocks);
 #endif /*__CRYPTO_INTERNAL_AES_GCM_H*/
@@ -5,14 +5,18 @@
 #ifndef KERNEL_HANDLE_H
 #define KERNEL_HANDLE_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 struct handle_db {
 	void **ptrs;
+	uint8_t *gens;
 	size_t max_ptrs;
+	size_t free_head;
 };
 
-#define HANDLE_DB_INITIALIZER { NULL, 0 }
+#define HANDLE_DB_INITIALIZER { NULL, NULL, 0, 0 }
 
 /*
  * Frees all internal data structures of the database, but does not free
@@ -23,10 +27,16 @@ void handle_db_destroy(struct handle_db *db);
 
 /*
  * Allocates a new handle and assigns the supplied pointer to it,
- * ptr must not be NULL.
+ * ptr must not be NULL and must be at least 2 byte aligned. Released
+ * handles are kept in a free list so this is O(1) unless the database
+ * has to grow.
  * The function returns
- * >= 0 on success and
+ * > 0 on success and
  * -1 on failure
+ *
+ * With CFG_HANDLE_DB_GENERATIONS the handle includes a generation count
+ * of the slot in the database, a handle which has been deallocated isn't
+ * valid even if the slot has been reused.
  */
 int handle_get(struct handle_db *db, void *ptr);
 
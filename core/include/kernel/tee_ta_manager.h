@@ -113,6 +113,9 @@ struct tee_ta_ctx {
 struct tee_ta_session {
 	TAILQ_ENTRY(tee_ta_session) link;
 	TAILQ_ENTRY(tee_ta_session) link_tsd;
+	uint32_t id;		/* Session id as seen by the client */
+	/* List of sessions the session is linked into */
+	struct tee_ta_session_head *open_sessions;
 	struct tee_ta_ctx *ctx;	/* TA context */
 	TEE_Identity clnt_id;	/* Identify of client */
 	bool cancel;		/* True if TAF is cancelled */
@@ -161,7 +164,7 @@ bool tee_ta_session_is_cancelled(struct tee_ta_session *s, TEE_Time *curr_time);
  * Returns:
  *        TEE_Result
  *---------------------------------------------------------------------------*/
-TEE_Result tee_ta_close_session(struct tee_ta_session *sess,
+TEE_Result tee_ta_close_session(uint32_t id,
 				struct tee_ta_session_head *open_sessions,
 				const TEE_Identity *clnt_id);
 
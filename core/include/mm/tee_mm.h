@@ -36,6 +36,14 @@
 #define TEE_MM_POOL_NO_FLAGS            0
 /* Flag to indicate that memory is allocated from hi address to low address */
 #define TEE_MM_POOL_HI_ALLOC            (1u << 0)
+/*
+ * Flag to indicate that the entries of the pool are also kept in a
+ * balanced tree, giving O(log n) allocation, lookup and free instead of
+ * walking the list of entries. Allocations of 0 bytes use one block.
+ * The tree links are allocated with each entry, which makes the entries
+ * of such a pool about 2.5 times larger on the core heap.
+ */
+#define TEE_MM_POOL_TREE                (1u << 1)
 
 struct _tee_mm_entry_t {
 	struct _tee_mm_pool_t *pool;
@@ -47,12 +55,14 @@ typedef struct _tee_mm_entry_t tee_mm_entry_t;
 
 struct _tee_mm_pool_t {
 	tee_mm_entry_t *entry;
+	tee_mm_entry_t *root;	/* root of tree with TEE_MM_POOL_TREE */
 	paddr_t lo;		/* low boundary of the pool */
 	paddr_t hi;		/* high boundary of the pool */
 	uint32_t flags;		/* Config flags for the pool */
 	uint8_t shift;		/* size shift */
 	unsigned int lock;
 #ifdef CFG_WITH_STATS
+	size_t allocated;	/* currently allocated pages/sections */
 	size_t max_allocated;
 #endif
 };
@@ -46,10 +46,14 @@ void tee_mmu_final(struct user_ta_ctx *utc);
 void tee_mmu_map_stack(struct user_ta_ctx *utc, struct mobj *mobj);
 /*
  * Map a code segment of a user TA, this function may be called multiple
- * times if there's several segments.
+ * times if there's several segments. @offs is the offset of the segment
+ * in the TA and @mobj_base the offset in the TA where @mobj starts. The
+ * first segment must use a @mobj_base of 0, @mobj may only change at a
+ * boundary between translation granules.
  */
 TEE_Result tee_mmu_map_add_segment(struct user_ta_ctx *utc, struct mobj *mobj,
-				   size_t offs, size_t size, uint32_t prot);
+				   size_t mobj_base, size_t offs, size_t size,
+				   uint32_t prot);
 
 void tee_mmu_map_init(struct user_ta_ctx *utc);
 
@@ -110,6 +114,25 @@ TEE_Result tee_mmu_check_access_rights(const struct user_ta_ctx *utc,
 void tee_mmu_set_ctx(struct tee_ta_ctx *ctx);
 struct tee_ta_ctx *tee_mmu_get_ctx(void);
 
+/*
+ * struct tee_mmu_switch_stats - per thread statistics of user map switches
+ * @reused:	user maps activated again with their kept page tables
+ * @rebuilt:	user maps created from scratch
+ */
+struct tee_mmu_switch_stats {
+	uint32_t reused;
+	uint32_t rebuilt;
+};
+
+#ifdef CFG_WITH_STATS
+/*
+ * Copies the user map switch statistics of thread @thread_id to @stats
+ * and clears them if @reset is true
+ */
+void tee_mmu_get_switch_stats(size_t thread_id,
+			      struct tee_mmu_switch_stats *stats, bool reset);
+#endif
+
 /* Returns virtual address to which TA is loaded */
 uintptr_t tee_mmu_get_load_addr(const struct tee_ta_ctx *const ctx);
 
@@ -94,6 +94,8 @@ struct tee_mmu_info {
 	vaddr_t ta_private_vmem_start;
 	vaddr_t ta_private_vmem_end;
 	unsigned int asid;
+	/* Updated each time the regions change */
+	unsigned int regions_gen;
 };
 
 static inline void mattr_perm_to_str(char *str, size_t size, uint32_t attr)
@@ -6,8 +6,17 @@
 #ifndef __OPTEE_MSG_SUPPLICANT_H
 #define __OPTEE_MSG_SUPPLICANT_H
 
+#include <stdint.h>
+
 /*
  * Load a TA into memory
+ *
+ * [in]     param[0].u.value	UUID of the TA
+ * [out]    param[1].u.tmem	Buffer for the TA, with a size of 0 only
+ *				the size of the TA is returned
+ * [in]     param[2].u.value.a	Optional, offset in the TA of the part to
+ *				load, the buffer may then be smaller than
+ *				the TA
  */
 #define OPTEE_MSG_RPC_CMD_LOAD_TA	0
 
@@ -133,6 +142,35 @@
  */
 #define OPTEE_MRF_READDIR		10
 
+/*
+ * Write to a file at several offsets
+ *
+ * [in]     param[0].u.value.a	OPTEE_MRF_WRITEV
+ * [in]     param[0].u.value.b	file descriptor of open file
+ * [in]     param[0].u.value.c	number of struct optee_mrf_iovec
+ * [in]     param[1].u.tmem	buffer starting with an array of
+ *				param[0].u.value.c struct optee_mrf_iovec
+ *				describing the data held in the rest of
+ *				the buffer
+ *
+ * The writes are done in the order of the array. A supplicant not
+ * supporting this command is expected to return an error, in which case
+ * the data is written again with OPTEE_MRF_WRITE.
+ */
+#define OPTEE_MRF_WRITEV		11
+
+/*
+ * struct optee_mrf_iovec - describes one write of OPTEE_MRF_WRITEV
+ * @offset:	offset into file
+ * @data_offs:	offset of the data from the start of the buffer
+ * @len:	number of bytes to write
+ */
+struct optee_mrf_iovec {
+	uint64_t offset;
+	uint32_t data_offs;
+	uint32_t len;
+};
+
 /*
  * End of definitions for messages with .cmd == OPTEE_MSG_RPC_CMD_FS
  */
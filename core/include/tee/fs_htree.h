@@ -78,6 +78,10 @@ struct tee_fs_rpc_operation;
  *			operation
  * @rpc_write_init:	initialize a struct tee_fs_rpc_operation for an RPC
  *			write operation
+ * @rpc_write_begin:	optional, writes until @rpc_write_end may be
+ *			deferred and sent to storage together
+ * @rpc_write_end:	optional, commits writes deferred since
+ *			@rpc_write_begin, or discards them if @abort is true
  *
  * The @idx arguments starts counting from 0. The @vers arguments are either
  * 0 or 1. The @data arguments is a pointer to a buffer in non-secure shared
@@ -94,6 +98,8 @@ struct tee_fs_htree_storage {
 				     enum tee_fs_htree_type type, size_t idx,
 				     uint8_t vers, void **data);
 	TEE_Result (*rpc_write_final)(struct tee_fs_rpc_operation *op);
+	TEE_Result (*rpc_write_begin)(void *aux);
+	TEE_Result (*rpc_write_end)(void *aux, bool abort);
 };
 
 struct tee_fs_htree;
@@ -155,6 +161,10 @@ TEE_Result tee_fs_htree_truncate(struct tee_fs_htree **ht, size_t block_num);
  * @block_num:	block number
  * @block:	pointer to a block of stor->block_size size
  *
+ * With CFG_REE_FS_HTREE_CACHE_BLOCKS > 0 the block may be kept in the
+ * block cache and written to storage first when evicted or when
+ * tee_fs_htree_sync_to_storage() is called.
+ *
  * Frees the hash tree and sets *ht to NULL on failure and returns an error code
  */
 TEE_Result tee_fs_htree_write_block(struct tee_fs_htree **ht, size_t block_num,
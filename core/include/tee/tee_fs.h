@@ -81,6 +81,16 @@ extern const struct tee_file_operations rpmb_fs_ops;
 
 TEE_Result tee_rpmb_fs_raw_open(const char *fname, bool create,
 				struct tee_file_handle **fh);
+
+/*
+ * Writes @size bytes (a multiple of the RPMB block size) from @buf to a
+ * scratch file which is removed afterwards, sending at most @max_blkcnt
+ * blocks in each write request. 0 means no other limit than the reliable
+ * write block count of the device. The number of blocks per request
+ * actually used is returned in @blkcnt. Only meant for benchmarking.
+ */
+TEE_Result tee_rpmb_fs_bench_write(const void *buf, size_t size,
+				   uint16_t max_blkcnt, uint16_t *blkcnt);
 #endif
 
 #endif /*TEE_FS_H*/
@@ -44,6 +44,49 @@ TEE_Result tee_fs_rpc_write_init(struct tee_fs_rpc_operation *op,
 				 size_t data_len, void **data);
 TEE_Result tee_fs_rpc_write_final(struct tee_fs_rpc_operation *op);
 
+/*
+ * Writes queued in a batch are sent to tee-supplicant with a single
+ * OPTEE_MRF_WRITEV request when the batch is full or when
+ * tee_fs_rpc_batch_final() is called. Queued writes are kept in the FS
+ * RPC cache memory so no other FS RPC may be issued by the thread while
+ * there are queued writes. The batch can be used again after
+ * tee_fs_rpc_batch_final().
+ */
+struct tee_fs_rpc_batch {
+	uint32_t id;
+	int fd;
+	struct mobj *mobj;
+	uint64_t cookie;
+	uint8_t *va;
+	size_t num_iov;
+	size_t data_len;
+#ifdef CFG_TEE_CORE_EMBED_INTERNAL_TESTS
+	/*
+	 * If set, called instead of thread_rpc_cmd() to send the requests
+	 * of the batch, used by the self tests to stub tee-supplicant.
+	 * Whether the stub understands OPTEE_MRF_WRITEV is then tracked in
+	 * @writev_unsupported.
+	 */
+	TEE_Result (*commit)(void *aux, struct tee_fs_rpc_operation *op);
+	void *commit_aux;
+	bool writev_unsupported;
+#endif
+};
+
+void tee_fs_rpc_batch_init(struct tee_fs_rpc_batch *b, uint32_t id, int fd);
+/*
+ * Queues a write in the batch, the returned operation is completed with
+ * tee_fs_rpc_write_final() as usual, but the data is only committed by
+ * a later call to tee_fs_rpc_batch_write_init() or
+ * tee_fs_rpc_batch_final().
+ */
+TEE_Result tee_fs_rpc_batch_write_init(struct tee_fs_rpc_batch *b,
+				       struct tee_fs_rpc_operation *op,
+				       tee_fs_off_t offset, size_t data_len,
+				       void **data);
+TEE_Result tee_fs_rpc_batch_final(struct tee_fs_rpc_batch *b);
+/* Discards the writes queued since they were last committed */
+void tee_fs_rpc_batch_abort(struct tee_fs_rpc_batch *b);
 
 TEE_Result tee_fs_rpc_truncate(uint32_t id, int fd, size_t len);
 TEE_Result tee_fs_rpc_remove(uint32_t id, struct tee_pobj *po);
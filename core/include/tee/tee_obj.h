@@ -45,9 +45,15 @@ struct tee_obj {
 	struct tee_pobj *pobj;	/* ptr to persistant object */
 	struct tee_file_handle *fh;
 	uint32_t flags;		/* permission flags for persistent objects */
+	uint32_t handle;	/* handle of the object in utc->obj_db */
 };
 
-void tee_obj_add(struct user_ta_ctx *utc, struct tee_obj *o);
+/*
+ * Links the object into the TA context and assigns o->handle. If the
+ * handle can't be allocated the object is still linked and has to be
+ * released with tee_obj_close().
+ */
+TEE_Result tee_obj_add(struct user_ta_ctx *utc, struct tee_obj *o);
 
 TEE_Result tee_obj_get(struct user_ta_ctx *utc, uint32_t obj_id,
 		       struct tee_obj **obj);
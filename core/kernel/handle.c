@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <kernel/handle.h>
+#include <types_ext.h>
 
 /*
  * Define the initial capacity of the database. It should be a low number
@@ -14,66 +15,151 @@
  */
 #define HANDLE_DB_INITIAL_MAX_PTRS	4
 
+/*
+ * A handle is the index into the database in the lower bits and the
+ * generation of the slot in the upper bits. The generation is increased
+ * each time the slot is released so a stale handle doesn't match a new
+ * pointer stored at the same index. Generation 0 is never used which
+ * keeps 0 from being a valid handle.
+ */
+#define HANDLE_IDX_BITS			24
+#define HANDLE_IDX_MASK			((1 << HANDLE_IDX_BITS) - 1)
+#ifdef CFG_HANDLE_DB_GENERATIONS
+#define HANDLE_GEN_MAX			0x7f
+#else
+#define HANDLE_GEN_MAX			1
+#endif
+
+/*
+ * Unused slots in db->ptrs form a singly linked free list. A free slot
+ * holds the index + 1 of the next free slot shifted up one bit with bit 0
+ * set, which can't be mistaken for a pointer since those are at least 2
+ * byte aligned. db->free_head is the index + 1 of the first free slot, 0
+ * if the list is empty.
+ */
+static void *free_slot_link(size_t next)
+{
+	return (void *)((next << 1) | 1);
+}
+
+static bool slot_is_free(void *p)
+{
+	return (vaddr_t)p & 1;
+}
+
+static size_t free_slot_next(void *p)
+{
+	return (vaddr_t)p >> 1;
+}
+
+static int make_handle(struct handle_db *db, size_t idx)
+{
+	return (db->gens[idx] << HANDLE_IDX_BITS) | idx;
+}
+
+static bool parse_handle(struct handle_db *db, int handle, size_t *idx)
+{
+	size_t n;
+
+	if (!db || handle < 0)
+		return false;
+
+	n = handle & HANDLE_IDX_MASK;
+	if (n >= db->max_ptrs || db->gens[n] != (handle >> HANDLE_IDX_BITS) ||
+	    slot_is_free(db->ptrs[n]))
+		return false;
+
+	*idx = n;
+	return true;
+}
+
 void handle_db_destroy(struct handle_db *db)
 {
 	if (db) {
 		free(db->ptrs);
+		free(db->gens);
 		db->ptrs = NULL;
+		db->gens = NULL;
 		db->max_ptrs = 0;
+		db->free_head = 0;
 	}
 }
 
-int handle_get(struct handle_db *db, void *ptr)
+static bool grow_db(struct handle_db *db)
 {
+	size_t new_max_ptrs;
 	size_t n;
+	uint8_t *g;
 	void *p;
-	size_t new_max_ptrs;
-
-	if (!db || !ptr)
-		return -1;
-
-	/* Try to find an empty location */
-	for (n = 0; n < db->max_ptrs; n++) {
-		if (!db->ptrs[n]) {
-			db->ptrs[n] = ptr;
-			return n;
-		}
-	}
 
-	/* No location available, grow the ptrs array */
 	if (db->max_ptrs)
 		new_max_ptrs = db->max_ptrs * 2;
 	else
 		new_max_ptrs = HANDLE_DB_INITIAL_MAX_PTRS;
+	if (new_max_ptrs > HANDLE_IDX_MASK + 1)
+		return false;
+
 	p = realloc(db->ptrs, new_max_ptrs * sizeof(void *));
 	if (!p)
-		return -1;
+		return false;
 	db->ptrs = p;
-	memset(db->ptrs + db->max_ptrs, 0,
-	       (new_max_ptrs - db->max_ptrs) * sizeof(void *));
+
+	g = realloc(db->gens, new_max_ptrs);
+	if (!g)
+		return false;
+	db->gens = g;
+	memset(db->gens + db->max_ptrs, 1, new_max_ptrs - db->max_ptrs);
+
+	/* Link the new slots in front of the (empty) free list */
+	for (n = db->max_ptrs; n < new_max_ptrs - 1; n++)
+		db->ptrs[n] = free_slot_link(n + 2);
+	db->ptrs[n] = free_slot_link(db->free_head);
+	db->free_head = db->max_ptrs + 1;
+
 	db->max_ptrs = new_max_ptrs;
+	return true;
+}
 
-	/* Since n stopped at db->max_ptrs there is an empty location there */
+int handle_get(struct handle_db *db, void *ptr)
+{
+	size_t n;
+
+	if (!db || !ptr || slot_is_free(ptr))
+		return -1;
+
+	if (!db->free_head && !grow_db(db))
+		return -1;
+
+	n = db->free_head - 1;
+	db->free_head = free_slot_next(db->ptrs[n]);
 	db->ptrs[n] = ptr;
-	return n;
+	return make_handle(db, n);
 }
 
 void *handle_put(struct handle_db *db, int handle)
 {
+	size_t n;
 	void *p;
 
-	if (!db || handle < 0 || (size_t)handle >= db->max_ptrs)
+	if (!parse_handle(db, handle, &n))
 		return NULL;
 
-	p = db->ptrs[handle];
-	db->ptrs[handle] = NULL;
+	p = db->ptrs[n];
+	db->ptrs[n] = free_slot_link(db->free_head);
+	db->free_head = n + 1;
+	if (db->gens[n] == HANDLE_GEN_MAX)
+		db->gens[n] = 1;
+	else
+		db->gens[n]++;
 	return p;
 }
 
 void *handle_lookup(struct handle_db *db, int handle)
 {
-	if (!db || handle < 0 || (size_t)handle >= db->max_ptrs)
+	size_t n;
+
+	if (!parse_handle(db, handle, &n))
 		return NULL;
 
-	return db->ptrs[handle];
+	return db->ptrs[n];
 }
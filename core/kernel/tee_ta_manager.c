@@ -33,6 +33,7 @@
 #include <string.h>
 #include <arm.h>
 #include <assert.h>
+#include <kernel/handle.h>
 #include <kernel/mutex.h>
 #include <kernel/panic.h>
 #include <kernel/pseudo_ta.h>
@@ -58,6 +59,12 @@
 struct mutex tee_ta_mutex = MUTEX_INITIALIZER;
 struct tee_ta_ctx_head tee_ctxes = TAILQ_HEAD_INITIALIZER(tee_ctxes);
 
+/*
+ * Session ids handed out to normal world and to TAs, protected by
+ * tee_ta_mutex.
+ */
+static struct handle_db tee_ta_session_db = HANDLE_DB_INITIALIZER;
+
 #ifndef CFG_CONCURRENT_SINGLE_INSTANCE_TA
 static struct condvar tee_ta_cv = CONDVAR_INITIALIZER;
 static int tee_ta_single_instance_thread = THREAD_ID_INVALID;
@@ -201,11 +208,13 @@ static struct tee_ta_session *find_session(uint32_t id,
 {
 	struct tee_ta_session *s;
 
-	TAILQ_FOREACH(s, open_sessions, link) {
-		if ((vaddr_t)s == id)
-			return s;
-	}
-	return NULL;
+	if (id > INT32_MAX)
+		return NULL;
+
+	s = handle_lookup(&tee_ta_session_db, id);
+	if (!s || s->open_sessions != open_sessions)
+		return NULL;
+	return s;
 }
 
 struct tee_ta_session *tee_ta_get_session(uint32_t id, bool exclusive,
@@ -262,6 +271,7 @@ static void tee_ta_unlink_session(struct tee_ta_session *s,
 		condvar_wait(&s->refc_cv, &tee_ta_mutex);
 
 	TAILQ_REMOVE(open_sessions, s, link);
+	handle_put(&tee_ta_session_db, s->id);
 
 	mutex_unlock(&tee_ta_mutex);
 }
@@ -392,7 +402,7 @@ infinite:
 /*-----------------------------------------------------------------------------
  * Close a Trusted Application and free available resources
  *---------------------------------------------------------------------------*/
-TEE_Result tee_ta_close_session(struct tee_ta_session *csess,
+TEE_Result tee_ta_close_session(uint32_t id,
 				struct tee_ta_session_head *open_sessions,
 				const TEE_Identity *clnt_id)
 {
@@ -400,16 +410,15 @@ TEE_Result tee_ta_close_session(struct tee_ta_session *csess,
 	struct tee_ta_ctx *ctx;
 	bool keep_alive;
 
-	DMSG("tee_ta_close_session(0x%" PRIxVA ")",  (vaddr_t)csess);
+	DMSG("tee_ta_close_session(0x%" PRIx32 ")", id);
 
-	if (!csess)
+	if (!id)
 		return TEE_ERROR_ITEM_NOT_FOUND;
 
-	sess = tee_ta_get_session((vaddr_t)csess, true, open_sessions);
+	sess = tee_ta_get_session(id, true, open_sessions);
 
 	if (!sess) {
-		EMSG("session 0x%" PRIxVA " to be removed is not found",
-		     (vaddr_t)csess);
+		EMSG("session 0x%" PRIx32 " to be removed is not found", id);
 		return TEE_ERROR_ITEM_NOT_FOUND;
 	}
 
@@ -495,6 +504,7 @@ static TEE_Result tee_ta_init_session(TEE_ErrorOrigin *err,
 	TEE_Result res;
 	struct tee_ta_ctx *ctx;
 	struct tee_ta_session *s = calloc(1, sizeof(struct tee_ta_session));
+	int id;
 
 	*err = TEE_ORIGIN_TEE;
 	if (!s)
@@ -515,6 +525,14 @@ static TEE_Result tee_ta_init_session(TEE_ErrorOrigin *err,
 
 
 	mutex_lock(&tee_ta_mutex);
+	id = handle_get(&tee_ta_session_db, s);
+	if (id < 0) {
+		mutex_unlock(&tee_ta_mutex);
+		free(s);
+		return TEE_ERROR_OUT_OF_MEMORY;
+	}
+	s->id = id;
+	s->open_sessions = open_sessions;
 	TAILQ_INSERT_TAIL(open_sessions, s, link);
 
 	/* Look for already loaded TA */
@@ -538,6 +556,7 @@ out:
 		*sess = s;
 	} else {
 		TAILQ_REMOVE(open_sessions, s, link);
+		handle_put(&tee_ta_session_db, s->id);
 		free(s);
 	}
 	mutex_unlock(&tee_ta_mutex);
@@ -571,7 +590,7 @@ TEE_Result tee_ta_open_session(TEE_ErrorOrigin *err,
 
 	if (ctx->panicked) {
 		DMSG("panicked, call tee_ta_close_session()");
-		tee_ta_close_session(s, open_sessions, KERN_IDENTITY);
+		tee_ta_close_session(s->id, open_sessions, KERN_IDENTITY);
 		*err = TEE_ORIGIN_TEE;
 		return TEE_ERROR_TARGET_DEAD;
 	}
@@ -594,7 +613,7 @@ TEE_Result tee_ta_open_session(TEE_ErrorOrigin *err,
 
 	tee_ta_put_session(s);
 	if (panicked || (res != TEE_SUCCESS))
-		tee_ta_close_session(s, open_sessions, KERN_IDENTITY);
+		tee_ta_close_session(s->id, open_sessions, KERN_IDENTITY);
 
 	/*
 	 * Origin error equal to TEE_ORIGIN_TRUSTED_APP for "regular" error,
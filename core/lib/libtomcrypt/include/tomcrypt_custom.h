@@ -199,6 +199,9 @@
 #endif
 #ifdef CFG_CRYPTO_SHA512
 #define LTC_SHA512
+#ifdef CFG_CRYPTO_SHA512_ARM64_CE
+#define LTC_SHA512_ARM64_CE
+#endif
 #endif
 
 #define LTC_NO_MACS
@@ -238,7 +241,12 @@
    #endif
 
    /* do we want fixed point ECC */
-   /* #define LTC_MECC_FP */
+   #ifdef CFG_CRYPTO_ECC_FP
+   #define LTC_MECC_FP
+   /* 2^FP_LUT points per table, one table per curve base point */
+   #define FP_LUT      6
+   #define FP_ENTRIES  5
+   #endif
 
    /* Timing Resistant */
    #define LTC_ECC_TIMING_RESISTANT
@@ -32,8 +32,41 @@
 #include <mpalib.h>
 #include "tomcrypt.h"
 
-extern mpa_scratch_mem external_mem_pool;
+/*
+ * Returns the scratch memory pool where the temporary variables of the
+ * calling thread are allocated
+ */
+typedef mpa_scratch_mem (*mpa_tomcrypt_get_pool_fn)(void);
+
+void init_mpa_tomcrypt(mpa_tomcrypt_get_pool_fn get_pool);
+
+/*
+ * Bignums for the values of keys. size is the size in bytes of the
+ * struct mpa_numbase_struct, returned zeroed. They must be released with
+ * mpa_tomcrypt_key_free().
+ */
+void *mpa_tomcrypt_key_alloc(size_t size);
+void mpa_tomcrypt_key_free(void *a);
+
+/*
+ * Same as mp_exptmod() but the Montgomery context of the modulus c, which
+ * must come from mpa_tomcrypt_key_alloc(), is computed once and kept with
+ * c until it's freed.
+ */
+int mpa_tomcrypt_exptmod_key_mod(void *a, void *b, void *c, void *d);
 
-void init_mpa_tomcrypt(mpa_scratch_mem pool);
+/*
+ * Bignums outside of the scratch memory pool, for values which outlive
+ * the operation computing them.
+ */
+int mpa_tomcrypt_init_persistent(void **a, int size_bits);
+void mpa_tomcrypt_free_persistent(void *a);
+
+/*
+ * Copies src into dest if cond is non-zero, else leaves dest unchanged,
+ * with the same memory accesses in both cases. dest must be large enough
+ * to hold src.
+ */
+void mpa_tomcrypt_cond_copy(void *dest, const void *src, int cond);
 
 #endif /* TOMCRYPT_MPA_H_ */
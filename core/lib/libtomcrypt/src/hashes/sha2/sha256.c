@@ -93,11 +93,7 @@ static const ulong32 K[64] = {
 #define Gamma1(x)       (S(x, 17) ^ S(x, 19) ^ R(x, 10))
 
 /* compress 512-bits */
-#ifdef LTC_CLEAN_STACK
 static int _sha256_compress(hash_state * md, unsigned char *buf)
-#else
-static int  sha256_compress(hash_state * md, unsigned char *buf)
-#endif
 {
     ulong32 S[8], W[64], t0, t1;
 #ifdef LTC_SMALL_CODE
@@ -216,15 +212,25 @@ static int  sha256_compress(hash_state * md, unsigned char *buf)
     return CRYPT_OK;
 }
 
-#ifdef LTC_CLEAN_STACK
-static int sha256_compress(hash_state * md, unsigned char *buf)
+/* compress a number of consecutive blocks, the stack is only burnt once */
+static int sha256_compress_nblocks(hash_state * md, unsigned char *buf, int blocks)
 {
-    int err;
-    err = _sha256_compress(md, buf);
+    int err = CRYPT_OK;
+
+    while (blocks-- > 0 && err == CRYPT_OK) {
+        err = _sha256_compress(md, buf);
+        buf += 64;
+    }
+#ifdef LTC_CLEAN_STACK
     burn_stack(sizeof(ulong32) * 74);
+#endif
     return err;
 }
-#endif
+
+static int sha256_compress(hash_state * md, unsigned char *buf)
+{
+    return sha256_compress_nblocks(md, buf, 1);
+}
 
 /**
    Initialize the hash state
@@ -255,7 +261,7 @@ int sha256_init(hash_state * md)
    @param inlen  The length of the data (octets)
    @return CRYPT_OK if successful
 */
-HASH_PROCESS(sha256_process, sha256_compress, sha256, 64)
+HASH_PROCESS_NBLOCKS(sha256_process, sha256_compress_nblocks, sha256, 64)
 
 /**
    Terminate the hash to get the digest
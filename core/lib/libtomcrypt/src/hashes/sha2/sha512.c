@@ -118,11 +118,7 @@ CONST64(0x5fcb6fab3ad6faec), CONST64(0x6c44198c4a475817)
 #define Gamma1(x)       (S(x, 19) ^ S(x, 61) ^ R(x, 6))
 
 /* compress 1024-bits */
-#ifdef LTC_CLEAN_STACK
 static int _sha512_compress(hash_state * md, unsigned char *buf)
-#else
-static int  sha512_compress(hash_state * md, unsigned char *buf)
-#endif
 {
     ulong64 S[8], W[80], t0, t1;
     int i;
@@ -184,16 +180,25 @@ static int  sha512_compress(hash_state * md, unsigned char *buf)
     return CRYPT_OK;
 }
 
-/* compress 1024-bits */
-#ifdef LTC_CLEAN_STACK
-static int sha512_compress(hash_state * md, unsigned char *buf)
+/* compress a number of consecutive blocks, the stack is only burnt once */
+static int sha512_compress_nblocks(hash_state * md, unsigned char *buf, int blocks)
 {
-    int err;
-    err = _sha512_compress(md, buf);
+    int err = CRYPT_OK;
+
+    while (blocks-- > 0 && err == CRYPT_OK) {
+        err = _sha512_compress(md, buf);
+        buf += 128;
+    }
+#ifdef LTC_CLEAN_STACK
     burn_stack(sizeof(ulong64) * 90 + sizeof(int));
+#endif
     return err;
 }
-#endif
+
+static int sha512_compress(hash_state * md, unsigned char *buf)
+{
+    return sha512_compress_nblocks(md, buf, 1);
+}
 
 /**
    Initialize the hash state
@@ -223,7 +228,7 @@ int sha512_init(hash_state * md)
    @param inlen  The length of the data (octets)
    @return CRYPT_OK if successful
 */
-HASH_PROCESS(sha512_process, sha512_compress, sha512, 128)
+HASH_PROCESS_NBLOCKS(sha512_process, sha512_compress_nblocks, sha512, 128)
 
 /**
    Terminate the hash to get the digest
@@ -14,4 +14,11 @@ endif
 endif
 
 srcs-$(CFG_CRYPTO_SHA384) += sha384.c
-srcs-$(CFG_CRYPTO_SHA512) += sha512.c
+ifeq ($(CFG_CRYPTO_SHA512),y)
+ifeq ($(CFG_CRYPTO_SHA512_ARM64_CE),y)
+srcs-y += sha512_armv8a_ce.c
+srcs-y += sha512_armv8a_ce_a64.S
+else
+srcs-y += sha512.c
+endif
+endif
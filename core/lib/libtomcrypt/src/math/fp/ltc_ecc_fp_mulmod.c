@@ -37,6 +37,7 @@
  * Tom St Denis, tomstdenis@gmail.com, http://libtom.org
  */
 #include "tomcrypt.h"
+#include "tomcrypt_mpa.h"
 
 /**
   @file ltc_ecc_fp_mulmod.c
@@ -44,7 +45,6 @@
 */  
 
 #if defined(LTC_MECC) && defined(LTC_MECC_FP)
-#include <limits.h>
 
 /* number of entries in the cache */
 #ifndef FP_ENTRIES
@@ -60,13 +60,19 @@
    #error FP_LUT must be between 2 and 12 inclusively
 #endif   
 
-/** Our FP cache */
+/** Our FP cache
+ *
+ * Entries are built with the lock held and never evicted, so they are
+ * used without holding the lock once looked up. The coordinates are
+ * allocated with mpa_tomcrypt_init_persistent() since they outlive the
+ * operation which computed them.
+ */
 static struct {
    ecc_point *g,              /* cached COPY of base point */
-             *LUT[1U<<FP_LUT]; /* fixed point lookup */ 
+             *LUT[1U<<FP_LUT], /* fixed point lookup */ 
+             *adj;            /* -(2^(bitlen-1))*g, see accel_fp_mul() */
+   void      *modulus;        /* copy of the modulus of the curve */
    void      *mu;             /* copy of the montgomery constant */
-   int        lru_count;      /* amount of times this entry has been used */
-   int        lock;           /* flag to indicate cache eviction permitted (0) or not (1) */
 } fp_cache[FP_ENTRIES];
 
 LTC_MUTEX_GLOBAL(ltc_ecc_fp_lock)
@@ -601,51 +607,103 @@ static const struct {
 #endif
 };
 
-/* find a hole and free as required, return -1 if no hole found */
-static int find_hole(void)
+/* number of bits of the scalar, one more than the size of the modulus rounded up to a multiple of FP_LUT */
+static unsigned fp_bitlen(void *modulus)
 {
-   unsigned x;
-   int      y, z;
-   for (z = -1, y = INT_MAX, x = 0; x < FP_ENTRIES; x++) {
-       if (fp_cache[x].lru_count < y && fp_cache[x].lock == 0) {
-          z = x;
-          y = fp_cache[x].lru_count;
-       }
+   unsigned bitlen, x;
+
+   bitlen  = (mp_unsigned_bin_size(modulus) << 3) + 1;
+   x       = bitlen % FP_LUT;
+   if (x) {
+      bitlen += FP_LUT - x;
    }
+   return bitlen;
+}
 
-   /* decrease all */
-   for (x = 0; x < FP_ENTRIES; x++) {
-      if (fp_cache[x].lru_count > 3) {
-         --(fp_cache[x].lru_count);
-      }
+static void fp_del_point(ecc_point *p)
+{
+   if (p != NULL) {
+      mpa_tomcrypt_free_persistent(p->x);
+      mpa_tomcrypt_free_persistent(p->y);
+      mpa_tomcrypt_free_persistent(p->z);
+      XFREE(p);
    }
+}
 
-   /* free entry z */
-   if (z >= 0 && fp_cache[z].g) {
-      if (fp_cache[z].mu != NULL) {
-         mp_clear(fp_cache[z].mu);
-         fp_cache[z].mu = NULL;
-      }
-      ltc_ecc_del_point(fp_cache[z].g);
-      fp_cache[z].g  = NULL;
-      for (x = 0; x < (1U<<FP_LUT); x++) {
-         ltc_ecc_del_point(fp_cache[z].LUT[x]);
-         fp_cache[z].LUT[x] = NULL;
+static ecc_point *fp_new_point(int size_bits)
+{
+   ecc_point *p;
+
+   p = XCALLOC(1, sizeof(*p));
+   if (p == NULL) {
+      return NULL;
+   }
+   if ((mpa_tomcrypt_init_persistent(&p->x, size_bits) != CRYPT_OK) ||
+       (mpa_tomcrypt_init_persistent(&p->y, size_bits) != CRYPT_OK) ||
+       (mpa_tomcrypt_init_persistent(&p->z, size_bits) != CRYPT_OK)) {
+      fp_del_point(p);
+      return NULL;
+   }
+   return p;
+}
+
+/* replace a value by a copy held in size_bits */
+static int fp_shrink(void **a, int size_bits)
+{
+   void *t;
+   int   err;
+
+   if ((err = mpa_tomcrypt_init_persistent(&t, size_bits)) != CRYPT_OK) {
+      return err;
+   }
+   mp_copy(*a, t);
+   mpa_tomcrypt_free_persistent(*a);
+   *a = t;
+   return CRYPT_OK;
+}
+
+/* release entry idx, must be called with the cache mutex locked */
+static void fp_free_entry(int idx)
+{
+   unsigned x;
+
+   for (x = 0; x < (1U<<FP_LUT); x++) {
+      fp_del_point(fp_cache[idx].LUT[x]);
+      fp_cache[idx].LUT[x] = NULL;
+   }
+   fp_del_point(fp_cache[idx].adj);
+   fp_cache[idx].adj = NULL;
+   fp_del_point(fp_cache[idx].g);
+   fp_cache[idx].g = NULL;
+   mpa_tomcrypt_free_persistent(fp_cache[idx].modulus);
+   fp_cache[idx].modulus = NULL;
+   mpa_tomcrypt_free_persistent(fp_cache[idx].mu);
+   fp_cache[idx].mu = NULL;
+}
+
+/* find a free entry, return -1 if the cache is full */
+static int find_hole(void)
+{
+   int x;
+
+   for (x = 0; x < FP_ENTRIES; x++) {
+      if (fp_cache[x].g == NULL) {
+         return x;
       }
-      fp_cache[z].lru_count = 0;
    }
-   return z;
+   return -1;
 }
 
 /* determine if a base is already in the cache and if so, where */
-static int find_base(ecc_point *g)
+static int find_base(ecc_point *g, void *modulus)
 {
    int x;
    for (x = 0; x < FP_ENTRIES; x++) {
       if (fp_cache[x].g != NULL && 
           mp_cmp(fp_cache[x].g->x, g->x) == LTC_MP_EQ && 
           mp_cmp(fp_cache[x].g->y, g->y) == LTC_MP_EQ && 
-          mp_cmp(fp_cache[x].g->z, g->z) == LTC_MP_EQ) {
+          mp_cmp(fp_cache[x].g->z, g->z) == LTC_MP_EQ &&
+          mp_cmp(fp_cache[x].modulus, modulus) == LTC_MP_EQ) {
          break;
       }
    }
@@ -655,44 +713,90 @@ static int find_base(ecc_point *g)
    return x;
 }
 
-/* add a new base to the cache */
-static int add_entry(int idx, ecc_point *g)
+/* determine if g is the base point of one of the curves in ltc_ecc_sets */
+static int is_curve_base(ecc_point *g, void *modulus)
 {
-   unsigned x, y;
+   void *t;
+   int   x, ret;
 
-   /* allocate base and LUT */
-   fp_cache[idx].g = ltc_ecc_new_point();
-   if (fp_cache[idx].g == NULL) {
-      return CRYPT_MEM;
+   if (mp_cmp_d(g->z, 1) != LTC_MP_EQ) {
+      return 0;
+   }
+   if (mp_init(&t) != CRYPT_OK) {
+      return 0;
+   }
+   ret = 0;
+   for (x = 0; ltc_ecc_sets[x].size; x++) {
+      if (ltc_ecc_sets[x].size != (int)mp_unsigned_bin_size(modulus)) {
+         continue;
+      }
+      if ((mp_read_radix(t, ltc_ecc_sets[x].prime, 16) != CRYPT_OK) ||
+          (mp_cmp(t, modulus) != LTC_MP_EQ) ||
+          (mp_read_radix(t, ltc_ecc_sets[x].Gx, 16) != CRYPT_OK) ||
+          (mp_cmp(t, g->x) != LTC_MP_EQ) ||
+          (mp_read_radix(t, ltc_ecc_sets[x].Gy, 16) != CRYPT_OK) ||
+          (mp_cmp(t, g->y) != LTC_MP_EQ)) {
+         continue;
+      }
+      ret = 1;
+      break;
    }
+   mp_clear(t);
+   return ret;
+}
 
-   /* copy x and y */
-   if ((mp_copy(g->x, fp_cache[idx].g->x) != CRYPT_OK) ||
-       (mp_copy(g->y, fp_cache[idx].g->y) != CRYPT_OK) ||
-       (mp_copy(g->z, fp_cache[idx].g->z) != CRYPT_OK)) {
-      ltc_ecc_del_point(fp_cache[idx].g);
-      fp_cache[idx].g = NULL;
+/* add a new base to the cache */
+static int add_entry(int idx, ecc_point *g, void *modulus)
+{
+   int size_bits;
+
+   size_bits = mp_count_bits(modulus);
+   fp_cache[idx].g = fp_new_point(size_bits);
+   if ((fp_cache[idx].g == NULL) ||
+       (mpa_tomcrypt_init_persistent(&fp_cache[idx].modulus, size_bits) != CRYPT_OK) ||
+       (mpa_tomcrypt_init_persistent(&fp_cache[idx].mu, size_bits) != CRYPT_OK)) {
+      fp_free_entry(idx);
       return CRYPT_MEM;
-   }              
-
-   for (x = 0; x < (1U<<FP_LUT); x++) {
-      fp_cache[idx].LUT[x] = ltc_ecc_new_point();
-      if (fp_cache[idx].LUT[x] == NULL) {
-         for (y = 0; y < x; y++) {
-            ltc_ecc_del_point(fp_cache[idx].LUT[y]);
-            fp_cache[idx].LUT[y] = NULL;
-         }
-         ltc_ecc_del_point(fp_cache[idx].g);
-         fp_cache[idx].g         = NULL;
-         fp_cache[idx].lru_count = 0;
-         return CRYPT_MEM;
-      }
    }
-   
-   fp_cache[idx].lru_count = 0;
+
+   /* copy x, y, z and the modulus */
+   mp_copy(g->x, fp_cache[idx].g->x);
+   mp_copy(g->y, fp_cache[idx].g->y);
+   mp_copy(g->z, fp_cache[idx].g->z);
+   mp_copy(modulus, fp_cache[idx].modulus);
    return CRYPT_OK;
 }
 
+/* map a point of the LUT to affine space and drop its z, keeping x and y in size_bits */
+static int fp_map_point(ecc_point *P, void *tmp, void *modulus, void *mp, int size_bits)
+{
+   int err;
+
+   /* convert z to normal from montgomery */
+   if ((err = mp_montgomery_reduce(P->z, modulus, mp)) != CRYPT_OK)                                       { return err; }
+
+   /* invert it */
+   if ((err = mp_invmod(P->z, modulus, P->z)) != CRYPT_OK)                                                { return err; }
+
+   /* now square it */
+   if ((err = mp_sqrmod(P->z, modulus, tmp)) != CRYPT_OK)                                                 { return err; }
+
+   /* fix x */
+   if ((err = mp_mulmod(P->x, tmp, modulus, P->x)) != CRYPT_OK)                                           { return err; }
+
+   /* get 1/z^3 */
+   if ((err = mp_mulmod(tmp, P->z, modulus, tmp)) != CRYPT_OK)                                            { return err; }
+
+   /* fix y */
+   if ((err = mp_mulmod(P->y, tmp, modulus, P->y)) != CRYPT_OK)                                           { return err; }
+
+   /* free z, shrink x and y to the size of the modulus */
+   mpa_tomcrypt_free_persistent(P->z);
+   P->z = NULL;
+   if ((err = fp_shrink(&P->x, size_bits)) != CRYPT_OK)                                                   { return err; }
+   return fp_shrink(&P->y, size_bits);
+}
+
 /* build the LUT by spacing the bits of the input by #modulus/FP_LUT bits apart 
  * 
  * The algorithm builds patterns in increasing bit order by first making all 
@@ -700,7 +804,8 @@ static int add_entry(int idx, ecc_point *g)
  */
 static int build_lut(int idx, void *modulus, void *mp, void *mu)
 { 
-   unsigned x, y, err, bitlen, lut_gap;
+   unsigned x, y, bitlen, lut_gap;
+   int      err, size_bits;
    void    *tmp;
 
    tmp = NULL;
@@ -711,18 +816,21 @@ static int build_lut(int idx, void *modulus, void *mp, void *mu)
        goto DONE;
    }       
 
-   /* get bitlen and round up to next multiple of FP_LUT */
-   bitlen  = mp_unsigned_bin_size(modulus) << 3;
-   x       = bitlen % FP_LUT;
-   if (x) {
-      bitlen += FP_LUT - x;
-   }  
+   bitlen  = fp_bitlen(modulus);
    lut_gap = bitlen / FP_LUT;
 
-   /* init the mu */
-   if ((err = mp_init_copy(&fp_cache[idx].mu, mu)) != CRYPT_OK) {
-      goto ERR;
+   /*
+    * The point operations store unreduced products in their result, the
+    * points are only shrunk to the size of the modulus once mapped.
+    */
+   size_bits = mp_count_bits(modulus);
+   for (x = 0; x < (1U<<FP_LUT); x++) {
+      if ((fp_cache[idx].LUT[x] = fp_new_point(2 * size_bits + 64)) == NULL) { goto ERR; }
    }
+   if ((fp_cache[idx].adj = fp_new_point(2 * size_bits + 64)) == NULL)      { goto ERR; }
+
+   /* copy the mu */
+   mp_copy(mu, fp_cache[idx].mu);
    
    /* copy base */
    if ((mp_mulmod(fp_cache[idx].g->x, mu, modulus, fp_cache[idx].LUT[1]->x) != CRYPT_OK) || 
@@ -742,6 +850,16 @@ static int build_lut(int idx, void *modulus, void *mp, void *mu)
           }
       }          
    }
+
+   /* adj is the highest single bit entry doubled up to 2^(bitlen-1)*g, negated once mapped */
+   if ((mp_copy(fp_cache[idx].LUT[1<<(FP_LUT-1)]->x, fp_cache[idx].adj->x) != CRYPT_OK) ||
+       (mp_copy(fp_cache[idx].LUT[1<<(FP_LUT-1)]->y, fp_cache[idx].adj->y) != CRYPT_OK) ||
+       (mp_copy(fp_cache[idx].LUT[1<<(FP_LUT-1)]->z, fp_cache[idx].adj->z) != CRYPT_OK))         { goto ERR; }
+   for (y = 1; y < lut_gap; y++) {
+      if ((err = ltc_mp.ecc_ptdbl(fp_cache[idx].adj, fp_cache[idx].adj, modulus, mp)) != CRYPT_OK) {
+         goto ERR;
+      }
+   }
       
    /* now make all entries in increase order of hamming weight */
    for (x = 2; x <= FP_LUT; x++) {
@@ -758,59 +876,125 @@ static int build_lut(int idx, void *modulus, void *mp, void *mu)
       
    /* now map all entries back to affine space to make point addition faster */
    if ((err = mp_init(&tmp)) != CRYPT_OK)                                                                    { goto ERR; }
-   for (x = 1; x < (1UL<<FP_LUT); x++) {
-       /* convert z to normal from montgomery */
-       if ((err = mp_montgomery_reduce(fp_cache[idx].LUT[x]->z, modulus, mp)) != CRYPT_OK)                   { goto ERR; }
- 
-       /* invert it */
-       if ((err = mp_invmod(fp_cache[idx].LUT[x]->z, modulus, fp_cache[idx].LUT[x]->z)) != CRYPT_OK)         { goto ERR; }
-
-       /* now square it */
-       if ((err = mp_sqrmod(fp_cache[idx].LUT[x]->z, modulus, tmp)) != CRYPT_OK)                             { goto ERR; }
-       
-       /* fix x */
-       if ((err = mp_mulmod(fp_cache[idx].LUT[x]->x, tmp, modulus, fp_cache[idx].LUT[x]->x)) != CRYPT_OK)    { goto ERR; }
-
-       /* get 1/z^3 */
-       if ((err = mp_mulmod(tmp, fp_cache[idx].LUT[x]->z, modulus, tmp)) != CRYPT_OK)                        { goto ERR; }
-
-       /* fix y */
-       if ((err = mp_mulmod(fp_cache[idx].LUT[x]->y, tmp, modulus, fp_cache[idx].LUT[x]->y)) != CRYPT_OK)    { goto ERR; }
-
-       /* free z */
-       mp_clear(fp_cache[idx].LUT[x]->z);
-       fp_cache[idx].LUT[x]->z = NULL;
+   for (x = 0; x < (1UL<<FP_LUT); x++) {
+       /* LUT[0] is never used as such but read by the masked lookup, keep it small */
+       if (x == 0) {
+          mpa_tomcrypt_free_persistent(fp_cache[idx].LUT[0]->z);
+          fp_cache[idx].LUT[0]->z = NULL;
+          if ((fp_shrink(&fp_cache[idx].LUT[0]->x, size_bits) != CRYPT_OK) ||
+              (fp_shrink(&fp_cache[idx].LUT[0]->y, size_bits) != CRYPT_OK))                                  { goto ERR; }
+          continue;
+       }
+       if ((err = fp_map_point(fp_cache[idx].LUT[x], tmp, modulus, mp, size_bits)) != CRYPT_OK)             { goto ERR; }
    }
+   if ((err = fp_map_point(fp_cache[idx].adj, tmp, modulus, mp, size_bits)) != CRYPT_OK)                   { goto ERR; }
+   if ((err = mp_sub(modulus, fp_cache[idx].adj->y, fp_cache[idx].adj->y)) != CRYPT_OK)                    { goto ERR; }
    mp_clear(tmp);
 
    return CRYPT_OK;                                                                       
 ERR:
    err = CRYPT_MEM;
 DONE:   
-   for (y = 0; y < (1U<<FP_LUT); y++) {
-      ltc_ecc_del_point(fp_cache[idx].LUT[y]);
-      fp_cache[idx].LUT[y] = NULL;
-   }
-   ltc_ecc_del_point(fp_cache[idx].g);
-   fp_cache[idx].g         = NULL;
-   fp_cache[idx].lru_count = 0;
-   if (fp_cache[idx].mu != NULL) {
-      mp_clear(fp_cache[idx].mu);
-      fp_cache[idx].mu = NULL;
-   }
+   fp_free_entry(idx);
    if (tmp != NULL) {
       mp_clear(tmp);
    }
    return err;
 }
 
-/* perform a fixed point ECC mulmod */
+/* add g to the cache and build its LUT, must be called with the cache mutex locked */
+static int fp_new_entry(ecc_point *g, void *modulus, int *idx)
+{
+   void *mp, *mu;
+   int   err;
+
+   mp = NULL;
+   mu = NULL;
+   if ((*idx = find_hole()) < 0) {
+      return CRYPT_BUFFER_OVERFLOW;
+   }
+   if ((err = add_entry(*idx, g, modulus)) != CRYPT_OK) {
+      goto LBL_ERR;
+   }
+
+   /* compute mp */
+   if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) {
+      goto LBL_ERR;
+   }
+
+   /* compute mu */
+   if ((err = mp_init(&mu)) != CRYPT_OK) {
+      goto LBL_ERR;
+   }
+   if ((err = mp_montgomery_normalization(mu, modulus)) != CRYPT_OK) {
+      goto LBL_ERR;
+   }
+
+   /* build the LUT, the entry is released on failure */
+   err = build_lut(*idx, modulus, mp, mu);
+   mp_montgomery_free(mp);
+   mp_clear(mu);
+   if (err != CRYPT_OK) {
+      *idx = -1;
+   }
+   return err;
+LBL_ERR:
+   fp_free_entry(*idx);
+   *idx = -1;
+   if (mp != NULL) {
+      mp_montgomery_free(mp);
+   }
+   if (mu != NULL) {
+      mp_clear(mu);
+   }
+   return err;
+}
+
+/*
+ * Find the entry of g, building it at first use if g is the base point of
+ * a curve in ltc_ecc_sets. Other points aren't cached, they are typically
+ * used once or twice like the public key of a peer. Returns -1 if g has no
+ * entry.
+ */
+static int fp_lookup(ecc_point *g, void *modulus)
+{
+   int idx;
+
+   LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
+   idx = find_base(g, modulus);
+   if (idx == -1 && is_curve_base(g, modulus)) {
+      fp_new_entry(g, modulus, &idx);
+   }
+   LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
+   return idx;
+}
+
+/* copy LUT[sel] of entry idx to the affine point S, reading all the entries */
+static void fp_select(int idx, unsigned sel, ecc_point *S)
+{
+   unsigned x;
+
+   for (x = 0; x < (1U<<FP_LUT); x++) {
+      mpa_tomcrypt_cond_copy(S->x, fp_cache[idx].LUT[x]->x, x == sel);
+      mpa_tomcrypt_cond_copy(S->y, fp_cache[idx].LUT[x]->y, x == sel);
+   }
+}
+
+/* perform a fixed point ECC mulmod
+ *
+ * The scalar is secret when signing, so the sequence of point operations
+ * doesn't depend on it: the top bit of the scalar is set, the bit
+ * patterns are read with a masked lookup and the sum for a pattern of
+ * zero is computed but discarded. The top bit is removed in the end by
+ * adding adj.
+ */
 static int accel_fp_mul(int idx, void *k, ecc_point *R, void *modulus, void *mp, int map)
 {
    unsigned char kb[128];
-   int      x;
-   unsigned y, z, err, bitlen, bitpos, lut_gap, first;
+   int      x, err;
+   unsigned y, z, sel, bitlen, bitpos, lut_gap;
    void     *tk, *order;
+   ecc_point *S, *T;
 
    /* if it's smaller than modulus we fine */
    if (mp_unsigned_bin_size(k) > mp_unsigned_bin_size(modulus)) {
@@ -850,12 +1034,7 @@ static int accel_fp_mul(int idx, void *k, ecc_point *R, void *modulus, void *mp,
        tk = k;
    }       
    
-   /* get bitlen and round up to next multiple of FP_LUT */
-   bitlen  = mp_unsigned_bin_size(modulus) << 3;
-   x       = bitlen % FP_LUT;
-   if (x) {
-      bitlen += FP_LUT - x;
-   }  
+   bitlen  = fp_bitlen(modulus);
    lut_gap = bitlen / FP_LUT;
         
    /* get the k value */
@@ -885,9 +1064,21 @@ static int accel_fp_mul(int idx, void *k, ecc_point *R, void *modulus, void *mp,
       z = kb[x]; kb[x] = kb[y]; kb[y] = z;
       ++x; --y;
    }      
+
+   /* k is shorter than bitlen - 1 bits, setting the top bit adds 2^(bitlen-1) */
+   kb[(bitlen - 1) >> 3] |= 1 << ((bitlen - 1) & 7);
+
+   /* S is affine, its z is dropped */
+   S = ltc_ecc_new_point();
+   T = ltc_ecc_new_point();
+   if (S == NULL || T == NULL) {
+      err = CRYPT_MEM;
+      goto done;
+   }
+   mp_clear(S->z);
+   S->z = NULL;
    
    /* at this point we can start, yipee */
-   first = 1;
    for (x = lut_gap-1; x >= 0; x--) {
        /* extract FP_LUT bits from kb spread out by lut_gap bits and offset by x bits from the start */
        bitpos = x;
@@ -895,34 +1086,51 @@ static int accel_fp_mul(int idx, void *k, ecc_point *R, void *modulus, void *mp,
           z |= ((kb[bitpos>>3] >> (bitpos&7)) & 1) << y;
           bitpos += lut_gap;                               /* it's y*lut_gap + x, but here we can avoid the mult in each loop */
        }
-              
-       /* double if not first */
-       if (!first) {
-          if ((err = ltc_mp.ecc_ptdbl(R, R, modulus, mp)) != CRYPT_OK) {
-             return err;
-          }
+
+       /* read LUT[1] instead of LUT[0] for a zero pattern */
+       sel = z | ((z - 1) >> (sizeof(z) * 8 - 1));
+       fp_select(idx, sel, S);
+
+       /* the first pattern has the top bit set, copy it */
+       if ((unsigned)x == lut_gap - 1) {
+          if ((mp_copy(S->x, R->x) != CRYPT_OK) || 
+              (mp_copy(S->y, R->y) != CRYPT_OK) || 
+              (mp_copy(fp_cache[idx].mu, R->z) != CRYPT_OK)) { err = CRYPT_MEM; goto done; }
+          continue;
        }
-       
-       /* add if not first, otherwise copy */          
-       if (!first && z) {
-          if ((err = ltc_mp.ecc_ptadd(R, fp_cache[idx].LUT[z], R, modulus, mp)) != CRYPT_OK) {
-             return err;
-          }
-       } else if (z) {
-          if ((mp_copy(fp_cache[idx].LUT[z]->x, R->x) != CRYPT_OK) || 
-              (mp_copy(fp_cache[idx].LUT[z]->y, R->y) != CRYPT_OK) || 
-              (mp_copy(fp_cache[idx].mu,        R->z) != CRYPT_OK)) { return CRYPT_MEM; }
-              first = 0;              
+
+       if ((err = ltc_mp.ecc_ptdbl(R, R, modulus, mp)) != CRYPT_OK) {
+          goto done;
+       }
+       if ((err = ltc_mp.ecc_ptadd(R, S, T, modulus, mp)) != CRYPT_OK) {
+          goto done;
        }
+       mpa_tomcrypt_cond_copy(R->x, T->x, z != 0);
+       mpa_tomcrypt_cond_copy(R->y, T->y, z != 0);
+       mpa_tomcrypt_cond_copy(R->z, T->z, z != 0);
    }     
-   z = 0;
-   zeromem(kb, sizeof(kb));
+
+   /* remove the top bit */
+   if ((err = ltc_mp.ecc_ptadd(R, fp_cache[idx].adj, R, modulus, mp)) != CRYPT_OK) {
+      goto done;
+   }
+
    /* map R back from projective space */
    if (map) {
       err = ltc_ecc_map(R, modulus, mp);
    } else {
       err = CRYPT_OK;
    }
+done:
+   z = 0;
+   sel = 0;
+   zeromem(kb, sizeof(kb));
+   if (S != NULL) {
+      ltc_ecc_del_point(S);
+   }
+   if (T != NULL) {
+      ltc_ecc_del_point(T);
+   }
    return err;
 }
 
@@ -1013,12 +1221,7 @@ static int accel_fp_mul2add(int idx1, int idx2,
       tkb = kB;
    }     
 
-   /* get bitlen and round up to next multiple of FP_LUT */
-   bitlen  = mp_unsigned_bin_size(modulus) << 3;
-   x       = bitlen % FP_LUT;
-   if (x) {
-      bitlen += FP_LUT - x;
-   }  
+   bitlen  = fp_bitlen(modulus);
    lut_gap = bitlen / FP_LUT;
         
    /* get the k value */
@@ -1143,104 +1346,22 @@ int ltc_ecc_fp_mul2add(ecc_point *A, void *kA,
                        ecc_point *C, void *modulus)
 {
    int  idx1, idx2, err;
-   void *mp, *mu;
-   
-   mp = NULL;
-   mu = NULL;
-   LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
-      /* find point */
-      idx1 = find_base(A);
-
-      /* no entry? */
-      if (idx1 == -1) {
-         /* find hole and add it */
-         if ((idx1 = find_hole()) >= 0) {
-            if ((err = add_entry(idx1, A)) != CRYPT_OK) {
-               goto LBL_ERR;
-            }
-         }
-      }
-      if (idx1 != -1) {
-         /* increment LRU */
-         ++(fp_cache[idx1].lru_count);
-      }
-
-      /* find point */
-      idx2 = find_base(B);
-
-      /* no entry? */
-      if (idx2 == -1) {
-         /* find hole and add it */
-         if ((idx2 = find_hole()) >= 0) {
-            if ((err = add_entry(idx2, B)) != CRYPT_OK) {
-               goto LBL_ERR;
-            }
-         }
-      }
-      if (idx2 != -1) {
-         /* increment LRU */
-         ++(fp_cache[idx2].lru_count);
-      }
-
-      /* if it's 2 build the LUT, if it's higher just use the LUT */
-      if (idx1 >= 0 && fp_cache[idx1].lru_count == 2) {
-         /* compute mp */
-         if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) { goto LBL_ERR; }
-
-         /* compute mu */
-         if ((err = mp_init(&mu)) != CRYPT_OK) {
-             goto LBL_ERR;
-         }
-         if ((err = mp_montgomery_normalization(mu, modulus)) != CRYPT_OK) {
-            goto LBL_ERR;
-         }            
-                 
-         /* build the LUT */
-         if ((err = build_lut(idx1, modulus, mp, mu)) != CRYPT_OK) {
-             goto LBL_ERR;;
-         }  
-      }
-
-      /* if it's 2 build the LUT, if it's higher just use the LUT */
-      if (idx2 >= 0 && fp_cache[idx2].lru_count == 2) {
-         if (mp == NULL) {
-            /* compute mp */
-            if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) { goto LBL_ERR; }
-
-            /* compute mu */
-            if ((err = mp_init(&mu)) != CRYPT_OK) {
-                goto LBL_ERR;
-            }
-            if ((err = mp_montgomery_normalization(mu, modulus)) != CRYPT_OK) {
-               goto LBL_ERR;
-            }            
-         }
-                 
-         /* build the LUT */
-         if ((err = build_lut(idx2, modulus, mp, mu)) != CRYPT_OK) {
-             goto LBL_ERR;;
-         }  
-      }
+   void *mp;
 
+   /* the tables are only used when both points have one */
+   idx1 = fp_lookup(A, modulus);
+   idx2 = fp_lookup(B, modulus);
+   if (idx1 < 0 || idx2 < 0) {
+      return ltc_ecc_mul2add(A, kA, B, kB, C, modulus);
+   }
 
-      if (idx1 >=0 && idx2 >= 0 && fp_cache[idx1].lru_count >= 2 && fp_cache[idx2].lru_count >= 2) {
-         if (mp == NULL) {
-            /* compute mp */
-            if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) { goto LBL_ERR; }
-         }
-         err = accel_fp_mul2add(idx1, idx2, kA, kB, C, modulus, mp);
-      } else {
-         err = ltc_ecc_mul2add(A, kA, B, kB, C, modulus);
-      }
-LBL_ERR:
-    LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
-    if (mp != NULL) {
-       mp_montgomery_free(mp);
-    }       
-    if (mu != NULL) {
-       mp_clear(mu);
-    }       
-    return err;
+   /* compute mp */
+   if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) {
+      return err;
+   }
+   err = accel_fp_mul2add(idx1, idx2, kA, kB, C, modulus, mp);
+   mp_montgomery_free(mp);
+   return err;
 }
 #endif
 
@@ -1255,93 +1376,33 @@ LBL_ERR:
 int ltc_ecc_fp_mulmod(void *k, ecc_point *G, ecc_point *R, void *modulus, int map)
 {
    int   idx, err;
-   void *mp, *mu;
-   
-   mp = NULL;
-   mu = NULL;
-   LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
-      /* find point */
-      idx = find_base(G);
-
-      /* no entry? */
-      if (idx == -1) {
-         /* find hole and add it */
-         idx = find_hole();
-
-         if (idx >= 0) {
-            if ((err = add_entry(idx, G)) != CRYPT_OK) {
-               goto LBL_ERR;
-            }
-         }
-      }
-      if (idx != -1) {
-         /* increment LRU */
-         ++(fp_cache[idx].lru_count);
-      }
+   void *mp;
 
- 
-      /* if it's 2 build the LUT, if it's higher just use the LUT */
-      if (idx >= 0 && fp_cache[idx].lru_count == 2) {
-         /* compute mp */
-         if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) { goto LBL_ERR; }
-
-         /* compute mu */
-         if ((err = mp_init(&mu)) != CRYPT_OK) {
-             goto LBL_ERR;
-         }
-         if ((err = mp_montgomery_normalization(mu, modulus)) != CRYPT_OK) {
-            goto LBL_ERR;
-         }            
-                 
-         /* build the LUT */
-         if ((err = build_lut(idx, modulus, mp, mu)) != CRYPT_OK) {
-             goto LBL_ERR;;
-         }  
-      }
+   idx = fp_lookup(G, modulus);
+   if (idx < 0) {
+      return ltc_ecc_mulmod(k, G, R, modulus, map);
+   }
 
-      if (idx >= 0 && fp_cache[idx].lru_count >= 2) {
-         if (mp == NULL) {
-            /* compute mp */
-            if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) { goto LBL_ERR; }
-         }
-         err = accel_fp_mul(idx, k, R, modulus, mp, map);
-      } else {
-         err = ltc_ecc_mulmod(k, G, R, modulus, map);
-      }
-LBL_ERR:
-    LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
-    if (mp != NULL) {
-       mp_montgomery_free(mp);
-    }       
-    if (mu != NULL) {
-       mp_clear(mu);
-    }       
-    return err;
+   /* compute mp */
+   if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) {
+      return err;
+   }
+   err = accel_fp_mul(idx, k, R, modulus, mp, map);
+   mp_montgomery_free(mp);
+   return err;
 }
 
 /* helper function for freeing the cache ... must be called with the cache mutex locked */
 static void ltc_ecc_fp_free_cache(void)
 {
-   unsigned x, y;
+   int x;
+
    for (x = 0; x < FP_ENTRIES; x++) {
-      if (fp_cache[x].g != NULL) {
-         for (y = 0; y < (1U<<FP_LUT); y++) {
-            ltc_ecc_del_point(fp_cache[x].LUT[y]);
-            fp_cache[x].LUT[y] = NULL;
-         }
-         ltc_ecc_del_point(fp_cache[x].g);
-         fp_cache[x].g         = NULL;
-         if (fp_cache[x].mu != NULL) {
-            mp_clear(fp_cache[x].mu);
-            fp_cache[x].mu     = NULL;
-         }
-         fp_cache[x].lru_count = 0;
-         fp_cache[x].lock = 0;
-      }         
+      fp_free_entry(x);
    }
 }         
 
-/** Free the Fixed Point cache */
+/** Free the Fixed Point cache, no operation may be using it */
 void ltc_ecc_fp_free(void)
 {
    LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
@@ -1352,7 +1413,7 @@ void ltc_ecc_fp_free(void)
 /** Add a point to the cache and initialize the LUT
   @param g        The point to add
   @param modulus  Modulus for curve 
-  @param lock     Flag to indicate if this entry should be locked into the cache or not
+  @param lock     Ignored, entries are never evicted
   @return CRYPT_OK on success
 */
 int
@@ -1360,250 +1421,53 @@ ltc_ecc_fp_add_point(ecc_point *g, void *modulus, int lock)
 {
    int idx;
    int err;
-   void *mp = NULL;
-   void *mu = NULL;
 
-   LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
-   if ((idx = find_base(g)) >= 0) {
-      /* it is already in the cache ... just check that the LUT is initialized */
-      if(fp_cache[idx].lru_count >= 2) {
-         LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
-         return CRYPT_OK;
-      }
-   }
+   LTC_UNUSED_PARAM(lock);
 
-   if(idx == -1 && (idx = find_hole()) == -1) {
-      err = CRYPT_BUFFER_OVERFLOW;
-      goto LBL_ERR;
-   }
-   if ((err = add_entry(idx, g)) != CRYPT_OK) {
-      goto LBL_ERR;
-   }
-   /* compute mp */
-   if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) {
-      goto LBL_ERR;
-   }
-
-   /* compute mu */
-   if ((err = mp_init(&mu)) != CRYPT_OK) {
-       goto LBL_ERR;
+   LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
+   if (find_base(g, modulus) >= 0) {
+      err = CRYPT_OK;
+   } else {
+      err = fp_new_entry(g, modulus, &idx);
    }
-   if ((err = mp_montgomery_normalization(mu, modulus)) != CRYPT_OK) {
-      goto LBL_ERR;
-   }            
-	   
-   /* build the LUT */
-   if ((err = build_lut(idx, modulus, mp, mu)) != CRYPT_OK) {
-       goto LBL_ERR;
-   }  
-   fp_cache[idx].lru_count = 2;
-   fp_cache[idx].lock = lock;
-LBL_ERR:
    LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
-   if (mp != NULL) {
-      mp_montgomery_free(mp);
-   }       
-   if (mu != NULL) {
-      mp_clear(mu);
-   }       
    return err;
 }
 
 /** Prevent/permit the FP cache from being updated 
-    @param flag        If flag is 0, remove cache lock (unlock), otherwise lock it
+    @param flag        Ignored, entries are never evicted
 */
 void ltc_ecc_fp_tablelock(int lock)
 {
-   int i;
-
-   LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
-   for (i = 0; i < FP_ENTRIES; i++) {
-      fp_cache[i].lock = lock;
-   }
-   LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
+   LTC_UNUSED_PARAM(lock);
 }
 
 /** Export the current cache as a binary packet
+    Not supported, the tables are rebuilt at first use
     @param out      [out] pointer to malloc'ed space containing the packet
     @param outlen   [out] size of exported packet
-    @return CRYPT_OK if successful
+    @return CRYPT_NOP
 */
 int ltc_ecc_fp_save_state(unsigned char **out, unsigned long *outlen)
 {
-   ltc_asn1_list *cache_entry;
-   unsigned int   i, j, k;
-   unsigned long  fp_entries, fp_lut, num_entries;
-   int            err;
-
    LTC_ARGCHK(out    != NULL);
    LTC_ARGCHK(outlen != NULL);
 
-   fp_entries  = FP_ENTRIES;
-   fp_lut      = FP_LUT;
-   num_entries = 0;
-
-   LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
-   /*
-    * build the list; 
-      Cache DEFINITIONS ::=
-      BEGIN
-       CacheDump ::= SEQUENCE {
-         numEntries    SHORTINTEGER,
-         maxEntries    SHORTINTEGER,
-         numLUT        SHORTINTEGER,
-         cache         SEQUENCE OF INTEGER
-       }
-      END
-    *      
-    */
-   /*
-    * The cache itself is a point (3 INTEGERS), 
-	* the LUT as pairs of INTEGERS (2 * 1<<FP_LUT), 
-	* and the mu INTEGER
-    */
-   cache_entry = XCALLOC(FP_ENTRIES*(2*(1U<<FP_LUT)+4)+3, sizeof(ltc_asn1_list));
-   if (cache_entry == NULL)
-      return CRYPT_MEM;
-   j = 1;   /* handle the zero'th element later */
-
-   LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_SHORT_INTEGER, &fp_entries, 1);
-   LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_SHORT_INTEGER, &fp_lut, 1);
-
-   for (i = 0; i < FP_ENTRIES; i++) {
-      /*
-       * do not save empty entries, or entries that have not yet had the lut built
-       */
-      if (fp_cache[i].g == NULL || fp_cache[i].lru_count < 2) {
-         continue;
-      }
-      num_entries++;
-      LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_INTEGER, fp_cache[i].g->x, 1);
-      LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_INTEGER, fp_cache[i].g->y, 1);
-      LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_INTEGER, fp_cache[i].g->z, 1);
-      for (k = 0; k < (1U<<FP_LUT); k++) {
-         LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_INTEGER, fp_cache[i].LUT[k]->x, 1);
-         LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_INTEGER, fp_cache[i].LUT[k]->y, 1);
-      }
-      LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_INTEGER, fp_cache[i].mu, 1);
-   }
-   LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_EOL, 0, 0);
-
-   LTC_SET_ASN1(cache_entry, 0, LTC_ASN1_SHORT_INTEGER, &num_entries, 1);
-
-   if ((err = der_length_sequence(cache_entry, j, outlen)) != CRYPT_OK) {
-      goto save_err;
-   }
-   if ((*out = XMALLOC(*outlen)) == NULL) {
-      err = CRYPT_MEM;
-      goto save_err;
-   }
-   err = der_encode_sequence(cache_entry, j, *out, outlen);
-save_err:
-   XFREE(cache_entry);
-   LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
-   return err;
+   return CRYPT_NOP;
 }
 
 /** Import a binary packet into the current cache
-    @param in      [in] pointer to packet
-    @param inlen   [in] size of packet (bytes)
-    @return CRYPT_OK if successful
+    Not supported, the tables are rebuilt at first use
+    @param in       [in] pointer to buffer containing the packet
+    @param inlen    [in] length of the packet
+    @return CRYPT_NOP
 */
 int ltc_ecc_fp_restore_state(unsigned char *in, unsigned long inlen)
 {
-   int            err;
-   ltc_asn1_list *asn1_list;
-   unsigned long  num_entries, fp_entries, fp_lut;
-   unsigned long  i, j;
-   unsigned int   x;
-
    LTC_ARGCHK(in != NULL);
-   if (inlen == 0) {
-      return CRYPT_INVALID_ARG;
-   } 
-
-   /* zero indecies */
-   i         = 0;
-   j         = 0;
-   asn1_list = NULL;
-
-   LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
-   /*
-    * start with an empty cache
-    */
-   ltc_ecc_fp_free_cache();
+   LTC_UNUSED_PARAM(inlen);
 
-   /*
-    * decode the input packet: It consists of a sequence with a few
-    * integers (including the FP_ENTRIES and FP_LUT sizes), followed by a
-    * SEQUENCE which is the cache itself.
-	*
-	* use standard decoding for the first part, then flexible for the second
-    */
-   if((err = der_decode_sequence_multi(in, inlen, 
-                                       LTC_ASN1_SHORT_INTEGER, 1, &num_entries,
-                                       LTC_ASN1_SHORT_INTEGER, 1, &fp_entries,
-                                       LTC_ASN1_SHORT_INTEGER, 1, &fp_lut,
-                                       LTC_ASN1_EOL,           0, 0)) != CRYPT_OK) {
-      goto ERR_OUT;
-   }
-   if (fp_entries != FP_ENTRIES || fp_lut != FP_LUT || num_entries > fp_entries) {
-      err = CRYPT_INVALID_PACKET;
-      goto ERR_OUT;
-   }
-   if ((asn1_list = XCALLOC(3+num_entries*(4+2*(1<<FP_LUT))+1, sizeof(ltc_asn1_list))) == NULL) {
-      err = CRYPT_MEM;
-      goto ERR_OUT;
-   }
-   j = 0;
-   LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_SHORT_INTEGER, &num_entries, 1);
-   LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_SHORT_INTEGER, &fp_entries, 1);
-   LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_SHORT_INTEGER, &fp_lut, 1);
-   for (i = 0; i < num_entries; i++) {
-      if((fp_cache[i].g = ltc_ecc_new_point()) == NULL) {
-         err = CRYPT_MEM;
-         goto ERR_OUT;
-      }
-      LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_INTEGER, fp_cache[i].g->x, 1);
-      LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_INTEGER, fp_cache[i].g->y, 1);
-      LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_INTEGER, fp_cache[i].g->z, 1);
-      for (x = 0; x < (1U<<FP_LUT); x++) {
-         /* since we don't store z in the cache, don't use ltc_ecc_new_point() 
-          * (which allocates space for z, only to have to free it later) */
-         ecc_point *p = XCALLOC(1, sizeof(*p));
-
-         if (p == NULL) {
-            err = CRYPT_MEM;
-            goto ERR_OUT;
-         }
-         fp_cache[i].LUT[x] = p;
-         if ((err = mp_init_multi(&p->x, &p->y, NULL)) != CRYPT_OK) {
-            goto ERR_OUT;
-         }
-         p->z = NULL;
-         LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_INTEGER, p->x, 1);
-         LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_INTEGER, p->y, 1);
-      }
-      if((err = mp_init(&fp_cache[i].mu)) != CRYPT_OK) {
-         goto ERR_OUT;
-      }
-      LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_INTEGER, fp_cache[i].mu, 1);
-      fp_cache[i].lru_count = 3;
-      fp_cache[i].lock = 1;
-   }
-
-   if ((err = der_decode_sequence(in, inlen, asn1_list, j)) != CRYPT_OK) {
-      goto ERR_OUT;
-   }
-   XFREE(asn1_list);
-   LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
-   return CRYPT_OK;
-ERR_OUT:
-   if(asn1_list)
-      XFREE(asn1_list);
-   ltc_ecc_fp_free_cache();
-   LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
-   return err;
+   return CRYPT_NOP;
 }
 
 #endif
@@ -28,18 +28,21 @@
 
 #include "tomcrypt_mpa.h"
 #include <mpa.h>
+#include <stddef.h>
+#include <string.h>
+#include <string_ext.h>
 
-mpa_scratch_mem external_mem_pool;
+static mpa_tomcrypt_get_pool_fn get_mpa_pool;
 
-void init_mpa_tomcrypt(const mpa_scratch_mem pool)
+void init_mpa_tomcrypt(mpa_tomcrypt_get_pool_fn get_pool)
 {
-	external_mem_pool = pool;
+	get_mpa_pool = get_pool;
 }
 
 static int init_mpanum(mpanum *a)
 {
 	LTC_ARGCHK(a != NULL);
-	if (!mpa_alloc_static_temp_var(a, external_mem_pool))
+	if (!mpa_alloc_static_temp_var(a, get_mpa_pool()))
 		return CRYPT_MEM;
 	mpa_set_S32(*a, 0);
 	return CRYPT_OK;
@@ -59,7 +62,7 @@ static int init_size(int size_bits, void **a)
 {
 	LTC_ARGCHK(a != NULL);
 	if (!mpa_alloc_static_temp_var_size(size_bits, (mpanum *)a,
-					    external_mem_pool))
+					    get_mpa_pool()))
 		return CRYPT_MEM;
 	mpa_set_S32(*a, 0);
 	return CRYPT_OK;
@@ -69,7 +72,7 @@ static void deinit_mpanum(mpanum a)
 {
 	LTC_ARGCHKVD(a != NULL);
 
-	mpa_free_static_temp_var(&a, external_mem_pool);
+	mpa_free_static_temp_var(&a, get_mpa_pool());
 }
 
 static void deinit(void *a)
@@ -279,7 +282,7 @@ static int add(void *a, void *b, void *c)
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(b != NULL);
 	LTC_ARGCHK(c != NULL);
-	mpa_add((mpanum) c, (const mpanum) a, (const mpanum) b, external_mem_pool);
+	mpa_add((mpanum) c, (const mpanum) a, (const mpanum) b, get_mpa_pool());
 	return CRYPT_OK;
 }
 
@@ -290,7 +293,7 @@ static int addi(void *a, unsigned long b, void *c)
 	if (b > (unsigned long) UINT32_MAX) {
 		return CRYPT_INVALID_ARG;
 	}
-	mpa_add_word((mpanum) c, (const mpanum) a, b, external_mem_pool);
+	mpa_add_word((mpanum) c, (const mpanum) a, b, get_mpa_pool());
 	return CRYPT_OK;
 }
 
@@ -300,7 +303,7 @@ static int sub(void *a, void *b, void *c)
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(b != NULL);
 	LTC_ARGCHK(c != NULL);
-	mpa_sub((mpanum) c, (const mpanum) a, (const mpanum) b, external_mem_pool);
+	mpa_sub((mpanum) c, (const mpanum) a, (const mpanum) b, get_mpa_pool());
 	return CRYPT_OK;
 }
 
@@ -311,7 +314,7 @@ static int subi(void *a, unsigned long b, void *c)
 	if (b > (unsigned long) UINT32_MAX) {
 		return CRYPT_INVALID_ARG;
 	}
-	mpa_sub_word((mpanum) c, (const mpanum) a, b, external_mem_pool);
+	mpa_sub_word((mpanum) c, (const mpanum) a, b, get_mpa_pool());
 	return CRYPT_OK;
 }
 
@@ -321,7 +324,7 @@ static int mul(void *a, void *b, void *c)
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(b != NULL);
 	LTC_ARGCHK(c != NULL);
-	mpa_mul((mpanum) c, (const mpanum) a, (const mpanum) b, external_mem_pool);
+	mpa_mul((mpanum) c, (const mpanum) a, (const mpanum) b, get_mpa_pool());
 	return CRYPT_OK;
 }
 
@@ -332,7 +335,7 @@ static int muli(void *a, unsigned long b, void *c)
 	if (b > (unsigned long) UINT32_MAX) {
 		return CRYPT_INVALID_ARG;
 	}
-	mpa_mul_word((mpanum) c, (const mpanum) a, b, external_mem_pool);
+	mpa_mul_word((mpanum) c, (const mpanum) a, b, get_mpa_pool());
 	return CRYPT_OK;
 }
 
@@ -341,7 +344,7 @@ static int sqr(void *a, void *b)
 {
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(b != NULL);
-	mpa_mul((mpanum) b, (const mpanum) a, (const mpanum) a, external_mem_pool);
+	mpa_mul((mpanum) b, (const mpanum) a, (const mpanum) a, get_mpa_pool());
 	return CRYPT_OK;
 }
 
@@ -350,7 +353,7 @@ static int divide(void *a, void *b, void *c, void *d)
 {
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(b != NULL);
-	mpa_div(c, d, (const mpanum) a, (const mpanum) b, external_mem_pool);
+	mpa_div(c, d, (const mpanum) a, (const mpanum) b, get_mpa_pool());
 	return CRYPT_OK;
 }
 
@@ -392,7 +395,7 @@ static int gcd(void *a, void *b, void *c)
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(b != NULL);
 	LTC_ARGCHK(c != NULL);
-	mpa_gcd((mpanum) c, (const mpanum) a, (const mpanum) b, external_mem_pool);
+	mpa_gcd((mpanum) c, (const mpanum) a, (const mpanum) b, get_mpa_pool());
 	return CRYPT_OK;
 }
 
@@ -422,9 +425,9 @@ static int mod(void *a, void *b, void *c)
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(b != NULL);
 	LTC_ARGCHK(c != NULL);
-	mpa_mod((mpanum) c, (const mpanum) a, (const mpanum) b, external_mem_pool);
+	mpa_mod((mpanum) c, (const mpanum) a, (const mpanum) b, get_mpa_pool());
 	if (mpa_cmp_short(c, 0) < 0) {
-		mpa_add(c, c, b, external_mem_pool);
+		mpa_add(c, c, b, get_mpa_pool());
 	}
 	return CRYPT_OK;
 }
@@ -441,7 +444,7 @@ static int mulmod(void *a, void *b, void *c, void *d)
 
 	mod(a, c, tmpa);
 	mod(b, c, tmpb);
-	mpa_mul_mod((mpanum) d, (const mpanum) tmpa, (const mpanum) tmpb, (const mpanum) c, external_mem_pool);
+	mpa_mul_mod((mpanum) d, (const mpanum) tmpa, (const mpanum) tmpb, (const mpanum) c, get_mpa_pool());
 	mp_clear_multi(tmpa, tmpb, NULL);
 	return CRYPT_OK;
 }
@@ -462,7 +465,7 @@ static int invmod(void *a, void *b, void *c)
 	LTC_ARGCHK(c != NULL);
 	LTC_ARGCHK(b != c);
 	mod(a, b, c);
-	if (mpa_inv_mod((mpanum) c, (const mpanum) c, (const mpanum) b, external_mem_pool) != 0) {
+	if (mpa_inv_mod((mpanum) c, (const mpanum) c, (const mpanum) b, get_mpa_pool()) != 0) {
 		return CRYPT_ERROR;
 	}
 
@@ -481,10 +484,153 @@ static int montgomery_setup(void *a, void **b)
 	}
 	mpa_fmm_context_base * b_tmp = (mpa_fmm_context_base *) *b;
 	mpa_init_static_fmm_context(b_tmp, len);
-	mpa_compute_fmm_context((const mpanum) a, b_tmp->r_ptr, b_tmp->r2_ptr, &(b_tmp->n_inv), external_mem_pool);
+	mpa_compute_fmm_context((const mpanum) a, b_tmp->r_ptr, b_tmp->r2_ptr, &(b_tmp->n_inv), get_mpa_pool());
 	return CRYPT_OK;
 }
 
+/*
+ * Bignums holding the values of keys, allocated with
+ * mpa_tomcrypt_key_alloc(). When one is the modulus of
+ * mpa_tomcrypt_exptmod_key_mod() its Montgomery context is computed the
+ * first time and kept with the bignum, so the context of the RSA n, p and
+ * q goes away with the key. A copy of the modulus the context was
+ * computed for is kept too, compared in constant time as p and q are
+ * secret, in case the value of the key has been changed since.
+ */
+struct key_bignum {
+	mpa_fmm_context mont;
+	size_t mont_len;	/* in mpa_word_t */
+	mpanum mont_mod;
+	uint32_t num[];		/* struct mpa_numbase_struct */
+};
+
+LTC_MUTEX_GLOBAL(key_mont_mutex)
+
+static struct key_bignum *to_key_bignum(void *a)
+{
+	return (struct key_bignum *)((uint8_t *)a -
+				     offsetof(struct key_bignum, num));
+}
+
+static void key_mont_free(struct key_bignum *k)
+{
+	if (k->mont_mod) {
+		mpa_wipe(k->mont_mod);
+		free(k->mont_mod);
+	}
+	if (k->mont) {
+		memset(k->mont, 0, k->mont_len * sizeof(mpa_word_t));
+		free(k->mont);
+	}
+	k->mont = NULL;
+	k->mont_len = 0;
+	k->mont_mod = NULL;
+}
+
+static bool key_mont_valid(struct key_bignum *k, mpanum modulus)
+{
+	return k->mont && k->mont_mod->size == modulus->size &&
+	       !buf_compare_ct(k->mont_mod->d, modulus->d,
+			       __mpanum_size(modulus) * BYTES_PER_WORD);
+}
+
+static int key_mont_setup(void *a, mpa_fmm_context *ctx)
+{
+	struct key_bignum *k = to_key_bignum(a);
+	mpanum modulus = a;
+	size_t len = mpa_fmm_context_size_in_U32(count_bits(a));
+	size_t mod_len = mpa_StaticVarSizeInU32(count_bits(a));
+	int res = CRYPT_OK;
+
+	LTC_MUTEX_LOCK(&key_mont_mutex);
+	if (key_mont_valid(k, modulus))
+		goto out;
+
+	key_mont_free(k);
+	k->mont = malloc(len * sizeof(mpa_word_t));
+	k->mont_mod = malloc(mod_len * sizeof(uint32_t));
+	if (!k->mont || !k->mont_mod) {
+		free(k->mont);
+		free(k->mont_mod);
+		k->mont = NULL;
+		k->mont_mod = NULL;
+		res = CRYPT_MEM;
+		goto out;
+	}
+	k->mont_len = len;
+	mpa_init_static_fmm_context(k->mont, len);
+	mpa_compute_fmm_context(modulus, k->mont->r_ptr, k->mont->r2_ptr,
+				&k->mont->n_inv, get_mpa_pool());
+	mpa_init_static(k->mont_mod, mod_len);
+	mpa_copy(k->mont_mod, modulus);
+out:
+	*ctx = k->mont;
+	LTC_MUTEX_UNLOCK(&key_mont_mutex);
+	return res;
+}
+
+void *mpa_tomcrypt_key_alloc(size_t size)
+{
+	struct key_bignum *k = calloc(1, sizeof(*k) + size);
+
+	if (!k)
+		return NULL;
+	return k->num;
+}
+
+void mpa_tomcrypt_key_free(void *a)
+{
+	struct key_bignum *k;
+
+	if (!a)
+		return;
+	k = to_key_bignum(a);
+	key_mont_free(k);
+	free(k);
+}
+
+/*
+ * Bignums allocated from the heap instead of the scratch memory pool, for
+ * values kept between operations like the precomputed tables of the fixed
+ * point ECC code. They must be released with
+ * mpa_tomcrypt_free_persistent() and not with mp_clear().
+ */
+int mpa_tomcrypt_init_persistent(void **a, int size_bits)
+{
+	size_t len = mpa_StaticVarSizeInU32(size_bits);
+	mpanum n;
+
+	LTC_ARGCHK(a != NULL);
+	n = calloc(len, sizeof(uint32_t));
+	if (!n)
+		return CRYPT_MEM;
+	mpa_init_static(n, len);
+	*a = n;
+	return CRYPT_OK;
+}
+
+void mpa_tomcrypt_free_persistent(void *a)
+{
+	if (a) {
+		mpa_wipe(a);
+		free(a);
+	}
+}
+
+void mpa_tomcrypt_cond_copy(void *dest, const void *src, int cond)
+{
+	mpanum d = dest;
+	const struct mpa_numbase_struct *s = src;
+	mpa_word_t mask = -(mpa_word_t)!!cond;
+	mpa_asize_t len = MIN(d->alloc, s->alloc);
+	mpa_asize_t n;
+
+	for (n = 0; n < len; n++)
+		d->d[n] = (d->d[n] & ~mask) | (s->d[n] & mask);
+	d->size = (mpa_usize_t)(((mpa_word_t)d->size & ~mask) |
+				((mpa_word_t)s->size & mask));
+}
+
 /* get normalization value */
 static int montgomery_normalization(void *a, void *b)
 {
@@ -493,7 +639,7 @@ static int montgomery_normalization(void *a, void *b)
 	mpa_asize_t s;
 	s = __mpanum_size((mpanum) b);
 	twoexpt(a, s * MPA_WORD_SIZE);
-	mpa_mod((mpanum) a, (const mpanum) a, (const mpanum) b, external_mem_pool);
+	mpa_mod((mpanum) a, (const mpanum) a, (const mpanum) b, get_mpa_pool());
 	return CRYPT_OK;
 }
 
@@ -511,14 +657,14 @@ static int montgomery_reduce(void *a, void *b, void *c)
 	// WARNING
 	//  Workaround for a bug when a > b (a greater than the modulus)
 	if (compare(a, b) == LTC_MP_GT) {
-		mpa_mod((mpanum) a, (const mpanum) a, (const mpanum) b, external_mem_pool);
+		mpa_mod((mpanum) a, (const mpanum) a, (const mpanum) b, get_mpa_pool());
 	}
 	mpa_montgomery_mul(tmp,
 			(mpanum) a,
 			mpa_constant_one(),
 			(mpanum) b,
 			((mpa_fmm_context) c)->n_inv,
-			external_mem_pool);
+			get_mpa_pool());
 	mpa_copy(a, tmp);
 	deinit(tmp);
 	return CRYPT_OK;
@@ -540,18 +686,11 @@ static void montgomery_deinit(void *a)
  * @b: exponent
  * @c: modulus
  * @d: destination
+ * @c_mont: Montgomery context of c
  */
-static int exptmod(void *a, void *b, void *c, void *d)
+static int exptmod_mont(void *a, void *b, void *c, void *d,
+			mpa_fmm_context c_mont)
 {
-	LTC_ARGCHK(a != NULL);
-	LTC_ARGCHK(b != NULL);
-	LTC_ARGCHK(c != NULL);
-	LTC_ARGCHK(d != NULL);
-	void *c_mont;
-	if (montgomery_setup(c, &c_mont) != CRYPT_OK) {
-		return CRYPT_MEM;
-	}
-
 	void *d_tmp;
 	int memguard;
 
@@ -580,12 +719,10 @@ static int exptmod(void *a, void *b, void *c, void *d)
 		    (const mpanum)d_tmp,
 		    (const mpanum)b,
 		    (const mpanum)c,
-		    ((mpa_fmm_context)c_mont)->r_ptr,
-		    ((mpa_fmm_context)c_mont)->r2_ptr,
-		    ((mpa_fmm_context)c_mont)->n_inv,
-		    external_mem_pool);
-
-	montgomery_deinit(c_mont);
+		    c_mont->r_ptr,
+		    c_mont->r2_ptr,
+		    c_mont->n_inv,
+		    get_mpa_pool());
 
 	if (memguard) {
 		deinit(d_tmp);
@@ -594,12 +731,45 @@ static int exptmod(void *a, void *b, void *c, void *d)
 	return CRYPT_OK;
 }
 
+static int exptmod(void *a, void *b, void *c, void *d)
+{
+	LTC_ARGCHK(a != NULL);
+	LTC_ARGCHK(b != NULL);
+	LTC_ARGCHK(c != NULL);
+	LTC_ARGCHK(d != NULL);
+	void *c_mont;
+	int res;
+
+	if (montgomery_setup(c, &c_mont) != CRYPT_OK) {
+		return CRYPT_MEM;
+	}
+	res = exptmod_mont(a, b, c, d, c_mont);
+	montgomery_deinit(c_mont);
+	return res;
+}
+
+int mpa_tomcrypt_exptmod_key_mod(void *a, void *b, void *c, void *d)
+{
+	LTC_ARGCHK(a != NULL);
+	LTC_ARGCHK(b != NULL);
+	LTC_ARGCHK(c != NULL);
+	LTC_ARGCHK(d != NULL);
+	mpa_fmm_context c_mont;
+	int res;
+
+	res = key_mont_setup(c, &c_mont);
+	if (res != CRYPT_OK) {
+		return res;
+	}
+	return exptmod_mont(a, b, c, d, c_mont);
+}
+
 static int isprime(void *a, int b, int *c)
 {
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(c != NULL);
 	LTC_UNUSED_PARAM(b);
-	*c = mpa_is_prob_prime((mpanum) a, 100, external_mem_pool) != 0 ? LTC_MP_YES : LTC_MP_NO;
+	*c = mpa_is_prob_prime((mpanum) a, 100, get_mpa_pool()) != 0 ? LTC_MP_YES : LTC_MP_NO;
 	return CRYPT_OK;
 }
 
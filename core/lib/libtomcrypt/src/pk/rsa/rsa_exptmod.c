@@ -39,6 +39,7 @@
  * Added RSA blinding --nmav
  */
 #include "tomcrypt.h"
+#include "tomcrypt_mpa.h"
 
 /**
   @file rsa_exptmod.c
@@ -114,7 +115,7 @@ int rsa_exptmod(const unsigned char *in,   unsigned long inlen,
       }
 
       /* rnd = rnd^e */
-      err = mp_exptmod( rnd, key->e, key->N, rnd);
+      err = mpa_tomcrypt_exptmod_key_mod(rnd, key->e, key->N, rnd);
       if (err != CRYPT_OK) {
              goto error;
       }
@@ -133,13 +134,13 @@ int rsa_exptmod(const unsigned char *in,   unsigned long inlen,
           * In case CRT optimization parameters are not provided,
           * the private key is directly used to exptmod it
           */
-         if ((err = mp_exptmod(tmp, key->d, key->N, tmp)) != CRYPT_OK)                              { goto error; }
+         if ((err = mpa_tomcrypt_exptmod_key_mod(tmp, key->d, key->N, tmp)) != CRYPT_OK)            { goto error; }
       } else {
          /* tmpa = tmp^dP mod p */
-         if ((err = mp_exptmod(tmp, key->dP, key->p, tmpa)) != CRYPT_OK)                            { goto error; }
+         if ((err = mpa_tomcrypt_exptmod_key_mod(tmp, key->dP, key->p, tmpa)) != CRYPT_OK)          { goto error; }
 
          /* tmpb = tmp^dQ mod q */
-         if ((err = mp_exptmod(tmp, key->dQ, key->q, tmpb)) != CRYPT_OK)                            { goto error; }
+         if ((err = mpa_tomcrypt_exptmod_key_mod(tmp, key->dQ, key->q, tmpb)) != CRYPT_OK)          { goto error; }
 
          /* tmp = (tmpa - tmpb) * qInv (mod p) */
          if ((err = mp_sub(tmpa, tmpb, tmp)) != CRYPT_OK)                                           { goto error; }
@@ -160,14 +161,14 @@ int rsa_exptmod(const unsigned char *in,   unsigned long inlen,
 
       #ifdef LTC_RSA_CRT_HARDENING
       if (!no_crt) {
-         if ((err = mp_exptmod(tmp, key->e, key->N, tmpa)) != CRYPT_OK)                              { goto error; }
+         if ((err = mpa_tomcrypt_exptmod_key_mod(tmp, key->e, key->N, tmpa)) != CRYPT_OK)            { goto error; }
          if ((err = mp_read_unsigned_bin(tmpb, (unsigned char *)in, (int)inlen)) != CRYPT_OK)        { goto error; }
          if (mp_cmp(tmpa, tmpb) != LTC_MP_EQ)                                     { err = CRYPT_ERROR; goto error; }
       }
       #endif
    } else {
       /* exptmod it */
-      if ((err = mp_exptmod(tmp, key->e, key->N, tmp)) != CRYPT_OK)                                { goto error; }
+      if ((err = mpa_tomcrypt_exptmod_key_mod(tmp, key->e, key->N, tmp)) != CRYPT_OK)              { goto error; }
    }
 
    /* read it back */
@@ -9,6 +9,7 @@
 #include <crypto/crypto.h>
 #include <kernel/panic.h>
 #include <mpalib.h>
+#include <platform_config.h>
 #include <stdlib.h>
 #include <string_ext.h>
 #include <string.h>
@@ -25,6 +26,33 @@
 #include <kernel/thread.h>
 #endif
 
+#if defined(CFG_CRYPTO_ACCEL)
+#include <crypto/crypto_accel.h>
+
+/*
+ * The crypto accelerator framework provides the crypto_hash_*() and
+ * crypto_cipher_*() functions, operations it doesn't offload are handed
+ * to the implementations below.
+ */
+#define crypto_hash_alloc_ctx		crypto_sw_hash_alloc_ctx
+#define crypto_hash_free_ctx		crypto_sw_hash_free_ctx
+#define crypto_hash_copy_state		crypto_sw_hash_copy_state
+#define crypto_hash_init		crypto_sw_hash_init
+#define crypto_hash_update		crypto_sw_hash_update
+#define crypto_hash_final		crypto_sw_hash_final
+#define crypto_cipher_alloc_ctx		crypto_sw_cipher_alloc_ctx
+#define crypto_cipher_free_ctx		crypto_sw_cipher_free_ctx
+#define crypto_cipher_copy_state	crypto_sw_cipher_copy_state
+#define crypto_cipher_init		crypto_sw_cipher_init
+#define crypto_cipher_update		crypto_sw_cipher_update
+#define crypto_cipher_final		crypto_sw_cipher_final
+#endif
+
+#if defined(CFG_CRYPTO_CTR_DRBG)
+/* The PRNG below seeds the CTR_DRBGs of core/crypto/ctr_drbg.c */
+#define crypto_rng_read			crypto_sw_rng_read
+#endif
+
 #if !defined(CFG_WITH_SOFTWARE_PRNG)
 
 /* Random generator */
@@ -499,31 +527,42 @@ TEE_Result crypto_hash_final(void *ctx, uint32_t algo, uint8_t *digest,
 	mpa_scratch_mem_size_in_U32(LTC_VARIABLE_NUMBER, \
 				    LTC_MAX_BITS_PER_VARIABLE)
 
+/*
+ * With CFG_LTC_OPTEE_THREAD each thread doing bignum arithmetic gets
+ * exclusive access to one of LTC_MPA_POOLS scratch memory pools, so that
+ * up to that many asymmetric operations can run in parallel.
+ * CFG_LTC_MPA_POOLS == 0 means one pool per core.
+ */
+#if defined(CFG_LTC_OPTEE_THREAD) && CFG_LTC_MPA_POOLS
+#define LTC_MPA_POOLS		CFG_LTC_MPA_POOLS
+#elif defined(CFG_LTC_OPTEE_THREAD)
+#define LTC_MPA_POOLS		CFG_TEE_CORE_NB_CORE
+#else
+#define LTC_MPA_POOLS		1
+#endif
+
 #if defined(CFG_WITH_PAGER)
 #include <mm/tee_pager.h>
 #include <util.h>
 #include <mm/core_mmu.h>
 
-static uint32_t *_ltc_mempool_u32;
-
 /* allocate pageable_zi vmem for mpa scratch memory pool */
-static mpa_scratch_mem get_mpa_scratch_memory_pool(size_t *size_pool)
+static mpa_scratch_mem get_mpa_scratch_memory_pool(size_t idx __unused,
+						   size_t *size_pool)
 {
 	void *pool;
 
 	*size_pool = ROUNDUP((LTC_MEMPOOL_U32_SIZE * sizeof(uint32_t)),
 			     SMALL_PAGE_SIZE);
-	_ltc_mempool_u32 = tee_pager_alloc(*size_pool, 0);
-	if (!_ltc_mempool_u32)
+	pool = tee_pager_alloc(*size_pool, 0);
+	if (!pool)
 		panic();
-	pool = (void *)_ltc_mempool_u32;
 	return (mpa_scratch_mem)pool;
 }
 
 /* release unused pageable_zi vmem */
-static void release_unused_mpa_scratch_memory(void)
+static void release_unused_mpa_scratch_memory(mpa_scratch_mem pool)
 {
-	mpa_scratch_mem pool = (void *)_ltc_mempool_u32;
 	struct mpa_scratch_item *item;
 	vaddr_t start;
 	vaddr_t end;
@@ -545,31 +584,30 @@ static void release_unused_mpa_scratch_memory(void)
 }
 #else /* CFG_WITH_PAGER */
 
-static uint32_t _ltc_mempool_u32[LTC_MEMPOOL_U32_SIZE]
+static uint32_t _ltc_mempool_u32[LTC_MPA_POOLS][LTC_MEMPOOL_U32_SIZE]
 	__aligned(__alignof__(mpa_scratch_mem_base));
 
-static mpa_scratch_mem get_mpa_scratch_memory_pool(size_t *size_pool)
+static mpa_scratch_mem get_mpa_scratch_memory_pool(size_t idx,
+						   size_t *size_pool)
 {
-	void *pool = (void *)_ltc_mempool_u32;
+	void *pool = (void *)_ltc_mempool_u32[idx];
 
-	*size_pool = sizeof(_ltc_mempool_u32);
+	*size_pool = sizeof(_ltc_mempool_u32[idx]);
 	return (mpa_scratch_mem)pool;
 }
 
-static void release_unused_mpa_scratch_memory(void)
+static void release_unused_mpa_scratch_memory(mpa_scratch_mem pool __unused)
 {
 	/* nothing to do in non-pager mode */
 }
 
 #endif
 
-static void pool_postactions(void)
+static void pool_postactions(mpa_scratch_mem pool)
 {
-	mpa_scratch_mem pool = (void *)_ltc_mempool_u32;
-
 	if (pool->last_offset)
 		panic("release issue in mpa scratch memory");
-	release_unused_mpa_scratch_memory();
+	release_unused_mpa_scratch_memory(pool);
 }
 
 #if defined(CFG_LTC_OPTEE_THREAD)
@@ -579,17 +617,15 @@ static struct mpa_scratch_mem_sync {
 	struct condvar cv;
 	size_t count;
 	int owner;
-} pool_sync = {
-	.mu = MUTEX_INITIALIZER,
-	.cv = CONDVAR_INITIALIZER,
-	.owner = THREAD_ID_INVALID,
-};
+	mpa_scratch_mem pool;
+} pool_sync[LTC_MPA_POOLS];
 #elif defined(LTC_PTHREAD)
 #error NOT SUPPORTED
 #else
 static struct mpa_scratch_mem_sync {
 	size_t count;
-} pool_sync;
+	mpa_scratch_mem pool;
+} pool_sync[LTC_MPA_POOLS];
 #endif
 
 /* Get exclusive access to scratch memory pool */
@@ -624,11 +660,44 @@ static void put_pool(struct mpa_scratch_mem_sync *sync)
 	if (!sync->count) {
 		sync->owner = THREAD_ID_INVALID;
 		condvar_signal(&sync->cv);
-		pool_postactions();
+		pool_postactions(sync->pool);
 	}
 
 	mutex_unlock(&sync->mu);
 }
+
+/*
+ * Selects the scratch memory pool used by the calling thread: the one it
+ * already owns if it has live temporary variables, else an idle pool. The
+ * owners are read without the mutex, it's only a hint since get_pool()
+ * waits until the selected pool is available.
+ */
+static mpa_scratch_mem get_thread_pool(void)
+{
+	int id = thread_get_id();
+	size_t n;
+
+	/* get_pool() needs a thread to wait on a busy pool */
+	assert(id != THREAD_ID_INVALID);
+
+	for (n = 0; n < LTC_MPA_POOLS; n++)
+		if (pool_sync[n].owner == id)
+			return pool_sync[n].pool;
+
+	for (n = 0; n < LTC_MPA_POOLS; n++)
+		if (pool_sync[n].owner == THREAD_ID_INVALID)
+			return pool_sync[n].pool;
+
+	/* All pools are busy, spread the waiting threads over them */
+	return pool_sync[(unsigned int)id % LTC_MPA_POOLS].pool;
+}
+
+static void init_pool_sync(struct mpa_scratch_mem_sync *sync)
+{
+	mutex_init(&sync->mu);
+	condvar_init(&sync->cv);
+	sync->owner = THREAD_ID_INVALID;
+}
 #elif defined(LTC_PTHREAD)
 #error NOT SUPPORTED
 #else
@@ -642,7 +711,16 @@ static void put_pool(struct mpa_scratch_mem_sync *sync)
 {
 	sync->count--;
 	if (!sync->count)
-		pool_postactions();
+		pool_postactions(sync->pool);
+}
+
+static mpa_scratch_mem get_thread_pool(void)
+{
+	return pool_sync[0].pool;
+}
+
+static void init_pool_sync(struct mpa_scratch_mem_sync *sync __unused)
+{
 }
 #endif
 
@@ -650,11 +728,17 @@ static void tee_ltc_alloc_mpa(void)
 {
 	mpa_scratch_mem pool;
 	size_t size_pool;
+	size_t n;
 
-	pool = get_mpa_scratch_memory_pool(&size_pool);
-	init_mpa_tomcrypt(pool);
-	mpa_init_scratch_mem_sync(pool, size_pool, LTC_MAX_BITS_PER_VARIABLE,
-				  get_pool, put_pool, &pool_sync);
+	for (n = 0; n < LTC_MPA_POOLS; n++) {
+		pool = get_mpa_scratch_memory_pool(n, &size_pool);
+		init_pool_sync(pool_sync + n);
+		pool_sync[n].pool = pool;
+		mpa_init_scratch_mem_sync(pool, size_pool,
+					  LTC_MAX_BITS_PER_VARIABLE,
+					  get_pool, put_pool, pool_sync + n);
+	}
+	init_mpa_tomcrypt(get_thread_pool);
 
 	mpa_set_random_generator(crypto_rng_read);
 }
@@ -695,7 +779,7 @@ void crypto_bignum_copy(struct bignum *to, const struct bignum *from)
 struct bignum *crypto_bignum_allocate(size_t size_bits)
 {
 	size_t sz = mpa_StaticVarSizeInU32(size_bits) *	sizeof(uint32_t);
-	struct mpa_numbase_struct *bn = calloc(1, sz);
+	struct mpa_numbase_struct *bn = mpa_tomcrypt_key_alloc(sz);
 
 	if (!bn)
 		return NULL;
@@ -705,7 +789,7 @@ struct bignum *crypto_bignum_allocate(size_t size_bits)
 
 void crypto_bignum_free(struct bignum *s)
 {
-	free(s);
+	mpa_tomcrypt_key_free(s);
 }
 
 void crypto_bignum_clear(struct bignum *s)
@@ -3138,3 +3222,28 @@ void crypto_aes_enc_block(const void *enc_key, unsigned int rounds,
 	if (aes_ecb_encrypt(src, dst, &skey))
 		panic();
 }
+
+void crypto_aes_enc_blocks(const void *enc_key, unsigned int rounds,
+			   const void *src, void *dst, size_t num_blocks)
+{
+	symmetric_key skey;
+	const uint8_t *s = src;
+	uint8_t *d = dst;
+	size_t n;
+
+	memcpy(skey.rijndael.eK, enc_key, sizeof(skey.rijndael.eK));
+	skey.rijndael.Nr = rounds;
+
+	/* The accelerated version interleaves several blocks */
+	if (aes_desc.accel_ecb_encrypt) {
+		if (aes_desc.accel_ecb_encrypt(s, d, num_blocks, &skey))
+			panic();
+		return;
+	}
+
+	for (n = 0; n < num_blocks; n++) {
+		if (aes_ecb_encrypt(s + n * TEE_AES_BLOCK_SIZE,
+				    d + n * TEE_AES_BLOCK_SIZE, &skey))
+			panic();
+	}
+}
@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <string_ext.h>
 #include <string.h>
+#include <sys/queue.h>
 #include <tee/fs_htree.h>
 #include <tee/tee_fs_key_manager.h>
 #include <tee/tee_fs_rpc.h>
@@ -31,6 +32,13 @@
 
 #define NODE_ID_TO_BLOCK_NUM(id)	((id) - 1)
 
+#ifndef CFG_REE_FS_HTREE_CACHE_BLOCKS
+#define CFG_REE_FS_HTREE_CACHE_BLOCKS	0
+#endif
+
+/* Maximum number of decrypted data blocks cached per hash tree */
+static const size_t htree_max_cached_blocks = CFG_REE_FS_HTREE_CACHE_BLOCKS;
+
 /*
  * The hash tree is implemented as a binary tree with the purpose to ensure
  * integrity of the data in the nodes. The data in the nodes their turn
@@ -86,6 +94,21 @@ struct htree_node {
 	struct htree_node *child[2];
 };
 
+/*
+ * Decrypted data block kept in the block cache of a hash tree. A dirty
+ * block has been updated with tee_fs_htree_write_block() but not yet
+ * encrypted and written to storage, that is done when the block is
+ * evicted or at the latest in tee_fs_htree_sync_to_storage().
+ */
+struct htree_block {
+	size_t block_num;
+	bool dirty;
+	TAILQ_ENTRY(htree_block) link;
+	uint8_t data[];
+};
+
+TAILQ_HEAD(htree_block_head, htree_block);
+
 struct tee_fs_htree {
 	struct htree_node root;
 	struct tee_fs_htree_image head;
@@ -95,6 +118,9 @@ struct tee_fs_htree {
 	const TEE_UUID *uuid;
 	const struct tee_fs_htree_storage *stor;
 	void *stor_aux;
+	/* Least recently used block last */
+	struct htree_block_head blocks;
+	size_t num_blocks;
 };
 
 struct traverse_arg;
@@ -628,6 +654,7 @@ TEE_Result tee_fs_htree_open(bool create, uint8_t *hash, const TEE_UUID *uuid,
 	ht->uuid = uuid;
 	ht->stor = stor;
 	ht->stor_aux = stor_aux;
+	TAILQ_INIT(&ht->blocks);
 
 	if (create) {
 		const struct tee_fs_htree_image dummy_head = { .counter = 0 };
@@ -694,8 +721,14 @@ static TEE_Result free_node(struct traverse_arg *targ __unused,
 
 void tee_fs_htree_close(struct tee_fs_htree **ht)
 {
+	struct htree_block *blk;
+
 	if (!*ht)
 		return;
+	while ((blk = TAILQ_FIRST(&(*ht)->blocks))) {
+		TAILQ_REMOVE(&(*ht)->blocks, blk, link);
+		free(blk);
+	}
 	htree_traverse_post_order(*ht, free_node, NULL);
 	free(*ht);
 	*ht = NULL;
@@ -758,6 +791,8 @@ static TEE_Result update_root(struct tee_fs_htree *ht)
 				     sizeof(ht->imeta), &ht->head.imeta);
 }
 
+static TEE_Result flush_blocks(struct tee_fs_htree *ht);
+
 TEE_Result tee_fs_htree_sync_to_storage(struct tee_fs_htree **ht_arg,
 					uint8_t *hash)
 {
@@ -775,16 +810,41 @@ TEE_Result tee_fs_htree_sync_to_storage(struct tee_fs_htree **ht_arg,
 	if (res != TEE_SUCCESS)
 		return res;
 
+	/*
+	 * Blocks, nodes and head are written in order, which is preserved
+	 * when the storage defers the writes.
+	 */
+	if (ht->stor->rpc_write_begin) {
+		res = ht->stor->rpc_write_begin(ht->stor_aux);
+		if (res != TEE_SUCCESS)
+			goto out;
+	}
+
+	/* Dirty blocks update the tags and flags of their nodes */
+	res = flush_blocks(ht);
+	if (res != TEE_SUCCESS)
+		goto out_end;
+
 	res = htree_traverse_post_order(ht, htree_sync_node_to_storage, ctx);
 	if (res != TEE_SUCCESS)
-		goto out;
+		goto out_end;
 
 	/* All the nodes are written to storage now. Time to update root. */
 	res = update_root(ht);
 	if (res != TEE_SUCCESS)
-		goto out;
+		goto out_end;
 
 	res = rpc_write_head(ht, ht->head.counter & 1, &ht->head);
+
+out_end:
+	/* Don't let a partly updated tree reach storage */
+	if (ht->stor->rpc_write_end) {
+		TEE_Result res2 = ht->stor->rpc_write_end(ht->stor_aux,
+							  res != TEE_SUCCESS);
+
+		if (res == TEE_SUCCESS)
+			res = res2;
+	}
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -811,10 +871,9 @@ static TEE_Result get_block_node(struct tee_fs_htree *ht, bool create,
 	return res;
 }
 
-TEE_Result tee_fs_htree_write_block(struct tee_fs_htree **ht_arg,
-				    size_t block_num, const void *block)
+static TEE_Result write_block_to_storage(struct tee_fs_htree *ht,
+					 size_t block_num, const void *block)
 {
-	struct tee_fs_htree *ht = *ht_arg;
 	TEE_Result res;
 	struct tee_fs_rpc_operation op;
 	struct htree_node *node = NULL;
@@ -822,12 +881,9 @@ TEE_Result tee_fs_htree_write_block(struct tee_fs_htree **ht_arg,
 	void *ctx;
 	void *enc_block;
 
-	if (!ht)
-		return TEE_ERROR_CORRUPT_OBJECT;
-
 	res = get_block_node(ht, true, block_num, &node);
 	if (res != TEE_SUCCESS)
-		goto out;
+		return res;
 
 	if (!node->block_updated)
 		node->node.flags ^= HTREE_NODE_COMMITTED_BLOCK;
@@ -837,34 +893,31 @@ TEE_Result tee_fs_htree_write_block(struct tee_fs_htree **ht_arg,
 				       TEE_FS_HTREE_TYPE_BLOCK, block_num,
 				       block_vers, &enc_block);
 	if (res != TEE_SUCCESS)
-		goto out;
+		return res;
 
 	res = authenc_init(&ctx, TEE_MODE_ENCRYPT, ht, &node->node,
 			   ht->stor->block_size);
 	if (res != TEE_SUCCESS)
-		goto out;
+		return res;
 	res = authenc_encrypt_final(ctx, node->node.tag, block,
 				    ht->stor->block_size, enc_block);
 	if (res != TEE_SUCCESS)
-		goto out;
+		return res;
 
 	res = ht->stor->rpc_write_final(&op);
 	if (res != TEE_SUCCESS)
-		goto out;
+		return res;
 
 	node->block_updated = true;
 	node->dirty = true;
 	ht->dirty = true;
-out:
-	if (res != TEE_SUCCESS)
-		tee_fs_htree_close(ht_arg);
-	return res;
+
+	return TEE_SUCCESS;
 }
 
-TEE_Result tee_fs_htree_read_block(struct tee_fs_htree **ht_arg,
-				   size_t block_num, void *block)
+static TEE_Result read_block_from_storage(struct tee_fs_htree *ht,
+					  size_t block_num, void *block)
 {
-	struct tee_fs_htree *ht = *ht_arg;
 	TEE_Result res;
 	struct tee_fs_rpc_operation op;
 	struct htree_node *node;
@@ -873,35 +926,196 @@ TEE_Result tee_fs_htree_read_block(struct tee_fs_htree **ht_arg,
 	void *ctx;
 	void *enc_block;
 
-	if (!ht)
-		return TEE_ERROR_CORRUPT_OBJECT;
-
 	res = get_block_node(ht, false, block_num, &node);
 	if (res != TEE_SUCCESS)
-		goto out;
+		return res;
 
 	block_vers = !!(node->node.flags & HTREE_NODE_COMMITTED_BLOCK);
 	res = ht->stor->rpc_read_init(ht->stor_aux, &op,
 				      TEE_FS_HTREE_TYPE_BLOCK, block_num,
 				      block_vers, &enc_block);
 	if (res != TEE_SUCCESS)
-		goto out;
+		return res;
 
 	res = ht->stor->rpc_read_final(&op, &len);
 	if (res != TEE_SUCCESS)
+		return res;
+	if (len != ht->stor->block_size)
+		return TEE_ERROR_CORRUPT_OBJECT;
+
+	res = authenc_init(&ctx, TEE_MODE_DECRYPT, ht, &node->node,
+			   ht->stor->block_size);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return authenc_decrypt_final(ctx, node->node.tag, enc_block,
+				     ht->stor->block_size, block);
+}
+
+/*
+ * Looks up a block in the block cache, a found block is moved first in
+ * the list as most recently used.
+ */
+static struct htree_block *find_block(struct tee_fs_htree *ht,
+				      size_t block_num)
+{
+	struct htree_block *blk;
+
+	TAILQ_FOREACH(blk, &ht->blocks, link) {
+		if (blk->block_num == block_num) {
+			if (blk != TAILQ_FIRST(&ht->blocks)) {
+				TAILQ_REMOVE(&ht->blocks, blk, link);
+				TAILQ_INSERT_HEAD(&ht->blocks, blk, link);
+			}
+			return blk;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Returns a block which isn't in the block cache list. A new block is
+ * allocated until the cache is full, after that the least recently used
+ * block is evicted, written back to storage first if it's dirty.
+ */
+static TEE_Result get_free_block(struct tee_fs_htree *ht,
+				 struct htree_block **blk_ret)
+{
+	TEE_Result res;
+	struct htree_block *blk;
+
+	if (ht->num_blocks < htree_max_cached_blocks) {
+		blk = malloc(sizeof(*blk) + ht->stor->block_size);
+		if (!blk)
+			return TEE_ERROR_OUT_OF_MEMORY;
+		ht->num_blocks++;
+	} else {
+		blk = TAILQ_LAST(&ht->blocks, htree_block_head);
+		assert(blk);
+		if (blk->dirty) {
+			res = write_block_to_storage(ht, blk->block_num,
+						     blk->data);
+			if (res != TEE_SUCCESS)
+				return res;
+		}
+		TAILQ_REMOVE(&ht->blocks, blk, link);
+	}
+
+	blk->dirty = false;
+	*blk_ret = blk;
+	return TEE_SUCCESS;
+}
+
+static void put_free_block(struct tee_fs_htree *ht, struct htree_block *blk)
+{
+	free(blk);
+	ht->num_blocks--;
+}
+
+static TEE_Result flush_blocks(struct tee_fs_htree *ht)
+{
+	TEE_Result res;
+	struct htree_block *blk;
+
+	TAILQ_FOREACH(blk, &ht->blocks, link) {
+		if (!blk->dirty)
+			continue;
+		res = write_block_to_storage(ht, blk->block_num, blk->data);
+		if (res != TEE_SUCCESS)
+			return res;
+		blk->dirty = false;
+	}
+
+	return TEE_SUCCESS;
+}
+
+/* Drops cached blocks which are beyond the end of a truncated hash tree */
+static void drop_blocks(struct tee_fs_htree *ht)
+{
+	struct htree_block *blk;
+	struct htree_block *next;
+
+	TAILQ_FOREACH_SAFE(blk, &ht->blocks, link, next) {
+		if (BLOCK_NUM_TO_NODE_ID(blk->block_num) >
+		    ht->imeta.max_node_id) {
+			TAILQ_REMOVE(&ht->blocks, blk, link);
+			put_free_block(ht, blk);
+		}
+	}
+}
+
+TEE_Result tee_fs_htree_write_block(struct tee_fs_htree **ht_arg,
+				    size_t block_num, const void *block)
+{
+	struct tee_fs_htree *ht = *ht_arg;
+	TEE_Result res;
+	struct htree_node *node;
+	struct htree_block *blk;
+
+	if (!ht)
+		return TEE_ERROR_CORRUPT_OBJECT;
+
+	if (!htree_max_cached_blocks) {
+		res = write_block_to_storage(ht, block_num, block);
 		goto out;
-	if (len != ht->stor->block_size) {
-		res = TEE_ERROR_CORRUPT_OBJECT;
+	}
+
+	/* Make sure that the node exists and that max_node_id is updated */
+	res = get_block_node(ht, true, block_num, &node);
+	if (res != TEE_SUCCESS)
 		goto out;
+
+	blk = find_block(ht, block_num);
+	if (!blk) {
+		res = get_free_block(ht, &blk);
+		if (res != TEE_SUCCESS)
+			goto out;
+		blk->block_num = block_num;
+		TAILQ_INSERT_HEAD(&ht->blocks, blk, link);
 	}
 
-	res = authenc_init(&ctx, TEE_MODE_DECRYPT, ht, &node->node,
-			   ht->stor->block_size);
+	memcpy(blk->data, block, ht->stor->block_size);
+	blk->dirty = true;
+	ht->dirty = true;
+out:
 	if (res != TEE_SUCCESS)
+		tee_fs_htree_close(ht_arg);
+	return res;
+}
+
+TEE_Result tee_fs_htree_read_block(struct tee_fs_htree **ht_arg,
+				   size_t block_num, void *block)
+{
+	struct tee_fs_htree *ht = *ht_arg;
+	TEE_Result res;
+	struct htree_block *blk;
+
+	if (!ht)
+		return TEE_ERROR_CORRUPT_OBJECT;
+
+	if (!htree_max_cached_blocks) {
+		res = read_block_from_storage(ht, block_num, block);
 		goto out;
+	}
 
-	res = authenc_decrypt_final(ctx, node->node.tag, enc_block,
-				    ht->stor->block_size, block);
+	blk = find_block(ht, block_num);
+	if (!blk) {
+		res = get_free_block(ht, &blk);
+		if (res != TEE_SUCCESS)
+			goto out;
+
+		res = read_block_from_storage(ht, block_num, blk->data);
+		if (res != TEE_SUCCESS) {
+			put_free_block(ht, blk);
+			goto out;
+		}
+		blk->block_num = block_num;
+		TAILQ_INSERT_HEAD(&ht->blocks, blk, link);
+	}
+
+	memcpy(block, blk->data, ht->stor->block_size);
+	res = TEE_SUCCESS;
 out:
 	if (res != TEE_SUCCESS)
 		tee_fs_htree_close(ht_arg);
@@ -929,5 +1143,7 @@ TEE_Result tee_fs_htree_truncate(struct tee_fs_htree **ht_arg, size_t block_num)
 		ht->dirty = true;
 	}
 
+	drop_blocks(ht);
+
 	return TEE_SUCCESS;
 }
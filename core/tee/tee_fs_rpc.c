@@ -24,6 +24,20 @@ struct tee_fs_dir {
 	struct tee_fs_dirent d;
 };
 
+/*
+ * Limits of a struct tee_fs_rpc_batch, room for a 64 KiB write of REE FS
+ * data blocks together with the nodes and the head of the hash tree.
+ */
+#define BATCH_MAX_IOV		64
+#define BATCH_IOV_SIZE		(BATCH_MAX_IOV * sizeof(struct optee_mrf_iovec))
+#define BATCH_DATA_SIZE		(68 * 1024)
+
+/*
+ * Set once tee-supplicant has rejected OPTEE_MRF_WRITEV, it doesn't learn
+ * the command later so batches go straight to OPTEE_MRF_WRITE after that.
+ */
+static bool writev_unsupported;
+
 static TEE_Result operation_commit(struct tee_fs_rpc_operation *op)
 {
 	return thread_rpc_cmd(op->id, op->num_params, op->params);
@@ -211,9 +225,165 @@ TEE_Result tee_fs_rpc_write_init(struct tee_fs_rpc_operation *op,
 
 TEE_Result tee_fs_rpc_write_final(struct tee_fs_rpc_operation *op)
 {
+	/* Queued in a batch, committed by tee_fs_rpc_batch_final() */
+	if (!op->num_params)
+		return TEE_SUCCESS;
+
 	return operation_commit(op);
 }
 
+static TEE_Result batch_operation_commit(struct tee_fs_rpc_batch *b,
+					 struct tee_fs_rpc_operation *op)
+{
+#ifdef CFG_TEE_CORE_EMBED_INTERNAL_TESTS
+	if (b->commit)
+		return b->commit(b->commit_aux, op);
+#endif
+
+	return operation_commit(op);
+}
+
+static bool *writev_flag(struct tee_fs_rpc_batch *b __maybe_unused)
+{
+#ifdef CFG_TEE_CORE_EMBED_INTERNAL_TESTS
+	if (b->commit)
+		return &b->writev_unsupported;
+#endif
+
+	return &writev_unsupported;
+}
+
+static TEE_Result batch_commit_writev(struct tee_fs_rpc_batch *b)
+{
+	struct tee_fs_rpc_operation op = { .id = b->id, .num_params = 2 };
+
+	op.params[0].attr = OPTEE_MSG_ATTR_TYPE_VALUE_INPUT;
+	op.params[0].u.value.a = OPTEE_MRF_WRITEV;
+	op.params[0].u.value.b = b->fd;
+	op.params[0].u.value.c = b->num_iov;
+
+	if (!msg_param_init_memparam(op.params + 1, b->mobj, 0,
+				     BATCH_IOV_SIZE + b->data_len, b->cookie,
+				     MSG_PARAM_MEM_DIR_IN))
+		return TEE_ERROR_BAD_STATE;
+
+	return batch_operation_commit(b, &op);
+}
+
+static TEE_Result batch_commit_separately(struct tee_fs_rpc_batch *b)
+{
+	struct optee_mrf_iovec *iov = (struct optee_mrf_iovec *)b->va;
+	TEE_Result res;
+	size_t n;
+
+	for (n = 0; n < b->num_iov; n++) {
+		struct tee_fs_rpc_operation op = {
+			.id = b->id, .num_params = 2
+		};
+
+		op.params[0].attr = OPTEE_MSG_ATTR_TYPE_VALUE_INPUT;
+		op.params[0].u.value.a = OPTEE_MRF_WRITE;
+		op.params[0].u.value.b = b->fd;
+		op.params[0].u.value.c = iov[n].offset;
+
+		if (!msg_param_init_memparam(op.params + 1, b->mobj,
+					     iov[n].data_offs, iov[n].len,
+					     b->cookie, MSG_PARAM_MEM_DIR_IN))
+			return TEE_ERROR_BAD_STATE;
+
+		res = batch_operation_commit(b, &op);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result batch_commit(struct tee_fs_rpc_batch *b)
+{
+	TEE_Result res;
+
+	if (!b->num_iov)
+		return TEE_SUCCESS;
+
+	if (!*writev_flag(b)) {
+		res = batch_commit_writev(b);
+		if (res != TEE_ERROR_NOT_SUPPORTED &&
+		    res != TEE_ERROR_BAD_PARAMETERS)
+			goto out;
+		DMSG("OPTEE_MRF_WRITEV not supported, using OPTEE_MRF_WRITE");
+		*writev_flag(b) = true;
+	}
+
+	res = batch_commit_separately(b);
+out:
+	b->num_iov = 0;
+	b->data_len = 0;
+	return res;
+}
+
+void tee_fs_rpc_batch_init(struct tee_fs_rpc_batch *b, uint32_t id, int fd)
+{
+	memset(b, 0, sizeof(*b));
+	b->id = id;
+	b->fd = fd;
+}
+
+TEE_Result tee_fs_rpc_batch_write_init(struct tee_fs_rpc_batch *b,
+				       struct tee_fs_rpc_operation *op,
+				       tee_fs_off_t offset, size_t data_len,
+				       void **data)
+{
+	TEE_Result res;
+	struct optee_mrf_iovec *iov;
+
+	if (offset < 0 || data_len > BATCH_DATA_SIZE)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (b->num_iov == BATCH_MAX_IOV ||
+	    b->data_len + data_len > BATCH_DATA_SIZE) {
+		res = batch_commit(b);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	/*
+	 * The FS RPC cache memory may have been used by other requests
+	 * since the last commit.
+	 */
+	if (!b->num_iov) {
+		b->va = tee_fs_rpc_cache_alloc(BATCH_IOV_SIZE + BATCH_DATA_SIZE,
+					       &b->mobj, &b->cookie);
+		if (!b->va)
+			return TEE_ERROR_OUT_OF_MEMORY;
+	}
+
+	iov = (struct optee_mrf_iovec *)b->va + b->num_iov;
+	iov->offset = offset;
+	iov->data_offs = BATCH_IOV_SIZE + b->data_len;
+	iov->len = data_len;
+	b->num_iov++;
+	b->data_len += data_len;
+
+	memset(op, 0, sizeof(*op));
+	op->id = b->id;
+
+	*data = b->va + iov->data_offs;
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_rpc_batch_final(struct tee_fs_rpc_batch *b)
+{
+	return batch_commit(b);
+}
+
+void tee_fs_rpc_batch_abort(struct tee_fs_rpc_batch *b)
+{
+	b->num_iov = 0;
+	b->data_len = 0;
+}
+
 TEE_Result tee_fs_rpc_truncate(uint32_t id, int fd, size_t len)
 {
 	struct tee_fs_rpc_operation op = { .id = id, .num_params = 1 };
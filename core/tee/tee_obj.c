@@ -28,6 +28,7 @@
 
 #include <tee/tee_obj.h>
 
+#include <kernel/handle.h>
 #include <stdlib.h>
 #include <tee_api_defines.h>
 #include <mm/tee_mmu.h>
@@ -37,9 +38,17 @@
 #include <tee/tee_svc_storage.h>
 #include <tee/tee_svc_cryp.h>
 
-void tee_obj_add(struct user_ta_ctx *utc, struct tee_obj *o)
+TEE_Result tee_obj_add(struct user_ta_ctx *utc, struct tee_obj *o)
 {
+	int h;
+
 	TAILQ_INSERT_TAIL(&utc->objects, o, link);
+
+	h = handle_get(&utc->obj_db, o);
+	if (h < 0)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	o->handle = h;
+	return TEE_SUCCESS;
 }
 
 TEE_Result tee_obj_get(struct user_ta_ctx *utc, uint32_t obj_id,
@@ -47,18 +56,21 @@ TEE_Result tee_obj_get(struct user_ta_ctx *utc, uint32_t obj_id,
 {
 	struct tee_obj *o;
 
-	TAILQ_FOREACH(o, &utc->objects, link) {
-		if (obj_id == (vaddr_t)o) {
-			*obj = o;
-			return TEE_SUCCESS;
-		}
-	}
-	return TEE_ERROR_BAD_PARAMETERS;
+	if (obj_id > INT32_MAX)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	o = handle_lookup(&utc->obj_db, obj_id);
+	if (!o)
+		return TEE_ERROR_BAD_PARAMETERS;
+	*obj = o;
+	return TEE_SUCCESS;
 }
 
 void tee_obj_close(struct user_ta_ctx *utc, struct tee_obj *o)
 {
 	TAILQ_REMOVE(&utc->objects, o, link);
+	if (o->handle)
+		handle_put(&utc->obj_db, o->handle);
 
 	if ((o->info.handleFlags & TEE_HANDLE_FLAG_PERSISTENT)) {
 		o->pobj->fops->close(&o->fh);
@@ -32,6 +32,9 @@ struct tee_fs_fd {
 	int fd;
 	struct tee_fs_dirfile_fileh dfh;
 	const TEE_UUID *uuid;
+	struct tee_fs_rpc_batch batch;
+	/* Nesting depth of ree_fs_rpc_write_begin() */
+	unsigned int batch_depth;
 };
 
 struct tee_fs_dir {
@@ -72,7 +75,9 @@ static TEE_Result out_of_place_write(struct tee_fs_fd *fdp, size_t pos,
 		if (size_to_write + offset > BLOCK_SIZE)
 			size_to_write = BLOCK_SIZE - offset;
 
-		if (start_block_num * BLOCK_SIZE <
+		/* A completely overwritten block isn't read first */
+		if (size_to_write != BLOCK_SIZE &&
+		    start_block_num * BLOCK_SIZE <
 		    ROUNDUP(meta->length, BLOCK_SIZE)) {
 			res = tee_fs_htree_read_block(&fdp->ht,
 						      start_block_num, block);
@@ -206,6 +211,13 @@ static TEE_Result ree_fs_rpc_read_init(void *aux,
 	if (res != TEE_SUCCESS)
 		return res;
 
+	/* Queued writes must reach storage before anything is read back */
+	if (fdp->batch_depth) {
+		res = tee_fs_rpc_batch_final(&fdp->batch);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
 	return tee_fs_rpc_read_init(op, OPTEE_MSG_RPC_CMD_FS, fdp->fd,
 				    offs, size, data);
 }
@@ -224,16 +236,73 @@ static TEE_Result ree_fs_rpc_write_init(void *aux,
 	if (res != TEE_SUCCESS)
 		return res;
 
+	if (fdp->batch_depth)
+		return tee_fs_rpc_batch_write_init(&fdp->batch, op, offs,
+						   size, data);
+
 	return tee_fs_rpc_write_init(op, OPTEE_MSG_RPC_CMD_FS, fdp->fd,
 				     offs, size, data);
 }
 
+/*
+ * Writes between ree_fs_rpc_write_begin() and ree_fs_rpc_write_end() are
+ * queued in a batch. The calls may be nested, the batch is committed by
+ * the outermost ree_fs_rpc_write_end() so that the data blocks, the nodes
+ * and the head of a write usually reach storage with a single request.
+ */
+static TEE_Result ree_fs_rpc_write_begin(void *aux)
+{
+	struct tee_fs_fd *fdp = aux;
+
+	if (!fdp->batch_depth)
+		tee_fs_rpc_batch_init(&fdp->batch, OPTEE_MSG_RPC_CMD_FS,
+				      fdp->fd);
+	fdp->batch_depth++;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result ree_fs_rpc_write_end(void *aux, bool abort)
+{
+	struct tee_fs_fd *fdp = aux;
+
+	assert(fdp->batch_depth);
+	fdp->batch_depth--;
+
+	if (abort) {
+		tee_fs_rpc_batch_abort(&fdp->batch);
+		return TEE_SUCCESS;
+	}
+	if (fdp->batch_depth)
+		return TEE_SUCCESS;
+
+	return tee_fs_rpc_batch_final(&fdp->batch);
+}
+
+/*
+ * Ends writes started with ree_fs_rpc_write_begin(), @res is the result
+ * of the writes. If something failed the hash tree is closed as it may
+ * refer to data which never reached storage.
+ */
+static TEE_Result ree_fs_end_writes(struct tee_fs_fd *fdp, TEE_Result res)
+{
+	TEE_Result res2 = ree_fs_rpc_write_end(fdp, res != TEE_SUCCESS);
+
+	if (res == TEE_SUCCESS)
+		res = res2;
+	if (res != TEE_SUCCESS)
+		tee_fs_htree_close(&fdp->ht);
+	return res;
+}
+
 static const struct tee_fs_htree_storage ree_fs_storage_ops = {
 	.block_size = BLOCK_SIZE,
 	.rpc_read_init = ree_fs_rpc_read_init,
 	.rpc_read_final = tee_fs_rpc_read_final,
 	.rpc_write_init = ree_fs_rpc_write_init,
 	.rpc_write_final = tee_fs_rpc_write_final,
+	.rpc_write_begin = ree_fs_rpc_write_begin,
+	.rpc_write_end = ree_fs_rpc_write_end,
 };
 
 static TEE_Result ree_fs_ftruncate_internal(struct tee_fs_fd *fdp,
@@ -263,6 +332,13 @@ static TEE_Result ree_fs_ftruncate_internal(struct tee_fs_fd *fdp,
 		if (res != TEE_SUCCESS)
 			return res;
 
+		/* Queued writes go first to keep the order of the requests */
+		if (fdp->batch_depth) {
+			res = tee_fs_rpc_batch_final(&fdp->batch);
+			if (res != TEE_SUCCESS)
+				return res;
+		}
+
 		res = tee_fs_rpc_truncate(OPTEE_MSG_RPC_CMD_FS, fdp->fd,
 					  offs + sz);
 		if (res != TEE_SUCCESS)
@@ -361,13 +437,16 @@ static TEE_Result ree_fs_write_primitive(struct tee_file_handle *fh, size_t pos,
 	if ((pos + len) < len)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	if (file_size < pos) {
+	res = ree_fs_rpc_write_begin(fdp);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (file_size < pos)
 		res = ree_fs_ftruncate_internal(fdp, pos);
-		if (res != TEE_SUCCESS)
-			return res;
-	}
+	if (res == TEE_SUCCESS)
+		res = out_of_place_write(fdp, pos, buf, len);
 
-	return out_of_place_write(fdp, pos, buf, len);
+	return ree_fs_end_writes(fdp, res);
 }
 
 static TEE_Result ree_fs_open_primitive(bool create, uint8_t *hash,
@@ -682,28 +761,34 @@ static TEE_Result ree_fs_create(struct tee_pobj *po, bool overwrite,
 	if (res)
 		goto out;
 
+	fdp = (struct tee_fs_fd *)*fh;
+	res = ree_fs_rpc_write_begin(fdp);
+	if (res)
+		goto out;
+
 	if (head && head_size) {
 		res = ree_fs_write_primitive(*fh, pos, head, head_size);
 		if (res)
-			goto out;
+			goto out_end;
 		pos += head_size;
 	}
 
 	if (attr && attr_size) {
 		res = ree_fs_write_primitive(*fh, pos, attr, attr_size);
 		if (res)
-			goto out;
+			goto out_end;
 		pos += attr_size;
 	}
 
 	if (data && data_size) {
 		res = ree_fs_write_primitive(*fh, pos, data, data_size);
 		if (res)
-			goto out;
+			goto out_end;
 	}
 
-	fdp = (struct tee_fs_fd *)*fh;
 	res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
+out_end:
+	res = ree_fs_end_writes(fdp, res);
 	if (res)
 		goto out;
 
@@ -735,11 +820,13 @@ static TEE_Result ree_fs_write(struct tee_file_handle *fh, size_t pos,
 	if (res)
 		goto out;
 
-	res = ree_fs_write_primitive(fh, pos, buf, len);
+	res = ree_fs_rpc_write_begin(fdp);
 	if (res)
 		goto out;
-
-	res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
+	res = ree_fs_write_primitive(fh, pos, buf, len);
+	if (!res)
+		res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
+	res = ree_fs_end_writes(fdp, res);
 	if (res)
 		goto out;
 
@@ -855,11 +942,13 @@ static TEE_Result ree_fs_truncate(struct tee_file_handle *fh, size_t len)
 	if (res)
 		goto out;
 
-	res = ree_fs_ftruncate_internal(fdp, len);
+	res = ree_fs_rpc_write_begin(fdp);
 	if (res)
 		goto out;
-
-	res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
+	res = ree_fs_ftruncate_internal(fdp, len);
+	if (!res)
+		res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
+	res = ree_fs_end_writes(fdp, res);
 	if (res)
 		goto out;
 
@@ -134,6 +134,52 @@ struct tee_fs_dir {
 
 static struct rpmb_fs_parameters *fs_par;
 
+/**
+ * Cached copy of a FAT entry. Only active entries keep a filename, they
+ * are also linked into the hash chains of the FAT cache.
+ */
+struct rpmb_fat_cache_entry {
+	uint32_t start_address;
+	uint32_t data_size;
+	uint32_t flags;
+	uint32_t write_counter;
+	uint8_t fek[TEE_FS_KM_FEK_SIZE];
+	char *filename;
+	uint32_t hash;
+	/* Index of next entry in the hash chain or FAT_CACHE_NONE */
+	size_t next;
+	/* RPMB area holding the file data, NULL if there's no data */
+	tee_mm_entry_t *mm;
+};
+
+/**
+ * In-core copy of the FAT.
+ *
+ * The cache is loaded by rpmb_fs_setup() with a single walk of the FAT in
+ * RPMB and is then kept up to date by write_fat_entry(). Entry i of the
+ * cache is FAT entry i in RPMB. Files are looked up by hashing the
+ * filename, the hash table has as many buckets as there are allocated
+ * entries. The pool is the map of used RPMB areas (partition data, FAT
+ * and file data of active entries), free areas are allocated from it.
+ *
+ * Protected by rpmb_mutex.
+ */
+struct rpmb_fat_cache {
+	struct rpmb_fat_cache_entry *entries;
+	size_t num_entries;
+	size_t max_entries;
+	size_t *buckets;
+	tee_mm_pool_t pool;
+	/* RPMB area holding the partition data and the FAT */
+	tee_mm_entry_t *fat_mm;
+	bool loaded;
+};
+
+#define FAT_CACHE_NONE			SIZE_MAX
+#define FAT_CACHE_INITIAL_ENTRIES	16
+
+static struct rpmb_fat_cache fat_cache;
+
 /*
  * Lower interface to RPMB device
  */
@@ -435,12 +481,16 @@ func_exit:
 	return res;
 }
 
+/*
+ * Request and response share one RPC payload buffer, the response
+ * starting at resp_offs. This saves one allocation and one free RPC per
+ * RPMB access.
+ */
 struct tee_rpmb_mem {
-	struct mobj *phreq_mobj;
-	uint64_t phreq_cookie;
-	struct mobj *phresp_mobj;
-	uint64_t phresp_cookie;
+	struct mobj *mobj;
+	uint64_t cookie;
 	size_t req_size;
+	size_t resp_offs;
 	size_t resp_size;
 };
 
@@ -449,15 +499,10 @@ static void tee_rpmb_free(struct tee_rpmb_mem *mem)
 	if (!mem)
 		return;
 
-	if (mem->phreq_mobj) {
-		thread_rpc_free_payload(mem->phreq_cookie, mem->phreq_mobj);
-		mem->phreq_cookie = 0;
-		mem->phreq_mobj = NULL;
-	}
-	if (mem->phresp_mobj) {
-		thread_rpc_free_payload(mem->phresp_cookie, mem->phresp_mobj);
-		mem->phresp_cookie = 0;
-		mem->phresp_mobj = NULL;
+	if (mem->mobj) {
+		thread_rpc_free_payload(mem->cookie, mem->mobj);
+		mem->cookie = 0;
+		mem->mobj = NULL;
 	}
 }
 
@@ -474,23 +519,21 @@ static TEE_Result tee_rpmb_alloc(size_t req_size, size_t resp_size,
 
 	memset(mem, 0, sizeof(*mem));
 
-	mem->phreq_mobj = thread_rpc_alloc_payload(req_s, &mem->phreq_cookie);
-	mem->phresp_mobj =
-		thread_rpc_alloc_payload(resp_s, &mem->phresp_cookie);
-
-	if (!mem->phreq_mobj || !mem->phresp_mobj) {
+	mem->mobj = thread_rpc_alloc_payload(req_s + resp_s, &mem->cookie);
+	if (!mem->mobj) {
 		res = TEE_ERROR_OUT_OF_MEMORY;
 		goto out;
 	}
 
-	*req = mobj_get_va(mem->phreq_mobj, 0);
-	*resp = mobj_get_va(mem->phresp_mobj, 0);
+	*req = mobj_get_va(mem->mobj, 0);
+	*resp = mobj_get_va(mem->mobj, req_s);
 	if (!*req || !*resp) {
 		res = TEE_ERROR_GENERIC;
 		goto out;
 	}
 
 	mem->req_size = req_size;
+	mem->resp_offs = req_s;
 	mem->resp_size = resp_size;
 
 out:
@@ -505,13 +548,13 @@ static TEE_Result tee_rpmb_invoke(struct tee_rpmb_mem *mem)
 
 	memset(params, 0, sizeof(params));
 
-	if (!msg_param_init_memparam(params + 0, mem->phreq_mobj, 0,
-				     mem->req_size, mem->phreq_cookie,
+	if (!msg_param_init_memparam(params + 0, mem->mobj, 0,
+				     mem->req_size, mem->cookie,
 				     MSG_PARAM_MEM_DIR_IN))
 		return TEE_ERROR_BAD_STATE;
 
-	if (!msg_param_init_memparam(params + 1, mem->phresp_mobj, 0,
-				     mem->resp_size, mem->phresp_cookie,
+	if (!msg_param_init_memparam(params + 1, mem->mobj, mem->resp_offs,
+				     mem->resp_size, mem->cookie,
 				     MSG_PARAM_MEM_DIR_OUT))
 		return TEE_ERROR_BAD_STATE;
 
@@ -1161,8 +1204,9 @@ static TEE_Result tee_rpmb_init(uint16_t dev_id)
 
 		memcpy(rpmb_ctx->cid, dev_info.cid, RPMB_EMMC_CID_SIZE);
 
-#ifdef RPMB_DRIVER_MULTIPLE_WRITE_FIXED
-		rpmb_ctx->rel_wr_blkcnt = dev_info.rel_wr_sec_c * 2;
+#ifdef CFG_RPMB_MULTIBLOCK_WRITE
+		/* rel_wr_sec_c counts 512-byte sectors, that is two blocks */
+		rpmb_ctx->rel_wr_blkcnt = MAX(dev_info.rel_wr_sec_c * 2, 1);
 #else
 		rpmb_ctx->rel_wr_blkcnt = 1;
 #endif
@@ -1290,6 +1334,29 @@ func_exit:
 	return res;
 }
 
+/*
+ * If not 0, limits the number of blocks sent in each authenticated data
+ * write request below the reliable write block count. Only changed when
+ * benchmarking.
+ */
+static uint16_t rpmb_max_wr_blkcnt;
+
+/* Scratch file written by tee_rpmb_fs_bench_write() */
+#define RPMB_BENCH_FILENAME	"rpmb_write_bench.tmp"
+
+/* Returns the number of blocks to send in one authenticated write */
+static uint16_t tee_rpmb_wr_blkcnt(void)
+{
+	if (rpmb_max_wr_blkcnt && rpmb_max_wr_blkcnt < rpmb_ctx->rel_wr_blkcnt)
+		return rpmb_max_wr_blkcnt;
+	return rpmb_ctx->rel_wr_blkcnt;
+}
+
+/*
+ * Writes @blkcnt blocks. The blocks are sent in as few requests as
+ * possible, each request carrying up to tee_rpmb_wr_blkcnt() blocks
+ * authenticated by a single MAC and incrementing the write counter once.
+ */
 static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 				     const uint8_t *data_blks, uint16_t blkcnt,
 				     const uint8_t *fek, const TEE_UUID *uuid)
@@ -1298,6 +1365,7 @@ static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 	struct tee_rpmb_mem mem;
 	uint16_t msg_type;
 	uint32_t wr_cnt;
+	uint16_t wr_blkcnt;
 	uint8_t hmac[RPMB_KEY_MAC_SIZE];
 	struct rpmb_req *req = NULL;
 	struct rpmb_data_frame *resp = NULL;
@@ -1323,12 +1391,13 @@ static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 	 * We need to split data when block count
 	 * is bigger than reliable block write count.
 	 */
-	if (blkcnt < rpmb_ctx->rel_wr_blkcnt)
+	wr_blkcnt = tee_rpmb_wr_blkcnt();
+	if (blkcnt < wr_blkcnt)
 		req_size = sizeof(struct rpmb_req) +
 		    RPMB_DATA_FRAME_SIZE * blkcnt;
 	else
 		req_size = sizeof(struct rpmb_req) +
-		    RPMB_DATA_FRAME_SIZE * rpmb_ctx->rel_wr_blkcnt;
+		    RPMB_DATA_FRAME_SIZE * wr_blkcnt;
 
 	resp_size = RPMB_DATA_FRAME_SIZE;
 	res = tee_rpmb_alloc(req_size, resp_size, &mem,
@@ -1336,11 +1405,11 @@ static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	nbr_writes = blkcnt / rpmb_ctx->rel_wr_blkcnt;
-	if (blkcnt % rpmb_ctx->rel_wr_blkcnt > 0)
+	nbr_writes = blkcnt / wr_blkcnt;
+	if (blkcnt % wr_blkcnt > 0)
 		nbr_writes += 1;
 
-	tmp_blkcnt = rpmb_ctx->rel_wr_blkcnt;
+	tmp_blkcnt = wr_blkcnt;
 	tmp_blk_idx = blk_idx;
 	for (i = 0; i < nbr_writes; i++) {
 		/*
@@ -1348,8 +1417,7 @@ static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 		 * equal or smaller than reliable write block count.
 		 */
 		if (i == nbr_writes - 1)
-			tmp_blkcnt = blkcnt - rpmb_ctx->rel_wr_blkcnt *
-			    (nbr_writes - 1);
+			tmp_blkcnt = blkcnt - wr_blkcnt * (nbr_writes - 1);
 
 		msg_type = RPMB_MSG_TYPE_REQ_AUTH_DATA_WRITE;
 		wr_cnt = rpmb_ctx->wr_cnt;
@@ -1364,7 +1432,7 @@ static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 		rawdata.write_counter = &wr_cnt;
 		rawdata.key_mac = hmac;
 		rawdata.data = (uint8_t *)data_blks +
-				i * rpmb_ctx->rel_wr_blkcnt * RPMB_DATA_SIZE;
+				i * wr_blkcnt * RPMB_DATA_SIZE;
 
 		res = tee_rpmb_req_pack(req, &rawdata, tmp_blkcnt, dev_id,
 					fek, uuid);
@@ -1416,7 +1484,7 @@ static bool tee_rpmb_write_is_atomic(uint16_t dev_id __unused, uint32_t addr,
 	uint16_t blkcnt = ROUNDUP(len + byte_offset,
 				  RPMB_DATA_SIZE) / RPMB_DATA_SIZE;
 
-	return (blkcnt <= rpmb_ctx->rel_wr_blkcnt);
+	return (blkcnt <= tee_rpmb_wr_blkcnt());
 }
 
 /*
@@ -1533,9 +1601,223 @@ func_exit:
  * End of lower interface to RPMB device
  */
 
-static TEE_Result get_fat_start_address(uint32_t *addr);
+static uint32_t fat_cache_hash(const char *filename)
+{
+	const uint8_t *p = (const uint8_t *)filename;
+	uint32_t hash = 2166136261;	/* FNV-1a */
 
-static void dump_fat(void)
+	while (*p) {
+		hash ^= *p++;
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+static size_t *fat_cache_bucket(uint32_t hash)
+{
+	return fat_cache.buckets + (hash & (fat_cache.max_entries - 1));
+}
+
+static void fat_cache_link(size_t idx)
+{
+	struct rpmb_fat_cache_entry *ce = fat_cache.entries + idx;
+	size_t *bucket = fat_cache_bucket(ce->hash);
+
+	ce->next = *bucket;
+	*bucket = idx;
+}
+
+static void fat_cache_unlink(size_t idx)
+{
+	size_t *p = fat_cache_bucket(fat_cache.entries[idx].hash);
+
+	while (*p != idx)
+		p = &fat_cache.entries[*p].next;
+	*p = fat_cache.entries[idx].next;
+}
+
+static uint32_t fat_cache_idx_to_addr(size_t idx)
+{
+	return fs_par->fat_start_address + idx * sizeof(struct rpmb_fat_entry);
+}
+
+static void fat_cache_invalidate(void)
+{
+	size_t n;
+
+	for (n = 0; n < fat_cache.num_entries; n++)
+		free(fat_cache.entries[n].filename);
+	free(fat_cache.entries);
+	free(fat_cache.buckets);
+	/* Releases fat_mm and the mm of each entry too */
+	tee_mm_final(&fat_cache.pool);
+	memset(&fat_cache, 0, sizeof(fat_cache));
+}
+
+static TEE_Result fat_cache_grow(void)
+{
+	struct rpmb_fat_cache_entry *entries;
+	size_t *buckets;
+	size_t max_entries;
+	size_t n;
+
+	if (fat_cache.max_entries)
+		max_entries = fat_cache.max_entries * 2;
+	else
+		max_entries = FAT_CACHE_INITIAL_ENTRIES;
+
+	entries = realloc(fat_cache.entries, max_entries * sizeof(*entries));
+	if (!entries)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	fat_cache.entries = entries;
+
+	buckets = realloc(fat_cache.buckets, max_entries * sizeof(*buckets));
+	if (!buckets)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	fat_cache.buckets = buckets;
+	fat_cache.max_entries = max_entries;
+
+	/* The number of buckets has changed, rehash everything */
+	for (n = 0; n < max_entries; n++)
+		buckets[n] = FAT_CACHE_NONE;
+	for (n = 0; n < fat_cache.num_entries; n++)
+		if (entries[n].filename)
+			fat_cache_link(n);
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * Replaces cached entry @idx with @fe, @idx == fat_cache.num_entries
+ * appends an entry. The cache must be invalidated if this fails.
+ */
+static TEE_Result fat_cache_set(size_t idx, const struct rpmb_fat_entry *fe)
+{
+	TEE_Result res;
+	struct rpmb_fat_cache_entry *ce;
+
+	if (idx > fat_cache.num_entries)
+		return TEE_ERROR_BAD_STATE;
+
+	if (idx == fat_cache.num_entries) {
+		if (idx == fat_cache.max_entries) {
+			res = fat_cache_grow();
+			if (res != TEE_SUCCESS)
+				return res;
+		}
+		ce = fat_cache.entries + idx;
+		memset(ce, 0, sizeof(*ce));
+		ce->next = FAT_CACHE_NONE;
+		fat_cache.num_entries++;
+	} else {
+		ce = fat_cache.entries + idx;
+		if (ce->filename) {
+			fat_cache_unlink(idx);
+			free(ce->filename);
+			ce->filename = NULL;
+		}
+		tee_mm_free(ce->mm);
+		ce->mm = NULL;
+	}
+
+	ce->start_address = fe->start_address;
+	ce->data_size = fe->data_size;
+	ce->flags = fe->flags;
+	ce->write_counter = fe->write_counter;
+	memcpy(ce->fek, fe->fek, sizeof(ce->fek));
+
+	if (!(fe->flags & FILE_IS_ACTIVE))
+		return TEE_SUCCESS;
+
+	/* Existing files are added to the map of used RPMB areas */
+	if (fe->data_size) {
+		ce->mm = tee_mm_alloc2(&fat_cache.pool, fe->start_address,
+				       fe->data_size);
+		if (!ce->mm)
+			return TEE_ERROR_OUT_OF_MEMORY;
+	}
+
+	ce->filename = strndup(fe->filename, sizeof(fe->filename));
+	if (!ce->filename)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	ce->hash = fat_cache_hash(ce->filename);
+	fat_cache_link(idx);
+
+	return TEE_SUCCESS;
+}
+
+static void fat_cache_get(size_t idx, struct rpmb_fat_entry *fe)
+{
+	struct rpmb_fat_cache_entry *ce = fat_cache.entries + idx;
+
+	memset(fe, 0, sizeof(*fe));
+	fe->start_address = ce->start_address;
+	fe->data_size = ce->data_size;
+	fe->flags = ce->flags;
+	fe->write_counter = ce->write_counter;
+	memcpy(fe->fek, ce->fek, sizeof(fe->fek));
+	if (ce->filename)
+		memcpy(fe->filename, ce->filename, strlen(ce->filename));
+}
+
+/* Returns the index of the first active entry matching @filename */
+static size_t fat_cache_find(const char *filename)
+{
+	uint32_t hash = fat_cache_hash(filename);
+	size_t found = FAT_CACHE_NONE;
+	size_t idx;
+
+	for (idx = *fat_cache_bucket(hash); idx != FAT_CACHE_NONE;
+	     idx = fat_cache.entries[idx].next) {
+		if (idx < found && fat_cache.entries[idx].hash == hash &&
+		    !strcmp(fat_cache.entries[idx].filename, filename))
+			found = idx;
+	}
+
+	return found;
+}
+
+/*
+ * Returns the index of the first unused entry, at worst the last FAT
+ * entry which is never active.
+ */
+static size_t fat_cache_find_unused(void)
+{
+	size_t idx;
+
+	for (idx = 0; idx < fat_cache.num_entries; idx++)
+		if (!(fat_cache.entries[idx].flags & FILE_IS_ACTIVE))
+			break;
+
+	assert(idx < fat_cache.num_entries);
+	return idx;
+}
+
+/*
+ * Makes sure that the partition data and the first @num_entries FAT
+ * entries are reserved in the pool. The cache must be invalidated if this
+ * fails.
+ */
+static TEE_Result fat_cache_reserve_fat(size_t num_entries)
+{
+	size_t size = fat_cache_idx_to_addr(num_entries) -
+		      RPMB_STORAGE_START_ADDRESS;
+
+	if (tee_mm_get_bytes(fat_cache.fat_mm) >= size)
+		return TEE_SUCCESS;
+
+	tee_mm_free(fat_cache.fat_mm);
+	fat_cache.fat_mm = tee_mm_alloc2(&fat_cache.pool,
+					 RPMB_STORAGE_START_ADDRESS, size);
+	if (!fat_cache.fat_mm)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	return TEE_SUCCESS;
+}
+
+/* Reads the FAT from RPMB into the cache unless it's already loaded */
+static TEE_Result fat_cache_load(void)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
 	struct rpmb_fat_entry *fat_entries = NULL;
@@ -1544,9 +1826,14 @@ static void dump_fat(void)
 	int i;
 	bool last_entry_found = false;
 
-	res = get_fat_start_address(&fat_address);
-	if (res != TEE_SUCCESS)
-		goto out;
+	if (fat_cache.loaded)
+		return TEE_SUCCESS;
+
+	/* Upper memory allocation must be used for RPMB_FS. */
+	if (!tee_mm_init(&fat_cache.pool, RPMB_STORAGE_START_ADDRESS,
+			 fs_par->max_rpmb_address, RPMB_BLOCK_SIZE_SHIFT,
+			 TEE_MM_POOL_HI_ALLOC))
+		return TEE_ERROR_OUT_OF_MEMORY;
 
 	size = N_ENTRIES * sizeof(struct rpmb_fat_entry);
 	fat_entries = malloc(size);
@@ -1555,6 +1842,7 @@ static void dump_fat(void)
 		goto out;
 	}
 
+	fat_address = fs_par->fat_start_address;
 	while (!last_entry_found) {
 		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_address,
 				    (uint8_t *)fat_entries, size, NULL, NULL);
@@ -1562,25 +1850,58 @@ static void dump_fat(void)
 			goto out;
 
 		for (i = 0; i < N_ENTRIES; i++) {
-
-			FMSG("flags 0x%x, size %d, address 0x%x, filename '%s'",
-				fat_entries[i].flags,
-				fat_entries[i].data_size,
-				fat_entries[i].start_address,
-				fat_entries[i].filename);
+			res = fat_cache_set(fat_cache.num_entries,
+					    fat_entries + i);
+			if (res != TEE_SUCCESS)
+				goto out;
 
 			if ((fat_entries[i].flags & FILE_IS_LAST_ENTRY) != 0) {
 				last_entry_found = true;
 				break;
 			}
-
-			/* Move to next fat_entry. */
-			fat_address += sizeof(struct rpmb_fat_entry);
 		}
+
+		fat_address += size;
 	}
 
+	res = fat_cache_reserve_fat(fat_cache.num_entries);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	fat_cache.loaded = true;
+
 out:
 	free(fat_entries);
+	if (res != TEE_SUCCESS)
+		fat_cache_invalidate();
+	return res;
+}
+
+/* Updates the cache with the FAT entry just written from @fh */
+static TEE_Result fat_cache_update(struct rpmb_file_handle *fh)
+{
+	if (!fat_cache.loaded)
+		return TEE_SUCCESS;
+
+	if (fh->rpmb_fat_address < fs_par->fat_start_address)
+		return TEE_ERROR_BAD_STATE;
+
+	return fat_cache_set((fh->rpmb_fat_address -
+			      fs_par->fat_start_address) /
+			     sizeof(struct rpmb_fat_entry), &fh->fat_entry);
+}
+
+static void dump_fat(void)
+{
+	size_t n;
+
+	for (n = 0; n < fat_cache.num_entries; n++)
+		FMSG("flags 0x%x, size %d, address 0x%x, filename '%s'",
+			fat_cache.entries[n].flags,
+			fat_cache.entries[n].data_size,
+			fat_cache.entries[n].start_address,
+			fat_cache.entries[n].filename ?
+			fat_cache.entries[n].filename : "");
 }
 
 #if (TRACE_LEVEL >= TRACE_DEBUG)
@@ -1644,6 +1965,13 @@ static TEE_Result write_fat_entry(struct rpmb_file_handle *fh,
 			     (uint8_t *)&fh->fat_entry,
 			     sizeof(struct rpmb_fat_entry), NULL, NULL);
 
+	/*
+	 * If the write failed we don't know what ended up in RPMB, drop the
+	 * cache so that it's reloaded on next access.
+	 */
+	if (res != TEE_SUCCESS || fat_cache_update(fh) != TEE_SUCCESS)
+		fat_cache_invalidate();
+
 	dump_fat();
 
 out:
@@ -1653,7 +1981,7 @@ out:
 /**
  * rpmb_fs_setup: Setup rpmb fs.
  * Set initial partition and FS values and write to RPMB.
- * Store frequently used data in RAM.
+ * Store frequently used data, including the FAT cache, in RAM.
  */
 static TEE_Result rpmb_fs_setup(void)
 {
@@ -1663,7 +1991,7 @@ static TEE_Result rpmb_fs_setup(void)
 	uint32_t max_rpmb_block = 0;
 
 	if (fs_par) {
-		res = TEE_SUCCESS;
+		res = fat_cache_load();
 		goto out;
 	}
 
@@ -1725,6 +2053,8 @@ static TEE_Result rpmb_fs_setup(void)
 	res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, RPMB_STORAGE_START_ADDRESS,
 			     (uint8_t *)partition_data,
 			     sizeof(struct rpmb_fs_partition), NULL, NULL);
+	if (res != TEE_SUCCESS)
+		goto out;
 
 #ifndef CFG_RPMB_RESET_FAT
 store_fs_par:
@@ -1740,6 +2070,10 @@ store_fs_par:
 	fs_par->fat_start_address = partition_data->fat_start_address;
 	fs_par->max_rpmb_address = max_rpmb_block << RPMB_BLOCK_SIZE_SHIFT;
 
+	res = fat_cache_load();
+	if (res != TEE_SUCCESS)
+		goto out;
+
 	dump_fat();
 
 out:
@@ -1749,172 +2083,59 @@ out:
 }
 
 /**
- * get_fat_start_address:
- * FAT start_address from fs_par.
- */
-static TEE_Result get_fat_start_address(uint32_t *addr)
-{
-	if (!fs_par)
-		return TEE_ERROR_NO_DATA;
-
-	*addr = fs_par->fat_start_address;
-
-	return TEE_SUCCESS;
-}
-
-/**
- * read_fat: Read FAT entries
+ * read_fat: Look up FAT entries in the FAT cache
  * Return matching FAT entry for read, rm rename and stat.
- * Build up memory pool and return matching entry for write operation.
- * "Last FAT entry" can be returned during write.
+ * Return an unused FAT entry if there's no match and @alloc_entry is set
+ * (create). "Last FAT entry" can be returned during create, in which case
+ * the FAT is expanded.
  */
-static TEE_Result read_fat(struct rpmb_file_handle *fh, tee_mm_pool_t *p)
+static TEE_Result read_fat(struct rpmb_file_handle *fh, bool alloc_entry)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
-	tee_mm_entry_t *mm = NULL;
-	struct rpmb_fat_entry *fat_entries = NULL;
-	uint32_t fat_address;
-	size_t size;
-	int i;
-	bool entry_found = false;
-	bool last_entry_found = false;
-	bool expand_fat = false;
 	struct rpmb_file_handle last_fh;
+	size_t idx;
 
 	DMSG("fat_address %d", fh->rpmb_fat_address);
 
 	res = rpmb_fs_setup();
 	if (res != TEE_SUCCESS)
-		goto out;
-
-	res = get_fat_start_address(&fat_address);
-	if (res != TEE_SUCCESS)
-		goto out;
+		return res;
 
-	size = N_ENTRIES * sizeof(struct rpmb_fat_entry);
-	fat_entries = malloc(size);
-	if (!fat_entries) {
-		res = TEE_ERROR_OUT_OF_MEMORY;
-		goto out;
-	}
+	idx = fat_cache_find(fh->filename);
+	if (idx == FAT_CACHE_NONE && alloc_entry && !fh->rpmb_fat_address) {
+		/* Unused FAT entries can be reused */
+		idx = fat_cache_find_unused();
 
-	/*
-	 * The pool is used to represent the current RPMB layout. To find
-	 * a slot for the file tee_mm_alloc is called on the pool. Thus
-	 * if it is not NULL the entire FAT must be traversed to fill in
-	 * the pool.
-	 */
-	while (!last_entry_found && (!entry_found || p)) {
-		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_address,
-				    (uint8_t *)fat_entries, size, NULL, NULL);
-		if (res != TEE_SUCCESS)
-			goto out;
-
-		for (i = 0; i < N_ENTRIES; i++) {
+		if (fat_cache.entries[idx].flags & FILE_IS_LAST_ENTRY) {
 			/*
-			 * Look for an entry, matching filenames. (read, rm,
-			 * rename and stat.). Only store first filename match.
+			 * The last entry was chosen so the FAT needs to be
+			 * expanded. Reserve room for yet a FAT entry before
+			 * writing the new last entry there.
 			 */
-			if (fh->filename &&
-			    (strcmp(fh->filename,
-				    fat_entries[i].filename) == 0) &&
-			    (fat_entries[i].flags & FILE_IS_ACTIVE) &&
-			    (!entry_found)) {
-				entry_found = true;
-				fh->rpmb_fat_address = fat_address;
-				memcpy(&fh->fat_entry, &fat_entries[i],
-				       sizeof(struct rpmb_fat_entry));
-				if (!p)
-					break;
-			}
-
-			/* Add existing files to memory pool. (write) */
-			if (p) {
-				if ((fat_entries[i].flags & FILE_IS_ACTIVE) &&
-				    (fat_entries[i].data_size > 0)) {
-
-					mm = tee_mm_alloc2
-						(p,
-						 fat_entries[i].start_address,
-						 fat_entries[i].data_size);
-					if (!mm) {
-						res = TEE_ERROR_OUT_OF_MEMORY;
-						goto out;
-					}
-				}
-
-				/* Unused FAT entries can be reused (write) */
-				if (((fat_entries[i].flags & FILE_IS_ACTIVE) ==
-				     0) && (fh->rpmb_fat_address == 0)) {
-					fh->rpmb_fat_address = fat_address;
-					memcpy(&fh->fat_entry, &fat_entries[i],
-					       sizeof(struct rpmb_fat_entry));
-				}
-			}
-
-			if ((fat_entries[i].flags & FILE_IS_LAST_ENTRY) != 0) {
-				last_entry_found = true;
-
-				/*
-				 * If the last entry was reached and was chosen
-				 * by the previous check, then the FAT needs to
-				 * be expanded.
-				 * fh->rpmb_fat_address is the address chosen
-				 * to store the files FAT entry and fat_address
-				 * is the current FAT entry address being
-				 * compared.
-				 */
-				if (p && fh->rpmb_fat_address == fat_address)
-					expand_fat = true;
-				break;
+			res = fat_cache_reserve_fat(idx + 2);
+			if (res != TEE_SUCCESS) {
+				fat_cache_invalidate();
+				return res;
 			}
 
-			/* Move to next fat_entry. */
-			fat_address += sizeof(struct rpmb_fat_entry);
-		}
-	}
-
-	/*
-	 * Represent the FAT table in the pool.
-	 */
-	if (p) {
-		/*
-		 * Since fat_address is the start of the last entry it needs to
-		 * be moved up by an entry.
-		 */
-		fat_address += sizeof(struct rpmb_fat_entry);
-
-		/* Make room for yet a FAT entry and add to memory pool. */
-		if (expand_fat)
-			fat_address += sizeof(struct rpmb_fat_entry);
-
-		mm = tee_mm_alloc2(p, RPMB_STORAGE_START_ADDRESS, fat_address);
-		if (!mm) {
-			res = TEE_ERROR_OUT_OF_MEMORY;
-			goto out;
-		}
-
-		if (expand_fat) {
-			/*
-			 * Point fat_address to the beginning of the new
-			 * entry.
-			 */
-			fat_address -= sizeof(struct rpmb_fat_entry);
 			memset(&last_fh, 0, sizeof(last_fh));
 			last_fh.fat_entry.flags = FILE_IS_LAST_ENTRY;
-			last_fh.rpmb_fat_address = fat_address;
+			last_fh.rpmb_fat_address = fat_cache_idx_to_addr(idx + 1);
 			res = write_fat_entry(&last_fh, true);
 			if (res != TEE_SUCCESS)
-				goto out;
+				return res;
 		}
 	}
 
-	if (fh->filename && !fh->rpmb_fat_address)
-		res = TEE_ERROR_ITEM_NOT_FOUND;
+	if (idx != FAT_CACHE_NONE) {
+		fh->rpmb_fat_address = fat_cache_idx_to_addr(idx);
+		fat_cache_get(idx, &fh->fat_entry);
+	}
 
-out:
-	free(fat_entries);
-	return res;
+	if (!fh->rpmb_fat_address)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+
+	return TEE_SUCCESS;
 }
 
 static TEE_Result generate_fek(struct rpmb_fat_entry *fe, const TEE_UUID *uuid)
@@ -1935,39 +2156,13 @@ again:
 static TEE_Result rpmb_fs_open_internal(struct rpmb_file_handle *fh,
 					const TEE_UUID *uuid, bool create)
 {
-	tee_mm_pool_t p;
-	bool pool_result;
 	TEE_Result res = TEE_ERROR_GENERIC;
 
-	/* We need to do setup in order to make sure fs_par is filled in */
-	res = rpmb_fs_setup();
+	fh->uuid = uuid;
+	res = read_fat(fh, create);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	fh->uuid = uuid;
-	if (create) {
-		/* Upper memory allocation must be used for RPMB_FS. */
-		pool_result = tee_mm_init(&p,
-					  RPMB_STORAGE_START_ADDRESS,
-					  fs_par->max_rpmb_address,
-					  RPMB_BLOCK_SIZE_SHIFT,
-					  TEE_MM_POOL_HI_ALLOC);
-
-		if (!pool_result) {
-			res = TEE_ERROR_OUT_OF_MEMORY;
-			goto out;
-		}
-
-		res = read_fat(fh, &p);
-		tee_mm_final(&p);
-		if (res != TEE_SUCCESS)
-			goto out;
-	} else {
-		res = read_fat(fh, NULL);
-		if (res != TEE_SUCCESS)
-			goto out;
-	}
-
 	/*
 	 * If this is opened with create and the entry found was not active
 	 * then this is a new file and the FAT entry must be written
@@ -2022,7 +2217,7 @@ static TEE_Result rpmb_fs_read(struct tee_file_handle *tfh, size_t pos,
 
 	dump_fh(fh);
 
-	res = read_fat(fh, NULL);
+	res = read_fat(fh, false);
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -2051,9 +2246,7 @@ static TEE_Result rpmb_fs_write_primitive(struct rpmb_file_handle *fh,
 					  size_t size)
 {
 	TEE_Result res;
-	tee_mm_pool_t p;
-	bool pool_result = false;
-	tee_mm_entry_t *mm;
+	tee_mm_entry_t *mm = NULL;
 	size_t end;
 	size_t newsize;
 	uint8_t *newbuf = NULL;
@@ -2070,18 +2263,7 @@ static TEE_Result rpmb_fs_write_primitive(struct rpmb_file_handle *fh,
 
 	dump_fh(fh);
 
-	/* Upper memory allocation must be used for RPMB_FS. */
-	pool_result = tee_mm_init(&p,
-				  RPMB_STORAGE_START_ADDRESS,
-				  fs_par->max_rpmb_address,
-				  RPMB_BLOCK_SIZE_SHIFT,
-				  TEE_MM_POOL_HI_ALLOC);
-	if (!pool_result) {
-		res = TEE_ERROR_OUT_OF_MEMORY;
-		goto out;
-	}
-
-	res = read_fat(fh, &p);
+	res = read_fat(fh, false);
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -2107,7 +2289,7 @@ static TEE_Result rpmb_fs_write_primitive(struct rpmb_file_handle *fh,
 
 		DMSG("Need to re-allocate");
 		newsize = MAX(end, fh->fat_entry.data_size);
-		mm = tee_mm_alloc(&p, newsize);
+		mm = tee_mm_alloc(&fat_cache.pool, newsize);
 		newbuf = calloc(1, newsize);
 		if (!mm || !newbuf) {
 			res = TEE_ERROR_OUT_OF_MEMORY;
@@ -2133,14 +2315,19 @@ static TEE_Result rpmb_fs_write_primitive(struct rpmb_file_handle *fh,
 
 		fh->fat_entry.data_size = newsize;
 		fh->fat_entry.start_address = newaddr;
+		/*
+		 * The FAT cache reserves the new area and releases the old
+		 * one when the FAT entry is written.
+		 */
+		tee_mm_free(mm);
+		mm = NULL;
 		res = write_fat_entry(fh, true);
 		if (res != TEE_SUCCESS)
 			goto out;
 	}
 
 out:
-	if (pool_result)
-		tee_mm_final(&p);
+	tee_mm_free(mm);
 	if (newbuf)
 		free(newbuf);
 
@@ -2164,7 +2351,7 @@ static TEE_Result rpmb_fs_remove_internal(struct rpmb_file_handle *fh)
 {
 	TEE_Result res;
 
-	res = read_fat(fh, NULL);
+	res = read_fat(fh, false);
 	if (res)
 		return res;
 
@@ -2222,11 +2409,11 @@ static  TEE_Result rpmb_fs_rename_internal(struct tee_pobj *old,
 		goto out;
 	}
 
-	res = read_fat(fh_old, NULL);
+	res = read_fat(fh_old, false);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = read_fat(fh_new, NULL);
+	res = read_fat(fh_new, false);
 	if (res == TEE_SUCCESS) {
 		if (!overwrite) {
 			res = TEE_ERROR_ACCESS_CONFLICT;
@@ -2268,9 +2455,7 @@ static  TEE_Result rpmb_fs_rename(struct tee_pobj *old, struct tee_pobj *new,
 static TEE_Result rpmb_fs_truncate(struct tee_file_handle *tfh, size_t length)
 {
 	struct rpmb_file_handle *fh = (struct rpmb_file_handle *)tfh;
-	tee_mm_pool_t p;
-	bool pool_result = false;
-	tee_mm_entry_t *mm;
+	tee_mm_entry_t *mm = NULL;
 	uint32_t newsize;
 	uint8_t *newbuf = NULL;
 	uintptr_t newaddr;
@@ -2284,27 +2469,14 @@ static TEE_Result rpmb_fs_truncate(struct tee_file_handle *tfh, size_t length)
 	}
 	newsize = length;
 
-	res = read_fat(fh, NULL);
+	res = read_fat(fh, false);
 	if (res != TEE_SUCCESS)
 		goto out;
 
 	if (newsize > fh->fat_entry.data_size) {
 		/* Extend file */
 
-		pool_result = tee_mm_init(&p,
-					  RPMB_STORAGE_START_ADDRESS,
-					  fs_par->max_rpmb_address,
-					  RPMB_BLOCK_SIZE_SHIFT,
-					  TEE_MM_POOL_HI_ALLOC);
-		if (!pool_result) {
-			res = TEE_ERROR_OUT_OF_MEMORY;
-			goto out;
-		}
-		res = read_fat(fh, &p);
-		if (res != TEE_SUCCESS)
-			goto out;
-
-		mm = tee_mm_alloc(&p, newsize);
+		mm = tee_mm_alloc(&fat_cache.pool, newsize);
 		newbuf = calloc(1, newsize);
 		if (!mm || !newbuf) {
 			res = TEE_ERROR_OUT_OF_MEMORY;
@@ -2334,12 +2506,14 @@ static TEE_Result rpmb_fs_truncate(struct tee_file_handle *tfh, size_t length)
 	/* fh->pos is unchanged */
 	fh->fat_entry.data_size = newsize;
 	fh->fat_entry.start_address = newaddr;
+	/* The FAT cache updates the used areas when the entry is written */
+	tee_mm_free(mm);
+	mm = NULL;
 	res = write_fat_entry(fh, true);
 
 out:
+	tee_mm_free(mm);
 	mutex_unlock(&rpmb_mutex);
-	if (pool_result)
-		tee_mm_final(&p);
 	if (newbuf)
 		free(newbuf);
 
@@ -2365,18 +2539,12 @@ static TEE_Result rpmb_fs_dir_populate(const char *path,
 				       struct tee_fs_dir *dir)
 {
 	struct tee_rpmb_fs_dirent *current = NULL;
-	struct rpmb_fat_entry *fat_entries = NULL;
-	uint32_t fat_address;
 	uint32_t filelen;
 	char *filename;
-	int i;
-	bool last_entry_found = false;
-	bool matched;
+	size_t n;
 	struct tee_rpmb_fs_dirent *next = NULL;
 	uint32_t pathlen;
 	TEE_Result res = TEE_ERROR_GENERIC;
-	uint32_t size;
-	char temp;
 
 	mutex_lock(&rpmb_mutex);
 
@@ -2384,69 +2552,33 @@ static TEE_Result rpmb_fs_dir_populate(const char *path,
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = get_fat_start_address(&fat_address);
-	if (res != TEE_SUCCESS)
-		goto out;
-
-	size = N_ENTRIES * sizeof(struct rpmb_fat_entry);
-	fat_entries = malloc(size);
-	if (!fat_entries) {
-		res = TEE_ERROR_OUT_OF_MEMORY;
-		goto out;
-	}
-
 	pathlen = strlen(path);
-	while (!last_entry_found) {
-		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_address,
-				    (uint8_t *)fat_entries, size, NULL, NULL);
-		if (res != TEE_SUCCESS)
+	for (n = 0; n < fat_cache.num_entries; n++) {
+		/* Only active entries have a filename */
+		filename = fat_cache.entries[n].filename;
+		if (!filename)
+			continue;
+
+		filelen = strlen(filename);
+		if (filelen <= pathlen || strncmp(filename, path, pathlen))
+			continue;
+
+		next = malloc(sizeof(*next));
+		if (!next) {
+			res = TEE_ERROR_OUT_OF_MEMORY;
 			goto out;
+		}
 
-		for (i = 0; i < N_ENTRIES; i++) {
-			filename = fat_entries[i].filename;
-			if (fat_entries[i].flags & FILE_IS_ACTIVE) {
-				matched = false;
-				filelen = strlen(filename);
-				if (filelen > pathlen) {
-					temp = filename[pathlen];
-					filename[pathlen] = '\0';
-					if (strcmp(filename, path) == 0)
-						matched = true;
-
-					filename[pathlen] = temp;
-				}
-
-				if (matched) {
-					next = malloc(sizeof(*next));
-					if (!next) {
-						res = TEE_ERROR_OUT_OF_MEMORY;
-						goto out;
-					}
-
-					next->entry.oidlen = tee_hs2b(
-						(uint8_t *)&filename[pathlen],
-						next->entry.oid,
-						filelen - pathlen,
-						sizeof(next->entry.oid));
-					if (next->entry.oidlen) {
-						SIMPLEQ_INSERT_TAIL(&dir->next,
-								    next, link);
-						current = next;
-					} else {
-						free(next);
-						next = NULL;
-					}
-
-				}
-			}
-
-			if (fat_entries[i].flags & FILE_IS_LAST_ENTRY) {
-				last_entry_found = true;
-				break;
-			}
-
-			/* Move to next fat_entry. */
-			fat_address += sizeof(struct rpmb_fat_entry);
+		next->entry.oidlen = tee_hs2b((uint8_t *)&filename[pathlen],
+					      next->entry.oid,
+					      filelen - pathlen,
+					      sizeof(next->entry.oid));
+		if (next->entry.oidlen) {
+			SIMPLEQ_INSERT_TAIL(&dir->next, next, link);
+			current = next;
+		} else {
+			free(next);
+			next = NULL;
 		}
 	}
 
@@ -2459,8 +2591,6 @@ out:
 	mutex_unlock(&rpmb_mutex);
 	if (res != TEE_SUCCESS)
 		rpmb_fs_dir_free(dir);
-	if (fat_entries)
-		free(fat_entries);
 
 	return res;
 }
@@ -2670,3 +2800,40 @@ TEE_Result tee_rpmb_fs_raw_open(const char *fname, bool create,
 
 	return res;
 }
+
+TEE_Result tee_rpmb_fs_bench_write(const void *buf, size_t size,
+				   uint16_t max_blkcnt, uint16_t *blkcnt)
+{
+	static const TEE_UUID uuid = { 0 };
+	struct rpmb_file_handle *fh;
+	TEE_Result res;
+
+	if (!size || size % RPMB_DATA_SIZE ||
+	    size / RPMB_DATA_SIZE > UINT16_MAX)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	fh = calloc(1, sizeof(*fh));
+	if (!fh)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	snprintf(fh->filename, sizeof(fh->filename), "/%s",
+		 RPMB_BENCH_FILENAME);
+
+	mutex_lock(&rpmb_mutex);
+
+	res = rpmb_fs_open_internal(fh, &uuid, true);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	rpmb_max_wr_blkcnt = max_blkcnt;
+	*blkcnt = tee_rpmb_wr_blkcnt();
+	res = rpmb_fs_write_primitive(fh, 0, buf, size);
+	rpmb_max_wr_blkcnt = 0;
+
+	/* The scratch file doesn't outlive the benchmark */
+	rpmb_fs_remove_internal(fh);
+
+out:
+	mutex_unlock(&rpmb_mutex);
+	free(fh);
+	return res;
+}
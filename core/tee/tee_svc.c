@@ -819,7 +819,7 @@ TEE_Result syscall_open_ta_session(const TEE_UUID *dest,
 function_exit:
 	mobj_free(mobj_param);
 	if (res == TEE_SUCCESS)
-		tee_svc_copy_kaddr_to_uref(ta_sess, s);
+		tee_svc_copy_to_user(ta_sess, &s->id, sizeof(s->id));
 	tee_svc_copy_to_user(ret_orig, &ret_o, sizeof(ret_o));
 
 out_free_only:
@@ -834,7 +834,6 @@ TEE_Result syscall_close_ta_session(unsigned long ta_sess)
 	TEE_Result res;
 	struct tee_ta_session *sess;
 	TEE_Identity clnt_id;
-	struct tee_ta_session *s = tee_svc_uref_to_kaddr(ta_sess);
 	struct user_ta_ctx *utc;
 
 	res = tee_ta_get_current_session(&sess);
@@ -845,7 +844,7 @@ TEE_Result syscall_close_ta_session(unsigned long ta_sess)
 	clnt_id.login = TEE_LOGIN_TRUSTED_APP;
 	memcpy(&clnt_id.uuid, &sess->ctx->uuid, sizeof(TEE_UUID));
 
-	return tee_ta_close_session(s, &utc->open_sessions, &clnt_id);
+	return tee_ta_close_session(ta_sess, &utc->open_sessions, &clnt_id);
 }
 
 TEE_Result syscall_invoke_ta_command(unsigned long ta_sess,
@@ -868,9 +867,7 @@ TEE_Result syscall_invoke_ta_command(unsigned long ta_sess,
 		return res;
 	utc = to_user_ta_ctx(sess->ctx);
 
-	called_sess = tee_ta_get_session(
-				(vaddr_t)tee_svc_uref_to_kaddr(ta_sess), true,
-				&utc->open_sessions);
+	called_sess = tee_ta_get_session(ta_sess, true, &utc->open_sessions);
 	if (!called_sess)
 		return TEE_ERROR_BAD_PARAMETERS;
 
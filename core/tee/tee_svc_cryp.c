@@ -28,6 +28,7 @@
 
 #include <assert.h>
 #include <crypto/crypto.h>
+#include <kernel/handle.h>
 #include <kernel/tee_ta_manager.h>
 #include <mm/tee_mmu.h>
 #include <string_ext.h>
@@ -60,8 +61,9 @@ struct tee_cryp_state {
 	TAILQ_ENTRY(tee_cryp_state) link;
 	uint32_t algo;
 	uint32_t mode;
-	vaddr_t key1;
-	vaddr_t key2;
+	uint32_t key1;
+	uint32_t key2;
+	uint32_t handle;
 	void *ctx;
 	tee_cryp_ctx_finalize_func_t ctx_finalize;
 };
@@ -860,7 +862,7 @@ TEE_Result syscall_cryp_obj_get_info(unsigned long obj, TEE_ObjectInfo *info)
 		goto exit;
 
 	res = tee_obj_get(to_user_ta_ctx(sess->ctx),
-			  tee_svc_uref_to_vaddr(obj), &o);
+			  obj, &o);
 	if (res != TEE_SUCCESS)
 		goto exit;
 
@@ -882,7 +884,7 @@ TEE_Result syscall_cryp_obj_restrict_usage(unsigned long obj,
 		goto exit;
 
 	res = tee_obj_get(to_user_ta_ctx(sess->ctx),
-			  tee_svc_uref_to_vaddr(obj), &o);
+			  obj, &o);
 	if (res != TEE_SUCCESS)
 		goto exit;
 
@@ -958,7 +960,7 @@ TEE_Result syscall_cryp_obj_get_attr(unsigned long obj, unsigned long attr_id,
 		return res;
 
 	res = tee_obj_get(to_user_ta_ctx(sess->ctx),
-			  tee_svc_uref_to_vaddr(obj), &o);
+			  obj, &o);
 	if (res != TEE_SUCCESS)
 		return TEE_ERROR_ITEM_NOT_FOUND;
 
@@ -1266,9 +1268,10 @@ TEE_Result syscall_cryp_obj_alloc(unsigned long obj_type,
 		return res;
 	}
 
-	tee_obj_add(to_user_ta_ctx(sess->ctx), o);
-
-	res = tee_svc_copy_kaddr_to_uref(obj, o);
+	res = tee_obj_add(to_user_ta_ctx(sess->ctx), o);
+	if (res == TEE_SUCCESS)
+		res = tee_svc_copy_to_user(obj, &o->handle,
+					   sizeof(o->handle));
 	if (res != TEE_SUCCESS)
 		tee_obj_close(to_user_ta_ctx(sess->ctx), o);
 	return res;
@@ -1285,7 +1288,7 @@ TEE_Result syscall_cryp_obj_close(unsigned long obj)
 		return res;
 
 	res = tee_obj_get(to_user_ta_ctx(sess->ctx),
-			  tee_svc_uref_to_vaddr(obj), &o);
+			  obj, &o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -1311,7 +1314,7 @@ TEE_Result syscall_cryp_obj_reset(unsigned long obj)
 		return res;
 
 	res = tee_obj_get(to_user_ta_ctx(sess->ctx),
-			  tee_svc_uref_to_vaddr(obj), &o);
+			  obj, &o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -1520,7 +1523,7 @@ TEE_Result syscall_cryp_obj_populate(unsigned long obj,
 		return res;
 
 	res = tee_obj_get(to_user_ta_ctx(sess->ctx),
-			  tee_svc_uref_to_vaddr(obj), &o);
+			  obj, &o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -1570,12 +1573,12 @@ TEE_Result syscall_cryp_obj_copy(unsigned long dst, unsigned long src)
 		return res;
 
 	res = tee_obj_get(to_user_ta_ctx(sess->ctx),
-			  tee_svc_uref_to_vaddr(dst), &dst_o);
+			  dst, &dst_o);
 	if (res != TEE_SUCCESS)
 		return res;
 
 	res = tee_obj_get(to_user_ta_ctx(sess->ctx),
-			  tee_svc_uref_to_vaddr(src), &src_o);
+			  src, &src_o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -1716,7 +1719,7 @@ TEE_Result syscall_obj_generate_key(unsigned long obj, unsigned long key_size,
 		return res;
 
 	res = tee_obj_get(to_user_ta_ctx(sess->ctx),
-			  tee_svc_uref_to_vaddr(obj), &o);
+			  obj, &o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -1841,13 +1844,14 @@ static TEE_Result tee_svc_cryp_get_state(struct tee_ta_session *sess,
 	struct tee_cryp_state *s;
 	struct user_ta_ctx *utc = to_user_ta_ctx(sess->ctx);
 
-	TAILQ_FOREACH(s, &utc->cryp_states, link) {
-		if (state_id == (vaddr_t)s) {
-			*state = s;
-			return TEE_SUCCESS;
-		}
-	}
-	return TEE_ERROR_BAD_PARAMETERS;
+	if (state_id > INT32_MAX)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	s = handle_lookup(&utc->cryp_state_db, state_id);
+	if (!s)
+		return TEE_ERROR_BAD_PARAMETERS;
+	*state = s;
+	return TEE_SUCCESS;
 }
 
 static void cryp_state_free(struct user_ta_ctx *utc, struct tee_cryp_state *cs)
@@ -1860,6 +1864,7 @@ static void cryp_state_free(struct user_ta_ctx *utc, struct tee_cryp_state *cs)
 		tee_obj_close(utc, o);
 
 	TAILQ_REMOVE(&utc->cryp_states, cs, link);
+	handle_put(&utc->cryp_state_db, cs->handle);
 	if (cs->ctx_finalize != NULL)
 		cs->ctx_finalize(cs->ctx, cs->algo);
 
@@ -1974,6 +1979,7 @@ TEE_Result syscall_cryp_state_alloc(unsigned long algo, unsigned long mode,
 	struct tee_obj *o1 = NULL;
 	struct tee_obj *o2 = NULL;
 	struct user_ta_ctx *utc;
+	int h;
 
 	res = tee_ta_get_current_session(&sess);
 	if (res != TEE_SUCCESS)
@@ -1981,7 +1987,7 @@ TEE_Result syscall_cryp_state_alloc(unsigned long algo, unsigned long mode,
 	utc = to_user_ta_ctx(sess->ctx);
 
 	if (key1 != 0) {
-		res = tee_obj_get(utc, tee_svc_uref_to_vaddr(key1), &o1);
+		res = tee_obj_get(utc, key1, &o1);
 		if (res != TEE_SUCCESS)
 			return res;
 		if (o1->busy)
@@ -1991,7 +1997,7 @@ TEE_Result syscall_cryp_state_alloc(unsigned long algo, unsigned long mode,
 			return res;
 	}
 	if (key2 != 0) {
-		res = tee_obj_get(utc, tee_svc_uref_to_vaddr(key2), &o2);
+		res = tee_obj_get(utc, key2, &o2);
 		if (res != TEE_SUCCESS)
 			return res;
 		if (o2->busy)
@@ -2004,6 +2010,12 @@ TEE_Result syscall_cryp_state_alloc(unsigned long algo, unsigned long mode,
 	cs = calloc(1, sizeof(struct tee_cryp_state));
 	if (!cs)
 		return TEE_ERROR_OUT_OF_MEMORY;
+	h = handle_get(&utc->cryp_state_db, cs);
+	if (h < 0) {
+		free(cs);
+		return TEE_ERROR_OUT_OF_MEMORY;
+	}
+	cs->handle = h;
 	TAILQ_INSERT_TAIL(&utc->cryp_states, cs, link);
 	cs->algo = algo;
 	cs->mode = mode;
@@ -2062,18 +2074,18 @@ TEE_Result syscall_cryp_state_alloc(unsigned long algo, unsigned long mode,
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = tee_svc_copy_kaddr_to_uref(state, cs);
+	res = tee_svc_copy_to_user(state, &cs->handle, sizeof(cs->handle));
 	if (res != TEE_SUCCESS)
 		goto out;
 
 	/* Register keys */
 	if (o1 != NULL) {
 		o1->busy = true;
-		cs->key1 = (vaddr_t)o1;
+		cs->key1 = o1->handle;
 	}
 	if (o2 != NULL) {
 		o2->busy = true;
-		cs->key2 = (vaddr_t)o2;
+		cs->key2 = o2->handle;
 	}
 
 out:
@@ -2093,11 +2105,11 @@ TEE_Result syscall_cryp_state_copy(unsigned long dst, unsigned long src)
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(dst), &cs_dst);
+	res = tee_svc_cryp_get_state(sess, dst, &cs_dst);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(src), &cs_src);
+	res = tee_svc_cryp_get_state(sess, src, &cs_src);
 	if (res != TEE_SUCCESS)
 		return res;
 	if (cs_dst->algo != cs_src->algo || cs_dst->mode != cs_src->mode)
@@ -2143,7 +2155,7 @@ TEE_Result syscall_cryp_state_free(unsigned long state)
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 	cryp_state_free(to_user_ta_ctx(sess->ctx), cs);
@@ -2162,7 +2174,7 @@ TEE_Result syscall_hash_init(unsigned long state,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -2225,7 +2237,7 @@ TEE_Result syscall_hash_update(unsigned long state, const void *chunk,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -2283,7 +2295,7 @@ TEE_Result syscall_hash_final(unsigned long state, const void *chunk,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -2356,7 +2368,7 @@ TEE_Result syscall_cipher_init(unsigned long state, const void *iv,
 		return res;
 	utc = to_user_ta_ctx(sess->ctx);
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -2410,7 +2422,7 @@ static TEE_Result tee_svc_cipher_update_helper(unsigned long state,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -2638,7 +2650,7 @@ TEE_Result syscall_cryp_derive_key(unsigned long state,
 		return res;
 	utc = to_user_ta_ctx(sess->ctx);
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -2654,7 +2666,7 @@ TEE_Result syscall_cryp_derive_key(unsigned long state,
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = tee_obj_get(utc, tee_svc_uref_to_vaddr(derived_key), &so);
+	res = tee_obj_get(utc, derived_key, &so);
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -2894,7 +2906,7 @@ TEE_Result syscall_authenc_init(unsigned long state, const void *nonce,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -2935,7 +2947,7 @@ TEE_Result syscall_authenc_update_aad(unsigned long state,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -2961,7 +2973,7 @@ TEE_Result syscall_authenc_update_payload(unsigned long state,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -3022,7 +3034,7 @@ TEE_Result syscall_authenc_enc_final(unsigned long state,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -3110,7 +3122,7 @@ TEE_Result syscall_authenc_dec_final(unsigned long state,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -3214,7 +3226,7 @@ TEE_Result syscall_asymm_operate(unsigned long state,
 		return res;
 	utc = to_user_ta_ctx(sess->ctx);
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -3376,7 +3388,7 @@ TEE_Result syscall_asymm_verify(unsigned long state,
 		return res;
 	utc = to_user_ta_ctx(sess->ctx);
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
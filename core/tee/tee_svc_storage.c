@@ -315,7 +315,9 @@ TEE_Result syscall_storage_obj_open(unsigned long storage_id, void *object_id,
 	    TEE_HANDLE_FLAG_PERSISTENT | TEE_HANDLE_FLAG_INITIALIZED;
 	o->flags = flags;
 	o->pobj = po;
-	tee_obj_add(utc, o);
+	res = tee_obj_add(utc, o);
+	if (res != TEE_SUCCESS)
+		goto oclose;
 
 	res = tee_svc_storage_read_head(o);
 	if (res != TEE_SUCCESS) {
@@ -326,7 +328,7 @@ TEE_Result syscall_storage_obj_open(unsigned long storage_id, void *object_id,
 		goto oclose;
 	}
 
-	res = tee_svc_copy_kaddr_to_uref(obj, o);
+	res = tee_svc_copy_to_user(obj, &o->handle, sizeof(o->handle));
 	if (res != TEE_SUCCESS)
 		goto oclose;
 
@@ -472,7 +474,7 @@ TEE_Result syscall_storage_obj_create(unsigned long storage_id, void *object_id,
 	o->pobj = po;
 
 	if (attr != TEE_HANDLE_NULL) {
-		res = tee_obj_get(utc, tee_svc_uref_to_vaddr(attr),
+		res = tee_obj_get(utc, attr,
 				  &attr_o);
 		if (res != TEE_SUCCESS)
 			goto err;
@@ -483,9 +485,11 @@ TEE_Result syscall_storage_obj_create(unsigned long storage_id, void *object_id,
 		goto err;
 
 	po = NULL; /* o owns it from now on */
-	tee_obj_add(utc, o);
+	res = tee_obj_add(utc, o);
+	if (res != TEE_SUCCESS)
+		goto oclose;
 
-	res = tee_svc_copy_kaddr_to_uref(obj, o);
+	res = tee_svc_copy_to_user(obj, &o->handle, sizeof(o->handle));
 	if (res != TEE_SUCCESS)
 		goto oclose;
 
@@ -521,7 +525,7 @@ TEE_Result syscall_storage_obj_del(unsigned long obj)
 		return res;
 	utc = to_user_ta_ctx(sess->ctx);
 
-	res = tee_obj_get(utc, tee_svc_uref_to_vaddr(obj), &o);
+	res = tee_obj_get(utc, obj, &o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -557,7 +561,7 @@ TEE_Result syscall_storage_obj_rename(unsigned long obj, void *object_id,
 		return res;
 	utc = to_user_ta_ctx(sess->ctx);
 
-	res = tee_obj_get(utc, tee_svc_uref_to_vaddr(obj), &o);
+	res = tee_obj_get(utc, obj, &o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -826,7 +830,7 @@ TEE_Result syscall_storage_obj_read(unsigned long obj, void *data, size_t len,
 		goto exit;
 	utc = to_user_ta_ctx(sess->ctx);
 
-	res = tee_obj_get(utc, tee_svc_uref_to_vaddr(obj), &o);
+	res = tee_obj_get(utc, obj, &o);
 	if (res != TEE_SUCCESS)
 		goto exit;
 
@@ -880,7 +884,7 @@ TEE_Result syscall_storage_obj_write(unsigned long obj, void *data, size_t len)
 		goto exit;
 	utc = to_user_ta_ctx(sess->ctx);
 
-	res = tee_obj_get(utc, tee_svc_uref_to_vaddr(obj), &o);
+	res = tee_obj_get(utc, obj, &o);
 	if (res != TEE_SUCCESS)
 		goto exit;
 
@@ -928,7 +932,7 @@ TEE_Result syscall_storage_obj_trunc(unsigned long obj, size_t len)
 		goto exit;
 
 	res = tee_obj_get(to_user_ta_ctx(sess->ctx),
-			  tee_svc_uref_to_vaddr(obj), &o);
+			  obj, &o);
 	if (res != TEE_SUCCESS)
 		goto exit;
 
@@ -978,7 +982,7 @@ TEE_Result syscall_storage_obj_seek(unsigned long obj, int32_t offset,
 		return res;
 
 	res = tee_obj_get(to_user_ta_ctx(sess->ctx),
-			  tee_svc_uref_to_vaddr(obj), &o);
+			  obj, &o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -33,22 +33,29 @@
 		*b = tmp; \
 	} while (0)
 
+/*
+ * Exponents of at least EXPMOD_WINDOW_MIN_BITS bits are processed
+ * EXPMOD_WINDOW_BITS bits at a time, for shorter exponents such as the
+ * usual public exponents the table setup costs more than it saves.
+ */
+#define EXPMOD_WINDOW_BITS	4
+#define EXPMOD_TABLE_SIZE	(1 << EXPMOD_WINDOW_BITS)
+#define EXPMOD_WINDOW_MIN_BITS	64
+
 /*------------------------------------------------------------
  *
- *  mpa_exp_mod
- *
- *  Calculates dest = op1 ^ op2 mod n
+ *  exp_mod_ladder
  *
  * This function uses the Montgomery ladder concept as proposed by Marc Joye and
  * Sun-Ming Yen, which makes the function more resistant to timing attacks.
  */
-void mpa_exp_mod(mpanum dest,
-		 const mpanum op1,
-		 const mpanum op2,
-		 const mpanum n,
-		 const mpanum r_modn,
-		 const mpanum r2_modn,
-		 const mpa_word_t n_inv, mpa_scratch_mem pool)
+static void exp_mod_ladder(mpanum dest,
+			   const mpanum op1,
+			   const mpanum op2,
+			   const mpanum n,
+			   const mpanum r_modn,
+			   const mpanum r2_modn,
+			   const mpa_word_t n_inv, mpa_scratch_mem pool)
 {
 	mpanum A;
 	mpanum tmp_a;
@@ -119,3 +126,148 @@ void mpa_exp_mod(mpanum dest,
 	mpa_free_static_temp_var(&xtilde, pool);
 	mpa_free_static_temp_var(&tmp_xtilde, pool);
 }
+
+/* Returns window number idx of the exponent, counted from the LSB */
+static mpa_word_t get_window(const mpanum op2, int idx)
+{
+	int bit = idx * EXPMOD_WINDOW_BITS;
+
+	/* A window never straddles two words */
+	return (__mpanum_get_word(bit >> LOG_OF_WORD_SIZE, op2) >>
+		(bit & (WORD_SIZE - 1))) & (EXPMOD_TABLE_SIZE - 1);
+}
+
+/*
+ * Copies table[win] into dest. All entries are read and combined with a
+ * mask so that the memory access pattern doesn't depend on the exponent.
+ */
+static void select_entry(mpanum dest, mpanum *table, mpa_word_t win,
+			 mpa_usize_t words)
+{
+	mpa_usize_t size = 0;
+	mpa_word_t mask;
+	mpa_word_t i;
+	mpa_usize_t k;
+
+	for (k = 0; k < words; k++)
+		dest->d[k] = 0;
+
+	for (i = 0; i < EXPMOD_TABLE_SIZE; i++) {
+		/* All ones if i == win, else zero */
+		mask = 0 - (((i ^ win) - 1) >> (WORD_SIZE - 1));
+		for (k = 0; k < words; k++)
+			dest->d[k] |= table[i]->d[k] & mask;
+		size |= table[i]->size & (mpa_usize_t)mask;
+	}
+	dest->size = size;
+}
+
+/*------------------------------------------------------------
+ *
+ *  exp_mod_window
+ *
+ * Fixed window exponentiation: each window of the exponent costs
+ * EXPMOD_WINDOW_BITS squarings and one multiplication by a precomputed
+ * power of the base, instead of two multiplications per bit with the
+ * ladder above. The multiplication is done even for a zero window and the
+ * table lookup is masked to keep the timing independent of the exponent
+ * bits.
+ *
+ * Returns false without touching dest if the pool can't hold the table,
+ * the caller falls back to the ladder which needs less scratch memory.
+ */
+static bool exp_mod_window(mpanum dest,
+			   const mpanum op1,
+			   const mpanum op2,
+			   const mpanum n,
+			   const mpanum r_modn,
+			   const mpanum r2_modn,
+			   const mpa_word_t n_inv, mpa_scratch_mem pool)
+{
+	mpanum table[EXPMOD_TABLE_SIZE] = { 0 };
+	mpanum A = 0;
+	mpanum tmp_a = 0;
+	mpanum sel = 0;
+	mpanum *ptr_a;
+	mpanum *ptr_tmp_a;
+	/* Room for the result of a Montgomery multiplication modulo n */
+	mpa_usize_t words = __mpanum_size(n) + 2;
+	bool ret = false;
+	int idx;
+	int n_win;
+	int i;
+
+	if (!mpa_alloc_static_temp_var_size(words * WORD_SIZE, &A, pool) ||
+	    !mpa_alloc_static_temp_var_size(words * WORD_SIZE, &tmp_a, pool) ||
+	    !mpa_alloc_static_temp_var_size(words * WORD_SIZE, &sel, pool))
+		goto out;
+	for (i = 0; i < EXPMOD_TABLE_SIZE; i++) {
+		if (!mpa_alloc_static_temp_var_size(words * WORD_SIZE,
+						    table + i, pool))
+			goto out;
+	}
+
+	/* table[i] = op1^i in Montgomery space */
+	mpa_copy(table[0], r_modn);
+	__mpa_set_unused_digits_to_zero(table[0]);
+	__mpa_montgomery_mul(table[1], op1, r2_modn, n, n_inv);
+	for (i = 2; i < EXPMOD_TABLE_SIZE; i++)
+		__mpa_montgomery_mul(table[i], table[i - 1], table[1], n,
+				     n_inv);
+
+	ptr_a = &A;
+	ptr_tmp_a = &tmp_a;
+
+	n_win = mpa_highest_bit_index(op2) / EXPMOD_WINDOW_BITS + 1;
+	select_entry(*ptr_a, table, get_window(op2, n_win - 1), words);
+
+	for (idx = n_win - 2; idx >= 0; idx--) {
+		for (i = 0; i < EXPMOD_WINDOW_BITS; i++) {
+			/* A = A^2 */
+			__mpa_montgomery_mul(*ptr_tmp_a, *ptr_a, *ptr_a, n,
+					     n_inv);
+			swp(&ptr_tmp_a, &ptr_a);
+		}
+
+		/* A = A*x'^window */
+		select_entry(sel, table, get_window(op2, idx), words);
+		__mpa_montgomery_mul(*ptr_tmp_a, *ptr_a, sel, n, n_inv);
+		swp(&ptr_tmp_a, &ptr_a);
+	}
+
+	/* Transform back from Montgomery space */
+	__mpa_montgomery_mul(*ptr_tmp_a, (const mpanum)&const_one, *ptr_a,
+			     n, n_inv);
+
+	mpa_copy(dest, *ptr_tmp_a);
+	ret = true;
+
+out:
+	for (i = EXPMOD_TABLE_SIZE - 1; i >= 0; i--)
+		mpa_free_static_temp_var(table + i, pool);
+	mpa_free_static_temp_var(&sel, pool);
+	mpa_free_static_temp_var(&tmp_a, pool);
+	mpa_free_static_temp_var(&A, pool);
+	return ret;
+}
+
+/*------------------------------------------------------------
+ *
+ *  mpa_exp_mod
+ *
+ *  Calculates dest = op1 ^ op2 mod n
+ */
+void mpa_exp_mod(mpanum dest,
+		 const mpanum op1,
+		 const mpanum op2,
+		 const mpanum n,
+		 const mpanum r_modn,
+		 const mpanum r2_modn,
+		 const mpa_word_t n_inv, mpa_scratch_mem pool)
+{
+	if (mpa_highest_bit_index(op2) + 1 >= EXPMOD_WINDOW_MIN_BITS &&
+	    exp_mod_window(dest, op1, op2, n, r_modn, r2_modn, n_inv, pool))
+		return;
+
+	exp_mod_ladder(dest, op1, op2, n, r_modn, r2_modn, n_inv, pool);
+}
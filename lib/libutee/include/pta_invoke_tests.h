@@ -68,5 +68,83 @@
 #define PTA_MUTEX_TEST_READER			1
 #define PTA_INVOKE_TESTS_CMD_MUTEX		7
 
+/*
+ * Benchmarks RPMB writes sent one block per request against writes
+ * batched up to the reliable write block count of the device
+ *
+ * [in]  value[0].a	Number of bytes to write, a multiple of 256
+ * [out] value[1].a	Time in ms with one block per request
+ * [out] value[1].b	Time in ms with batched requests
+ * [out] value[2].a	Number of blocks per batched request
+ */
+#define PTA_INVOKE_TESTS_CMD_RPMB_WRITE_BENCH	8
+
+/*
+ * Benchmarks handle_get()/handle_put() against a first-fit scan of the
+ * handle array and checks that released handles are rejected
+ *
+ * [in]  value[0].a	Number of handles, 0 for the default of 1000,
+ *			TEE_ERROR_OUT_OF_MEMORY if the core heap can't
+ *			hold them
+ * [out] value[1].a	Time in ms with a first-fit scan
+ * [out] value[1].b	Time in ms with struct handle_db
+ */
+#define PTA_INVOKE_TESTS_CMD_HANDLE_DB_BENCH	9
+
+/*
+ * Benchmarks a fragmenting allocation pattern and lookups on a tee_mm
+ * pool walking its list of entries against a pool with TEE_MM_POOL_TREE
+ *
+ * [in]  value[0].a	Number of entries, 0 for the default of 256,
+ *			TEE_ERROR_OUT_OF_MEMORY if the core heap can't
+ *			hold them
+ * [in]  value[0].b	Number of rounds, 0 for the default of 16
+ * [out] value[1].a	Time in ns per allocation or free, list
+ * [out] value[1].b	Time in ns per allocation or free, tree
+ * [out] value[2].a	Time in ns per lookup, list
+ * [out] value[2].b	Time in ns per lookup, tree
+ */
+#define PTA_INVOKE_TESTS_CMD_MM_POOL_BENCH	10
+
+/*
+ * Benchmarks RSA-2048 PKCS#1 v1.5 signing, invoke from several sessions
+ * concurrently to measure how bignum operations scale with the cores
+ *
+ * [in]  value[0].a	Number of signatures, 0 for the default of 10
+ * [out] value[1].a	Time in ms
+ * [out] value[1].b	Signatures per second
+ */
+#define PTA_INVOKE_TESTS_CMD_RSA_SIGN_BENCH	11
+
+/*
+ * Measures the latency of the first RSA-2048 signature with a new key
+ * object, which sets up the values precomputed from the key, and of the
+ * following ones
+ *
+ * [in]  value[0].a	Number of signatures, 0 for the default of 10
+ * [out] value[1].a	Time in us of the first signature
+ * [out] value[1].b	Average time in us of the following signatures
+ */
+#define PTA_INVOKE_TESTS_CMD_RSA_KEY_CACHE_BENCH	12
+
+/*
+ * Benchmarks ECDSA P-256 signing with a freshly generated key
+ *
+ * [in]  value[0].a	Number of signatures, 0 for the default of 10
+ * [out] value[1].a	Time in ms
+ * [out] value[1].b	Average time in us of a signature
+ */
+#define PTA_INVOKE_TESTS_CMD_ECC_SIGN_BENCH	13
+
+/*
+ * Benchmarks hashing a buffer with one of the TEE_ALG_SHA* algorithms
+ *
+ * [in]  value[0].a	Algorithm
+ * [in]  value[0].b	Size in KiB, 0 for the default of 1024
+ * [out] value[1].a	Time in ms
+ * [out] value[1].b	Throughput in MiB/s
+ */
+#define PTA_INVOKE_TESTS_CMD_HASH_BENCH		14
+
 #endif /*__PTA_INVOKE_TESTS_H*/
 
@@ -1804,10 +1804,49 @@ void TEE_DeriveKey(TEE_OperationHandle operation,
 
 /* Cryptographic Operations API - Random Number Generation Functions */
 
+#if CFG_TA_RANDOM_BUFFER_SIZE
+/*
+ * Random bytes fetched with one syscall and handed out to the following
+ * small requests, bytes are cleared once handed out.
+ */
+static uint8_t random_buf[CFG_TA_RANDOM_BUFFER_SIZE];
+static size_t random_buf_offs = sizeof(random_buf);
+
+static void generate_random_buffered(uint8_t *buf, size_t len)
+{
+	TEE_Result res;
+	size_t n;
+
+	while (len) {
+		if (random_buf_offs == sizeof(random_buf)) {
+			res = utee_cryp_random_number_generate(random_buf,
+							sizeof(random_buf));
+			if (res != TEE_SUCCESS)
+				TEE_Panic(res);
+			random_buf_offs = 0;
+		}
+
+		n = MIN(len, sizeof(random_buf) - random_buf_offs);
+		memcpy(buf, random_buf + random_buf_offs, n);
+		memset(random_buf + random_buf_offs, 0, n);
+		random_buf_offs += n;
+		buf += n;
+		len -= n;
+	}
+}
+#endif
+
 void TEE_GenerateRandom(void *randomBuffer, uint32_t randomBufferLen)
 {
 	TEE_Result res;
 
+#if CFG_TA_RANDOM_BUFFER_SIZE
+	if (randomBufferLen <= sizeof(random_buf) / 4) {
+		generate_random_buffered(randomBuffer, randomBufferLen);
+		return;
+	}
+#endif
+
 	res = utee_cryp_random_number_generate(randomBuffer, randomBufferLen);
 	if (res != TEE_SUCCESS)
 		TEE_Panic(res);
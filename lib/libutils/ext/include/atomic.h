@@ -43,4 +43,14 @@ static inline void atomic_store_u32(uint32_t *p, uint32_t val)
 	__compiler_atomic_store(p, val);
 }
 
+/*
+ * Stores made before the call are visible to anyone observing the new
+ * value, pairs with the acquire semantics of atomic_cas_uint()
+ */
+static inline void atomic_store_release_uint(unsigned int *p,
+					     unsigned int val)
+{
+	__compiler_atomic_store_release(p, val);
+}
+
 #endif /*__ATOMIC_H*/
@@ -112,8 +112,15 @@
 #if defined(__KERNEL__)
 /* Compiling for TEE Core */
 #include <kernel/asan.h>
+#include <kernel/misc.h>
 #include <kernel/thread.h>
 #include <kernel/spinlock.h>
+#include <platform_config.h>
+
+#if defined(CFG_CORE_MALLOC_MAGAZINES) && !defined(ENABLE_MDBG) && \
+	!defined(CFG_CORE_SANITIZE_KADDRESS)
+#define WITH_MAGAZINES
+#endif
 
 static uint32_t malloc_lock(void)
 {
@@ -828,6 +835,312 @@ void mdbg_check(int bufdump)
 
 #else
 
+#ifdef WITH_MAGAZINES
+/*
+ * Per-CPU magazines of free small buffers in front of bget. Buffers are
+ * kept in size classes of 32, 64, 128 and 256 bytes, each class caching
+ * at most MAG_CLASS_BYTES bytes per CPU. Each magazine has its own
+ * spinlock which normally is only taken by its own CPU, the global
+ * malloc lock is only taken to refill or flush a batch of half a
+ * magazine at a time. All buffers in the magazines are allocated as far
+ * as bget is concerned.
+ */
+#define MAG_MIN_SHIFT		5
+#define MAG_NUM_CLASSES		4
+#define MAG_CLASS_BYTES		512
+#define MAG_MAX_BUFS		(MAG_CLASS_BYTES >> MAG_MIN_SHIFT)
+
+struct malloc_mag_class {
+	size_t count;
+	void *bufs[MAG_MAX_BUFS];
+};
+
+struct malloc_magazine {
+	unsigned int lock;
+	struct malloc_mag_class cls[MAG_NUM_CLASSES];
+	struct malloc_cache_stats stats;
+};
+
+static struct malloc_magazine malloc_magazines[CFG_TEE_CORE_NB_CORE];
+
+static size_t mag_class_size(int c)
+{
+	return 1 << (MAG_MIN_SHIFT + c);
+}
+
+static size_t mag_class_max_bufs(int c)
+{
+	return MAG_CLASS_BYTES / mag_class_size(c);
+}
+
+/* Returns the smallest class which can hold size bytes, or -1 */
+static int mag_class_of_request(size_t size)
+{
+	int c;
+
+	for (c = 0; c < MAG_NUM_CLASSES; c++)
+		if (size <= mag_class_size(c))
+			return c;
+	return -1;
+}
+
+/* Returns the largest class a buffer with size bytes can serve, or -1 */
+static int mag_class_of_buf(size_t size)
+{
+	int c;
+
+	if (size < mag_class_size(0) ||
+	    size >= 2 * mag_class_size(MAG_NUM_CLASSES - 1))
+		return -1;
+
+	for (c = MAG_NUM_CLASSES - 1; c > 0; c--)
+		if (size >= mag_class_size(c))
+			break;
+	return c;
+}
+
+static struct malloc_magazine *mag_lock(uint32_t *exceptions)
+{
+	struct malloc_magazine *m;
+
+	*exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
+	m = malloc_magazines + get_core_pos();
+	cpu_spin_lock(&m->lock);
+	return m;
+}
+
+static void mag_unlock(struct malloc_magazine *m, uint32_t exceptions)
+{
+	cpu_spin_unlock(&m->lock);
+	thread_unmask_exceptions(exceptions);
+}
+
+static void mag_release_bufs(void **bufs, size_t count)
+{
+	uint32_t exceptions;
+	size_t n;
+
+	if (!count)
+		return;
+
+	exceptions = malloc_lock();
+	for (n = 0; n < count; n++)
+		raw_free(bufs[n], &malloc_poolset);
+	malloc_unlock(exceptions);
+}
+
+/*
+ * Allocates a buffer of class c. On a miss half a magazine is allocated
+ * from bget in one go, one buffer is returned and the rest is cached.
+ */
+static void *mag_alloc(int c)
+{
+	void *bufs[MAG_MAX_BUFS / 2];
+	size_t batch = mag_class_max_bufs(c) / 2;
+	struct malloc_mag_class *mc;
+	struct malloc_magazine *m;
+	uint32_t exceptions;
+	size_t count;
+	void *p = NULL;
+
+	m = mag_lock(&exceptions);
+	mc = m->cls + c;
+	if (mc->count) {
+		mc->count--;
+		p = mc->bufs[mc->count];
+		m->stats.hits++;
+	} else {
+		m->stats.misses++;
+	}
+	mag_unlock(m, exceptions);
+	if (p)
+		return p;
+
+	exceptions = malloc_lock();
+	for (count = 0; count < batch; count++) {
+		bufs[count] = raw_malloc(0, 0, mag_class_size(c),
+					 &malloc_poolset);
+		if (!bufs[count])
+			break;
+	}
+	malloc_unlock(exceptions);
+	if (!count)
+		return NULL;
+
+	count--;
+	p = bufs[count];
+
+	m = mag_lock(&exceptions);
+	mc = m->cls + c;
+	m->stats.refills++;
+	while (count && mc->count < mag_class_max_bufs(c)) {
+		count--;
+		mc->bufs[mc->count] = bufs[count];
+		mc->count++;
+	}
+	mag_unlock(m, exceptions);
+
+	/* In case the magazine was refilled meanwhile */
+	mag_release_bufs(bufs, count);
+
+	return p;
+}
+
+/*
+ * Caches a free buffer in the magazine of the current CPU. If the
+ * magazine is full half of it is flushed back to bget first.
+ */
+static bool mag_free(void *ptr)
+{
+	void *bufs[MAG_MAX_BUFS / 2];
+	struct malloc_mag_class *mc;
+	struct malloc_magazine *m;
+	uint32_t exceptions;
+	size_t count = 0;
+	size_t max;
+	int c;
+
+	c = mag_class_of_buf(bget_buf_size(ptr));
+	if (c < 0)
+		return false;
+	max = mag_class_max_bufs(c);
+
+	m = mag_lock(&exceptions);
+	mc = m->cls + c;
+	if (mc->count == max) {
+		count = max / 2;
+		mc->count -= count;
+		memcpy(bufs, mc->bufs + mc->count, count * sizeof(void *));
+		m->stats.flushes++;
+	}
+	mc->bufs[mc->count] = ptr;
+	mc->count++;
+	mag_unlock(m, exceptions);
+
+	mag_release_bufs(bufs, count);
+	return true;
+}
+
+/* Returns all cached buffers of all CPUs to bget */
+static void mag_drain(void)
+{
+	void *bufs[MAG_MAX_BUFS];
+	struct malloc_mag_class *mc;
+	uint32_t exceptions;
+	size_t count;
+	size_t n;
+	int c;
+
+	for (n = 0; n < CFG_TEE_CORE_NB_CORE; n++) {
+		for (c = 0; c < MAG_NUM_CLASSES; c++) {
+			exceptions = cpu_spin_lock_xsave(
+					&malloc_magazines[n].lock);
+			mc = malloc_magazines[n].cls + c;
+			count = mc->count;
+			memcpy(bufs, mc->bufs, count * sizeof(void *));
+			mc->count = 0;
+			cpu_spin_unlock_xrestore(&malloc_magazines[n].lock,
+						 exceptions);
+
+			mag_release_bufs(bufs, count);
+		}
+	}
+}
+
+void malloc_get_cache_stats(struct malloc_cache_stats *stats, bool reset)
+{
+	struct malloc_magazine *m;
+	uint32_t exceptions;
+	size_t n;
+	int c;
+
+	memset(stats, 0, sizeof(*stats));
+	for (n = 0; n < CFG_TEE_CORE_NB_CORE; n++) {
+		m = malloc_magazines + n;
+		exceptions = cpu_spin_lock_xsave(&m->lock);
+		stats->hits += m->stats.hits;
+		stats->misses += m->stats.misses;
+		stats->refills += m->stats.refills;
+		stats->flushes += m->stats.flushes;
+		for (c = 0; c < MAG_NUM_CLASSES; c++)
+			stats->cached += m->cls[c].count * mag_class_size(c);
+		if (reset) {
+			m->stats.hits = 0;
+			m->stats.misses = 0;
+			m->stats.refills = 0;
+			m->stats.flushes = 0;
+		}
+		cpu_spin_unlock_xrestore(&m->lock, exceptions);
+	}
+}
+
+void *malloc(size_t size)
+{
+	void *p;
+	uint32_t exceptions;
+	int c = mag_class_of_request(size);
+
+	if (c >= 0) {
+		p = mag_alloc(c);
+		if (p)
+			return p;
+	}
+
+	exceptions = malloc_lock();
+	p = raw_malloc(0, 0, size, &malloc_poolset);
+	malloc_unlock(exceptions);
+	if (!p) {
+		/* Give back what's cached in the magazines and try again */
+		mag_drain();
+		exceptions = malloc_lock();
+		p = raw_malloc(0, 0, size, &malloc_poolset);
+		malloc_unlock(exceptions);
+	}
+	return p;
+}
+
+void free(void *ptr)
+{
+	uint32_t exceptions;
+
+	if (!ptr || mag_free(ptr))
+		return;
+
+	exceptions = malloc_lock();
+	raw_free(ptr, &malloc_poolset);
+	malloc_unlock(exceptions);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	void *p;
+	uint32_t exceptions;
+	size_t s = nmemb * size;
+	int c = -1;
+
+	/* Only use the magazines when the multiplication doesn't wrap */
+	if (!nmemb || s / nmemb == size)
+		c = mag_class_of_request(s);
+	if (c >= 0) {
+		p = mag_alloc(c);
+		if (p) {
+			memset(p, 0, s);
+			return p;
+		}
+	}
+
+	exceptions = malloc_lock();
+	p = raw_calloc(0, 0, nmemb, size, &malloc_poolset);
+	malloc_unlock(exceptions);
+	if (!p) {
+		mag_drain();
+		exceptions = malloc_lock();
+		p = raw_calloc(0, 0, nmemb, size, &malloc_poolset);
+		malloc_unlock(exceptions);
+	}
+	return p;
+}
+#else /*WITH_MAGAZINES*/
 void *malloc(size_t size)
 {
 	void *p;
@@ -855,6 +1168,7 @@ void *calloc(size_t nmemb, size_t size)
 	malloc_unlock(exceptions);
 	return p;
 }
+#endif /*WITH_MAGAZINES*/
 
 static void *realloc_unlocked(void *ptr, size_t size)
 {
@@ -868,6 +1182,15 @@ void *realloc(void *ptr, size_t size)
 
 	p = realloc_unlocked(ptr, size);
 	malloc_unlock(exceptions);
+#ifdef WITH_MAGAZINES
+	if (!p && size) {
+		/* Same as malloc(), ptr is left untouched on failure */
+		mag_drain();
+		exceptions = malloc_lock();
+		p = realloc_unlocked(ptr, size);
+		malloc_unlock(exceptions);
+	}
+#endif
 	return p;
 }
 
@@ -878,6 +1201,14 @@ void *memalign(size_t alignment, size_t size)
 
 	p = raw_memalign(0, 0, alignment, size, &malloc_poolset);
 	malloc_unlock(exceptions);
+#ifdef WITH_MAGAZINES
+	if (!p) {
+		mag_drain();
+		exceptions = malloc_lock();
+		p = raw_memalign(0, 0, alignment, size, &malloc_poolset);
+		malloc_unlock(exceptions);
+	}
+#endif
 	return p;
 }
 
@@ -889,6 +1220,14 @@ static void *get_payload_start_size(void *ptr, size_t *size)
 
 #endif
 
+#if defined(__KERNEL__) && !defined(WITH_MAGAZINES)
+void malloc_get_cache_stats(struct malloc_cache_stats *stats,
+			    bool reset __unused)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+#endif
+
 void malloc_add_pool(void *buf, size_t len)
 {
 	void *p;
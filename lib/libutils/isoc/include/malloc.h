@@ -106,4 +106,18 @@ void malloc_get_stats(struct malloc_stats *stats);
 void malloc_reset_stats(void);
 #endif /* CFG_WITH_STATS */
 
+struct malloc_cache_stats {
+	uint32_t hits;		/* Small allocations served by a magazine */
+	uint32_t misses;	/* Small allocations with an empty magazine */
+	uint32_t refills;	/* Batches allocated to refill a magazine */
+	uint32_t flushes;	/* Batches freed from a full magazine */
+	uint32_t cached;	/* Bytes currently cached in magazines */
+};
+
+/*
+ * Returns the statistics of the per-CPU magazines of small buffers in
+ * front of the core heap, only available with CFG_CORE_MALLOC_MAGAZINES.
+ */
+void malloc_get_cache_stats(struct malloc_cache_stats *stats, bool reset);
+
 #endif /* MALLOC_H */
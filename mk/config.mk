@@ -59,6 +59,11 @@ CFG_TEE_TA_LOG_LEVEL ?= 1
 # CFG_TEE_TA_LOG_LEVEL. Otherwise, they are not output at all
 CFG_TEE_CORE_TA_TRACE ?= y
 
+# Size in bytes of a buffer in libutee from which TEE_GenerateRandom()
+# serves requests of up to a quarter of its size, saving a syscall for
+# most small requests. 0 disables the buffer.
+CFG_TA_RANDOM_BUFFER_SIZE ?= 0
+
 # If 1, enable debug features in TA memory allocation.
 # Debug features include check of buffer overflow, statistics, mark/check heap
 # feature.
@@ -123,6 +128,14 @@ CFG_TEE_FW_MANUFACTURER ?= FW_MAN_UNDEF
 # TEE_STORAGE_PRIVATE is passed to the trusted storage API)
 CFG_REE_FS ?= y
 
+# Number of decrypted data blocks cached per open REE FS object. Blocks
+# are 4 KiB and allocated from the core heap on demand. Writes to cached
+# blocks are deferred until the object is synced. 0 disables the cache.
+# Each open object may use up to this many blocks of core heap, so it's
+# disabled by default; enable it only on platforms where CFG_CORE_HEAP_SIZE
+# leaves room for it with the expected number of open objects.
+CFG_REE_FS_HTREE_CACHE_BLOCKS ?= 0
+
 # RPMB file system support
 CFG_RPMB_FS ?= n
 
@@ -141,6 +154,13 @@ CFG_RPMB_FS_DEV_ID ?= 0
 # - RPMB key provisioning in a controlled environment (factory setup)
 CFG_RPMB_WRITE_KEY ?= n
 
+# Send up to the device's "reliable write sector count" of blocks in each
+# authenticated RPMB write request, instead of one block per request. This
+# saves one MAC computation and one RPC per block on large writes but
+# requires an eMMC driver in normal world that supports multi-block RPMB
+# writes.
+CFG_RPMB_MULTIBLOCK_WRITE ?= n
+
 # Embed public part of this key in OP-TEE OS
 TA_SIGN_KEY ?= keys/default_ta.pem
 
@@ -182,6 +202,24 @@ CFG_WITH_USER_TA ?= y
 # case you implement your own TA store
 CFG_REE_FS_TA ?= y
 
+# Maximum size of the shared memory buffer through which a TA is read from
+# the REE filesystem. Larger TAs are loaded in several parts, which needs a
+# tee-supplicant supporting partial loads, else the whole TA is loaded in a
+# buffer of its size.
+CFG_REE_FS_TA_WINDOW_SIZE ?= 262144
+
+# Keep the images of loaded user TAs, verified and relocated, in a cache
+# of CFG_TA_IMAGE_CACHE_SIZE bytes of TA RAM. A TA found in the cache is
+# copied from there instead of being read, hashed and relocated again,
+# only its signed header is still fetched and checked. The least recently
+# used images are evicted first.
+# Unless user TAs are paged, the read-only start of a cached image (code and
+# rodata up to the first writable segment) isn't copied but mapped into each
+# instance created from it, only the remainder is private to the instance.
+CFG_TA_IMAGE_CACHE ?= n
+CFG_TA_IMAGE_CACHE_SIZE ?= 1048576
+$(eval $(call cfg-depends-all,CFG_TA_IMAGE_CACHE,CFG_WITH_USER_TA))
+
 # Support for loading user TAs from a special section in the TEE binary.
 # Such TAs are available even before tee-supplicant is available (hence their
 # name), but note that many services exported to TAs may need tee-supplicant,
@@ -213,6 +251,29 @@ CFG_WITH_PAGER ?= n
 # Use the pager for user TAs
 CFG_PAGED_USER_TA ?= $(CFG_WITH_PAGER)
 
+# Keep the translation tables of a user TA populated when a thread unmaps
+# it, so that the thread can activate them again as they are if it maps
+# the same TA next, as with consecutive invocations of a TA without memref
+# parameters. Not supported with CFG_PAGED_USER_TA.
+ifeq ($(CFG_PAGED_USER_TA),y)
+$(call force,CFG_CORE_KEEP_USER_MAP,n)
+endif
+CFG_CORE_KEEP_USER_MAP ?= y
+
+# Number of pages following a faulting page in a read-only or read-write
+# paged area which are loaded and mapped by the same fault, 0 (default)
+# disables fault-around. When an area is faulted sequentially the window
+# doubles with each fault up to CFG_PAGER_READ_AHEAD_MAX pages. The window
+# is limited to an eighth of the pageable pages.
+CFG_PAGER_FAULT_AROUND ?= 0
+CFG_PAGER_READ_AHEAD_MAX ?= 8
+
+# Page replacement policy of the pager. With CFG_PAGER_CLOCK=y a CLOCK
+# (second chance) policy is used over all pageable pages, hidden pages
+# serving as reference bits. Else the oldest page is replaced, with only
+# the oldest third of the pages hidden to detect pages still in use.
+CFG_PAGER_CLOCK ?= n
+
 # Enable support for detected undefined behavior in C
 # Uses a lot of memory, can't be enabled by default
 CFG_CORE_SANITIZE_UNDEFINED ?= n
@@ -244,6 +305,22 @@ CFG_BOOT_SECONDARY_REQUEST ?= n
 # Default heap size for Core, 64 kB
 CFG_CORE_HEAP_SIZE ?= 65536
 
+# Cache freed buffers of up to 256 bytes in per-CPU magazines in front of
+# the core heap. Small allocations and frees then normally only take a
+# per-CPU lock instead of the global heap lock. At most 2 kB per CPU is
+# kept in the magazines. Not used with CFG_CORE_SANITIZE_KADDRESS.
+CFG_CORE_MALLOC_MAGAZINES ?= y
+
+# Number of hash buckets used to look up registered shared memory by
+# cookie, must be a power of 2.
+CFG_CORE_REG_SHM_HASH_BUCKETS ?= 64
+
+# Encode a per-slot generation count in the handles returned by
+# handle_get(). A handle which has been released is then rejected even if
+# its slot has been reused. With this disabled only the slot index is
+# checked.
+CFG_HANDLE_DB_GENERATIONS ?= y
+
 # TA profiling.
 # When this option is enabled, OP-TEE can execute Trusted Applications
 # instrumented with GCC's -pg flag and will output profiling information